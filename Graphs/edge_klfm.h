@@ -15,8 +15,6 @@
 
 class EdgeKlfm : public Edge {
  public:
-  typedef std::vector<int> NodeIdVector;
-
   EdgeKlfm(int edge_id, const std::string& edge_name);
   explicit EdgeKlfm(Edge* edge);
   virtual ~EdgeKlfm() {
@@ -26,23 +24,21 @@ class EdgeKlfm : public Edge {
   virtual void Print() const;
 
   // Reset KLFM-specific data for a new iteration of the algorithm.
-  // 'part_a_connections' and 'part_b_connections' are the IDs of the nodes
-  // in initial partition A and initial partition B connected to the edge at
-  // the start of the iteration. This method also sets the edge's critical
-  // status based on these initial partition connections.
-  template<typename T>
-  void KlfmReset(const std::pair<T, T>& partitions);
+  // 'num_in_part_a' is the number of nodes connected to the edge that are in
+  // partition A at the start of the iteration; the rest are in partition B.
+  // This method also sets the edge's critical status based on these initial
+  // partition connections.
+  void KlfmReset(int num_in_part_a);
 
-  template<typename T>
-  void PopulatePartitionNodeIds(const std::pair<T,T>& partitions);
+  // Sets the number of connected nodes in each partition, as KlfmReset() does,
+  // without changing the edge's critical status.
+  void PopulatePartitionCounts(int num_in_part_a);
 
   bool TouchesPartitionA() const {
-    return !(part_a_locked_nodes.empty() &&
-             part_a_unlocked_nodes.empty());
+    return num_part_a_locked + num_part_a_unlocked != 0;
   }
   bool TouchesPartitionB() const {
-    return !(part_b_locked_nodes.empty() &&
-             part_b_unlocked_nodes.empty());
+    return num_part_b_locked + num_part_b_unlocked != 0;
   }
   bool CrossesPartitions() const {
     return TouchesPartitionA() && TouchesPartitionB();
@@ -53,28 +49,30 @@ class EdgeKlfm : public Edge {
 
   // This method should be called once a node has been selected by the KLFM
   // algorithm for movement, and should be called for all edges that are
-  // connected to that node, specified by 'node_id'.
-  // This method will append the node IDs of the connected nodes that need to
-  // have their gains increased/reduced based on changes to this edge to the
-  // corresponding vectors.
-  // NOTE: The same node ID may appear in both the increase gain and decrease
-  // gain vectors and/or may appear multiple times in a vector. The node's gain
-  // should be adjusted for each time it appears.
+  // connected to that node. 'from_part_a' is the side the node moved from.
+  // The edge only keeps counts of its nodes, so rather than naming the nodes
+  // whose gains change, it sets 'num_increase_from_side' to the number of
+  // times the gain of every unlocked connected node still on the source side
+  // must be increased by the edge weight, and 'num_reduce_to_side' to the
+  // number of times the gain of every unlocked connected node on the
+  // destination side must be reduced. Each count is 0, 1 or 2.
   // The method also updates the critical status of the edge.
-  void MoveNode(int node_id,
-                NodeIdVector* nodes_to_increase_gain,
-                NodeIdVector* nodes_to_reduce_gain);
+  void MoveNode(bool from_part_a, int* num_increase_from_side,
+                int* num_reduce_to_side);
 
-  // Returns the value this edge would contribute to the node's gain value.
-  double GainContributionToNode(int node_id) const;
+  // Returns the value this edge would contribute to the gain of a connected
+  // node that is in partition A if 'in_part_a' and that is locked if
+  // 'is_locked'.
+  double GainContributionToNode(bool in_part_a, bool is_locked) const;
 
  private:
   void SetInitialCriticality();
-  bool InGroup(const NodeIdVector& group, int node_id) const;
-  NodeIdVector part_a_unlocked_nodes;
-  NodeIdVector part_b_unlocked_nodes;
-  NodeIdVector part_a_locked_nodes;
-  NodeIdVector part_b_locked_nodes;
+  // The number of connected nodes in each partition that have and have not
+  // been moved since the last reset.
+  int num_part_a_unlocked{0};
+  int num_part_b_unlocked{0};
+  int num_part_a_locked{0};
+  int num_part_b_locked{0};
 
   // An edge is critical iff at least one partition has 0 locked nodes and
   // 0-2 unlocked nodes from the edge's connected nodes.
@@ -84,26 +82,4 @@ class EdgeKlfm : public Edge {
   bool locked_noncritical{false};
 };
 
-template<typename T>
-void EdgeKlfm::PopulatePartitionNodeIds(const std::pair<T,T>& partitions) {
-  part_a_locked_nodes.clear();
-  part_b_locked_nodes.clear();
-  part_a_unlocked_nodes.clear();
-  part_b_unlocked_nodes.clear();
-  for (int node_id : connection_ids_) {
-    if (partitions.first.find(node_id) != partitions.first.end()) {
-      part_a_unlocked_nodes.push_back(node_id);
-    } else {
-      part_b_unlocked_nodes.push_back(node_id);
-    }
-  }
-}
-
-template<typename T>
-void EdgeKlfm::KlfmReset(const std::pair<T,T>& partitions) {
-  PopulatePartitionNodeIds(partitions);
-  locked_noncritical = false;
-  SetInitialCriticality();
-}
-
 #endif /* EDGE_KLFM_H_ */
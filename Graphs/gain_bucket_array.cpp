@@ -0,0 +1,243 @@
+#include "gain_bucket_array.h"
+
+#include <cstdio>
+
+#include "universal_macros.h"
+
+using namespace std;
+
+const int GainBucketArray::kNone;
+const int GainBucketArray::kMinHeadsGrowth;
+
+void GainBucketArray::Add(const GainBucketEntry& entry) {
+  int index = entry.Index();
+  assert(index >= 0);
+  if ((size_t)index >= present_.size()) {
+    // Sized for the whole graph at once, which is at its largest at the base
+    // level, so this happens at most once per refinement level.
+    size_t new_size = hypergraph_->num_nodes();
+    next_.resize(new_size, kNone);
+    prev_.resize(new_size, kNone);
+    gain_index_.resize(new_size, 0);
+    present_.resize(new_size, false);
+    entries_.resize(new_size);
+  }
+  assert(!present_[index]);
+  entries_[index] = entry;
+  Link(index, entry.GainIndex());
+  num_entries_++;
+}
+
+GainBucketEntry& GainBucketArray::Top() {
+  assert(num_entries_ > 0);
+  SkipEmptyBuckets();
+  return entries_[Head(max_gain_index_)];
+}
+
+GainBucketEntry& GainBucketArray::Peek(int offset) {
+  GainBucketEntry* peek_ptr = PeekPtr(offset);
+  assert(peek_ptr != nullptr);
+  return *peek_ptr;
+}
+
+GainBucketEntry* GainBucketArray::PeekPtr(int offset) {
+  if (offset > num_entries_ - 1) {
+    return nullptr;
+  }
+  SkipEmptyBuckets();
+  int cur_offset = 0;
+  for (int gain_index = max_gain_index_; gain_index >= lowest_gain_index_;
+       gain_index--) {
+    for (int index = Head(gain_index); index != kNone;
+         index = next_[index]) {
+      if (cur_offset == offset) {
+        return &entries_[index];
+      }
+      ++cur_offset;
+    }
+  }
+  return nullptr;
+}
+
+GainBucketEntry* GainBucketArray::PeekFirst() {
+  SkipEmptyBuckets();
+  if (num_entries_ == 0) {
+    peek_index_ = kNone;
+    return nullptr;
+  }
+  peek_gain_index_ = max_gain_index_;
+  peek_index_ = Head(peek_gain_index_);
+  return &entries_[peek_index_];
+}
+
+GainBucketEntry* GainBucketArray::PeekNext() {
+  if (peek_index_ == kNone) {
+    return nullptr;
+  }
+  peek_index_ = next_[peek_index_];
+  while (peek_index_ == kNone) {
+    if (--peek_gain_index_ < lowest_gain_index_) {
+      return nullptr;
+    }
+    peek_index_ = Head(peek_gain_index_);
+  }
+  return &entries_[peek_index_];
+}
+
+void GainBucketArray::Pop() {
+  assert(num_entries_ > 0);
+  SkipEmptyBuckets();
+  Unlink(Head(max_gain_index_));
+  num_entries_--;
+}
+
+void GainBucketArray::Clear() {
+  // Only the occupied lists are walked, so this takes time in the number of
+  // entries and the span of occupied gain indices.
+  for (int gain_index = max_gain_index_; gain_index >= lowest_gain_index_;
+       gain_index--) {
+    int& head = Head(gain_index);
+    for (int index = head; index != kNone; index = next_[index]) {
+      present_[index] = false;
+    }
+    head = kNone;
+  }
+  max_gain_index_ = lowest_gain_index_ - 1;
+  num_entries_ = 0;
+  peek_index_ = kNone;
+}
+
+void GainBucketArray::UpdateGains(
+    double cost_gain_modifier,
+    const vector<int>& nodes_to_update) {
+  // Nodes are relinked in place rather than removed and added, which would
+  // copy their entries.
+  for (int index : nodes_to_update) {
+    assert(present_[index]);
+    GainBucketEntry& entry = entries_[index];
+    Unlink(index);
+    entry.SetCostGain(entry.CostGain() + cost_gain_modifier);
+    Link(index, entry.GainIndex());
+  }
+}
+
+void GainBucketArray::Touch(int node_index) {
+  assert(HasNode(node_index));
+  int gain_index = gain_index_[node_index];
+  if (Head(gain_index) == node_index) {
+    return;
+  }
+  Unlink(node_index);
+  Link(node_index, gain_index);
+}
+
+GainBucketEntry GainBucketArray::RemoveByIndex(int node_index) {
+  assert(HasNode(node_index));
+  Unlink(node_index);
+  num_entries_--;
+  return std::move(entries_[node_index]);
+}
+
+GainBucketEntry& GainBucketArray::GbeRefByIndex(int node_index) {
+  assert(HasNode(node_index));
+  return entries_[node_index];
+}
+
+GainBucketEntry* GainBucketArray::GbePtrByIndex(int node_index) {
+  return HasNode(node_index) ? &entries_[node_index] : nullptr;
+}
+
+void GainBucketArray::GrowHeads(int gain_index) {
+  assert_b(gain_index >= -MAX_GAIN && gain_index <= MAX_GAIN) {
+    printf("Gain Index of %d was computed. May need to increase MAX_GAIN\n",
+           gain_index);
+  }
+  int growth = max<int>(heads_.size(), kMinHeadsGrowth);
+  int old_low = lowest_gain_index_;
+  int old_high = lowest_gain_index_ + (int)heads_.size() - 1;
+  int new_low, new_high;
+  if (heads_.empty()) {
+    new_low = max(gain_index - growth / 2, -MAX_GAIN);
+    new_high = min(gain_index + growth / 2, MAX_GAIN);
+  } else if (gain_index < old_low) {
+    new_low = max(min(gain_index, old_low - growth), -MAX_GAIN);
+    new_high = old_high;
+  } else {
+    new_low = old_low;
+    new_high = min(max(gain_index, old_high + growth), MAX_GAIN);
+  }
+  vector<int> new_heads(new_high - new_low + 1, kNone);
+  if (!heads_.empty()) {
+    copy(heads_.begin(), heads_.end(),
+         new_heads.begin() + (old_low - new_low));
+  }
+  heads_.swap(new_heads);
+  if (max_gain_index_ < lowest_gain_index_) {
+    max_gain_index_ = new_low - 1;
+  }
+  lowest_gain_index_ = new_low;
+}
+
+void GainBucketArray::Link(int index, int gain_index) {
+  if (gain_index < lowest_gain_index_ ||
+      gain_index >= lowest_gain_index_ + (int)heads_.size()) {
+    GrowHeads(gain_index);
+  }
+  int& head = Head(gain_index);
+  int old_head = head;
+  next_[index] = old_head;
+  prev_[index] = kNone;
+  if (old_head != kNone) {
+    prev_[old_head] = index;
+  }
+  head = index;
+  gain_index_[index] = gain_index;
+  present_[index] = true;
+  if (gain_index > max_gain_index_) {
+    max_gain_index_ = gain_index;
+  }
+}
+
+void GainBucketArray::Unlink(int index) {
+  int next = next_[index];
+  int prev = prev_[index];
+  if (prev != kNone) {
+    next_[prev] = next;
+  } else {
+    Head(gain_index_[index]) = next;
+  }
+  if (next != kNone) {
+    prev_[next] = prev;
+  }
+  present_[index] = false;
+}
+
+void GainBucketArray::Print(bool condensed) const {
+  printf("Occupied buckets (by value): ");
+  for (int gain_index = max_gain_index_; gain_index >= lowest_gain_index_;
+       gain_index--) {
+    if (heads_[gain_index - lowest_gain_index_] != kNone) {
+      printf("%d ", gain_index);
+    }
+  }
+  printf("\n");
+  if (!condensed) {
+    for (int gain_index = max_gain_index_; gain_index >= lowest_gain_index_;
+         gain_index--) {
+      int head = heads_[gain_index - lowest_gain_index_];
+      if (head == kNone) {
+        continue;
+      }
+      printf("Nodes in bucket %d (id: weight):\n", gain_index);
+      for (int index = head; index != kNone; index = next_[index]) {
+        printf("(%d: ", entries_[index].Id());
+        for (auto wt_it : entries_[index].current_weight_vector()) {
+          printf(" %d", wt_it);
+        }
+        printf(")\n");
+      }
+      printf("\n");
+    }
+  }
+  printf("\n");
+}
@@ -0,0 +1,135 @@
+#ifndef GAIN_BUCKET_ARRAY_H_
+#define GAIN_BUCKET_ARRAY_H_
+
+#include "gain_bucket_interface.h"
+
+#include <vector>
+
+#include "gain_bucket_entry.h"
+#include "klfm_hypergraph.h"
+
+/* Classic Fiduccia-Mattheyses bucket list. Each gain index has a doubly
+   linked list of nodes threaded through 'next_' and 'prev_', which are
+   indexed by the node's dense index in the engine's hypergraph, as are the
+   entries themselves, so nodes are looked up without any translation. The
+   hypergraph is only read for its node count and may be rebuilt while the
+   bucket is empty. The highest
+   possibly occupied gain index is tracked and lowered lazily when the bucket
+   it refers to is found empty, so that selecting the top entry costs O(1)
+   amortized over a pass. The list heads only span the range of gain indices
+   seen so far, which is bounded by the largest weighted degree in the graph.
+   The per-node arrays are sized to the node count of the hypergraph when the
+   first node beyond them is added, and the heads only grow when a gain index
+   beyond any before is added, so no operation allocates in steady state.
+
+   Entries are kept in the same order as GainBucketStandard: each list is
+   last in, first out. */
+class GainBucketArray : public GainBucketInterface {
+ public:
+  explicit GainBucketArray(const KlfmHypergraph* hypergraph)
+    : hypergraph_(hypergraph), lowest_gain_index_(0), max_gain_index_(-1),
+      num_entries_(0), peek_gain_index_(0), peek_index_(kNone) {
+    assert(hypergraph_ != nullptr);
+  }
+
+  virtual ~GainBucketArray() {}
+
+  virtual void Add(const GainBucketEntry& entry);
+
+  // Returns the entry of the highest gain element.
+  virtual GainBucketEntry& Top();
+
+  // Returns a reference to the entry with the offset from the top.
+  // Peek(0) is the same as Top(). It is unsafe to call this function
+  // with offset > num_entries - 1.
+  virtual GainBucketEntry& Peek(int offset);
+  virtual GainBucketEntry* PeekPtr(int offset);
+
+  // Walk the entries in the order they would be popped. See
+  // GainBucketInterface.
+  virtual GainBucketEntry* PeekFirst();
+  virtual GainBucketEntry* PeekNext();
+
+  // Removes the entry corresponding to Top() from the gain bucket.
+  virtual void Pop();
+
+  virtual void Clear();
+
+  // Returns false if there are any entries in the bucket.
+  virtual bool Empty() const { return num_entries_ == 0; }
+
+  // Add the gain modifier to each of the nodes in the vector.
+  virtual void UpdateGains(double gain_modifier,
+                           const std::vector<int>& nodes_to_update);
+
+  // Moves the node to the front of its gain queue.
+  virtual void Touch(int node_index);
+
+  // Returns true if the node with 'node_index' is in the bucket.
+  virtual bool HasNode(int node_index) {
+    assert(node_index >= 0);
+    return (size_t)node_index < present_.size() && present_[node_index];
+  }
+
+  // Removes the node with 'node_index' and returns its entry.
+  virtual GainBucketEntry RemoveByIndex(int node_index);
+
+  // Returns a reference to the gain bucket entry with 'node_index'.
+  virtual GainBucketEntry& GbeRefByIndex(int node_index);
+  virtual GainBucketEntry* GbePtrByIndex(int node_index);
+
+  // Print debug information.
+  virtual void Print(bool condensed) const;
+
+  // Return the number of entries in the bucket.
+  virtual int num_entries() const { return num_entries_; }
+
+ private:
+  static const int kNone = -1;
+  // The fewest gain indices that the heads are grown by at a time.
+  static const int kMinHeadsGrowth = 64;
+
+  int& Head(int gain_index) {
+    return heads_[gain_index - lowest_gain_index_];
+  }
+
+  // Lowers 'max_gain_index_' to the highest occupied bucket.
+  void SkipEmptyBuckets() {
+    while (max_gain_index_ >= lowest_gain_index_ &&
+           Head(max_gain_index_) == kNone) {
+      max_gain_index_--;
+    }
+  }
+
+  // Extends 'heads_' to cover 'gain_index'. The covered range at least
+  // doubles each time so that growth is amortized.
+  void GrowHeads(int gain_index);
+
+  // Links the node with 'index', whose entry is already stored, at the
+  // front of the list for 'gain_index'.
+  void Link(int index, int gain_index);
+  void Unlink(int index);
+
+  const KlfmHypergraph* hypergraph_;
+  // The index of the first node of the list for each gain index from
+  // 'lowest_gain_index_' upwards, or kNone.
+  std::vector<int> heads_;
+  int lowest_gain_index_;
+  // Indexed by node index. 'gain_index_' is only meaningful for nodes that
+  // are 'present_'.
+  std::vector<int> next_;
+  std::vector<int> prev_;
+  std::vector<int> gain_index_;
+  std::vector<char> present_;
+  std::vector<GainBucketEntry> entries_;
+  // No bucket above this index is occupied. Below 'lowest_gain_index_' when
+  // the bucket is empty.
+  int max_gain_index_;
+  int num_entries_;
+  // The position of the walk started by PeekFirst(). 'peek_index_' is kNone
+  // once the walk has ended.
+  int peek_gain_index_;
+  int peek_index_;
+};
+
+#endif // GAIN_BUCKET_ARRAY_H
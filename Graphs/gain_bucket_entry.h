@@ -4,31 +4,37 @@
 #include "node.h"
 
 #include <cassert>
+#include <cmath>
+#include <type_traits>
 #include <vector>
 
+// The largest gain index. Storage is allocated for the range of gains in use,
+// so this only bounds gains to +-MAX_GAIN * 2^-8.
+#ifndef MAX_GAIN
+#define MAX_GAIN (1 << 24)
+#endif
+
+// A small, trivially copyable handle for a node in a gain bucket. The
+// node's implementations are not copied; the entry refers to the node's own
+// weight vector table, which must outlive it and is not modified while the
+// node is in a gain bucket. Entries are keyed by the node's dense index in
+// the engine's hypergraph, which stays valid while the node is in a bucket;
+// the ID is only kept for output.
 class GainBucketEntry {
  public:
   GainBucketEntry() {}
 
-  GainBucketEntry(double cost, int id, const std::vector<int>& weight_vector,
-                  int current_weight_vector_index = 0)
-    : cost_(cost), id_(id),
-      current_weight_vector_index_(current_weight_vector_index) {
-    UpdateGainIndex();
-    all_weight_vectors_.push_back(weight_vector);
-  }
-
-  GainBucketEntry(double cost, Node* node) : cost_(cost), id_(node->id),
+  GainBucketEntry(double cost, Node* node, int index)
+    : cost_(cost), all_weight_vectors_(&node->WeightVectors()), id_(node->id),
+      index_(index),
       current_weight_vector_index_(node->selected_weight_vector_index()) {
     UpdateGainIndex();
     assert(!node->WeightVectors().empty());
-    for (auto& wv : node->WeightVectors()) {
-      all_weight_vectors_.push_back(wv);
-    }
     assert(node->SelectedWeightVector() == current_weight_vector());
   }
 
   int Id() const { return id_; }
+  int Index() const { return index_; }
   double CostGain() const { return cost_; }
   void SetCostGain(double cost) {
     cost_ = cost;
@@ -44,38 +50,40 @@ class GainBucketEntry {
   }
 
   const std::vector<std::vector<int>>& AllWeightVectors() const {
-    return all_weight_vectors_;
+    assert(all_weight_vectors_ != nullptr);
+    return *all_weight_vectors_;
   }
 
   const std::vector<int>& current_weight_vector() const {
-    assert(current_weight_vector_index_ < all_weight_vectors_.size());
-    return all_weight_vectors_[current_weight_vector_index_];
+    assert((size_t)current_weight_vector_index_ < AllWeightVectors().size());
+    return (*all_weight_vectors_)[current_weight_vector_index_];
   };
 
  private:
+  // Gains are quantized to multiples of 2^-kExponent. Gains beyond the range
+  // of the buckets share the highest or lowest bucket.
   static const int kExponent{8};
-  // Performs fast multiplication of a double by a power of 2,
-  // similar to shifting an int. Returns input * 2^exponent.
-  // Does not handle special double conditions like NaN, infinity,
-  // or subnormal.
-  double FastDoublePower2Mul(double input, int exponent) {
-    long long exponent_masked = static_cast<long long>(input) & 0x7FF00000ULL;
-    long long exponent_val = exponent_masked >> 52;
-    exponent_val += static_cast<long long>(exponent);
-    exponent_masked = exponent_val << 52;
-    return static_cast<double>(
-        (static_cast<long long>(input) & 0x800FFFFFULL) & exponent_masked);
-  }
 
   void UpdateGainIndex() {
-    gain_ = FastDoublePower2Mul(cost_, kExponent);
+    double scaled = std::floor(std::ldexp(cost_, kExponent));
+    if (scaled > MAX_GAIN) {
+      gain_ = MAX_GAIN;
+    } else if (scaled < -MAX_GAIN) {
+      gain_ = -MAX_GAIN;
+    } else {
+      gain_ = static_cast<int>(scaled);
+    }
   }
 
-  int gain_{0};
   double cost_{0.0};
+  const std::vector<std::vector<int>>* all_weight_vectors_{nullptr};
+  int gain_{0};
   int id_{0};
-  size_t current_weight_vector_index_{0};
-  std::vector<std::vector<int>> all_weight_vectors_;
+  int index_{0};
+  int current_weight_vector_index_{0};
 };
 
+static_assert(std::is_trivially_copyable<GainBucketEntry>::value,
+              "GainBucketEntry is copied freely between buckets.");
+
 #endif // GAIN_BUCKET_ENTRY_H
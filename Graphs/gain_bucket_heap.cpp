@@ -0,0 +1,218 @@
+#include "gain_bucket_heap.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "universal_macros.h"
+
+using namespace std;
+
+const int GainBucketHeap::kNone;
+const int GainBucketHeap::kArity;
+const int GainBucketHeap::kKeyFractionBits;
+
+void GainBucketHeap::Add(const GainBucketEntry& entry) {
+  int index = entry.Index();
+  assert(index >= 0);
+  if ((size_t)index >= position_.size()) {
+    // Sized for the whole graph at once. See GainBucketArray::Add.
+    size_t new_size = hypergraph_->num_nodes();
+    heap_.reserve(new_size);
+    position_.resize(new_size, kNone);
+    key_.resize(new_size, 0);
+    stamp_.resize(new_size, 0);
+    entries_.resize(new_size);
+  }
+  assert(position_[index] == kNone);
+  entries_[index] = entry;
+  key_[index] = GainToKey(entry.CostGain());
+  entries_[index].SetCostGain(KeyToGain(key_[index]));
+  stamp_[index] = ++next_stamp_;
+  heap_.push_back(index);
+  position_[index] = num_entries_;
+  num_entries_++;
+  SiftUp(num_entries_ - 1);
+}
+
+GainBucketEntry& GainBucketHeap::Top() {
+  assert(num_entries_ > 0);
+  return entries_[heap_[0]];
+}
+
+GainBucketEntry& GainBucketHeap::Peek(int offset) {
+  GainBucketEntry* peek_ptr = PeekPtr(offset);
+  assert(peek_ptr != nullptr);
+  return *peek_ptr;
+}
+
+GainBucketEntry* GainBucketHeap::PeekPtr(int offset) {
+  if (offset > num_entries_ - 1 || offset < 0) {
+    return nullptr;
+  }
+  if (offset == 0) {
+    return &entries_[heap_[0]];
+  }
+  GainBucketEntry* gbe = PeekFirst();
+  for (int cur_offset = 0; cur_offset < offset; ++cur_offset) {
+    gbe = PeekNext();
+  }
+  return gbe;
+}
+
+GainBucketEntry* GainBucketHeap::PeekFirst() {
+  peek_frontier_.clear();
+  if (num_entries_ > 0) {
+    peek_frontier_.push_back(0);
+  }
+  return PeekNext();
+}
+
+GainBucketEntry* GainBucketHeap::PeekNext() {
+  // Best-first expansion from the root. Every entry ahead of the k-th one is
+  // an ancestor or an earlier expanded sibling, so the frontier never holds
+  // more than k * (kArity - 1) + 1 positions.
+  if (peek_frontier_.empty()) {
+    return nullptr;
+  }
+  auto frontier_less = [this](int a_pos, int b_pos) {
+    return Before(heap_[b_pos], heap_[a_pos]);
+  };
+  pop_heap(peek_frontier_.begin(), peek_frontier_.end(), frontier_less);
+  int position = peek_frontier_.back();
+  peek_frontier_.pop_back();
+  int first_child = kArity * position + 1;
+  int last_child = min(first_child + kArity, num_entries_);
+  for (int child = first_child; child < last_child; child++) {
+    peek_frontier_.push_back(child);
+    push_heap(peek_frontier_.begin(), peek_frontier_.end(), frontier_less);
+  }
+  return &entries_[heap_[position]];
+}
+
+void GainBucketHeap::Pop() {
+  assert(num_entries_ > 0);
+  Remove(heap_[0]);
+}
+
+void GainBucketHeap::Clear() {
+  for (int index : heap_) {
+    position_[index] = kNone;
+  }
+  heap_.clear();
+  peek_frontier_.clear();
+  num_entries_ = 0;
+  next_stamp_ = 0;
+}
+
+void GainBucketHeap::UpdateGains(
+    double cost_gain_modifier,
+    const vector<int>& nodes_to_update) {
+  const int64_t key_modifier = GainToKey(cost_gain_modifier);
+  for (int index : nodes_to_update) {
+    assert(position_[index] != kNone);
+    key_[index] += key_modifier;
+    entries_[index].SetCostGain(KeyToGain(key_[index]));
+    // Updated nodes go in front of others with the same gain, as if they had
+    // been removed and added again.
+    stamp_[index] = ++next_stamp_;
+    int position = position_[index];
+    SiftUp(position);
+    if (position_[index] == position) {
+      SiftDown(position);
+    }
+  }
+}
+
+void GainBucketHeap::Touch(int node_index) {
+  assert(HasNode(node_index));
+  stamp_[node_index] = ++next_stamp_;
+  SiftUp(position_[node_index]);
+}
+
+GainBucketEntry GainBucketHeap::RemoveByIndex(int node_index) {
+  assert(HasNode(node_index));
+  return Remove(node_index);
+}
+
+GainBucketEntry GainBucketHeap::Remove(int index) {
+  int position = position_[index];
+  int last_index = heap_.back();
+  heap_.pop_back();
+  position_[index] = kNone;
+  num_entries_--;
+  if (last_index != index) {
+    Place(last_index, position);
+    SiftUp(position);
+    if (position_[last_index] == position) {
+      SiftDown(position);
+    }
+  }
+  return entries_[index];
+}
+
+GainBucketEntry& GainBucketHeap::GbeRefByIndex(int node_index) {
+  assert(HasNode(node_index));
+  return entries_[node_index];
+}
+
+GainBucketEntry* GainBucketHeap::GbePtrByIndex(int node_index) {
+  return HasNode(node_index) ? &entries_[node_index] : nullptr;
+}
+
+void GainBucketHeap::SiftUp(int position) {
+  int index = heap_[position];
+  while (position > 0) {
+    int parent = (position - 1) / kArity;
+    if (!Before(index, heap_[parent])) {
+      break;
+    }
+    Place(heap_[parent], position);
+    position = parent;
+  }
+  Place(index, position);
+}
+
+void GainBucketHeap::SiftDown(int position) {
+  int index = heap_[position];
+  while (true) {
+    int first_child = kArity * position + 1;
+    if (first_child >= num_entries_) {
+      break;
+    }
+    int last_child = min(first_child + kArity, num_entries_);
+    int best_child = first_child;
+    for (int child = first_child + 1; child < last_child; child++) {
+      if (Before(heap_[child], heap_[best_child])) {
+        best_child = child;
+      }
+    }
+    if (!Before(heap_[best_child], index)) {
+      break;
+    }
+    Place(heap_[best_child], position);
+    position = best_child;
+  }
+  Place(index, position);
+}
+
+void GainBucketHeap::Print(bool condensed) const {
+  vector<int> sorted_indices(heap_);
+  sort(sorted_indices.begin(), sorted_indices.end(),
+       [this](int a, int b) { return Before(a, b); });
+  printf("Gains (by value): ");
+  for (auto index : sorted_indices) {
+    printf("%f ", entries_[index].CostGain());
+  }
+  printf("\n");
+  if (!condensed) {
+    printf("Nodes (id: gain: weight):\n");
+    for (auto index : sorted_indices) {
+      printf("(%d: %f: ", entries_[index].Id(), entries_[index].CostGain());
+      for (auto wt_it : entries_[index].current_weight_vector()) {
+        printf(" %d", wt_it);
+      }
+      printf(")\n");
+    }
+  }
+  printf("\n");
+}
@@ -0,0 +1,135 @@
+#ifndef GAIN_BUCKET_HEAP_H_
+#define GAIN_BUCKET_HEAP_H_
+
+#include "gain_bucket_interface.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "gain_bucket_entry.h"
+#include "klfm_hypergraph.h"
+
+/* Gain bucket backed by an addressable 4-ary max-heap keyed on the gain, for
+   cost functions such as entropy whose gains do not quantize well into
+   integer buckets. Add, Pop, RemoveByIndex and gain updates cost O(log n).
+   Entries and heap positions are indexed by the node's dense index in the
+   engine's hypergraph.
+
+   The key is the gain in fixed point with kKeyFractionBits fractional bits.
+   Gain updates add the rounded modifier to the key, so adding and later
+   subtracting the same edge weight restores the key exactly, and nodes whose
+   gains received the same updates compare equal. Accumulating the updates in
+   floating point instead would let rounding error reorder them. The entry's
+   cost gain is kept equal to its key.
+
+   Entries with equal gains are ordered by how recently they were added,
+   updated or touched, newest first. This is the last in, first out order of
+   the list based buckets, so for gains that are multiples of the bucket
+   quantum both storages select the same nodes. */
+class GainBucketHeap : public GainBucketInterface {
+ public:
+  explicit GainBucketHeap(const KlfmHypergraph* hypergraph)
+    : hypergraph_(hypergraph), num_entries_(0), next_stamp_(0) {
+    assert(hypergraph_ != nullptr);
+  }
+
+  virtual ~GainBucketHeap() {}
+
+  virtual void Add(const GainBucketEntry& entry);
+
+  // Returns the entry of the highest gain element.
+  virtual GainBucketEntry& Top();
+
+  // Returns a reference to the entry with the offset from the top.
+  // Peek(0) is the same as Top(). It is unsafe to call this function
+  // with offset > num_entries - 1. Costs O(offset log offset).
+  virtual GainBucketEntry& Peek(int offset);
+  virtual GainBucketEntry* PeekPtr(int offset);
+
+  // Walk the entries in the order they would be popped. See
+  // GainBucketInterface.
+  virtual GainBucketEntry* PeekFirst();
+  virtual GainBucketEntry* PeekNext();
+
+  // Removes the entry corresponding to Top() from the gain bucket.
+  virtual void Pop();
+
+  virtual void Clear();
+
+  // Returns false if there are any entries in the bucket.
+  virtual bool Empty() const { return num_entries_ == 0; }
+
+  // Add the gain modifier to each of the nodes in the vector.
+  virtual void UpdateGains(double gain_modifier,
+                           const std::vector<int>& nodes_to_update);
+
+  // Moves the node in front of all others with the same gain.
+  virtual void Touch(int node_index);
+
+  // Returns true if the node with 'node_index' is in the bucket.
+  virtual bool HasNode(int node_index) {
+    assert(node_index >= 0);
+    return (size_t)node_index < position_.size() &&
+           position_[node_index] != kNone;
+  }
+
+  // Removes the node with 'node_index' and returns its entry.
+  virtual GainBucketEntry RemoveByIndex(int node_index);
+
+  // Returns a reference to the gain bucket entry with 'node_index'.
+  virtual GainBucketEntry& GbeRefByIndex(int node_index);
+  virtual GainBucketEntry* GbePtrByIndex(int node_index);
+
+  // Print debug information.
+  virtual void Print(bool condensed) const;
+
+  // Return the number of entries in the bucket.
+  virtual int num_entries() const { return num_entries_; }
+
+ private:
+  static const int kNone = -1;
+  static const int kArity = 4;
+  static const int kKeyFractionBits = 32;
+
+  static int64_t GainToKey(double gain) {
+    return llround(ldexp(gain, kKeyFractionBits));
+  }
+  static double KeyToGain(int64_t key) {
+    return ldexp((double)key, -kKeyFractionBits);
+  }
+
+  // Returns true if the node with index 'a' should be selected before the
+  // node with index 'b'.
+  bool Before(int a, int b) const {
+    return key_[a] > key_[b] || (key_[a] == key_[b] && stamp_[a] > stamp_[b]);
+  }
+
+  void Place(int index, int position) {
+    heap_[position] = index;
+    position_[index] = position;
+  }
+
+  // Removes the node with 'index' and returns its entry.
+  GainBucketEntry Remove(int index);
+
+  // Restores the heap order after the node at 'position' has changed.
+  void SiftUp(int position);
+  void SiftDown(int position);
+
+  const KlfmHypergraph* hypergraph_;
+  // Node indices in heap order.
+  std::vector<int> heap_;
+  // Indexed by node index. 'position_' is kNone for absent nodes.
+  std::vector<int> position_;
+  std::vector<int64_t> key_;
+  std::vector<uint64_t> stamp_;
+  std::vector<GainBucketEntry> entries_;
+  // Heap positions not yet visited by the walk started by PeekFirst() whose
+  // parents have been. Kept to avoid reallocation.
+  std::vector<int> peek_frontier_;
+  int num_entries_;
+  uint64_t next_stamp_;
+};
+
+#endif // GAIN_BUCKET_HEAP_H
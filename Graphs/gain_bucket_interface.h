@@ -1,10 +1,6 @@
 #ifndef GAIN_BUCKET_INTERFACE_H_
 #define GAIN_BUCKET_INTERFACE_H_
 
-#ifndef MAX_GAIN
-#define MAX_GAIN 40000
-#endif
-
 #include <vector>
 
 #include "edge_klfm.h"
@@ -26,28 +22,43 @@ class GainBucketInterface {
   virtual GainBucketEntry& Peek(int offset) = 0;
   virtual GainBucketEntry* PeekPtr(int offset) = 0;
 
+  // Walk the entries in the order they would be popped, without removing
+  // them:
+  //   for (auto gbe = bucket->PeekFirst(); gbe; gbe = bucket->PeekNext())
+  // Each returns nullptr once all entries have been visited. Visiting the
+  // first k entries takes O(k) steps, unlike k calls to PeekPtr. A bucket has
+  // a single walk position, which is invalidated by PeekPtr and by any change
+  // to the bucket.
+  virtual GainBucketEntry* PeekFirst() = 0;
+  virtual GainBucketEntry* PeekNext() = 0;
+
   // Removes the entry corresponding to Top() from the gain bucket.
   virtual void Pop() = 0;
 
+  // Removes all entries from the bucket. Storage that has already been
+  // allocated is kept for later use.
+  virtual void Clear() = 0;
+
   // Returns false if there are any entries in the bucket.
   virtual bool Empty() const = 0;
 
-  // Add the gain modifier to each of the nodes in the vector.
+  // Add the gain modifier to each of the nodes in the vector, given by
+  // their indices.
   virtual void UpdateGains(double gain_modifier,
-                           const EdgeKlfm::NodeIdVector& nodes_to_update) = 0;
+                           const std::vector<int>& nodes_to_update) = 0;
 
   // Moves node to front of its gain queue.
-  virtual void Touch(int node_id) = 0;
+  virtual void Touch(int node_index) = 0;
 
-  // Returns true if the node with 'node_id' is in the bucket.
-  virtual bool HasNode(int node_id) = 0;
+  // Returns true if the node with 'node_index' is in the bucket.
+  virtual bool HasNode(int node_index) = 0;
 
-  // Removes the node with 'node_id' and returns its entry.
-  virtual GainBucketEntry RemoveByNodeId(int node_id) = 0;
+  // Removes the node with 'node_index' and returns its entry.
+  virtual GainBucketEntry RemoveByIndex(int node_index) = 0;
 
-  // Returns a reference to the gain bucket entry with 'node_id'.
-  virtual GainBucketEntry& GbeRefByNodeId(int node_id) = 0;
-  virtual GainBucketEntry* GbePtrByNodeId(int node_id) = 0;
+  // Returns a reference to the gain bucket entry with 'node_index'.
+  virtual GainBucketEntry& GbeRefByIndex(int node_index) = 0;
+  virtual GainBucketEntry* GbePtrByIndex(int node_index) = 0;
 
   // Print debug information.
   virtual void Print(bool condensed) const = 0;
@@ -1,16 +1,22 @@
 #ifndef GAIN_BUCKET_MANAGER_H_
 #define GAIN_BUCKET_MANAGER_H_
 
+#include <cassert>
 #include <vector>
 
+#include "gain_bucket_array.h"
 #include "gain_bucket_entry.h"
+#include "gain_bucket_heap.h"
 #include "gain_bucket_interface.h"
+#include "gain_bucket_standard.h"
+#include "klfm_hypergraph.h"
 #include "node.h"
 #include "partitioner_config.h"
 #include "universal_macros.h"
 
 class GainBucketManager {
  public:
+  GainBucketManager() : search_depth_(MAX_CONSTRAINED_ENTRY_CHECKS) {}
   virtual ~GainBucketManager() {};
 
   // Selects the next node to move from the two gain buckets by returning the
@@ -26,8 +32,13 @@ class GainBucketManager {
   // Returns true if all buckets controlled by this manager are empty.
   virtual bool Empty() const = 0;
 
-  // Adds a node to the gain bucket(s).
-  virtual void AddNode(double gain, Node* node, bool in_part_a,
+  // Removes all nodes from the buckets. The buckets keep the storage they
+  // have allocated, so this is cheaper than creating a new manager.
+  virtual void Clear() = 0;
+
+  // Adds a node to the gain bucket(s). Nodes are identified by their
+  // 'node_index' in the engine's hypergraph in all of the methods below.
+  virtual void AddNode(double gain, Node* node, int node_index, bool in_part_a,
                        const std::vector<int>& total_weight) = 0;
 
   // Updates the gains of the nodes in 'nodes_to_increase_gain' and
@@ -43,22 +54,50 @@ class GainBucketManager {
   // manager will update its internal buckets (if applicable) to account for the
   // change in selected weight vector. Does nothing if 'node' is not currently
   // in the gain buckets.
-  virtual void UpdateNodeImplementation(Node* node) = 0;
+  virtual void UpdateNodeImplementation(Node* node, int node_index) = 0;
 
   virtual void Print(bool condensed) const = 0;
 
   virtual void set_selection_policy(
       PartitionerConfig::GainBucketSelectionPolicy selection_policy) = 0;
 
-  virtual GainBucketEntry& GbeRefByNodeId(int node_id) = 0;
-  virtual GainBucketEntry* GbePtrByNodeId(int node_id) = 0;
+  // Sets the maximum number of entries examined in each bucket when searching
+  // past entries that cannot be moved.
+  void set_search_depth(int search_depth) {
+    assert(search_depth > 0);
+    search_depth_ = search_depth;
+  }
+
+  virtual GainBucketEntry& GbeRefByIndex(int node_index) = 0;
+  virtual GainBucketEntry* GbePtrByIndex(int node_index) = 0;
 
-  virtual bool HasNode(int node_id) = 0;
+  virtual bool HasNode(int node_index) = 0;
 
   // Touches nodes in vector order.
-  virtual void TouchNodes(const std::vector<int>& node_ids) = 0;
+  virtual void TouchNodes(const std::vector<int>& node_indices) = 0;
 
  protected:
+  // Returns a new empty gain bucket using 'storage'. Array and heap storage
+  // are indexed by the node indices of 'hypergraph', which must outlive the
+  // bucket. The caller takes ownership.
+  static GainBucketInterface* NewGainBucket(
+      PartitionerConfig::GainBucketStorage storage,
+      const KlfmHypergraph* hypergraph) {
+    switch (storage) {
+      case PartitionerConfig::kGainBucketStorageList:
+        return new GainBucketStandard();
+      case PartitionerConfig::kGainBucketStorageArray:
+        return new GainBucketArray(hypergraph);
+      case PartitionerConfig::kGainBucketStorageHeap:
+        return new GainBucketHeap(hypergraph);
+      default:
+        assert_b(false) {
+          printf("\nUnrecognized gain bucket storage.\n");
+        }
+        return nullptr;
+    }
+  }
+
   virtual std::vector<int> GetMaxImbalance(
       const std::vector<double> frac, const std::vector<int> total_weight) {
     std::vector<int> imb;
@@ -79,7 +118,9 @@ class GainBucketManager {
     return reusable_imb_;
   }
 
+  int search_depth_;
   std::vector<int> reusable_imb_;
+  std::vector<int> reusable_passed_indices_;
 };
 
 #endif // GAIN_BUCKET_MANAGER_H
@@ -67,24 +67,24 @@ GainBucketEntry
 
   // Remove any duplicate entries from other gain buckets.
   // TODO Is this call still necessary?
-  RemoveNode(entry.Id());
+  RemoveNode(entry.Index());
   return entry;
 }
 
-void GainBucketManagerMultiResourceExclusive::RemoveNode(int node_id) {
-  int erased = node_id_to_resource_index_.erase(node_id);
+void GainBucketManagerMultiResourceExclusive::RemoveNode(int node_index) {
+  int erased = node_index_to_resource_index_.erase(node_index);
   if (erased > 0) {
     for (auto& bucket : gain_buckets_a_) {
-      if (bucket->HasNode(node_id)) {
+      if (bucket->HasNode(node_index)) {
         // TODO Get rid of debug check when stable.
-        GainBucketEntry debug = bucket->RemoveByNodeId(node_id);
-        assert(debug.Id() == node_id);
+        GainBucketEntry debug = bucket->RemoveByIndex(node_index);
+        assert(debug.Index() == node_index);
       }
     }
     for (auto& bucket : gain_buckets_b_) {
-      if (bucket->HasNode(node_id)) {
-        GainBucketEntry debug = bucket->RemoveByNodeId(node_id);
-        assert(debug.Id() == node_id);
+      if (bucket->HasNode(node_index)) {
+        GainBucketEntry debug = bucket->RemoveByIndex(node_index);
+        assert(debug.Index() == node_index);
       }
     }
     num_nodes_--;
@@ -248,7 +248,7 @@ GainBucketEntry GainBucketManagerMultiResourceExclusive::GetNextGainBucketEntryL
   }
   GainBucketEntry entry = unconstrained_buckets[index]->Top();
   unconstrained_buckets[index]->Pop();
-  RemoveNode(entry.Id());
+  RemoveNode(entry.Index());
   return entry;
 }
 
@@ -289,37 +289,33 @@ GainBucketEntry
 
   vector<pair<int, GainBucketEntry>> top_entries;
   for (size_t bucket_num = 0; bucket_num < buckets.size(); bucket_num++) {
-    vector<GainBucketEntry> passed_entries;
-    GainBucketEntry entry;
-    bool found_good_entry = false;
+    reusable_passed_indices_.clear();
     GainBucketInterface* bucket = buckets[bucket_num].second.second;
     int res = buckets[bucket_num].second.first;
     bool bucket_is_constrained = buckets[bucket_num].first;
     // This is likely to be a critical loop in the algorithm, so the value
-    // of MAX_CONSTRAINED_ENTRY_CHECKS may have a large impact on performance.
-    for (size_t entry_num = 0; entry_num < MAX_CONSTRAINED_ENTRY_CHECKS &&
-         !bucket->Empty(); entry_num++) {
-      entry = bucket->Top();
-      bucket->Pop();
+    // of 'search_depth_' may have a large impact on performance.
+    GainBucketEntry* entry_ptr = bucket->PeekFirst();
+    for (int entry_num = 0; entry_num < search_depth_ && entry_ptr != nullptr;
+         entry_num++) {
       bool entry_fits = true;
       if (bucket_is_constrained &&
-          abs(entry.current_weight_vector()[res]) >
+          abs(entry_ptr->current_weight_vector()[res]) >
               max_constrained_node_weights[res]) {
         entry_fits = false;
       }
       if (entry_fits) {
-        found_good_entry = true;
+        top_entries.push_back(make_pair(bucket_num, *entry_ptr));
         break;
       } else {
-        passed_entries.push_back(entry);
+        reusable_passed_indices_.push_back(entry_ptr->Index());
       }
+      entry_ptr = bucket->PeekNext();
     }
-    if (found_good_entry) {
-      top_entries.push_back(make_pair(bucket_num, entry));
-    }
-    // Put all of the entries that didn't fit back in their buckets.
-    for (auto& passed_entry : passed_entries) {
-      bucket->Add(passed_entry);
+    // Move the entries that didn't fit to the front of their gain queues, as
+    // if they had been popped and added again.
+    for (int passed_index : reusable_passed_indices_) {
+      bucket->Touch(passed_index);
     }
   }
   if (top_entries.size() == 0) {
@@ -332,7 +328,7 @@ GainBucketEntry
     assert(use_adaptive_);
     assert(!buckets.empty());
     GainBucketEntry entry = buckets[0].second.second->Top();
-    RemoveNode(entry.Id());
+    RemoveNode(entry.Index());
     return entry;
   }
 
@@ -340,26 +336,25 @@ GainBucketEntry
   // resource order.
   shuffle(top_entries.begin(), top_entries.end(), random_engine_);
 
-  // Find max-gain entry. Put any non-max entries back in their buckets.
+  // Find max-gain entry. Move any non-max entries to the front of their gain
+  // queues.
   double max_gain = top_entries[0].second.CostGain();
   int max_index = 0;
   for (size_t i = 1; i < top_entries.size(); i++) {
     if (top_entries[i].second.CostGain() > max_gain) {
-      // Put the previous max back in its bucket.
-      buckets[top_entries[max_index].first].second.second->Add(
-          top_entries[max_index].second);
+      buckets[top_entries[max_index].first].second.second->Touch(
+          top_entries[max_index].second.Index());
       max_gain = top_entries[i].second.CostGain();
       max_index = i;
     } else {
-      // Not the max, so put it back in its bucket.
-      buckets[top_entries[i].first].second.second->Add(top_entries[i].second);
+      buckets[top_entries[i].first].second.second->Touch(
+          top_entries[i].second.Index());
     }
   }
 
-  // At this point, all non-max entries have been copied back to their buckets,
-  // so it is safe to return.
+  // The max entry is still in its buckets and is removed from all of them.
   GainBucketEntry& entry = top_entries[max_index].second;
-  RemoveNode(entry.Id());
+  RemoveNode(entry.Index());
   return entry;
 }
 
@@ -377,38 +372,36 @@ GainBucketEntry GainBucketManagerMultiResourceExclusive::SelectBetweenBuckets(
     assert(!unconstrained_bucket->Empty()); // DEBUG
     unconstrained_entry = unconstrained_bucket->Top();
     unconstrained_bucket->Pop();
-    RemoveNode(unconstrained_entry.Id());
+    RemoveNode(unconstrained_entry.Index());
     return unconstrained_entry;
   } else if (unconstrained_bucket->Empty()) {
     assert(!constrained_bucket->Empty()); // DEBUG
     constrained_entry = constrained_bucket->Top();
     constrained_bucket->Pop();
-    RemoveNode(constrained_entry.Id());
+    RemoveNode(constrained_entry.Index());
     return constrained_entry;
   }
 
-  constrained_entry = constrained_bucket->Top();
   unconstrained_entry = unconstrained_bucket->Top();
 
   /* Actually finding the highest gain node that will fit has unacceptable
      worst-case complexity - O(n). Instead, we will only consider the highest
-     gain entry from the unconstrained bucket and a statically capped number
-     of entries from the constrained bucket, determined by the macro value
-     MAX_CONSTRAINED_ENTRY_CHECKS. */
+     gain entry from the unconstrained bucket and a capped number of entries
+     from the constrained bucket, determined by 'search_depth_'. */
   int constrained_entries_checked = 1;
-  int max_checks =
-      (constrained_bucket->num_entries() > MAX_CONSTRAINED_ENTRY_CHECKS) ?
-      MAX_CONSTRAINED_ENTRY_CHECKS : constrained_bucket->num_entries() - 1;
-  vector<GainBucketEntry> constrained_entries_passed;
-  while ((constrained_entry.CostGain() > unconstrained_entry.CostGain()) &&
-         (constrained_entry.current_weight_vector()[resource_index] >
+  int max_checks = (constrained_bucket->num_entries() > search_depth_) ?
+      search_depth_ : constrained_bucket->num_entries() - 1;
+  reusable_passed_indices_.clear();
+  GainBucketEntry* constrained_ptr = constrained_bucket->PeekFirst();
+  while ((constrained_ptr->CostGain() > unconstrained_entry.CostGain()) &&
+         (constrained_ptr->current_weight_vector()[resource_index] >
           max_constrained_node_weight) &&
          (constrained_entries_checked <= max_checks)) {
-    constrained_entries_passed.push_back(constrained_entry);
-    constrained_bucket->Pop();
-    constrained_entry = constrained_bucket->Top();
+    reusable_passed_indices_.push_back(constrained_ptr->Index());
+    constrained_ptr = constrained_bucket->PeekNext();
     constrained_entries_checked++;
   }
+  constrained_entry = *constrained_ptr;
 
   bool use_constrained =
     (constrained_entry.CostGain() > unconstrained_entry.CostGain()) &&
@@ -416,17 +409,19 @@ GainBucketEntry GainBucketManagerMultiResourceExclusive::SelectBetweenBuckets(
      max_constrained_node_weight);
 
   if (use_constrained) {
-    constrained_bucket->Pop();
+    constrained_bucket->RemoveByIndex(constrained_entry.Index());
   } else {
     unconstrained_bucket->Pop();
   }
 
-  for (auto& it : constrained_entries_passed) {
-    constrained_bucket->Add(it);
+  // Entries that were passed over go back in front of their gain queues, as
+  // if they had been popped and added again.
+  for (int passed_index : reusable_passed_indices_) {
+    constrained_bucket->Touch(passed_index);
   }
 
   if (use_constrained) {
-    RemoveNode(constrained_entry.Id());
+    RemoveNode(constrained_entry.Index());
     DLOG(DEBUG_OPT_BUCKET_NODE_SELECT, 0) <<
         "Used constrained entry with weight " <<
         constrained_entry.current_weight_vector()[0] << " " <<
@@ -435,7 +430,7 @@ GainBucketEntry GainBucketManagerMultiResourceExclusive::SelectBetweenBuckets(
         " when max weight is " << max_constrained_node_weight << endl;
     return constrained_entry;
   } else {
-    RemoveNode(unconstrained_entry.Id());
+    RemoveNode(unconstrained_entry.Index());
     DLOG(DEBUG_OPT_BUCKET_NODE_SELECT, 0) <<
         "Used unconstrained entry with weight " <<
         unconstrained_entry.current_weight_vector()[0] << " " <<
@@ -454,9 +449,18 @@ bool GainBucketManagerMultiResourceExclusive::Empty() const {
   return num_nodes_ == 0;
 }
 
+void GainBucketManagerMultiResourceExclusive::Clear() {
+  for (size_t i = 0; i < num_resources_per_node_; i++) {
+    gain_buckets_a_[i]->Clear();
+    gain_buckets_b_[i]->Clear();
+  }
+  node_index_to_resource_index_.clear();
+  num_nodes_ = 0;
+}
+
 void GainBucketManagerMultiResourceExclusive::AddNode(double gain, Node* node,
-    bool in_part_a, const std::vector<int>& total_weight) {
-  GainBucketEntry entry(gain, node);
+    int node_index, bool in_part_a, const std::vector<int>& total_weight) {
+  GainBucketEntry entry(gain, node, node_index);
   if (use_adaptive_) {
     // Can only add one entry per resource type.
     vector<pair<int,int>> res_min_index;
@@ -508,7 +512,7 @@ void GainBucketManagerMultiResourceExclusive::AddEntry(
   } else {
     gain_buckets_b_[pos]->Add(entry);
   }
-  node_id_to_resource_index_.insert(make_pair(entry.Id(), pos));
+  node_index_to_resource_index_.insert(make_pair(entry.Index(), pos));
 }
 
 void GainBucketManagerMultiResourceExclusive::UpdateGains(
@@ -518,18 +522,18 @@ void GainBucketManagerMultiResourceExclusive::UpdateGains(
   inc.resize(num_resources_per_node_);
   vector<vector<int>> dec;  
   dec.resize(num_resources_per_node_);
-  for (auto id : nodes_to_increase_gain) {
-    assert(node_id_to_resource_index_.count(id) != 0);
-    auto it_pair = node_id_to_resource_index_.equal_range(id);
+  for (int node_index : nodes_to_increase_gain) {
+    assert(node_index_to_resource_index_.count(node_index) != 0);
+    auto it_pair = node_index_to_resource_index_.equal_range(node_index);
     for (auto it = it_pair.first; it != it_pair.second; it++) {
-      inc[it->second].push_back(id);
+      inc[it->second].push_back(node_index);
     }
   }
-  for (auto id : nodes_to_decrease_gain) {
-    assert(node_id_to_resource_index_.count(id) != 0);
-    auto it_pair = node_id_to_resource_index_.equal_range(id);
+  for (int node_index : nodes_to_decrease_gain) {
+    assert(node_index_to_resource_index_.count(node_index) != 0);
+    auto it_pair = node_index_to_resource_index_.equal_range(node_index);
     for (auto it = it_pair.first; it != it_pair.second; it++) {
-      dec[it->second].push_back(id);
+      dec[it->second].push_back(node_index);
     }
   }
   for (size_t i = 0; i < num_resources_per_node_; i++) {
@@ -551,34 +555,34 @@ void GainBucketManagerMultiResourceExclusive::UpdateGains(
 }
 
 void GainBucketManagerMultiResourceExclusive::UpdateNodeImplementation(
-    Node* node) {
+    Node* node, int node_index) {
   if (use_adaptive_) {
     // The selected implementation should be in one of the buckets already,
     // except in strange cases. 
     return;
   }
-  auto res_it = node_id_to_resource_index_.find(node->id);
-  if (res_it == node_id_to_resource_index_.end()) {
+  auto res_it = node_index_to_resource_index_.find(node_index);
+  if (res_it == node_index_to_resource_index_.end()) {
     return;
   }
   int res_index = res_it->second;
-  if (gain_buckets_a_[res_index]->HasNode(node->id)) {
+  if (gain_buckets_a_[res_index]->HasNode(node_index)) {
     double gain =
-        gain_buckets_a_[res_index]->RemoveByNodeId(node->id).CostGain();
-    gain_buckets_a_[res_index]->Add(GainBucketEntry(gain, node));
+        gain_buckets_a_[res_index]->RemoveByIndex(node_index).CostGain();
+    gain_buckets_a_[res_index]->Add(GainBucketEntry(gain, node, node_index));
   } else {
     double gain =
-        gain_buckets_b_[res_index]->RemoveByNodeId(node->id).CostGain();
-    gain_buckets_b_[res_index]->Add(GainBucketEntry(gain, node));
+        gain_buckets_b_[res_index]->RemoveByIndex(node_index).CostGain();
+    gain_buckets_b_[res_index]->Add(GainBucketEntry(gain, node, node_index));
   }
 }
 
-bool GainBucketManagerMultiResourceExclusive::InPartA(int node_id) {
-  auto res_it = node_id_to_resource_index_.find(node_id);
-  if (res_it == node_id_to_resource_index_.end()) {
+bool GainBucketManagerMultiResourceExclusive::InPartA(int node_index) {
+  auto res_it = node_index_to_resource_index_.find(node_index);
+  if (res_it == node_index_to_resource_index_.end()) {
     return false;
   }
-  if (gain_buckets_a_[res_it->second]->HasNode(node_id)) {
+  if (gain_buckets_a_[res_it->second]->HasNode(node_index)) {
     return true;
   } else {
     return false;
@@ -603,62 +607,63 @@ void GainBucketManagerMultiResourceExclusive::set_selection_policy(
   selection_policy_ = selection_policy;
 }
 
-GainBucketEntry& GainBucketManagerMultiResourceExclusive::GbeRefByNodeId(
-    int node_id) {
+GainBucketEntry& GainBucketManagerMultiResourceExclusive::GbeRefByIndex(
+    int node_index) {
   for (auto& gb : gain_buckets_a_) {
-    if (gb->HasNode(node_id)) {
-      return gb->GbeRefByNodeId(node_id);
+    if (gb->HasNode(node_index)) {
+      return gb->GbeRefByIndex(node_index);
     }
   }
   for (auto& gb : gain_buckets_b_) {
-    if (gb->HasNode(node_id)) {
-      return gb->GbeRefByNodeId(node_id);
+    if (gb->HasNode(node_index)) {
+      return gb->GbeRefByIndex(node_index);
     }
   }
   assert(false);
   // Shouldn't execute.
-  return gain_buckets_a_.at(0)->GbeRefByNodeId(node_id);
+  return gain_buckets_a_.at(0)->GbeRefByIndex(node_index);
 }
 
-GainBucketEntry* GainBucketManagerMultiResourceExclusive::GbePtrByNodeId(
-    int node_id) {
+GainBucketEntry* GainBucketManagerMultiResourceExclusive::GbePtrByIndex(
+    int node_index) {
   for (auto& gb : gain_buckets_a_) {
-    if (gb->HasNode(node_id)) {
-      return gb->GbePtrByNodeId(node_id);
+    if (gb->HasNode(node_index)) {
+      return gb->GbePtrByIndex(node_index);
     }
   }
   for (auto& gb : gain_buckets_b_) {
-    if (gb->HasNode(node_id)) {
-      return gb->GbePtrByNodeId(node_id);
+    if (gb->HasNode(node_index)) {
+      return gb->GbePtrByIndex(node_index);
     }
   }
   return nullptr;
 }
 
-bool GainBucketManagerMultiResourceExclusive::HasNode(int node_id) {
+bool GainBucketManagerMultiResourceExclusive::HasNode(int node_index) {
   for (auto& gb : gain_buckets_a_) {
-    if (gb->HasNode(node_id)) {
+    if (gb->HasNode(node_index)) {
       return true;
     }
   }
   for (auto& gb : gain_buckets_b_) {
-    if (gb->HasNode(node_id)) {
+    if (gb->HasNode(node_index)) {
       return true;
     }
   }
   return false;
 }
 
-void GainBucketManagerMultiResourceExclusive::TouchNodes(const vector<int>& node_ids) {
-  for (int node_id : node_ids) {
+void GainBucketManagerMultiResourceExclusive::TouchNodes(
+    const vector<int>& node_indices) {
+  for (int node_index : node_indices) {
     for (auto& gb : gain_buckets_a_) {
-      if (gb->HasNode(node_id)) {
-        gb->Touch(node_id);
+      if (gb->HasNode(node_index)) {
+        gb->Touch(node_index);
       }
     }
     for (auto& gb : gain_buckets_b_) {
-      if (gb->HasNode(node_id)) {
-        gb->Touch(node_id);
+      if (gb->HasNode(node_index)) {
+        gb->Touch(node_index);
       }
     }
   }
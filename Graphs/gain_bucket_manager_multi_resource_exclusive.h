@@ -8,7 +8,6 @@
 
 #include "gain_bucket_entry.h"
 #include "gain_bucket_manager.h"
-#include "gain_bucket_standard.h"
 #include "partitioner_config.h"
 
 class GainBucketManagerMultiResourceExclusive : public GainBucketManager {
@@ -16,15 +15,18 @@ class GainBucketManagerMultiResourceExclusive : public GainBucketManager {
   GainBucketManagerMultiResourceExclusive(
       const std::vector<double>& max_imbalance_fraction,
       PartitionerConfig::GainBucketSelectionPolicy selection_policy,
-      bool adaptive)
+      bool adaptive,
+      PartitionerConfig::GainBucketStorage storage =
+          PartitionerConfig::kGainBucketStorageList,
+      const KlfmHypergraph* hypergraph = nullptr)
     : max_imbalance_fraction_(max_imbalance_fraction),
       selection_policy_(selection_policy), use_adaptive_(adaptive),
       num_nodes_(0) {
     random_engine_.seed(time(NULL));
     num_resources_per_node_ = max_imbalance_fraction_.size();   
     for (size_t i = 0; i < num_resources_per_node_; i++) {
-      gain_buckets_a_.push_back(new GainBucketStandard());
-      gain_buckets_b_.push_back(new GainBucketStandard());
+      gain_buckets_a_.push_back(NewGainBucket(storage, hypergraph));
+      gain_buckets_b_.push_back(NewGainBucket(storage, hypergraph));
     }
   }
 
@@ -45,8 +47,10 @@ class GainBucketManagerMultiResourceExclusive : public GainBucketManager {
 
   virtual bool Empty() const;
 
+  virtual void Clear();
+
   // Adds a node to the gain bucket(s).
-  virtual void AddNode(double gain, Node* node, bool in_part_a,
+  virtual void AddNode(double gain, Node* node, int node_index, bool in_part_a,
                        const std::vector<int>& total_weight);
 
   virtual void UpdateGains(double gain_modifier,
@@ -54,28 +58,29 @@ class GainBucketManagerMultiResourceExclusive : public GainBucketManager {
                            const std::vector<int>& nodes_to_decrease_gain, 
                            bool moved_from_part_a);
 
-  virtual void UpdateNodeImplementation(Node* node);
+  virtual void UpdateNodeImplementation(Node* node, int node_index);
 
   virtual void Print(bool condensed) const;
 
   virtual void set_selection_policy(
       PartitionerConfig::GainBucketSelectionPolicy selection_policy);
 
-  virtual GainBucketEntry& GbeRefByNodeId(int node_id);
-  virtual GainBucketEntry* GbePtrByNodeId(int node_id);
+  virtual GainBucketEntry& GbeRefByIndex(int node_index);
+  virtual GainBucketEntry* GbePtrByIndex(int node_index);
 
-  virtual bool HasNode(int node_id);
+  virtual bool HasNode(int node_index);
 
-  virtual void TouchNodes(const std::vector<int>& node_ids);
+  virtual void TouchNodes(const std::vector<int>& node_indices);
  
  private:
   virtual void AddEntry(const GainBucketEntry& entry, bool in_part_a);
-  // It is safe to call this method even if 'node_id' is not present in any of
-  // the buckets.
-  virtual void RemoveNode(int node_id);
+  // It is safe to call this method even if 'node_index' is not present in any
+  // of the buckets.
+  virtual void RemoveNode(int node_index);
 
-  // Returns true if an entry with 'node_id' is in one of the part_a buckets.
-  virtual bool InPartA(int node_id);
+  // Returns true if an entry with 'node_index' is in one of the part_a
+  // buckets.
+  virtual bool InPartA(int node_index);
 
   GainBucketEntry GetNextGainBucketEntryRandomResource(
       const std::vector<int>& current_balance,
@@ -99,7 +104,7 @@ class GainBucketManagerMultiResourceExclusive : public GainBucketManager {
   std::vector<GainBucketInterface*> gain_buckets_b_;
   std::vector<double> max_imbalance_fraction_;
   PartitionerConfig::GainBucketSelectionPolicy selection_policy_;
-  std::unordered_multimap<int, int> node_id_to_resource_index_;
+  std::unordered_multimap<int, int> node_index_to_resource_index_;
   bool use_adaptive_;
   size_t num_nodes_;
   std::default_random_engine random_engine_;
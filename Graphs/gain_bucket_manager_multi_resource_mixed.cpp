@@ -68,31 +68,31 @@ GainBucketEntry
 
   // Remove any duplicate entries from other gain buckets.
   // TODO Is this call still necessary?
-  RemoveNode(entry.Id());
+  RemoveNode(entry.Index());
   return entry;
 }
 
-void GainBucketManagerMultiResourceMixed::RemoveNode(int node_id) {
-  int erased = node_id_to_resource_index_.erase(node_id);
+void GainBucketManagerMultiResourceMixed::RemoveNode(int node_index) {
+  int erased = node_index_to_resource_index_.erase(node_index);
   if (erased > 0) {
     for (auto& bucket : gain_buckets_a_) {
-      if (bucket->HasNode(node_id)) {
-        GainBucketEntry debug = bucket->RemoveByNodeId(node_id);
-        assert(debug.Id() == node_id);
+      if (bucket->HasNode(node_index)) {
+        GainBucketEntry debug = bucket->RemoveByIndex(node_index);
+        assert(debug.Index() == node_index);
       }
     }
     for (auto& bucket : gain_buckets_b_) {
-      if (bucket->HasNode(node_id)) {
-        GainBucketEntry debug = bucket->RemoveByNodeId(node_id);
-        assert(debug.Id() == node_id);
+      if (bucket->HasNode(node_index)) {
+        GainBucketEntry debug = bucket->RemoveByIndex(node_index);
+        assert(debug.Index() == node_index);
       }
     }
-    if (gain_bucket_a_master_->HasNode(node_id)) {
-      GainBucketEntry debug = gain_bucket_a_master_->RemoveByNodeId(node_id);
-      assert(debug.Id() == node_id);
+    if (gain_bucket_a_master_->HasNode(node_index)) {
+      GainBucketEntry debug = gain_bucket_a_master_->RemoveByIndex(node_index);
+      assert(debug.Index() == node_index);
     } else {
-      GainBucketEntry debug = gain_bucket_b_master_->RemoveByNodeId(node_id);
-      assert(debug.Id() == node_id);
+      GainBucketEntry debug = gain_bucket_b_master_->RemoveByIndex(node_index);
+      assert(debug.Index() == node_index);
     }
   }
 }
@@ -114,7 +114,7 @@ GainBucketEntry GainBucketManagerMultiResourceMixed::GetNextGainBucketEntryRando
 
   GainBucketEntry entry = SelectBetweenBucketsByImbalancePower(
       bucket_a, bucket_b, current_balance, total_weight,
-      max_bucket_search_depth_);
+      search_depth_);
   return entry;
 }
 
@@ -141,7 +141,7 @@ GainBucketEntry GainBucketManagerMultiResourceMixed::GetNextGainBucketEntryMostU
 
   GainBucketEntry entry = SelectBetweenBucketsByImbalancePower(
       bucket_a, bucket_b, current_balance, total_weight,
-      max_bucket_search_depth_);
+      search_depth_);
   return entry;
 }
 
@@ -203,10 +203,10 @@ GainBucketEntry GainBucketManagerMultiResourceMixed::GetNextGainBucketEntryBestG
     }
   }
   if (use_entry_a) {
-    RemoveNode(entry_a.Id());
+    RemoveNode(entry_a.Index());
     return entry_a;
   } else {
-    RemoveNode(entry_b.Id());
+    RemoveNode(entry_b.Index());
     return entry_b;
   }
 }
@@ -223,12 +223,11 @@ GainBucketEntry GainBucketManagerMultiResourceMixed::GetNextGainBucketEntryBestG
   vector<CandidateEntry> candidate_entries;
   for (size_t res_index = 0; res_index < gain_buckets_a_.size(); res_index++) {
     // Part A buckets.
-    size_t depth;
-    for (depth = 0; depth < max_bucket_search_depth_; depth++) {
-      GainBucketEntry* gbe = gain_buckets_a_[res_index]->PeekPtr(depth);
-      if (nullptr == gbe) {
-        break;
-      }
+    GainBucketInterface* bucket_a = gain_buckets_a_[res_index];
+    int depth = 0;
+    for (GainBucketEntry* gbe = bucket_a->PeekFirst();
+         gbe != nullptr && depth < search_depth_;
+         gbe = bucket_a->PeekNext(), depth++) {
       CandidateEntry candidate;
       candidate.from_part_a = true;
       candidate.resource_index = res_index;
@@ -246,11 +245,11 @@ GainBucketEntry GainBucketManagerMultiResourceMixed::GetNextGainBucketEntryBestG
       candidate_entries.push_back(candidate);
     }
     // Part B buckets.
-    for (depth = 0; depth < max_bucket_search_depth_; depth++) {
-      GainBucketEntry* gbe = gain_buckets_b_[res_index]->PeekPtr(depth);
-      if (nullptr == gbe) {
-        break;
-      }
+    GainBucketInterface* bucket_b = gain_buckets_b_[res_index];
+    depth = 0;
+    for (GainBucketEntry* gbe = bucket_b->PeekFirst();
+         gbe != nullptr && depth < search_depth_;
+         gbe = bucket_b->PeekNext(), depth++) {
       CandidateEntry candidate;
       candidate.from_part_a = false;
       candidate.resource_index = res_index;
@@ -293,19 +292,21 @@ GainBucketEntry GainBucketManagerMultiResourceMixed::GetNextGainBucketEntryBestG
     auto& candidate = candidate_entries[i];
     if (i == best_score_index) {
       if (candidate.from_part_a) {
-        gain_buckets_a_[candidate.resource_index]->RemoveByNodeId(candidate.entry->Id());
+        gain_buckets_a_[candidate.resource_index]->RemoveByIndex(candidate.entry->Index());
       } else {
-        gain_buckets_b_[candidate.resource_index]->RemoveByNodeId(candidate.entry->Id());
+        gain_buckets_b_[candidate.resource_index]->RemoveByIndex(candidate.entry->Index());
       }
     } else {
       if (candidate.from_part_a) {
-        gain_buckets_a_[candidate.resource_index]->Touch(candidate.entry->Id());
+        gain_buckets_a_[candidate.resource_index]->Touch(
+            candidate.entry->Index());
       } else {
-        gain_buckets_b_[candidate.resource_index]->Touch(candidate.entry->Id());
+        gain_buckets_b_[candidate.resource_index]->Touch(
+            candidate.entry->Index());
       }
     }
   }
-  RemoveNode(selected_entry.Id());
+  RemoveNode(selected_entry.Index());
   return selected_entry;
 }
 
@@ -320,22 +321,24 @@ GainBucketEntry GainBucketManagerMultiResourceMixed::SelectBetweenBucketsByImbal
     assert(!bucket_b->Empty()); // DEBUG
     GainBucketEntry bucket_b_entry = bucket_b->Top();
     bucket_b->Pop();
-    RemoveNode(bucket_b_entry.Id());
+    RemoveNode(bucket_b_entry.Index());
     return bucket_b_entry;
   } else if (bucket_b->Empty()) {
     assert(!bucket_a->Empty()); // DEBUG
     GainBucketEntry bucket_a_entry = bucket_a->Top();
     bucket_a->Pop();
-    RemoveNode(bucket_a_entry.Id());
+    RemoveNode(bucket_a_entry.Index());
     return bucket_a_entry;
   }
 
   vector<pair<double,GainBucketEntry>> bucket_a_entries;
   vector<pair<double,GainBucketEntry>> bucket_b_entries;
 
+  // Candidates are copied so that the walk position of each bucket can
+  // advance; the buckets themselves are left unchanged until one is chosen.
+  GainBucketEntry* entry_ptr = bucket_a->PeekFirst();
   for (int i = 0; i < search_depth; i++) {
-    GainBucketEntry bucket_a_entry = bucket_a->Top();
-    bucket_a->Pop();
+    GainBucketEntry bucket_a_entry = *entry_ptr;
     double imbalance_power = ImbalancePowerIfMoved(
         bucket_a_entry.current_weight_vector(), current_balance, total_weight,
         true, true);
@@ -350,13 +353,14 @@ GainBucketEntry GainBucketManagerMultiResourceMixed::SelectBetweenBucketsByImbal
     bucket_a_entries.push_back(make_pair(imbalance_power, bucket_a_entry));
     // Equality check on double is OK based on definition of ImbalancePower().
     // If calculation is changed, will want to do a range-based check.
-    if (imbalance_power == 0 || bucket_a->Empty()) {
+    entry_ptr = bucket_a->PeekNext();
+    if (imbalance_power == 0 || entry_ptr == nullptr) {
       break;
     }
   }
+  entry_ptr = bucket_b->PeekFirst();
   for (int i = 0; i < search_depth; i++) {
-    GainBucketEntry bucket_b_entry = bucket_b->Top();
-    bucket_b->Pop();
+    GainBucketEntry bucket_b_entry = *entry_ptr;
     double imbalance_power = ImbalancePowerIfMoved(
         bucket_b_entry.current_weight_vector(), current_balance, total_weight,
         false, true);
@@ -365,7 +369,8 @@ GainBucketEntry GainBucketManagerMultiResourceMixed::SelectBetweenBucketsByImbal
           RatioPowerIfChangedByEntry(bucket_b_entry, total_weight);
     }
     bucket_b_entries.push_back(make_pair(imbalance_power, bucket_b_entry));
-    if (imbalance_power == 0 || bucket_b->Empty()) {
+    entry_ptr = bucket_b->PeekNext();
+    if (imbalance_power == 0 || entry_ptr == nullptr) {
       break;
     }
   }
@@ -411,21 +416,23 @@ GainBucketEntry GainBucketManagerMultiResourceMixed::SelectBetweenBucketsByImbal
     }
   }
 
+  // Unselected entries move to the front of their gain queues, as if they had
+  // been popped and added again.
   GainBucketEntry selected_entry;
   for (size_t i = 0; i < bucket_a_entries.size(); i++) {
     if (use_bucket_a_candidate && (i == bucket_a_best_index)) {
       selected_entry = bucket_a_entries[i].second;
+      bucket_a->RemoveByIndex(selected_entry.Index());
     } else {
-      // Return unselected entry to bucket.
-      bucket_a->Add(bucket_a_entries[i].second);
+      bucket_a->Touch(bucket_a_entries[i].second.Index());
     }
   }
   for (size_t i = 0; i < bucket_b_entries.size(); i++) {
     if (!use_bucket_a_candidate && (i == bucket_b_best_index)) {
       selected_entry = bucket_b_entries[i].second;
+      bucket_b->RemoveByIndex(selected_entry.Index());
     } else {
-      // Return unselected entry to bucket.
-      bucket_b->Add(bucket_b_entries[i].second);
+      bucket_b->Touch(bucket_b_entries[i].second.Index());
     }
   }
   return selected_entry;
@@ -440,9 +447,19 @@ bool GainBucketManagerMultiResourceMixed::Empty() const {
   return NumUnlockedNodes() == 0;
 }
 
+void GainBucketManagerMultiResourceMixed::Clear() {
+  for (size_t i = 0; i < num_resources_per_node_; i++) {
+    gain_buckets_a_[i]->Clear();
+    gain_buckets_b_[i]->Clear();
+  }
+  gain_bucket_a_master_->Clear();
+  gain_bucket_b_master_->Clear();
+  node_index_to_resource_index_.clear();
+}
+
 void GainBucketManagerMultiResourceMixed::AddNode(double gain, Node* node,
-    bool in_part_a, const std::vector<int>& total_weight) {
-  GainBucketEntry entry(gain, node);
+    int node_index, bool in_part_a, const std::vector<int>& total_weight) {
+  GainBucketEntry entry(gain, node, node_index);
   if (in_part_a) {
     gain_bucket_a_master_->Add(entry);
   } else {
@@ -489,7 +506,8 @@ void GainBucketManagerMultiResourceMixed::AddEntry(
   } else {
     gain_buckets_b_[associated_resource]->Add(entry);
   }
-  node_id_to_resource_index_.insert(make_pair(entry.Id(), associated_resource));
+  node_index_to_resource_index_.insert(
+      make_pair(entry.Index(), associated_resource));
 }
 
 int GainBucketManagerMultiResourceMixed::DetermineResourceAffinity(
@@ -518,18 +536,20 @@ void GainBucketManagerMultiResourceMixed::UpdateGains(
   for (auto& v : temp_nodes_to_increase_gain_by_resource_) {
     v.resize(0);
   }
-  for (auto id : nodes_to_increase_gain) {
-    //assert(node_id_to_resource_index_.count(id) != 0);
-    auto it_pair = node_id_to_resource_index_.equal_range(id);
+  for (int node_index : nodes_to_increase_gain) {
+    //assert(node_index_to_resource_index_.count(node_index) != 0);
+    auto it_pair = node_index_to_resource_index_.equal_range(node_index);
     for (auto it = it_pair.first; it != it_pair.second; it++) {
-      temp_nodes_to_increase_gain_by_resource_[it->second].push_back(id);
+      temp_nodes_to_increase_gain_by_resource_[it->second].push_back(
+          node_index);
     }
   }
-  for (auto id : nodes_to_decrease_gain) {
-    //assert(node_id_to_resource_index_.count(id) != 0);
-    auto it_pair = node_id_to_resource_index_.equal_range(id);
+  for (int node_index : nodes_to_decrease_gain) {
+    //assert(node_index_to_resource_index_.count(node_index) != 0);
+    auto it_pair = node_index_to_resource_index_.equal_range(node_index);
     for (auto it = it_pair.first; it != it_pair.second; it++) {
-      temp_nodes_to_decrease_gain_by_resource_[it->second].push_back(id);
+      temp_nodes_to_decrease_gain_by_resource_[it->second].push_back(
+          node_index);
     }
   }
   for (size_t i = 0; i < num_resources_per_node_; i++) {
@@ -557,17 +577,18 @@ void GainBucketManagerMultiResourceMixed::UpdateGains(
   }
 }
 
-void GainBucketManagerMultiResourceMixed::UpdateNodeImplementation(Node* node) {
-  auto res_it = node_id_to_resource_index_.find(node->id);
-  if (res_it == node_id_to_resource_index_.end()) {
+void GainBucketManagerMultiResourceMixed::UpdateNodeImplementation(
+    Node* node, int node_index) {
+  auto res_it = node_index_to_resource_index_.find(node_index);
+  if (res_it == node_index_to_resource_index_.end()) {
     return;
   }
-  bool in_part_a = gain_bucket_a_master_->HasNode(node->id);
+  bool in_part_a = gain_bucket_a_master_->HasNode(node_index);
   if (in_part_a) {
-    GainBucketEntry& gbe = gain_bucket_a_master_->GbeRefByNodeId(node->id);
+    GainBucketEntry& gbe = gain_bucket_a_master_->GbeRefByIndex(node_index);
     gbe.SetCurrentWeightVectorIndex(node->selected_weight_vector_index());
   } else {
-    GainBucketEntry& gbe = gain_bucket_b_master_->GbeRefByNodeId(node->id);
+    GainBucketEntry& gbe = gain_bucket_b_master_->GbeRefByIndex(node_index);
     gbe.SetCurrentWeightVectorIndex(node->selected_weight_vector_index());
   }
   // We don't update the implementation for the resource-affinity buckets.
@@ -628,16 +649,16 @@ double GainBucketManagerMultiResourceMixed::ImbalancePowerIfMoved(
 
 double GainBucketManagerMultiResourceMixed::RatioPowerIfChangedByEntry(
     const GainBucketEntry& entry, const std::vector<int>& total_weight) {
-  bool in_part_a = gain_bucket_a_master_->HasNode(entry.Id());
+  bool in_part_a = gain_bucket_a_master_->HasNode(entry.Index());
   if (in_part_a) {
     const GainBucketEntry& gbe =
-      gain_bucket_a_master_->GbeRefByNodeId(entry.Id());
+      gain_bucket_a_master_->GbeRefByIndex(entry.Index());
     return RatioPowerIfChanged(
         gbe.current_weight_vector(), entry.current_weight_vector(),
         resource_ratio_weights_, total_weight);
   } else {
     const GainBucketEntry& gbe =
-      gain_bucket_b_master_->GbeRefByNodeId(entry.Id());
+      gain_bucket_b_master_->GbeRefByIndex(entry.Index());
     return RatioPowerIfChanged(
         gbe.current_weight_vector(), entry.current_weight_vector(),
         resource_ratio_weights_, total_weight);
@@ -693,46 +714,47 @@ void GainBucketManagerMultiResourceMixed::set_selection_policy(
   selection_policy_ = selection_policy;
 }
 
-GainBucketEntry& GainBucketManagerMultiResourceMixed::GbeRefByNodeId(
-    int node_id) {
-  if (gain_bucket_a_master_->HasNode(node_id)) {
-    return gain_bucket_a_master_->GbeRefByNodeId(node_id);
+GainBucketEntry& GainBucketManagerMultiResourceMixed::GbeRefByIndex(
+    int node_index) {
+  if (gain_bucket_a_master_->HasNode(node_index)) {
+    return gain_bucket_a_master_->GbeRefByIndex(node_index);
   } else {
-    return gain_bucket_b_master_->GbeRefByNodeId(node_id);
+    return gain_bucket_b_master_->GbeRefByIndex(node_index);
   }
 }
 
-GainBucketEntry* GainBucketManagerMultiResourceMixed::GbePtrByNodeId(
-    int node_id) {
-  if (gain_bucket_a_master_->HasNode(node_id)) {
-    return gain_bucket_a_master_->GbePtrByNodeId(node_id);
+GainBucketEntry* GainBucketManagerMultiResourceMixed::GbePtrByIndex(
+    int node_index) {
+  if (gain_bucket_a_master_->HasNode(node_index)) {
+    return gain_bucket_a_master_->GbePtrByIndex(node_index);
   } else {
-    return gain_bucket_b_master_->GbePtrByNodeId(node_id);
+    return gain_bucket_b_master_->GbePtrByIndex(node_index);
   }
 }
 
 bool GainBucketManagerMultiResourceMixed::HasNode(
-    int node_id) {
-  return gain_bucket_a_master_->HasNode(node_id) ||
-         gain_bucket_b_master_->HasNode(node_id);
+    int node_index) {
+  return gain_bucket_a_master_->HasNode(node_index) ||
+         gain_bucket_b_master_->HasNode(node_index);
 }
 
-void GainBucketManagerMultiResourceMixed::TouchNodes(const vector<int>& node_ids) {
-  for (int node_id : node_ids) {
+void GainBucketManagerMultiResourceMixed::TouchNodes(
+    const vector<int>& node_indices) {
+  for (int node_index : node_indices) {
     for (auto& gb : gain_buckets_a_) {
-      if (gb->HasNode(node_id)) {
-        gb->Touch(node_id);
+      if (gb->HasNode(node_index)) {
+        gb->Touch(node_index);
       }
     }
     for (auto& gb : gain_buckets_b_) {
-      if (gb->HasNode(node_id)) {
-        gb->Touch(node_id);
+      if (gb->HasNode(node_index)) {
+        gb->Touch(node_index);
       }
     }
-    if (gain_bucket_a_master_->HasNode(node_id)) {
-      gain_bucket_a_master_->Touch(node_id);
+    if (gain_bucket_a_master_->HasNode(node_index)) {
+      gain_bucket_a_master_->Touch(node_index);
     } else {
-      gain_bucket_b_master_->Touch(node_id);
+      gain_bucket_b_master_->Touch(node_index);
     }
   }
 }
@@ -8,7 +8,6 @@
 
 #include "gain_bucket_entry.h"
 #include "gain_bucket_manager.h"
-#include "gain_bucket_standard.h"
 #include "partitioner_config.h"
 
 class GainBucketManagerMultiResourceMixed : public GainBucketManager {
@@ -16,7 +15,10 @@ class GainBucketManagerMultiResourceMixed : public GainBucketManager {
   GainBucketManagerMultiResourceMixed(
       const std::vector<double>& max_imbalance_fraction,
       PartitionerConfig::GainBucketSelectionPolicy selection_policy,
-      bool adaptive, bool use_ratio, const std::vector<int>& resource_ratios)
+      bool adaptive, bool use_ratio, const std::vector<int>& resource_ratios,
+      PartitionerConfig::GainBucketStorage storage =
+          PartitionerConfig::kGainBucketStorageList,
+      const KlfmHypergraph* hypergraph = nullptr)
     : max_imbalance_fraction_(max_imbalance_fraction),
       selection_policy_(selection_policy), use_adaptive_(adaptive),
       use_ratio_(use_ratio), resource_ratio_weights_(resource_ratios) {
@@ -25,15 +27,13 @@ class GainBucketManagerMultiResourceMixed : public GainBucketManager {
     //use_ratio_ = false;
     random_engine_.seed(0);
     num_resources_per_node_ = max_imbalance_fraction_.size();   
-    // TODO - Make this a parameter of the constructor and incorporate into
-    // the partitioner configuration.
-    max_bucket_search_depth_ = 3;
+    search_depth_ = 3;
     for (size_t i = 0; i < num_resources_per_node_; i++) {
-      gain_buckets_a_.push_back(new GainBucketStandard());
-      gain_buckets_b_.push_back(new GainBucketStandard());
+      gain_buckets_a_.push_back(NewGainBucket(storage, hypergraph));
+      gain_buckets_b_.push_back(NewGainBucket(storage, hypergraph));
     }
-    gain_bucket_a_master_ = new GainBucketStandard();
-    gain_bucket_b_master_ = new GainBucketStandard();
+    gain_bucket_a_master_ = NewGainBucket(storage, hypergraph);
+    gain_bucket_b_master_ = NewGainBucket(storage, hypergraph);
     temp_nodes_to_increase_gain_by_resource_.resize(num_resources_per_node_);
     temp_nodes_to_decrease_gain_by_resource_.resize(num_resources_per_node_);
   }
@@ -54,38 +54,40 @@ class GainBucketManagerMultiResourceMixed : public GainBucketManager {
       const std::vector<int>& total_weight);
 
   // Adds a node to the gain bucket(s).
-  virtual void AddNode(double gain, Node* node, bool in_part_a,
+  virtual void AddNode(double gain, Node* node, int node_index, bool in_part_a,
                        const std::vector<int>& total_weight);
 
   virtual int NumUnlockedNodes() const;
 
   virtual bool Empty() const;
 
+  virtual void Clear();
+
   virtual void UpdateGains(double gain_modifier,
                            const std::vector<int>& nodes_to_increase_gain, 
                            const std::vector<int>& nodes_to_decrease_gain, 
                            bool moved_from_part_a);
 
-  virtual void UpdateNodeImplementation(Node* node);
+  virtual void UpdateNodeImplementation(Node* node, int node_index);
 
   virtual void Print(bool condensed) const;
 
   virtual void set_selection_policy(
       PartitionerConfig::GainBucketSelectionPolicy selection_policy);
 
-  virtual GainBucketEntry& GbeRefByNodeId(int node_id);
-  virtual GainBucketEntry* GbePtrByNodeId(int node_id);
+  virtual GainBucketEntry& GbeRefByIndex(int node_index);
+  virtual GainBucketEntry* GbePtrByIndex(int node_index);
  
-  virtual bool HasNode(int node_id);
+  virtual bool HasNode(int node_index);
 
-  virtual void TouchNodes(const std::vector<int>& node_ids);
+  virtual void TouchNodes(const std::vector<int>& node_indices);
 
  private:
   virtual void AddEntry(
       const GainBucketEntry& entry, int associated_resource, bool in_part_a);
-  // It is safe to call this method even if 'node_id' is not present in any of
-  // the buckets.
-  virtual void RemoveNode(int node_id);
+  // It is safe to call this method even if 'node_index' is not present in any
+  // of the buckets.
+  virtual void RemoveNode(int node_index);
   int DetermineResourceAffinity(const std::vector<int>& weight_vector,
                                 const std::vector<int>& total_weight);
   // Violater version returns 0.0 if no resource maxes are exceeded. Otherwise,
@@ -137,7 +139,6 @@ class GainBucketManagerMultiResourceMixed : public GainBucketManager {
   double ComputeGainImbalanceFn(double gain, double imbalance_power);
 
   size_t num_resources_per_node_;
-  size_t max_bucket_search_depth_;
   // This vector has the same number of entries as there are resources types.
   // Each bucket represents a resource type and may include entries that are
   // weighted toward that resource.
@@ -152,7 +153,7 @@ class GainBucketManagerMultiResourceMixed : public GainBucketManager {
   bool use_adaptive_;
   bool use_ratio_;
   std::vector<int> resource_ratio_weights_;
-  std::unordered_multimap<int, int> node_id_to_resource_index_;
+  std::unordered_multimap<int, int> node_index_to_resource_index_;
   std::default_random_engine random_engine_;
 
   // Reuse data structure for performance.
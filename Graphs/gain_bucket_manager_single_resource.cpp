@@ -38,28 +38,26 @@ GainBucketEntry
     return constrained_entry;
   }
 
-  constrained_entry = constrained_bucket->Top();
   unconstrained_entry = unconstrained_bucket->Top();
 
   /* Actually finding the highest gain node that will fit has unacceptable
      worst-case complexity - O(n). Instead, we will only consider the highest
-     gain entry from the unconstrained bucket and a statically capped number
-     of entries from the constrained bucket, determined by the macro value
-     MAX_CONSTRAINED_ENTRY_CHECKS. */
+     gain entry from the unconstrained bucket and a capped number of entries
+     from the constrained bucket, determined by 'search_depth_'. */
   int constrained_entries_checked = 1;
-  int max_checks =
-      (constrained_bucket->num_entries() > MAX_CONSTRAINED_ENTRY_CHECKS) ?
-      MAX_CONSTRAINED_ENTRY_CHECKS : constrained_bucket->num_entries() - 1;
-  vector<GainBucketEntry> constrained_entries_passed;
-  while ((constrained_entry.CostGain() > unconstrained_entry.CostGain()) &&
-         (constrained_entry.current_weight_vector()[resource_index_] >
+  int max_checks = (constrained_bucket->num_entries() > search_depth_) ?
+      search_depth_ : constrained_bucket->num_entries() - 1;
+  reusable_passed_indices_.clear();
+  GainBucketEntry* constrained_ptr = constrained_bucket->PeekFirst();
+  while ((constrained_ptr->CostGain() > unconstrained_entry.CostGain()) &&
+         (constrained_ptr->current_weight_vector()[resource_index_] >
           max_constrained_node_weight) &&
          (constrained_entries_checked <= max_checks)) {
-    constrained_entries_passed.push_back(constrained_entry);
-    constrained_bucket->Pop();
-    constrained_entry = constrained_bucket->Top();
+    reusable_passed_indices_.push_back(constrained_ptr->Index());
+    constrained_ptr = constrained_bucket->PeekNext();
     constrained_entries_checked++;
   }
+  constrained_entry = *constrained_ptr;
 
   bool use_constrained =
     (constrained_entry.CostGain() > unconstrained_entry.CostGain()) &&
@@ -67,13 +65,15 @@ GainBucketEntry
      max_constrained_node_weight);
 
   if (use_constrained) {
-    constrained_bucket->Pop();
+    constrained_bucket->RemoveByIndex(constrained_entry.Index());
   } else {
     unconstrained_bucket->Pop();
   }
 
-  for (auto& it : constrained_entries_passed) {
-    constrained_bucket->Add(it);
+  // Entries that were passed over go back in front of their gain queues, as
+  // if they had been popped and added again.
+  for (int passed_index : reusable_passed_indices_) {
+    constrained_bucket->Touch(passed_index);
   }
 
   if (use_constrained) {
@@ -91,10 +91,15 @@ bool GainBucketManagerSingleResource::Empty() const {
   return NumUnlockedNodes() == 0;
 }
 
+void GainBucketManagerSingleResource::Clear() {
+  gain_bucket_a_->Clear();
+  gain_bucket_b_->Clear();
+}
+
 void GainBucketManagerSingleResource::AddNode(
-    double gain, Node* node, bool in_part_a,
+    double gain, Node* node, int node_index, bool in_part_a,
     const std::vector<int>& /* total_weight */) {
-  GainBucketEntry entry(gain, node);
+  GainBucketEntry entry(gain, node, node_index);
   AddEntry(entry, in_part_a);
 }
 
@@ -107,12 +112,13 @@ void GainBucketManagerSingleResource::AddEntry(
   }
 }
 
-void GainBucketManagerSingleResource::UpdateNodeImplementation(Node* node) {
-  if (gain_bucket_a_->HasNode(node->id)) {
-    GainBucketEntry& gbe = gain_bucket_a_->GbeRefByNodeId(node->id);
+void GainBucketManagerSingleResource::UpdateNodeImplementation(
+    Node* node, int node_index) {
+  if (gain_bucket_a_->HasNode(node_index)) {
+    GainBucketEntry& gbe = gain_bucket_a_->GbeRefByIndex(node_index);
     gbe.SetCurrentWeightVectorIndex(node->selected_weight_vector_index());
-  } else if (gain_bucket_b_->HasNode(node->id)) {
-    GainBucketEntry& gbe = gain_bucket_b_->GbeRefByNodeId(node->id);
+  } else if (gain_bucket_b_->HasNode(node_index)) {
+    GainBucketEntry& gbe = gain_bucket_b_->GbeRefByIndex(node_index);
     gbe.SetCurrentWeightVectorIndex(node->selected_weight_vector_index());
   }
 }
@@ -136,32 +142,36 @@ void GainBucketManagerSingleResource::Print(bool condensed) const {
   gain_bucket_b_->Print(condensed);
 }
 
-GainBucketEntry& GainBucketManagerSingleResource::GbeRefByNodeId(int node_id) {
-  if (gain_bucket_a_->HasNode(node_id)) {
-    return gain_bucket_a_->GbeRefByNodeId(node_id);
+GainBucketEntry& GainBucketManagerSingleResource::GbeRefByIndex(
+    int node_index) {
+  if (gain_bucket_a_->HasNode(node_index)) {
+    return gain_bucket_a_->GbeRefByIndex(node_index);
   } else {
-    return gain_bucket_b_->GbeRefByNodeId(node_id);
+    return gain_bucket_b_->GbeRefByIndex(node_index);
   }
 }
 
-GainBucketEntry* GainBucketManagerSingleResource::GbePtrByNodeId(int node_id) {
-  if (gain_bucket_a_->HasNode(node_id)) {
-    return gain_bucket_a_->GbePtrByNodeId(node_id);
+GainBucketEntry* GainBucketManagerSingleResource::GbePtrByIndex(
+    int node_index) {
+  if (gain_bucket_a_->HasNode(node_index)) {
+    return gain_bucket_a_->GbePtrByIndex(node_index);
   } else {
-    return gain_bucket_b_->GbePtrByNodeId(node_id);
+    return gain_bucket_b_->GbePtrByIndex(node_index);
   }
 }
 
-bool GainBucketManagerSingleResource::HasNode(int node_id) {
-  return gain_bucket_a_->HasNode(node_id) || gain_bucket_b_->HasNode(node_id);
+bool GainBucketManagerSingleResource::HasNode(int node_index) {
+  return gain_bucket_a_->HasNode(node_index) ||
+         gain_bucket_b_->HasNode(node_index);
 }
 
-void GainBucketManagerSingleResource::TouchNodes(const vector<int>& node_ids) {
-  for (int id : node_ids) {
-    if (gain_bucket_a_->HasNode(id)) {
-      gain_bucket_a_->Touch(id);
+void GainBucketManagerSingleResource::TouchNodes(
+    const vector<int>& node_indices) {
+  for (int node_index : node_indices) {
+    if (gain_bucket_a_->HasNode(node_index)) {
+      gain_bucket_a_->Touch(node_index);
     } else {
-      gain_bucket_b_->Touch(id);
+      gain_bucket_b_->Touch(node_index);
     }
   }
 }
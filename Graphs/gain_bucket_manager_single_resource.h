@@ -5,17 +5,20 @@
 
 #include "gain_bucket_entry.h"
 #include "gain_bucket_manager.h"
-#include "gain_bucket_standard.h"
 
 class GainBucketManagerSingleResource : public GainBucketManager {
  public:
   // 'resource_index' refers to which resource in a node's weight vector is the
   // single resource considered in this gain bucket manager.
-  GainBucketManagerSingleResource(int resource_index, double max_imbalance_frac)
+  GainBucketManagerSingleResource(
+      int resource_index, double max_imbalance_frac,
+      PartitionerConfig::GainBucketStorage storage =
+          PartitionerConfig::kGainBucketStorageList,
+      const KlfmHypergraph* hypergraph = nullptr)
     : resource_index_(resource_index),
       max_imbalance_fraction_(max_imbalance_frac),
-      gain_bucket_a_(new GainBucketStandard()),
-      gain_bucket_b_(new GainBucketStandard()) {}
+      gain_bucket_a_(NewGainBucket(storage, hypergraph)),
+      gain_bucket_b_(NewGainBucket(storage, hypergraph)) {}
 
   virtual ~GainBucketManagerSingleResource() {
     delete gain_bucket_a_;
@@ -32,8 +35,10 @@ class GainBucketManagerSingleResource : public GainBucketManager {
 
   virtual bool Empty() const;
 
+  virtual void Clear();
+
   // Adds a node to the gain bucket(s).
-  virtual void AddNode(double gain, Node* node, bool in_part_a,
+  virtual void AddNode(double gain, Node* node, int node_index, bool in_part_a,
                        const std::vector<int>& total_weight);
 
   virtual void UpdateGains(double gain_modifier,
@@ -41,7 +46,7 @@ class GainBucketManagerSingleResource : public GainBucketManager {
                            const std::vector<int>& nodes_to_decrease_gain, 
                            bool moved_from_part_a);
 
-  virtual void UpdateNodeImplementation(Node* node);
+  virtual void UpdateNodeImplementation(Node* node, int node_index);
 
   virtual void Print(bool condensed) const;
 
@@ -52,12 +57,12 @@ class GainBucketManagerSingleResource : public GainBucketManager {
     exit(1);
   }
 
-  virtual GainBucketEntry& GbeRefByNodeId(int node_id);
-  virtual GainBucketEntry* GbePtrByNodeId(int node_id);
+  virtual GainBucketEntry& GbeRefByIndex(int node_index);
+  virtual GainBucketEntry* GbePtrByIndex(int node_index);
 
-  virtual bool HasNode(int node_id);
+  virtual bool HasNode(int node_index);
 
-  virtual void TouchNodes(const std::vector<int>& node_ids);
+  virtual void TouchNodes(const std::vector<int>& node_indices);
  
  private:
   virtual void AddEntry(const GainBucketEntry& entry, bool in_part_a);
@@ -6,25 +6,21 @@ using namespace std;
 
 void GainBucketStandard::Add(const GainBucketEntry& entry) {
   // Quantize floating point gain values into an integer
-  int bucket_index = entry.GainIndex() + MAX_GAIN;
-  assert_b(bucket_index >= 0) {
-    printf("Bucket Index of %d was computed. May need to increase MAX_GAIN\n",
-           bucket_index);
+  int gain_index = entry.GainIndex();
+  assert_b(gain_index >= -MAX_GAIN && gain_index <= MAX_GAIN) {
+    printf("Gain Index of %d was computed. May need to increase MAX_GAIN\n",
+           gain_index);
   }
 
-  // Gains can be positive or negative, so add offset to index into buckets.
-  if (buckets_.at(bucket_index).empty()) {
-    occupied_buckets_by_index_.insert(bucket_index);
-  }
-
-  buckets_[bucket_index].push_front(entry);
+  BucketContents& bucket = buckets_[gain_index];
+  bucket.push_front(entry);
   /*
   assert(node_id_to_current_gain_index_.find(entry.Id()) ==
          node_id_to_current_gain_index_.end());
          */
-  BucketContents::iterator bucket_iterator = buckets_.at(bucket_index).begin();
-  node_id_to_data_.insert(
-      make_pair(entry.Id(), NodeTrackingData(bucket_iterator, entry.GainIndex())));
+  BucketContents::iterator bucket_iterator = bucket.begin();
+  node_index_to_data_.insert(
+      make_pair(entry.Index(), NodeTrackingData(bucket_iterator, gain_index)));
   /*
   node_id_to_current_gain_index_.insert(
       make_pair(entry.Id(), entry.GainIndex()));
@@ -33,19 +29,17 @@ void GainBucketStandard::Add(const GainBucketEntry& entry) {
 
   // Update iterator affected by insertion into bucket.
   bucket_iterator++;
-  if (bucket_iterator != buckets_.at(bucket_index).end()) {
+  if (bucket_iterator != bucket.end()) {
     //node_id_to_bucket_iterator_.at(bucket_iterator->Id()) = bucket_iterator;
-    node_id_to_data_.at(bucket_iterator->Id()).bucket_iterator = bucket_iterator;
+    node_index_to_data_.at(bucket_iterator->Index()).bucket_iterator =
+        bucket_iterator;
   }
   num_entries_++;
 }
 
 GainBucketEntry& GainBucketStandard::Top() {
-  assert(!occupied_buckets_by_index_.empty());
-  auto top_bucket_iter = occupied_buckets_by_index_.begin();
-  int gain_index = *top_bucket_iter;
-  BucketContents& bucket = buckets_.at(gain_index);
-  return bucket.front();
+  assert(!buckets_.empty());
+  return buckets_.begin()->second.front();
 }
 
 GainBucketEntry& GainBucketStandard::Peek(int offset) {
@@ -59,9 +53,8 @@ GainBucketEntry* GainBucketStandard::PeekPtr(int offset) {
   if (offset > num_entries_ - 1) {
     return nullptr;
   }
-  for (int valid_index : occupied_buckets_by_index_) {
-    BucketContents& bucket = buckets_.at(valid_index);
-    for (auto& gbe : bucket) {
+  for (auto& index_bucket : buckets_) {
+    for (auto& gbe : index_bucket.second) {
       if (cur_offset == offset) {
         return &gbe;
       }
@@ -71,12 +64,40 @@ GainBucketEntry* GainBucketStandard::PeekPtr(int offset) {
   return nullptr;
 }
 
+GainBucketEntry* GainBucketStandard::PeekFirst() {
+  peek_bucket_ = buckets_.begin();
+  if (peek_bucket_ == buckets_.end()) {
+    return nullptr;
+  }
+  peek_entry_ = peek_bucket_->second.begin();
+  return &(*peek_entry_);
+}
+
+GainBucketEntry* GainBucketStandard::PeekNext() {
+  if (peek_bucket_ == buckets_.end()) {
+    return nullptr;
+  }
+  if (++peek_entry_ == peek_bucket_->second.end()) {
+    if (++peek_bucket_ == buckets_.end()) {
+      return nullptr;
+    }
+    peek_entry_ = peek_bucket_->second.begin();
+  }
+  return &(*peek_entry_);
+}
+
 void GainBucketStandard::Pop() {
-  auto top_bucket_iter = occupied_buckets_by_index_.begin();
-  int bucket_index = *top_bucket_iter;
-  BucketContents& bucket = buckets_.at(bucket_index);
+  assert(!buckets_.empty());
+  BucketContents& bucket = buckets_.begin()->second;
   assert(!bucket.empty());
-  RemoveByNodeId(bucket.front().Id());
+  RemoveByIndex(bucket.front().Index());
+}
+
+void GainBucketStandard::Clear() {
+  buckets_.clear();
+  node_index_to_data_.clear();
+  peek_bucket_ = buckets_.end();
+  num_entries_ = 0;
 }
 
 
@@ -86,23 +107,21 @@ bool GainBucketStandard::Empty() const {
 
 void GainBucketStandard::UpdateGains(
     double cost_gain_modifier,
-    const EdgeKlfm::NodeIdVector& nodes_to_update) {
-  for (auto node_id : nodes_to_update) {
-    GainBucketEntry entry = RemoveByNodeId(node_id);
+    const vector<int>& nodes_to_update) {
+  for (int node_index : nodes_to_update) {
+    GainBucketEntry entry = RemoveByIndex(node_index);
     entry.SetCostGain(entry.CostGain() + cost_gain_modifier);
     Add(entry);
   }
 }
 
-bool GainBucketStandard::HasNode(int node_id) {
-  return node_id_to_data_.find(node_id) != node_id_to_data_.end();
+bool GainBucketStandard::HasNode(int node_index) {
+  return node_index_to_data_.find(node_index) != node_index_to_data_.end();
 }
 
-void GainBucketStandard::Touch(int node_id) {
-  NodeTrackingData& new_front_ntd = node_id_to_data_.at(node_id);
-  int gain_index = new_front_ntd.current_gain_index;
-  int bucket_index = gain_index + MAX_GAIN;
-  BucketContents& bucket = buckets_.at(bucket_index);
+void GainBucketStandard::Touch(int node_index) {
+  NodeTrackingData& new_front_ntd = node_index_to_data_.at(node_index);
+  BucketContents& bucket = buckets_.at(new_front_ntd.current_gain_index);
   if (new_front_ntd.bucket_iterator == bucket.begin()) {
     return;
   }
@@ -111,42 +130,43 @@ void GainBucketStandard::Touch(int node_id) {
   new_front_ntd.bucket_iterator = bucket.begin();
 }
 
-GainBucketEntry GainBucketStandard::RemoveByNodeId(int node_id) {
-  NodeTrackingData& ntd = node_id_to_data_.at(node_id);
-  int gain_index = ntd.current_gain_index;
-  int bucket_index = gain_index + MAX_GAIN;
-  BucketContents& bucket = buckets_.at(bucket_index);
+GainBucketEntry GainBucketStandard::RemoveByIndex(int node_index) {
+  NodeTrackingData& ntd = node_index_to_data_.at(node_index);
+  auto bucket_iter = buckets_.find(ntd.current_gain_index);
+  assert(bucket_iter != buckets_.end());
+  BucketContents& bucket = bucket_iter->second;
   assert(!bucket.empty());
 
   BucketContents::iterator erase_iter = ntd.bucket_iterator;
   GainBucketEntry entry = std::move(*erase_iter);
-  assert(entry.Id() == node_id);
+  assert(entry.Index() == node_index);
 
   // Erase returns the new iterator for the element that follows the erased one.
   BucketContents::iterator next_iter = bucket.erase(erase_iter);
-  if (bucket.empty()) {
-    occupied_buckets_by_index_.erase(bucket_index);
-  }
-  node_id_to_data_.erase(node_id);
+  node_index_to_data_.erase(node_index);
   //assert(node_id_to_bucket_iterator_.count(node_id) == 0);
   num_entries_--;
+  if (bucket.empty()) {
+    buckets_.erase(bucket_iter);
+    return entry;
+  }
 
   // Update the iterators before and after the erased element.
   if (next_iter != bucket.end()) {
-    assert(next_iter->Id() != node_id);
-    node_id_to_data_.at(next_iter->Id()).bucket_iterator = next_iter;
+    assert(next_iter->Index() != node_index);
+    node_index_to_data_.at(next_iter->Index()).bucket_iterator = next_iter;
   }
   if (next_iter != bucket.begin()) {
     next_iter--;
-    assert(next_iter->Id() != node_id);
-    node_id_to_data_.at(next_iter->Id()).bucket_iterator = next_iter;
+    assert(next_iter->Index() != node_index);
+    node_index_to_data_.at(next_iter->Index()).bucket_iterator = next_iter;
   }
 
   return entry;
 }
 
-GainBucketEntry& GainBucketStandard::GbeRefByNodeId(int node_id) {
-  NodeTrackingData& ntd = node_id_to_data_.at(node_id);
+GainBucketEntry& GainBucketStandard::GbeRefByIndex(int node_index) {
+  NodeTrackingData& ntd = node_index_to_data_.at(node_index);
   /*
   int gain_index = ntd.current_gain_index;
   int bucket_index = gain_index + MAX_GAIN;
@@ -158,25 +178,24 @@ GainBucketEntry& GainBucketStandard::GbeRefByNodeId(int node_id) {
   return *(ntd.bucket_iterator);
 }
 
-GainBucketEntry* GainBucketStandard::GbePtrByNodeId(int node_id) {
-  if (node_id > (int)node_id_to_data_.size()) {
+GainBucketEntry* GainBucketStandard::GbePtrByIndex(int node_index) {
+  auto it = node_index_to_data_.find(node_index);
+  if (it == node_index_to_data_.end()) {
     return nullptr;
   }
-  NodeTrackingData& ntd = node_id_to_data_.at(node_id);
-  return &(*(ntd.bucket_iterator));
+  return &(*(it->second.bucket_iterator));
 }
 
 void GainBucketStandard::Print(bool condensed) const {
   printf("Occupied buckets (by value): ");
-  for (auto bucket_index : occupied_buckets_by_index_) {
-    printf("%d ", bucket_index - MAX_GAIN);
+  for (auto& index_bucket : buckets_) {
+    printf("%d ", index_bucket.first);
   }
   printf("\n");
   if (!condensed) {
-    for (auto bucket_index : occupied_buckets_by_index_) {
-      const BucketContents& bucket = buckets_.at(bucket_index);
-      printf("Nodes in bucket %d (id: weight):\n", bucket_index - MAX_GAIN);
-      for (auto entry : bucket) {
+    for (auto& index_bucket : buckets_) {
+      printf("Nodes in bucket %d (id: weight):\n", index_bucket.first);
+      for (auto& entry : index_bucket.second) {
         printf("(%d: ", entry.Id());
         for (auto wt_it : entry.current_weight_vector()) {
           printf(" %d", wt_it);
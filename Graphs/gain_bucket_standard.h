@@ -4,8 +4,9 @@
 #include "gain_bucket_interface.h"
 
 #include <cassert>
+#include <functional>
 #include <list>
-#include <set>
+#include <map>
 #include <unordered_map>
 #include <vector>
 
@@ -17,9 +18,7 @@ class GainBucketStandard : public GainBucketInterface {
   // iterators and need to reason about what operations will invalidate them.
   typedef std::list<GainBucketEntry> BucketContents;
 
-  GainBucketStandard() : num_entries_(0) {
-    buckets_.resize(2 * MAX_GAIN + 1);
-  }
+  GainBucketStandard() : peek_bucket_(buckets_.end()), num_entries_(0) {}
 
   virtual ~GainBucketStandard() {}
 
@@ -34,28 +33,35 @@ class GainBucketStandard : public GainBucketInterface {
   virtual GainBucketEntry& Peek(int offset);
   virtual GainBucketEntry* PeekPtr(int offset);
 
+  // Walk the entries in the order they would be popped. See
+  // GainBucketInterface.
+  virtual GainBucketEntry* PeekFirst();
+  virtual GainBucketEntry* PeekNext();
+
   // Removes the entry corresponding to Top() from the gain bucket.
   virtual void Pop();
 
+  virtual void Clear();
+
   // Returns false if there are any entries in the bucket.
   virtual bool Empty() const;
 
   // Add the gain modifier to each of the nodes in the vector.
   virtual void UpdateGains(double gain_modifier,
-                           const EdgeKlfm::NodeIdVector& nodes_to_update);
+                           const std::vector<int>& nodes_to_update);
 
   // Moves the node to the front of its gain queue.
-  virtual void Touch(int node_id);
+  virtual void Touch(int node_index);
 
-  // Returns true if the node with 'node_id' is in the bucket.
-  virtual bool HasNode(int node_id);
+  // Returns true if the node with 'node_index' is in the bucket.
+  virtual bool HasNode(int node_index);
 
-  // Removes the node with 'node_id' and returns its entry.
-  virtual GainBucketEntry RemoveByNodeId(int node_id);
+  // Removes the node with 'node_index' and returns its entry.
+  virtual GainBucketEntry RemoveByIndex(int node_index);
 
-  // Returns a reference to the gain bucket entry with 'node_id'.
-  virtual GainBucketEntry& GbeRefByNodeId(int node_id);
-  virtual GainBucketEntry* GbePtrByNodeId(int node_id);
+  // Returns a reference to the gain bucket entry with 'node_index'.
+  virtual GainBucketEntry& GbeRefByIndex(int node_index);
+  virtual GainBucketEntry* GbePtrByIndex(int node_index);
 
   // Print debug information.
   virtual void Print(bool condensed) const;
@@ -72,9 +78,14 @@ class GainBucketStandard : public GainBucketInterface {
     int current_gain_index;
     bool valid;
   };
-  // Use greater to make the set sort in descending value.
-  std::set<int, std::greater<int>> occupied_buckets_by_index_;
-  std::vector<BucketContents> buckets_;
+  // Only occupied buckets are stored, keyed by gain index. Use greater to
+  // make the map sort in descending value. Lists are node based, so entry
+  // iterators stay valid as other buckets are inserted and erased.
+  typedef std::map<int, BucketContents, std::greater<int>> BucketMap;
+  BucketMap buckets_;
+  // The position of the walk started by PeekFirst().
+  BucketMap::iterator peek_bucket_;
+  BucketContents::iterator peek_entry_;
   // Note: gain, NOT gain offset!
   //std::unordered_map<int, int> node_id_to_current_gain_index_;
   // This data structure is used to accelerate finding items in a bucket.
@@ -83,7 +94,7 @@ class GainBucketStandard : public GainBucketInterface {
   //std::unordered_map<int, BucketContents::iterator>
   //    node_id_to_bucket_iterator_;
 
-  std::unordered_map<int, NodeTrackingData> node_id_to_data_;
+  std::unordered_map<int, NodeTrackingData> node_index_to_data_;
   int num_entries_;
 
 };
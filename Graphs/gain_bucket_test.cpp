@@ -0,0 +1,256 @@
+/* Checks that the list, array and heap gain bucket storages select nodes in
+   the same order, and that gain indices follow the gains they quantize.
+
+   The three storages are driven through the same random sequence of
+   operations. Gains are kept to multiples of the bucket quantum, for which
+   the heap promises the same order as the list based buckets. After every
+   operation, the full pop order is read back through PeekFirst/PeekNext and
+   compared, along with PeekPtr and the per-node lookups.
+
+   Exits with a non-zero status if any check fails. */
+
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "edge_klfm.h"
+#include "gain_bucket_array.h"
+#include "gain_bucket_entry.h"
+#include "gain_bucket_heap.h"
+#include "gain_bucket_interface.h"
+#include "gain_bucket_standard.h"
+#include "klfm_hypergraph.h"
+#include "node.h"
+
+using namespace std;
+
+namespace {
+
+int num_failures = 0;
+
+#define EXPECT(cond) \
+  do { \
+    if (!(cond)) { \
+      printf("%s:%d: Check failed: %s\n", __FILE__, __LINE__, #cond); \
+      num_failures++; \
+    } \
+  } while (0)
+
+// The order in which a bucket would pop its entries, as node ID and gain
+// index pairs.
+vector<pair<int,int>> WalkOrder(GainBucketInterface* bucket) {
+  vector<pair<int,int>> order;
+  for (GainBucketEntry* gbe = bucket->PeekFirst(); gbe != nullptr;
+       gbe = bucket->PeekNext()) {
+    order.push_back(make_pair(gbe->Id(), gbe->GainIndex()));
+  }
+  return order;
+}
+
+// Compares every storage in 'buckets' against the first.
+void ExpectSameState(const vector<GainBucketInterface*>& buckets,
+                     int num_nodes, const string& step) {
+  GainBucketInterface* reference = buckets[0];
+  vector<pair<int,int>> reference_order = WalkOrder(reference);
+  EXPECT((int)reference_order.size() == reference->num_entries());
+  // Entries are popped in order of non-increasing gain.
+  for (size_t i = 1; i < reference_order.size(); i++) {
+    EXPECT(reference_order[i - 1].second >= reference_order[i].second);
+  }
+  for (size_t b = 1; b < buckets.size(); b++) {
+    GainBucketInterface* bucket = buckets[b];
+    EXPECT(bucket->num_entries() == reference->num_entries());
+    EXPECT(bucket->Empty() == reference->Empty());
+    vector<pair<int,int>> order = WalkOrder(bucket);
+    EXPECT(order == reference_order);
+    if (order != reference_order) {
+      printf("  Storage %lu differs from the list storage after %s.\n", b,
+             step.c_str());
+    }
+    // PeekPtr() ends the walk, so it is checked afterwards.
+    for (size_t i = 0; i < order.size(); i += 3) {
+      EXPECT(bucket->PeekPtr(i)->Id() == order[i].first);
+    }
+    if (!bucket->Empty()) {
+      EXPECT(bucket->Top().Id() == reference->Top().Id());
+    }
+    for (int index = 0; index < num_nodes; index++) {
+      EXPECT(bucket->HasNode(index) == reference->HasNode(index));
+      if (reference->HasNode(index)) {
+        EXPECT(bucket->GbePtrByIndex(index)->CostGain() ==
+               reference->GbePtrByIndex(index)->CostGain());
+      }
+    }
+  }
+}
+
+// Gains are multiples of half a unit, which every storage represents
+// exactly.
+double RandomGain(default_random_engine* engine) {
+  return uniform_int_distribution<int>(-24, 24)(*engine) * 0.5;
+}
+
+void TestStoragesSelectInSameOrder() {
+  const int kNumNodes = 60;
+  const int kNumSteps = 4000;
+  vector<unique_ptr<Node>> owned_nodes;
+  KlfmHypergraph::NodeMap node_map;
+  for (int id = 1; id <= kNumNodes; id++) {
+    owned_nodes.emplace_back(new Node(id));
+    Node* node = owned_nodes.back().get();
+    node->AddWeightVector(vector<int>{1});
+    node_map.insert(make_pair(id, node));
+  }
+  KlfmHypergraph hypergraph;
+  hypergraph.Build(node_map, KlfmHypergraph::EdgeMap());
+  const int num_nodes = hypergraph.num_nodes();
+
+  GainBucketStandard list_bucket;
+  GainBucketArray array_bucket(&hypergraph);
+  GainBucketHeap heap_bucket(&hypergraph);
+  vector<GainBucketInterface*> buckets = {
+      &list_bucket, &array_bucket, &heap_bucket};
+
+  default_random_engine engine(1);
+  for (int step = 0; step < kNumSteps; step++) {
+    vector<int> present_indices;
+    vector<int> absent_indices;
+    for (int index = 0; index < num_nodes; index++) {
+      if (list_bucket.HasNode(index)) {
+        present_indices.push_back(index);
+      } else {
+        absent_indices.push_back(index);
+      }
+    }
+    auto pick = [&engine](const vector<int>& indices) {
+      return indices[uniform_int_distribution<size_t>(
+          0, indices.size() - 1)(engine)];
+    };
+    int op = uniform_int_distribution<int>(0, 9)(engine);
+    string description;
+    if (present_indices.empty() || (op < 3 && !absent_indices.empty())) {
+      int index = pick(absent_indices);
+      GainBucketEntry entry(RandomGain(&engine), hypergraph.node(index),
+                            index);
+      for (auto bucket : buckets) {
+        bucket->Add(entry);
+      }
+      description = "Add";
+    } else if (op < 6) {
+      double modifier = RandomGain(&engine);
+      vector<int> nodes_to_update;
+      for (int index : present_indices) {
+        if (uniform_int_distribution<int>(0, 3)(engine) == 0) {
+          nodes_to_update.push_back(index);
+        }
+      }
+      for (auto bucket : buckets) {
+        bucket->UpdateGains(modifier, nodes_to_update);
+      }
+      description = "UpdateGains";
+    } else if (op < 7) {
+      int index = pick(present_indices);
+      for (auto bucket : buckets) {
+        bucket->Touch(index);
+      }
+      description = "Touch";
+    } else if (op < 8) {
+      int index = pick(present_indices);
+      for (auto bucket : buckets) {
+        GainBucketEntry removed = bucket->RemoveByIndex(index);
+        EXPECT(removed.Index() == index);
+        EXPECT(removed.Id() == hypergraph.node(index)->id);
+      }
+      description = "RemoveByIndex";
+    } else {
+      int top_id = list_bucket.Top().Id();
+      for (auto bucket : buckets) {
+        EXPECT(bucket->Top().Id() == top_id);
+        bucket->Pop();
+      }
+      description = "Pop";
+    }
+    ExpectSameState(buckets, num_nodes,
+                    description + " at step " + to_string(step));
+    if (num_failures > 20) {
+      return;
+    }
+  }
+
+  // A walk stops at the end of the entries and can be restarted.
+  for (auto bucket : buckets) {
+    size_t num_visited = WalkOrder(bucket).size();
+    EXPECT(num_visited == (size_t)bucket->num_entries());
+    EXPECT(bucket->PeekNext() == nullptr);
+    EXPECT(WalkOrder(bucket).size() == num_visited);
+  }
+}
+
+// Gain indices once all collapsed to zero, which left every bucket a single
+// last in, first out list that ignored the gains.
+void TestGainIndexFollowsGain() {
+  Node node(1);
+  node.AddWeightVector(vector<int>{1});
+  vector<double> gains = {-3.0, -0.5, -1.0 / 256, 0.0, 1.0 / 256, 0.5, 1.0,
+                          2.0, 7.25, 1000.0};
+  for (size_t i = 1; i < gains.size(); i++) {
+    GainBucketEntry lower(gains[i - 1], &node, 0);
+    GainBucketEntry higher(gains[i], &node, 0);
+    EXPECT(lower.GainIndex() < higher.GainIndex());
+  }
+  EXPECT(GainBucketEntry(1.0, &node, 0).GainIndex() == 256);
+  EXPECT(GainBucketEntry(-1.0, &node, 0).GainIndex() == -256);
+  // Gains within one quantum share an index.
+  EXPECT(GainBucketEntry(1.0, &node, 0).GainIndex() ==
+         GainBucketEntry(1.0 + 1.0 / 512, &node, 0).GainIndex());
+  // Gains beyond the range of the buckets share the outermost ones.
+  EXPECT(GainBucketEntry(1e12, &node, 0).GainIndex() == MAX_GAIN);
+  EXPECT(GainBucketEntry(-1e12, &node, 0).GainIndex() == -MAX_GAIN);
+
+  // The highest gain is selected first, whatever the order of addition.
+  vector<unique_ptr<Node>> nodes;
+  KlfmHypergraph::NodeMap node_map;
+  for (int id = 1; id <= 3; id++) {
+    nodes.emplace_back(new Node(id));
+    nodes.back()->AddWeightVector(vector<int>{1});
+    node_map.insert(make_pair(id, nodes.back().get()));
+  }
+  KlfmHypergraph hypergraph;
+  hypergraph.Build(node_map, KlfmHypergraph::EdgeMap());
+  GainBucketStandard list_bucket;
+  GainBucketArray array_bucket(&hypergraph);
+  GainBucketHeap heap_bucket(&hypergraph);
+  for (GainBucketInterface* bucket : vector<GainBucketInterface*>{
+           &list_bucket, &array_bucket, &heap_bucket}) {
+    bucket->Add(GainBucketEntry(1.0, nodes[0].get(),
+                                hypergraph.NodeIndex(1)));
+    bucket->Add(GainBucketEntry(3.0, nodes[1].get(),
+                                hypergraph.NodeIndex(2)));
+    bucket->Add(GainBucketEntry(2.0, nodes[2].get(),
+                                hypergraph.NodeIndex(3)));
+    vector<pair<int,int>> order = WalkOrder(bucket);
+    EXPECT(order.size() == 3);
+    if (order.size() == 3) {
+      EXPECT(order[0].first == 2);
+      EXPECT(order[1].first == 3);
+      EXPECT(order[2].first == 1);
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  TestGainIndexFollowsGain();
+  TestStoragesSelectInSameOrder();
+  if (num_failures != 0) {
+    printf("gain_bucket_test: %d checks FAILED\n", num_failures);
+    return 1;
+  }
+  printf("gain_bucket_test: PASSED\n");
+  return 0;
+}
@@ -1,9 +1,96 @@
 #include "id_manager.h"
 
+#include <algorithm>
+
+using namespace std;
+
 // Reserve ID 0 to indicate a terminal connection (i.e. a port).
 const int IdManager::kReservedTerminalId = 0;
-int IdManager::next_id = 1;
-int IdManager::prev_id = 0;
+std::atomic<int> IdManager::next_id(1);
+std::mutex IdManager::free_node_ids_mutex;
+std::vector<int> IdManager::free_node_ids;
+std::atomic<int> IdManager::num_free_node_ids(0);
+thread_local IdManager::ThreadRange IdManager::thread_range;
+
+int IdManager::AcquireNodeId() {
+  if (thread_range.end != 0) {
+    if (!thread_range.free_node_ids.empty()) {
+      int id = thread_range.free_node_ids.back();
+      thread_range.free_node_ids.pop_back();
+      return id;
+    }
+    if (thread_range.next < thread_range.end) {
+      return thread_range.next++;
+    }
+  }
+  if (num_free_node_ids > 0) {
+    lock_guard<mutex> lock(free_node_ids_mutex);
+    if (!free_node_ids.empty()) {
+      int id = free_node_ids.back();
+      free_node_ids.pop_back();
+      num_free_node_ids--;
+      return id;
+    }
+  }
+  int id = next_id++;
+  assert(id > 0 && id != std::numeric_limits<int>::max() - 1);
+  return id;
+}
+
+void IdManager::ReleaseNodeId(int id) {
+  assert(id > 0 && id < next_id);
+  if (thread_range.end != 0 && thread_range.begin <= id &&
+      id < thread_range.end) {
+    thread_range.free_node_ids.push_back(id);
+    return;
+  }
+  lock_guard<mutex> lock(free_node_ids_mutex);
+  free_node_ids.push_back(id);
+  num_free_node_ids++;
+}
+
+void IdManager::Reset(int val) {
+  lock_guard<mutex> lock(free_node_ids_mutex);
+  free_node_ids.clear();
+  num_free_node_ids = 0;
+  next_id = val;
+}
+
+void IdManager::Reserve(int id) {
+  {
+    lock_guard<mutex> lock(free_node_ids_mutex);
+    auto it = find(free_node_ids.begin(), free_node_ids.end(), id);
+    if (it != free_node_ids.end()) {
+      free_node_ids.erase(it);
+      num_free_node_ids--;
+    }
+  }
+  int next = next_id;
+  while (next <= id && !next_id.compare_exchange_weak(next, id + 1)) {}
+}
+
+int IdManager::ReserveRange(int count) {
+  int begin = next_id.fetch_add(count);
+  assert(count >= 0 && begin <= std::numeric_limits<int>::max() - 1 - count);
+  return begin;
+}
 
+void IdManager::UnreserveRange(int begin, int end) {
+  assert(begin <= end);
+  next_id.compare_exchange_strong(end, begin);
+}
 
+void IdManager::SetThreadRange(int begin, int end) {
+  assert(0 < begin && begin <= end && end <= next_id);
+  thread_range.begin = begin;
+  thread_range.next = begin;
+  thread_range.end = end;
+  thread_range.free_node_ids.clear();
+}
 
+int IdManager::ClearThreadRange() {
+  int next = thread_range.next;
+  thread_range.end = 0;
+  thread_range.free_node_ids.clear();
+  return next;
+}
@@ -1,36 +1,78 @@
 #ifndef ID_MANAGER_H_
 #define ID_MANAGER_H_
 
+#include <atomic>
 #include <cassert>
 #include <limits>
+#include <mutex>
+#include <vector>
 
-/* Provides methods for obtaining unique IDs for nodes and edges. */
+/* Provides methods for obtaining unique IDs for nodes and edges. IDs may be
+   acquired concurrently from multiple threads. Released node IDs are handed
+   out again by AcquireNodeId(), so that the IDs of the supernodes made and
+   discarded by every run of multilevel partitioning stay within a bounded
+   range.
+
+   A thread can instead be given a range of its own, so that the IDs it
+   receives do not depend on how it interleaves with other threads. */
 class IdManager {
  public:
   static int AcquireEdgeId() { 
+    if (thread_range.next < thread_range.end) {
+      return thread_range.next++;
+    }
     // Detect overflow in IDs.
     // TODO If this ever occurs, code a more robust system or convert
     // all IDs to larger datatype.
-    assert(next_id != std::numeric_limits<int>::max() - 1);
-    assert(next_id > prev_id);
-    prev_id = next_id;
-    return next_id++;
-  }
-  static int AcquireNodeId() {
-    assert(next_id != std::numeric_limits<int>::max() - 1);
-    assert(next_id > prev_id);
-    prev_id = next_id;
-    return next_id++;
+    int id = next_id++;
+    assert(id > 0 && id != std::numeric_limits<int>::max() - 1);
+    return id;
   }
+  static int AcquireNodeId();
   static void ReleaseEdgeId(int /*id*/) { /* Currently does nothing. */ }
-  static void ReleaseNodeId(int /*id*/) { /* Currently does nothing. */ }
-  static void Reset(int val) { next_id = val; }
+  // Makes 'id' available to AcquireNodeId() again. The caller must hold no
+  // other reference to the node.
+  static void ReleaseNodeId(int id);
+  // Also forgets all released IDs.
+  static void Reset(int val);
+  // Ensures that 'id', which was assigned without the manager, is never
+  // handed out.
+  static void Reserve(int id);
+
+  // Reserves 'count' consecutive IDs that are not otherwise handed out, and
+  // returns the first.
+  static int ReserveRange(int count);
+  // Returns the IDs from 'begin' to 'end', the last range reserved, to the
+  // pool, provided that no IDs have been acquired since it was reserved.
+  static void UnreserveRange(int begin, int end);
+
+  // Makes the calling thread acquire IDs from the reserved range from
+  // 'begin' to 'end', and from the pool only once the range runs out. Node
+  // IDs from the range that the thread releases are reused only by the
+  // thread itself.
+  static void SetThreadRange(int begin, int end);
+  // Makes the calling thread acquire IDs from the pool again, and returns
+  // one past the highest ID that it acquired from its range.
+  static int ClearThreadRange();
 
   static const int kReservedTerminalId;
 
  private:
-  static int next_id;
-  static int prev_id;
+  struct ThreadRange {
+    int begin = 0;
+    int next = 0;
+    // Zero while the thread has no range.
+    int end = 0;
+    std::vector<int> free_node_ids;
+  };
+
+  static std::atomic<int> next_id;
+  // Released node IDs, reused last in first out. 'num_free_node_ids' lets
+  // AcquireNodeId() skip the lock while there are none.
+  static std::mutex free_node_ids_mutex;
+  static std::vector<int> free_node_ids;
+  static std::atomic<int> num_free_node_ids;
+  static thread_local ThreadRange thread_range;
 };
 
 #endif /* ID_MANAGER_H_ */
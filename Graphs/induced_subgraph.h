@@ -0,0 +1,55 @@
+#ifndef INDUCED_SUBGRAPH_H_
+#define INDUCED_SUBGRAPH_H_
+
+/* Read-only view of the subgraph of a graph induced by a subset of its
+   internal nodes. The view holds the nodes in the subset and the edges whose
+   connections all lie in the subset. Edges that leave the subset are not
+   part of the view.
+
+   The view keeps its own copy of the node IDs, but refers to the nodes and
+   edges of the graph, which must outlive the view. Consumers that modify
+   the nodes, such as PartitionEngineKlfm, copy them out of the view. */
+
+#include <set>
+#include <utility>
+
+#include "edge.h"
+#include "node.h"
+
+class InducedSubgraph {
+ public:
+  typedef std::set<int> NodeIdSet;
+
+  InducedSubgraph(Node* graph, NodeIdSet node_ids)
+    : graph_(graph), node_ids_(std::move(node_ids)) {}
+
+  Node* graph() const { return graph_; }
+  const NodeIdSet& node_ids() const { return node_ids_; }
+
+  Node* node(int node_id) const {
+    return graph_->internal_nodes().at(node_id);
+  }
+  Edge* edge(int edge_id) const {
+    return graph_->internal_edges().at(edge_id);
+  }
+
+  bool ContainsNode(int node_id) const {
+    return node_ids_.find(node_id) != node_ids_.end();
+  }
+
+  // Returns true if every connection of 'edge' is a node in the view.
+  bool ContainsEdge(const Edge* edge) const {
+    for (auto cnx_id : edge->connection_ids()) {
+      if (!ContainsNode(cnx_id)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  Node* graph_;
+  NodeIdSet node_ids_;
+};
+
+#endif /* INDUCED_SUBGRAPH_H_ */
@@ -0,0 +1,79 @@
+#include "klfm_hypergraph.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "universal_macros.h"
+
+using namespace std;
+
+void KlfmHypergraph::Build(const NodeMap& node_map, const EdgeMap& edge_map) {
+  Clear();
+
+  int max_node_id = -1;
+  nodes_.reserve(node_map.size());
+  node_ids_.reserve(node_map.size());
+  for (auto node_pair : node_map) {
+    nodes_.push_back(node_pair.second);
+    node_ids_.push_back(node_pair.first);
+    max_node_id = max(max_node_id, node_pair.first);
+  }
+  node_index_by_id_.assign(max_node_id + 1, -1);
+  for (size_t i = 0; i < node_ids_.size(); i++) {
+    node_index_by_id_[node_ids_[i]] = i;
+  }
+
+  // Edge IDs are only needed while building, to translate the edge ID on
+  // each port to a net index.
+  int max_edge_id = -1;
+  nets_.reserve(edge_map.size());
+  for (auto edge_pair : edge_map) {
+    nets_.push_back(edge_pair.second);
+    max_edge_id = max(max_edge_id, edge_pair.first);
+  }
+  vector<int> net_index_by_id(max_edge_id + 1, -1);
+  for (size_t i = 0; i < nets_.size(); i++) {
+    net_index_by_id[nets_[i]->id_] = i;
+  }
+
+  net_pin_offsets_.reserve(nets_.size() + 1);
+  net_pin_offsets_.push_back(0);
+  for (EdgeKlfm* net : nets_) {
+    for (int node_id : net->connection_ids()) {
+      int node_index = NodeIndex(node_id);
+      assert_b(node_index >= 0) {
+        printf("Edge %d connects to node %d, which is not in the node map.\n",
+               net->id_, node_id);
+      }
+      net_pins_.push_back(node_index);
+    }
+    net_pin_offsets_.push_back(net_pins_.size());
+  }
+
+  node_net_offsets_.reserve(nodes_.size() + 1);
+  node_net_offsets_.push_back(0);
+  node_nets_.reserve(net_pins_.size());
+  for (Node* node : nodes_) {
+    for (auto& port_pair : node->ports()) {
+      int edge_id = port_pair.second.external_edge_id;
+      assert_b(edge_id >= 0 && edge_id <= max_edge_id &&
+               net_index_by_id[edge_id] >= 0) {
+        printf("Node %d connects to edge %d, which is not in the edge map.\n",
+               node->id, edge_id);
+      }
+      node_nets_.push_back(net_index_by_id[edge_id]);
+    }
+    node_net_offsets_.push_back(node_nets_.size());
+  }
+}
+
+void KlfmHypergraph::Clear() {
+  nodes_.clear();
+  node_ids_.clear();
+  nets_.clear();
+  node_index_by_id_.clear();
+  node_net_offsets_.clear();
+  node_nets_.clear();
+  net_pin_offsets_.clear();
+  net_pins_.clear();
+}
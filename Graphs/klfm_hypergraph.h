@@ -0,0 +1,85 @@
+#ifndef KLFM_HYPERGRAPH_H_
+#define KLFM_HYPERGRAPH_H_
+
+/* Flat, cache-friendly view of the graph/hypergraph held in the node and edge
+   maps of the KLFM partition engine. Nodes and nets (edges) are assigned dense
+   indices 0..N-1 and 0..M-1, and incidence is stored in compressed sparse row
+   form in both directions: node -> incident nets and net -> pins.
+
+   The view does not own the nodes or edges it refers to. It must be rebuilt
+   whenever nodes or edges are added to or removed from the maps, e.g. after
+   coarsening or decoarsening. */
+
+#include <cassert>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "edge_klfm.h"
+#include "node.h"
+
+class KlfmHypergraph {
+ public:
+  typedef std::unordered_map<int, Node*> NodeMap;
+  typedef std::unordered_map<int, EdgeKlfm*> EdgeMap;
+
+  KlfmHypergraph() {}
+
+  // Rebuilds the view from 'node_map' and 'edge_map'. Node indices are
+  // assigned in the iteration order of 'node_map', and the nets of each node
+  // are stored in the order of its ports.
+  void Build(const NodeMap& node_map, const EdgeMap& edge_map);
+
+  void Clear();
+
+  size_t num_nodes() const { return nodes_.size(); }
+  size_t num_nets() const { return nets_.size(); }
+  size_t num_pins() const { return net_pins_.size(); }
+
+  // Returns the dense index of the node with 'node_id', or -1 if it is not
+  // part of the view.
+  int NodeIndex(int node_id) const {
+    return ((size_t)node_id < node_index_by_id_.size()) ?
+        node_index_by_id_[node_id] : -1;
+  }
+
+  Node* node(int node_index) const { return nodes_[node_index]; }
+  int node_id(int node_index) const { return node_ids_[node_index]; }
+  EdgeKlfm* net(int net_index) const { return nets_[net_index]; }
+
+  // The indices of the nets incident to 'node_index' are in the range
+  // [NetsBegin(node_index), NetsEnd(node_index)).
+  const int* NetsBegin(int node_index) const {
+    return node_nets_.data() + node_net_offsets_[node_index];
+  }
+  const int* NetsEnd(int node_index) const {
+    return node_nets_.data() + node_net_offsets_[node_index + 1];
+  }
+
+  // The indices of the nodes connected to 'net_index' are in the range
+  // [PinsBegin(net_index), PinsEnd(net_index)).
+  const int* PinsBegin(int net_index) const {
+    return net_pins_.data() + net_pin_offsets_[net_index];
+  }
+  const int* PinsEnd(int net_index) const {
+    return net_pins_.data() + net_pin_offsets_[net_index + 1];
+  }
+
+ private:
+  std::vector<Node*> nodes_;
+  std::vector<int> node_ids_;
+  std::vector<EdgeKlfm*> nets_;
+
+  // Indexed by node ID. -1 marks IDs that are not nodes in the view.
+  std::vector<int> node_index_by_id_;
+
+  // Node -> net incidence. Has num_nodes() + 1 offsets.
+  std::vector<int> node_net_offsets_;
+  std::vector<int> node_nets_;
+
+  // Net -> node incidence. Has num_nets() + 1 offsets.
+  std::vector<int> net_pin_offsets_;
+  std::vector<int> net_pins_;
+};
+
+#endif /* KLFM_HYPERGRAPH_H_ */
@@ -0,0 +1,184 @@
+#include "klfm_move_trace.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "universal_macros.h"
+
+using namespace std;
+
+const char KlfmMoveTrace::kMagic[] = "KLFMTRC2";
+const size_t KlfmMoveTrace::Writer::kChunkSize;
+mutex KlfmMoveTrace::Writer::file_mutex_;
+
+void KlfmMoveTrace::Writer::StartRun(int run) {
+  cur_run_ = run;
+  cur_level_ = 0;
+  cur_pass_ = 0;
+  cur_move_ = 0;
+  Append<uint8_t>(kRecordRunStart);
+  Append<int32_t>(run);
+}
+
+void KlfmMoveTrace::Writer::StartPass() {
+  cur_move_ = 0;
+  AppendContextIfChunkStart();
+  Append<uint8_t>(kRecordPassStart);
+  Append<int32_t>(cur_level_);
+  Append<int32_t>(cur_pass_);
+}
+
+void KlfmMoveTrace::Writer::RecordMove(
+    int node_id, double gain, double cost, const vector<int>& balance) {
+  AppendContextIfChunkStart();
+  Append<uint8_t>(kRecordMove);
+  Append<int32_t>(node_id);
+  Append<double>(gain);
+  Append<double>(cost);
+  AppendBalance(balance);
+  cur_move_++;
+  FlushIfChunkFull();
+}
+
+void KlfmMoveTrace::Writer::EndPass(
+    size_t num_moves, size_t num_moves_kept, bool partition_changed,
+    double cost, const vector<int>& balance) {
+  AppendContextIfChunkStart();
+  Append<uint8_t>(kRecordPassEnd);
+  Append<uint32_t>(num_moves);
+  Append<uint32_t>(num_moves_kept);
+  Append<uint8_t>(partition_changed);
+  Append<double>(cost);
+  AppendBalance(balance);
+  cur_pass_++;
+  FlushIfChunkFull();
+}
+
+void KlfmMoveTrace::Writer::EndRun(double cost) {
+  AppendContextIfChunkStart();
+  Append<uint8_t>(kRecordRunEnd);
+  Append<double>(cost);
+  Flush();
+}
+
+void KlfmMoveTrace::Writer::Flush() {
+  if (buffer_.empty()) {
+    return;
+  }
+  lock_guard<mutex> lock(file_mutex_);
+  ofstream outfile(filename_, ios_base::app | ios_base::binary);
+  assert_b(outfile.is_open()) {
+    printf("Failed to open move trace file '%s'.\n", filename_.c_str());
+  }
+  outfile.write(buffer_.data(), buffer_.size());
+  buffer_.clear();
+}
+
+void KlfmMoveTrace::Writer::WriteHeader(
+    const string& filename, size_t num_resources) {
+  lock_guard<mutex> lock(file_mutex_);
+  ofstream outfile(filename, ios_base::trunc | ios_base::binary);
+  assert_b(outfile.is_open()) {
+    printf("Failed to open move trace file '%s'.\n", filename.c_str());
+  }
+  outfile.write(kMagic, kMagicSize);
+  uint32_t num_resources_out = num_resources;
+  outfile.write(reinterpret_cast<const char*>(&num_resources_out),
+                sizeof(num_resources_out));
+}
+
+void KlfmMoveTrace::Writer::AppendBalance(const vector<int>& balance) {
+  for (int resource_balance : balance) {
+    Append<int32_t>(resource_balance);
+  }
+}
+
+void KlfmMoveTrace::Writer::AppendContextIfChunkStart() {
+  if (buffer_.empty()) {
+    Append<uint8_t>(kRecordContext);
+    Append<int32_t>(cur_run_);
+    Append<int32_t>(cur_level_);
+    Append<int32_t>(cur_pass_);
+    Append<uint32_t>(cur_move_);
+  }
+}
+
+KlfmMoveTrace::Reader::Reader(istream& is)
+  : is_(is), num_resources_(0), cur_run_(-1), cur_level_(-1),
+    cur_pass_(-1), cur_move_(0) {
+  char magic[kMagicSize];
+  is_.read(magic, kMagicSize);
+  assert_b(is_.good() && memcmp(magic, kMagic, kMagicSize) == 0) {
+    printf("Input is not a KLFM move trace.\n");
+  }
+  num_resources_ = Read<uint32_t>();
+}
+
+bool KlfmMoveTrace::Reader::ReadRecord(Record* record) {
+  uint8_t type;
+  if (!is_.read(reinterpret_cast<char*>(&type), sizeof(type))) {
+    return false;
+  }
+  // Context records only restore the position in the trace.
+  while (type == kRecordContext) {
+    cur_run_ = Read<int32_t>();
+    cur_level_ = Read<int32_t>();
+    cur_pass_ = Read<int32_t>();
+    cur_move_ = Read<uint32_t>();
+    if (!is_.read(reinterpret_cast<char*>(&type), sizeof(type))) {
+      return false;
+    }
+  }
+  record->type = (RecordType)type;
+  switch (record->type) {
+    case kRecordRunStart:
+      cur_run_ = Read<int32_t>();
+      cur_level_ = -1;
+      cur_pass_ = -1;
+      break;
+    case kRecordPassStart:
+      cur_level_ = Read<int32_t>();
+      cur_pass_ = Read<int32_t>();
+      cur_move_ = 0;
+      break;
+    case kRecordMove:
+      record->move = ++cur_move_;
+      record->node_id = Read<int32_t>();
+      record->gain = Read<double>();
+      record->cost = Read<double>();
+      ReadBalance(&record->balance);
+      break;
+    case kRecordPassEnd:
+      record->num_moves = Read<uint32_t>();
+      record->num_moves_kept = Read<uint32_t>();
+      record->partition_changed = Read<uint8_t>();
+      record->cost = Read<double>();
+      ReadBalance(&record->balance);
+      break;
+    case kRecordRunEnd:
+      record->cost = Read<double>();
+      break;
+    default:
+      assert_b(false) {
+        printf("Invalid record type %d in move trace.\n", type);
+      }
+  }
+  record->run = cur_run_;
+  record->level = cur_level_;
+  record->pass = cur_pass_;
+  return true;
+}
+
+void KlfmMoveTrace::Reader::ReadBalance(vector<int>* balance) {
+  balance->resize(num_resources_);
+  for (size_t i = 0; i < num_resources_; i++) {
+    balance->at(i) = Read<int32_t>();
+  }
+}
+
+void KlfmMoveTrace::Reader::CheckStream() const {
+  assert_b(is_.good()) {
+    printf("Move trace ends in the middle of a record.\n");
+  }
+}
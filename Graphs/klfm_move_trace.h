@@ -0,0 +1,165 @@
+#ifndef KLFM_MOVE_TRACE_H_
+#define KLFM_MOVE_TRACE_H_
+
+/* Compact binary trace of the moves made by the KLFM partition engine.
+
+   A trace file starts with the 8 byte magic "KLFMTRC2" and the number of
+   resources in each balance vector as a uint32. A sequence of records
+   follows, each beginning with a one byte RecordType:
+
+   kRecordRunStart:  int32 run
+   kRecordPassStart: int32 level, int32 pass
+   kRecordMove:      int32 node ID, float64 gain, float64 cost,
+                     int32 balance[num_resources]
+   kRecordPassEnd:   uint32 moves made, uint32 moves kept,
+                     uint8 partition changed, float64 cost,
+                     int32 balance[num_resources]
+   kRecordRunEnd:    float64 cost
+   kRecordContext:   int32 run, int32 level, int32 pass,
+                     uint32 moves made so far in the pass
+
+   Move records hold the cost and balance just after the move. Pass end
+   records hold them after rolling back to the best result of the pass, of
+   which the first 'moves kept' moves were part. Levels count coarsening
+   levels, with 0 being the base graph. Values are stored in host byte order.
+
+   Each engine streams its records to the file in chunks. Runs executing on
+   different threads share the file, so chunks of different runs may be
+   interleaved. Every chunk that does not begin a run starts with a context
+   record naming the run and pass its records continue. */
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class KlfmMoveTrace {
+ public:
+  typedef enum {
+    kNullRecord, // Guard value.
+    kRecordRunStart,
+    kRecordPassStart,
+    kRecordMove,
+    kRecordPassEnd,
+    kRecordRunEnd,
+    kRecordContext,
+  } RecordType;
+
+  static const char kMagic[];
+  static const size_t kMagicSize = 8;
+
+  // Buffers records in memory and appends them to the trace file in chunks
+  // of about kChunkSize bytes, so memory use does not grow with the length of
+  // a run. Writers on different threads may share a trace file.
+  class Writer {
+   public:
+    Writer()
+      : cur_run_(0), cur_level_(0), cur_pass_(0), cur_move_(0) {}
+    ~Writer() { Flush(); }
+
+    // Records are appended to 'filename', which must already hold the
+    // header written by WriteHeader(). An empty name disables the trace.
+    bool enabled() const { return !filename_.empty(); }
+    void set_filename(const std::string& filename) { filename_ = filename; }
+
+    // The coarsening level that subsequent passes refine.
+    void set_level(int level) { cur_level_ = level; }
+
+    void StartRun(int run);
+    void StartPass();
+    void RecordMove(int node_id, double gain, double cost,
+                    const std::vector<int>& balance);
+    void EndPass(size_t num_moves, size_t num_moves_kept,
+                 bool partition_changed, double cost,
+                 const std::vector<int>& balance);
+    void EndRun(double cost);
+
+    // Appends the buffered records to the trace file.
+    void Flush();
+
+    // Truncates 'filename' and writes the file header. Called once before
+    // any engine starts, so that a trace never mixes invocations.
+    static void WriteHeader(const std::string& filename,
+                            size_t num_resources);
+
+   private:
+    static const size_t kChunkSize = 1 << 16;
+
+    template <typename T>
+    void Append(T value) {
+      buffer_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    void AppendBalance(const std::vector<int>& balance);
+    // Starts a chunk with a context record if nothing is buffered.
+    void AppendContextIfChunkStart();
+    // Flushes the buffer once it holds a full chunk.
+    void FlushIfChunkFull() {
+      if (buffer_.size() >= kChunkSize) {
+        Flush();
+      }
+    }
+
+    // Serializes the writers appending to a trace file.
+    static std::mutex file_mutex_;
+
+    std::string filename_;
+    int cur_run_;
+    int cur_level_;
+    int cur_pass_;
+    uint32_t cur_move_;
+    std::string buffer_;
+  };
+
+  // A decoded record. Run, level and pass are filled in for every record
+  // type from the enclosing run and pass. Fields that the record type does
+  // not carry are left unchanged.
+  struct Record {
+    RecordType type{kNullRecord};
+    int run{-1};
+    int level{-1};
+    int pass{-1};
+    // The number of the move within its pass, from 1. Only set for moves.
+    uint32_t move{0};
+    int node_id{-1};
+    double gain{0.0};
+    double cost{0.0};
+    uint32_t num_moves{0};
+    uint32_t num_moves_kept{0};
+    bool partition_changed{false};
+    std::vector<int> balance;
+  };
+
+  class Reader {
+   public:
+    // Reads the file header from 'is'. Dies if it is not a trace file.
+    explicit Reader(std::istream& is);
+
+    size_t num_resources() const { return num_resources_; }
+
+    // Reads the next record into 'record'. Returns false once the end of the
+    // trace is reached.
+    bool ReadRecord(Record* record);
+
+   private:
+    template <typename T>
+    T Read() {
+      T value;
+      is_.read(reinterpret_cast<char*>(&value), sizeof(T));
+      CheckStream();
+      return value;
+    }
+    void ReadBalance(std::vector<int>* balance);
+    void CheckStream() const;
+
+    std::istream& is_;
+    size_t num_resources_;
+    int cur_run_;
+    int cur_level_;
+    int cur_pass_;
+    uint32_t cur_move_;
+  };
+};
+
+#endif /* KLFM_MOVE_TRACE_H_ */
@@ -0,0 +1,99 @@
+#include "klfm_profiler.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include "universal_macros.h"
+
+using namespace std;
+
+void KlfmProfiler::StartRun(int run) {
+  cur_run_ = run;
+  cur_level_ = 0;
+  cur_pass_ = 0;
+  run_num_moves_ = 0;
+  ClearTotals(current_);
+  ClearTotals(run_);
+  run_start_nsec_ = NowNsec();
+}
+
+void KlfmProfiler::StartPass() {
+  AddToRunTotals();
+  pass_start_nsec_ = NowNsec();
+}
+
+void KlfmProfiler::EndPass(size_t num_moves, double cost) {
+  AppendRecord("pass", cur_level_, cur_pass_, num_moves, cost,
+               NowNsec() - pass_start_nsec_, current_);
+  AddToRunTotals();
+  run_num_moves_ += num_moves;
+  cur_pass_++;
+}
+
+void KlfmProfiler::EndRun(double cost) {
+  AddToRunTotals();
+  AppendRecord("run", 0, cur_pass_, run_num_moves_, cost,
+               NowNsec() - run_start_nsec_, run_);
+}
+
+void KlfmProfiler::WriteRecords(const string& filename) {
+  ofstream outfile(filename, ios_base::app);
+  assert_b(outfile.is_open()) {
+    printf("Failed to open profile file '%s'.\n", filename.c_str());
+  }
+  outfile << records_.str();
+  records_.str("");
+}
+
+void KlfmProfiler::WriteHeader(const string& filename) {
+  ofstream outfile(filename, ios_base::trunc);
+  assert_b(outfile.is_open()) {
+    printf("Failed to open profile file '%s'.\n", filename.c_str());
+  }
+  outfile << "Record,Run,Level,Pass,Moves,Cost,WallNsec";
+  for (int i = 0; i < kNumSections; i++) {
+    const char* name = SectionName((Section)i);
+    outfile << "," << name << "Nsec," << name << "Calls";
+  }
+  outfile << "\n";
+}
+
+const char* KlfmProfiler::SectionName(Section section) {
+  switch (section) {
+    case kSectionGainBucketSelect: return "GainBucketSelect";
+    case kSectionGainUpdate: return "GainUpdate";
+    case kSectionRebalance: return "Rebalance";
+    case kSectionCoarsen: return "Coarsen";
+    case kSectionUncoarsen: return "Uncoarsen";
+    case kSectionPassSetup: return "PassSetup";
+    case kSectionRollback: return "Rollback";
+    default: assert(false);
+  }
+  return "";
+}
+
+void KlfmProfiler::ClearTotals(SectionTotals* totals) {
+  for (int i = 0; i < kNumSections; i++) {
+    totals[i].nsec = 0;
+    totals[i].calls = 0;
+  }
+}
+
+void KlfmProfiler::AddToRunTotals() {
+  for (int i = 0; i < kNumSections; i++) {
+    run_[i].nsec += current_[i].nsec;
+    run_[i].calls += current_[i].calls;
+  }
+  ClearTotals(current_);
+}
+
+void KlfmProfiler::AppendRecord(
+    const char* record_type, int level, int pass, size_t num_moves,
+    double cost, uint64_t wall_nsec, const SectionTotals* totals) {
+  records_ << record_type << "," << cur_run_ << "," << level << ","
+           << pass << "," << num_moves << "," << cost << "," << wall_nsec;
+  for (int i = 0; i < kNumSections; i++) {
+    records_ << "," << totals[i].nsec << "," << totals[i].calls;
+  }
+  records_ << "\n";
+}
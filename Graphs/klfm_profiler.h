@@ -0,0 +1,119 @@
+#ifndef KLFM_PROFILER_H_
+#define KLFM_PROFILER_H_
+
+/* Accumulates the run time spent in the hot sections of the KLFM partition
+   engine and formats it as CSV records, one per pass and one per run.
+
+   Timing uses a monotonic clock and is switched on at run time. While the
+   profiler is disabled, each instrumented section costs a single branch. */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+class KlfmProfiler {
+ public:
+  typedef enum {
+    kSectionGainBucketSelect,
+    kSectionGainUpdate,
+    kSectionRebalance,
+    kSectionCoarsen,
+    kSectionUncoarsen,
+    kSectionPassSetup,
+    kSectionRollback,
+    kNumSections, // Guard value.
+  } Section;
+
+  // Adds the time between construction and destruction to 'section' of
+  // 'profiler', if it is enabled.
+  class ScopedTimer {
+   public:
+    ScopedTimer(KlfmProfiler* profiler, Section section)
+      : profiler_(profiler->enabled() ? profiler : NULL),
+        section_(section),
+        start_nsec_(profiler_ ? NowNsec() : 0) {}
+    ~ScopedTimer() {
+      if (profiler_) {
+        profiler_->AddTime(section_, NowNsec() - start_nsec_);
+      }
+    }
+
+   private:
+    KlfmProfiler* profiler_;
+    Section section_;
+    uint64_t start_nsec_;
+  };
+
+  KlfmProfiler()
+    : enabled_(false), cur_run_(0), cur_level_(0), cur_pass_(0),
+      run_num_moves_(0), run_start_nsec_(0), pass_start_nsec_(0) {
+    ClearTotals(current_);
+    ClearTotals(run_);
+  }
+
+  bool enabled() const { return enabled_; }
+  void set_enabled(bool enabled) { enabled_ = enabled; }
+
+  static uint64_t NowNsec() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void AddTime(Section section, uint64_t nsec) {
+    current_[section].nsec += nsec;
+    current_[section].calls++;
+  }
+
+  // The coarsening level that subsequent passes refine, with 0 being the
+  // base graph.
+  void set_level(int level) { cur_level_ = level; }
+
+  // Marks the boundaries of runs and passes. Time recorded outside a pass,
+  // such as coarsening, is only reported in the record of the run.
+  void StartRun(int run);
+  void StartPass();
+  void EndPass(size_t num_moves, double cost);
+  void EndRun(double cost);
+
+  // Appends the records completed since the last call to 'filename', which
+  // must already hold the header written by WriteHeader().
+  void WriteRecords(const std::string& filename);
+
+  // Truncates 'filename' and writes the CSV header. Called once before any
+  // engine starts, so that the records of earlier invocations are not mixed
+  // with those of this one.
+  static void WriteHeader(const std::string& filename);
+
+  static const char* SectionName(Section section);
+
+ private:
+  struct SectionTotals {
+    uint64_t nsec;
+    uint64_t calls;
+  };
+
+  static void ClearTotals(SectionTotals* totals);
+  void AddToRunTotals();
+  void AppendRecord(const char* record_type, int level, int pass,
+                    size_t num_moves, double cost, uint64_t wall_nsec,
+                    const SectionTotals* totals);
+
+  bool enabled_;
+  int cur_run_;
+  int cur_level_;
+  int cur_pass_;
+  size_t run_num_moves_;
+  uint64_t run_start_nsec_;
+  uint64_t pass_start_nsec_;
+
+  // Time recorded since the last pass or run boundary, and the totals for
+  // the current run.
+  SectionTotals current_[kNumSections];
+  SectionTotals run_[kNumSections];
+
+  std::stringstream records_;
+};
+
+#endif /* KLFM_PROFILER_H_ */
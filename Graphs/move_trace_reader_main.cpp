@@ -0,0 +1,88 @@
+/*
+ * move_trace_reader_main.cpp
+ *
+ * Converts a binary KLFM move trace written by partition_main
+ * (--move-trace-file) to CSV with one row per move and per pass.
+ */
+
+#include <cassert>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "klfm_move_trace.h"
+#include "tclap/CmdLine.h"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+
+  TCLAP::CmdLine cmd("Converts a KLFM move trace to CSV", ' ', "0.0");
+
+  TCLAP::ValueArg<string> trace_input_file_flag(
+      "i", "input", "Move trace input file name", true, "", "string", cmd);
+
+  TCLAP::ValueArg<string> result_output_file_flag(
+      "o", "output", "CSV output file name", false, "", "string", cmd);
+
+  TCLAP::SwitchArg passes_only_switch(
+      "p", "passes-only", "Omit the rows of individual moves", cmd);
+
+  cmd.parse(argc, argv);
+
+  ifstream trace_in_file(trace_input_file_flag.getValue(),
+                         ios_base::in | ios_base::binary);
+  assert(trace_in_file.is_open());
+
+  std::ofstream outfile;
+  if (result_output_file_flag.isSet()) {
+    outfile.open(result_output_file_flag.getValue());
+    assert(outfile.is_open());
+  }
+
+  std::ostream& os = (outfile.is_open()) ? outfile : std::cout;
+
+  KlfmMoveTrace::Reader reader(trace_in_file);
+  os << "Record,Run,Level,Pass,Move,NodeId,Gain,MovesKept,PartitionChanged,"
+     << "Cost";
+  for (size_t i = 0; i < reader.num_resources(); i++) {
+    os << ",Balance" << i;
+  }
+  os << "\n";
+
+  // Moves are numbered from 1 within each pass.
+  KlfmMoveTrace::Record record;
+  while (reader.ReadRecord(&record)) {
+    switch (record.type) {
+      case KlfmMoveTrace::kRecordMove:
+        if (passes_only_switch.isSet()) {
+          break;
+        }
+        os << "move," << record.run << "," << record.level << ","
+           << record.pass << "," << record.move << "," << record.node_id << ","
+           << record.gain << ",,," << record.cost;
+        for (int resource_balance : record.balance) {
+          os << "," << resource_balance;
+        }
+        os << "\n";
+        break;
+      case KlfmMoveTrace::kRecordPassEnd:
+        os << "pass," << record.run << "," << record.level << ","
+           << record.pass << "," << record.num_moves << ",,,"
+           << record.num_moves_kept << "," << record.partition_changed << ","
+           << record.cost;
+        for (int resource_balance : record.balance) {
+          os << "," << resource_balance;
+        }
+        os << "\n";
+        break;
+      case KlfmMoveTrace::kRecordRunEnd:
+        os << "run," << record.run << ",,,,,,,," << record.cost << "\n";
+        break;
+      default:
+        break;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,199 @@
+#include "netlist_delta.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "id_manager.h"
+#include "universal_macros.h"
+
+using namespace std;
+
+bool NetlistDelta::Parse(const char* filename) {
+  ifstream input_file(filename);
+  if (!input_file.is_open()) {
+    printf("Failed to open %s\n", filename);
+    return false;
+  }
+  changes_.clear();
+  string cur_line;
+  int line_num = 0;
+  while (getline(input_file, cur_line)) {
+    line_num++;
+    istringstream line_stream(cur_line);
+    string keyword;
+    if (!(line_stream >> keyword) || keyword[0] == '#') {
+      continue;
+    }
+    Change change;
+    change.net_weight = 1.0;
+    if (keyword == "add_node") {
+      change.type = kAddNode;
+    } else if (keyword == "remove_node") {
+      change.type = kRemoveNode;
+    } else if (keyword == "set_weights") {
+      change.type = kSetWeights;
+    } else if (keyword == "add_net") {
+      change.type = kAddNet;
+    } else if (keyword == "remove_net") {
+      change.type = kRemoveNet;
+    } else {
+      printf("Error: Unknown change '%s' on line %d of %s.\n",
+             keyword.c_str(), line_num, filename);
+      return false;
+    }
+    bool valid = static_cast<bool>(line_stream >> change.id);
+    if (valid && change.type == kAddNet) {
+      valid = static_cast<bool>(line_stream >> change.net_weight);
+    }
+    int value;
+    while (valid && line_stream >> value) {
+      if (change.type == kAddNet) {
+        change.node_ids.push_back(value);
+      } else {
+        change.weights.push_back(value);
+      }
+    }
+    valid = valid && line_stream.eof();
+    switch (change.type) {
+      case kAddNode:
+      case kSetWeights:
+        valid = valid && !change.weights.empty();
+        break;
+      case kAddNet:
+        valid = valid && change.node_ids.size() >= 2;
+        break;
+      default:
+        valid = valid && change.weights.empty();
+    }
+    if (!valid) {
+      printf("Error: Malformed '%s' on line %d of %s.\n", keyword.c_str(),
+             line_num, filename);
+      return false;
+    }
+    changes_.push_back(change);
+  }
+  return true;
+}
+
+void NetlistDelta::Apply(Node* graph, set<int>* affected_node_ids) const {
+  Node::NodeMap& nodes = graph->internal_nodes();
+  Node::EdgeMap& edges = graph->internal_edges();
+  size_t num_resources = 1;
+  if (!nodes.empty()) {
+    num_resources = nodes.begin()->second->SelectedWeightVector().size();
+  }
+
+  for (const Change& change : changes_) {
+    switch (change.type) {
+      case kAddNode: {
+        assert_b(nodes.find(change.id) == nodes.end()) {
+          printf("Delta adds node %d, which already exists.\n", change.id);
+        }
+        Node* node = new Node(change.id);
+        for (auto& weight_vector : WeightVectors(change, num_resources)) {
+          node->AddWeightVector(weight_vector);
+        }
+        graph->AddInternalNode(change.id, node);
+        IdManager::Reserve(change.id);
+        affected_node_ids->insert(change.id);
+        break;
+      }
+      case kRemoveNode: {
+        auto node_it = nodes.find(change.id);
+        assert_b(node_it != nodes.end()) {
+          printf("Delta removes node %d, which does not exist.\n", change.id);
+        }
+        Node* node = node_it->second;
+        for (auto& port_pair : node->ports()) {
+          auto edge_it = edges.find(port_pair.second.external_edge_id);
+          if (edge_it == edges.end()) {
+            continue;
+          }
+          Edge* edge = edge_it->second;
+          edge->RemoveConnection(change.id);
+          if (edge->degree() < 2) {
+            RemoveNet(graph, edge->id_, affected_node_ids);
+          } else {
+            affected_node_ids->insert(edge->connection_ids().begin(),
+                                      edge->connection_ids().end());
+          }
+        }
+        nodes.erase(node_it);
+        delete node;
+        affected_node_ids->erase(change.id);
+        break;
+      }
+      case kSetWeights: {
+        auto node_it = nodes.find(change.id);
+        assert_b(node_it != nodes.end()) {
+          printf("Delta sets the weights of node %d, which does not exist.\n",
+                 change.id);
+        }
+        Node* node = node_it->second;
+        node->ClearWeightVectors();
+        for (auto& weight_vector : WeightVectors(change, num_resources)) {
+          node->AddWeightVector(weight_vector);
+        }
+        affected_node_ids->insert(change.id);
+        break;
+      }
+      case kAddNet: {
+        assert_b(edges.find(change.id) == edges.end()) {
+          printf("Delta adds net %d, which already exists.\n", change.id);
+        }
+        Edge* edge = new Edge(change.id);
+        edge->SetWeight(change.net_weight);
+        for (auto node_id : change.node_ids) {
+          auto node_it = nodes.find(node_id);
+          assert_b(node_it != nodes.end()) {
+            printf("Delta connects net %d to node %d, which does not exist.\n",
+                   change.id, node_id);
+          }
+          edge->AddConnection(node_id);
+          node_it->second->AddConnection(change.id);
+          affected_node_ids->insert(node_id);
+        }
+        graph->AddInternalEdge(change.id, edge);
+        IdManager::Reserve(change.id);
+        break;
+      }
+      case kRemoveNet:
+        assert_b(edges.find(change.id) != edges.end()) {
+          printf("Delta removes net %d, which does not exist.\n", change.id);
+        }
+        RemoveNet(graph, change.id, affected_node_ids);
+        break;
+    }
+  }
+}
+
+vector<vector<int>> NetlistDelta::WeightVectors(
+    const Change& change, size_t num_resources) const {
+  assert_b(change.weights.size() % num_resources == 0) {
+    printf("Delta gives node %d %lu weights, which is not a multiple of the "
+           "%lu resources in the graph.\n", change.id, change.weights.size(),
+           num_resources);
+  }
+  vector<vector<int>> weight_vectors;
+  for (auto it = change.weights.begin(); it != change.weights.end();
+       it += num_resources) {
+    weight_vectors.push_back(vector<int>(it, it + num_resources));
+  }
+  return weight_vectors;
+}
+
+void NetlistDelta::RemoveNet(Node* graph, int net_id,
+                             set<int>* affected_node_ids) const {
+  auto edge_it = graph->internal_edges().find(net_id);
+  Edge* edge = edge_it->second;
+  for (auto node_id : edge->connection_ids()) {
+    auto node_it = graph->internal_nodes().find(node_id);
+    if (node_it != graph->internal_nodes().end()) {
+      node_it->second->RemoveConnection(net_id);
+      affected_node_ids->insert(node_id);
+    }
+  }
+  graph->internal_edges().erase(edge_it);
+  delete edge;
+}
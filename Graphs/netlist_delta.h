@@ -0,0 +1,67 @@
+#ifndef NETLIST_DELTA_H_
+#define NETLIST_DELTA_H_
+
+/* A set of changes to a graph, used to repartition a modified design
+   incrementally. The delta file lists one change per line. Blank lines and
+   lines starting with '#' are ignored.
+
+   add_node    <node ID> <weight vector>*
+   remove_node <node ID>
+   set_weights <node ID> <weight vector>*
+   add_net     <net ID> <weight> <node ID> <node ID>+
+   remove_net  <net ID>
+
+   Each weight vector holds one weight per resource, and a node may be given
+   several to describe its implementations. The IDs of added nodes and nets
+   must not be in use. Changes are applied in the order they are listed. */
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "node.h"
+
+class NetlistDelta {
+ public:
+  typedef enum {
+    kAddNode,
+    kRemoveNode,
+    kSetWeights,
+    kAddNet,
+    kRemoveNet
+  } ChangeType;
+
+  struct Change {
+    ChangeType type;
+    int id;
+    double net_weight;
+    std::vector<int> node_ids;
+    std::vector<int> weights;
+  };
+
+  // Reads the changes in 'filename'. Returns false if the file could not be
+  // read or is malformed.
+  bool Parse(const char* filename);
+
+  // Applies the changes to the internal nodes and edges of 'graph'. Nets
+  // left with fewer than two nodes by the removal of a node are removed as
+  // well. The IDs of the remaining nodes whose weights or connections
+  // changed are inserted into 'affected_node_ids'. Dies if a change refers
+  // to a node or net that does not exist, or adds one that does.
+  void Apply(Node* graph, std::set<int>* affected_node_ids) const;
+
+  const std::vector<Change>& changes() const { return changes_; }
+
+ private:
+  // Converts the flat 'weights' of a change to weight vectors of the size
+  // used by 'graph'.
+  std::vector<std::vector<int>> WeightVectors(
+      const Change& change, size_t num_resources) const;
+
+  void RemoveNet(Node* graph, int net_id,
+                 std::set<int>* affected_node_ids) const;
+
+  std::vector<Change> changes_;
+};
+
+#endif /* NETLIST_DELTA_H_ */
@@ -1,8 +1,8 @@
 #include "node.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <limits>
-#include <random>
 #include <sstream>
 #include <utility>
 
@@ -51,6 +51,13 @@ void Node::AddWeightVector(const vector<int>& wv) {
   weight_vectors_.push_back(wv);
 }
 
+void Node::ClearWeightVectors() {
+  assert(!is_supernode());
+  weight_vectors_.clear();
+  selected_weight_vector_index_ = 0;
+  prev_selected_weight_vector_index_ = 0;
+}
+
 
 void Node::CopyFrom(Node* src) {
   id = src->id;
@@ -267,16 +274,14 @@ void Node::TransferEdgeConnectionsExcluding(
 }
 
 void Node::PopulateSupernodeWeightVectors(
-    const vector<int>& /* ratio */, bool restrict_to_default_implementation,
+    bool restrict_to_default_implementation,
     size_t max_implementations_per_supernode) {
   assert(!internal_nodes_.empty());
   weight_vectors_.clear();
   internal_node_weight_vector_indices_.clear();
-  size_t max_possible_vectors = 1;
-  size_t num_resources_per_vector =
-      internal_nodes_.begin()->second->SelectedWeightVector().size();
+  bool has_alternatives = false;
   for (auto node_pair : internal_nodes_) {
-    max_possible_vectors *= node_pair.second->WeightVectors().size();
+    has_alternatives |= (node_pair.second->WeightVectors().size() > 1);
   }
   // Always set the weight vector constructed from the default weight vectors.
   vector<pair<int,int>> indices;
@@ -284,165 +289,175 @@ void Node::PopulateSupernodeWeightVectors(
       TotalInternalSelectedWeight(&indices);
   AddSupernodeWeightVector(default_weight_vector, indices);
   SetSelectedWeightVector(0);
-  if (max_possible_vectors == 1 || restrict_to_default_implementation) {
+  if (!has_alternatives || restrict_to_default_implementation ||
+      max_implementations_per_supernode <= 1) {
     return;
-  } else if (max_possible_vectors <= max_implementations_per_supernode) {
-    // Easy case, include all possible implementations.
-    vector<vector<int>> permutations;
-    permutations.resize(1);
-    permutations[0].assign(num_resources_per_vector, 0);
-    vector<vector<pair<int,int>>> permutation_indices;
-    permutation_indices.resize(1);
-    for (auto node_pair : internal_nodes_) {
-      vector<vector<int>> next_step; 
-      vector<vector<pair<int,int>>> next_step_indices;
-      for (size_t p_idx = 0; p_idx < permutations.size(); p_idx++) {
-        for (size_t wv_index = 0;
-             wv_index < node_pair.second->WeightVectors().size(); wv_index++) {
-          vector<int> intermediate_wv = permutations[p_idx];
-          const vector<int>& wv_modifier =
-              node_pair.second->WeightVector(wv_index);
-          for (size_t i = 0; i < wv_modifier.size(); i++) {
-            intermediate_wv[i] += wv_modifier[i];
-          }
-          vector<pair<int,int>> intermediate_indices =
-              permutation_indices[p_idx];
-          intermediate_indices.push_back(make_pair(node_pair.first, wv_index));
-          next_step.push_back(intermediate_wv);
-          next_step_indices.push_back(intermediate_indices);
+  }
+
+  // Merge the internal nodes one at a time. After each merge, 'frontier'
+  // holds the non-dominated sums of the weight vectors of the nodes merged so
+  // far. A sum that is dominated by another stays dominated whatever the
+  // remaining nodes add, so pruning early loses no Pareto-optimal
+  // implementation. Instead of copying the choices made for every entry,
+  // each merge records for each entry the entry it extends and the weight
+  // vector index that was added, from which the choices are recovered at the
+  // end. Vectors are stored back to back in flat arrays.
+  const size_t num_res = default_weight_vector.size();
+  vector<int> frontier(num_res, 0);
+  vector<int> candidates;
+  vector<pair<int,int>> candidate_back_pointers;
+  vector<vector<pair<int,int>>> back_pointers;
+  vector<int> merged_node_ids;
+  vector<size_t> kept;
+  for (auto node_pair : internal_nodes_) {
+    const vector<vector<int>>& node_wvs = node_pair.second->WeightVectors();
+    size_t frontier_size = frontier.size() / num_res;
+    candidates.clear();
+    candidate_back_pointers.clear();
+    for (size_t f_idx = 0; f_idx < frontier_size; f_idx++) {
+      for (size_t wv_index = 0; wv_index < node_wvs.size(); wv_index++) {
+        for (size_t res = 0; res < num_res; res++) {
+          candidates.push_back(
+              frontier[f_idx * num_res + res] + node_wvs[wv_index][res]);
         }
+        candidate_back_pointers.push_back(make_pair(f_idx, wv_index));
       }
-      permutations = next_step;
-      permutation_indices = next_step_indices;
-    }
-    assert(permutations.size() == permutation_indices.size());
-    assert(permutations.size() == max_possible_vectors);
-    for (size_t p_idx = 0; p_idx < permutations.size(); p_idx++) {
-      vector<int>& permutation = permutations[p_idx];
-      vector<pair<int,int>>& indices = permutation_indices[p_idx];
-      AddSupernodeWeightVector(permutation, indices);
     }
-    return;
-  } else {
-    // Tough (common) case: Have to choose between implementations.
-    vector<vector<int>> implementations;
-    vector<vector<pair<int,int>>> implementations_indices;
-
-    // Try adding one implementation maximally-weighted toward each reseource.
-    for (size_t res = 0; res < num_resources_per_vector; res++) {
-      vector<int> implementation;
-      vector<pair<int,int>> implementation_indices;
-      implementation.assign(num_resources_per_vector, 0);
-      for (auto node_pair : internal_nodes_) {
-        size_t max_index = 0;
-        int max_weight = 0;
-        for(size_t wv_index = 0;
-            wv_index < node_pair.second->WeightVectors().size(); wv_index++) {
-            auto& wv = node_pair.second->WeightVector(wv_index);
-          if (wv[res] > max_weight) {
-            max_weight = wv[res];
-            max_index = wv_index;
-          }
-        }
-        for (size_t i = 0; i < implementation.size(); i++) {
-          implementation[i] += node_pair.second->WeightVector(max_index)[i];
-        }
-        implementation_indices.push_back(make_pair(node_pair.first, max_index));
-      }
-      implementations.push_back(implementation);
-      implementations_indices.push_back(implementation_indices);
-    }
-    // Add two ratio-matched implementations.
-    // Forward
-    vector<int> implementation;
-    vector<pair<int,int>> implementation_indices;
-    implementation.assign(num_resources_per_vector, 0);
-    for (auto node_it = internal_nodes_.begin();
-         node_it != internal_nodes_.end(); node_it++) {
-      int best_index = -1;
-      double max_diff = std::numeric_limits<double>::max();
-      for (size_t wv_index = 0; wv_index < node_it->second->WeightVectors().size();
-           wv_index++) {
-        auto& wv = node_it->second->WeightVector(wv_index);
-        vector<int> temp = implementation;
-        for (size_t i = 0; i < temp.size(); i++) {
-          temp[i] += wv[i];
-        }
-        double total_diff = 0.0;
-        for (size_t res = 0; res < num_resources_per_vector; res++) {
-          total_diff += abs(temp[res]);
-        }
-        if (total_diff < max_diff) {
-          best_index = wv_index;
-          max_diff = total_diff;
-        }
+    if (node_wvs.size() == 1) {
+      // Adding the same vector to every entry keeps the frontier intact.
+      back_pointers.push_back(candidate_back_pointers);
+      frontier.swap(candidates);
+    } else {
+      ParetoFrontier(candidates, num_res, &kept);
+      ThinFrontier(candidates, num_res, max_implementations_per_supernode,
+                   &kept);
+      vector<pair<int,int>> next_back_pointers;
+      frontier.clear();
+      for (auto c_idx : kept) {
+        frontier.insert(frontier.end(), candidates.begin() + c_idx * num_res,
+                        candidates.begin() + (c_idx + 1) * num_res);
+        next_back_pointers.push_back(candidate_back_pointers[c_idx]);
       }
-      assert(best_index >= 0);
-      for (size_t i = 0; i < implementation.size(); i++) {
-        implementation[i] += node_it->second->WeightVector(best_index)[i];
-      }
-      implementation_indices.push_back(make_pair(node_it->first, best_index));
-    }
-    implementations.push_back(implementation);
-    implementations_indices.push_back(implementation_indices);
-    // Backward
-    implementation.clear();
-    implementation.assign(num_resources_per_vector, 0);
-    implementation_indices.clear();
-    for (auto node_it = internal_nodes_.rbegin();
-         node_it != internal_nodes_.rend(); node_it++) {
-      int best_index = -1;
-      double max_diff = std::numeric_limits<double>::max();
-      for (size_t wv_index = 0; wv_index < node_it->second->WeightVectors().size();
-          wv_index++) {
-        auto& wv = node_it->second->WeightVector(wv_index);
-        vector<int> temp = implementation;
-        assert(temp.size() == num_resources_per_vector);
-        for (size_t i = 0; i < temp.size(); i++) {
-          temp[i] += wv[i];
-        }
-        double total_diff = 0.0;
-        for (size_t res = 0; res < num_resources_per_vector; res++) {
-          total_diff += abs(temp[res]);
-        }
-        if (total_diff < max_diff) {
-          best_index = wv_index;
-          max_diff = total_diff;
-        }
+      back_pointers.push_back(next_back_pointers);
+    }
+    merged_node_ids.push_back(node_pair.first);
+  }
+
+  size_t frontier_size = frontier.size() / num_res;
+  for (size_t f_idx = 0; f_idx < frontier_size &&
+       weight_vectors_.size() < max_implementations_per_supernode; f_idx++) {
+    vector<int> implementation(frontier.begin() + f_idx * num_res,
+                               frontier.begin() + (f_idx + 1) * num_res);
+    if (implementation == default_weight_vector) {
+      continue;
+    }
+    vector<pair<int,int>> implementation_indices(merged_node_ids.size());
+    int entry = f_idx;
+    for (int step = merged_node_ids.size() - 1; step >= 0; step--) {
+      const pair<int,int>& back_pointer = back_pointers[step][entry];
+      implementation_indices[step] =
+          make_pair(merged_node_ids[step], back_pointer.second);
+      entry = back_pointer.first;
+    }
+    AddSupernodeWeightVector(implementation, implementation_indices);
+  }
+}
+
+void Node::ParetoFrontier(const vector<int>& vectors, size_t num_res,
+                          vector<size_t>* frontier) {
+  // A vector can only be dominated by one with a smaller or equal total, so
+  // visiting them in order of their totals means that each one only has to
+  // be compared with those already kept. Equal vectors count as dominated,
+  // which removes duplicates.
+  size_t num_vectors = vectors.size() / num_res;
+  vector<pair<long long, size_t>> total_index_pairs;
+  for (size_t v_idx = 0; v_idx < num_vectors; v_idx++) {
+    long long total = 0;
+    for (size_t res = 0; res < num_res; res++) {
+      total += vectors[v_idx * num_res + res];
+    }
+    total_index_pairs.push_back(make_pair(total, v_idx));
+  }
+  sort(total_index_pairs.begin(), total_index_pairs.end());
+  frontier->clear();
+  for (auto& total_index_pair : total_index_pairs) {
+    const int* candidate = &vectors[total_index_pair.second * num_res];
+    bool is_dominated = false;
+    for (auto k_idx : *frontier) {
+      const int* other = &vectors[k_idx * num_res];
+      size_t res = 0;
+      while (res < num_res && other[res] <= candidate[res]) {
+        res++;
       }
-      assert(best_index >= 0);
-      for (size_t i = 0; i < implementation.size(); i++) {
-        implementation[i] += node_it->second->WeightVector(best_index)[i];
+      if (res == num_res) {
+        is_dominated = true;
+        break;
       }
-      implementation_indices.push_back(make_pair(node_it->first, best_index));
-    }
-    implementations.push_back(implementation);
-    implementations_indices.push_back(implementation_indices);
-    default_random_engine random_engine;
-    random_engine.seed(0);
-    while (implementations.size() < max_implementations_per_supernode) {
-      // TODO This may produce duplicate implementations, which is wasteful.
-      vector<int> implementation(num_resources_per_vector, 0);
-      vector<pair<int,int>> implementation_indices;
-      for (auto node_pair : internal_nodes_) {
-        int selected_node_impl =
-            random_engine() % node_pair.second->WeightVectors().size();
-        for (size_t i = 0; i < num_resources_per_vector; i++) {
-          implementation[i] +=
-              node_pair.second->WeightVector(selected_node_impl).at(i);
-        }
-        implementation_indices.push_back(
-            make_pair(node_pair.second->id, selected_node_impl));;
+    }
+    if (!is_dominated) {
+      frontier->push_back(total_index_pair.second);
+    }
+  }
+}
+
+void Node::ThinFrontier(const vector<int>& vectors, size_t num_res,
+                        size_t max_size, vector<size_t>* frontier) {
+  if (frontier->size() <= max_size) {
+    return;
+  }
+  // Keep the vector that uses the least of each resource, then spread the
+  // remaining picks evenly over the others in lexicographic order, which
+  // follows the trade-off curve between the resources.
+  sort(frontier->begin(), frontier->end(),
+       [&vectors, num_res](size_t a, size_t b) {
+    return lexicographical_compare(
+        vectors.begin() + a * num_res, vectors.begin() + (a + 1) * num_res,
+        vectors.begin() + b * num_res, vectors.begin() + (b + 1) * num_res);
+  });
+  vector<char> is_picked(frontier->size(), false);
+  size_t num_picked = 0;
+  for (size_t res = 0; res < num_res && num_picked < max_size; res++) {
+    size_t min_pos = 0;
+    for (size_t pos = 1; pos < frontier->size(); pos++) {
+      if (vectors[frontier->at(pos) * num_res + res] <
+          vectors[frontier->at(min_pos) * num_res + res]) {
+        min_pos = pos;
       }
-      implementations.push_back(implementation);
-      implementations_indices.push_back(implementation_indices);
     }
-    assert(implementations.size() == implementations_indices.size());
-    for (size_t imp_idx = 0; imp_idx < implementations.size(); imp_idx++) {
-      AddSupernodeWeightVector(
-          implementations[imp_idx], implementations_indices[imp_idx]);
+    if (!is_picked[min_pos]) {
+      is_picked[min_pos] = true;
+      num_picked++;
+    }
+  }
+  vector<size_t> unpicked_positions;
+  for (size_t pos = 0; pos < frontier->size(); pos++) {
+    if (!is_picked[pos]) {
+      unpicked_positions.push_back(pos);
     }
   }
+  size_t num_remaining = max_size - num_picked;
+  for (size_t j = 0; j < num_remaining; j++) {
+    is_picked[unpicked_positions[
+        j * unpicked_positions.size() / num_remaining]] = true;
+  }
+  vector<size_t> thinned;
+  for (size_t pos = 0; pos < frontier->size(); pos++) {
+    if (is_picked[pos]) {
+      thinned.push_back(frontier->at(pos));
+    }
+  }
+  frontier->swap(thinned);
+}
+
+void Node::SetSupernodeWeightVectors(
+    const vector<vector<int>>& weight_vectors,
+    const vector<vector<pair<int,int>>>& internal_indices) {
+  assert(is_supernode());
+  assert(!weight_vectors.empty());
+  assert(weight_vectors.size() == internal_indices.size());
+  weight_vectors_ = weight_vectors;
+  internal_node_weight_vector_indices_ = internal_indices;
+  SetSelectedWeightVector(0);
 }
 
 void Node::AddSupernodeWeightVector(
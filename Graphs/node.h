@@ -42,6 +42,9 @@ class Node {
   int RemoveConnection(int connected_id);
 
   void AddWeightVector(const std::vector<int>& wv);
+  // Removes all weight vectors. The first vector added afterward is
+  // selected.
+  void ClearWeightVectors();
 
   // Copies all data from 'src'. NOTE: This includes the ID. Care must be
   // taken not to have separate objects with duplicate IDs in the same
@@ -150,12 +153,29 @@ class Node {
   }
 
   // Populates the weight vectors for a supernode based on its component nodes.
-  // 'ratio' represents a desired resource ratio to achieve for -some- of
-  // the implementations.
+  // The first weight vector is the sum of the selected weight vectors of the
+  // component nodes. The others are Pareto-optimal sums of their weight
+  // vectors, at most 'max_implementations_per_supernode' vectors in total.
   void PopulateSupernodeWeightVectors(
-      const std::vector<int>& ratio, bool restrict_to_default_implementation,
+      bool restrict_to_default_implementation,
       size_t max_implementations_per_supernode);
 
+  // Sets the weight vectors of a supernode to ones computed earlier by
+  // PopulateSupernodeWeightVectors() for the same component nodes, with the
+  // same implementations selected. 'internal_indices' is indexed like
+  // 'weight_vectors' and pairs each component ID with its weight vector
+  // index. Selects the first weight vector.
+  void SetSupernodeWeightVectors(
+      const std::vector<std::vector<int>>& weight_vectors,
+      const std::vector<std::vector<std::pair<int,int>>>& internal_indices);
+
+  // For each supernode weight vector, the component weight vectors it is
+  // made of, as component ID and weight vector index pairs.
+  const std::vector<std::vector<std::pair<int,int>>>&
+      internal_node_weight_vector_indices() const {
+    return internal_node_weight_vector_indices_;
+  }
+
   // Sets the weight vectors of the internal nodes of a supernode to match
   // the selected supernode weight vector. In many cases it is OK for the
   // state of the internal weight vectors to be inconsistent with the supernode
@@ -200,6 +220,18 @@ class Node {
   void AddSupernodeWeightVector(const std::vector<int>& wv,
       const std::vector<std::pair<int,int>>& internal_indices);
 
+  // Sets 'frontier' to the indices of the vectors in 'vectors' that are not
+  // dominated by another one, i.e. for which no other vector is smaller or
+  // equal in every resource. Only one of a group of equal vectors is kept.
+  // 'vectors' holds vectors of 'num_res' resources back to back.
+  static void ParetoFrontier(const std::vector<int>& vectors, size_t num_res,
+                             std::vector<size_t>* frontier);
+
+  // Reduces 'frontier', a set of indices into 'vectors', to at most
+  // 'max_size' entries that are spread across the range of each resource.
+  static void ThinFrontier(const std::vector<int>& vectors, size_t num_res,
+                           size_t max_size, std::vector<size_t>* frontier);
+
   EdgeMap internal_edges_;
   NodeMap internal_nodes_;
   PortMap ports_;
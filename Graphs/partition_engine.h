@@ -48,6 +48,11 @@ class PartitionSummary {
   std::vector<double> total_resource_ratio;
   std::vector<std::vector<double>> partition_resource_ratios;
   int num_passes_used{0};
+  // Set if the engine's deadline expired before refinement of this partition
+  // was complete. The partition is the best found before that point.
+  bool truncated{false};
+  // Set if the partition is within the maximum weight imbalance.
+  bool balanced{true};
 };
 
 #endif /* PARTITION_ENGINE_H_ */
@@ -1,11 +1,14 @@
 #include "partition_engine_klfm.h"
 
 #include <algorithm>
+#include <cstdarg>
+#include <cstdio>
 #include <cstdlib>
 #include <functional>
 #include <limits>
 #include <queue>
 #include <sstream>
+#include <thread>
 #include <utility>
 
 #include "gain_bucket_manager_single_resource.h"
@@ -16,36 +19,29 @@
 #include "universal_macros.h"
 #include "weight_score.h"
 
+// Messages go to the engine's log stream so that parallel workers can buffer
+// them. See log_stream().
+#undef VLOG
+#define VLOG(lev) if (VERBOSITY >= lev) log_stream()
+#undef DLOG
+#define DLOG(debug_option, level) \
+    if (DEBUG_ENABLED && debug_option && (DEBUG_LEVEL >= level)) log_stream()
+
 using namespace std;
 
+mutex PartitionEngineKlfm::output_file_mutex_;
+mutex PartitionEngineKlfm::worker_output_mutex_;
+const unsigned PartitionEngineKlfm::kWorkerRandomSeedBase;
+
 PartitionEngineKlfm::PartitionEngineKlfm(Node* graph,
     PartitionEngineKlfm::Options& options, ostream& os)
-  : options_(options), os_(os), balance_exceeded_(false) {
-
-  Edge::SetEntropyMode(options_.use_entropy);
-
-  //random_engine_.seed(time(NULL));
-  // Give the same seed each time for consistency between benchmarks. The
-  // randomization of initial partition from run-to-run will still be different,
-  // however for run 0 of one configuration and run 0 of another, they will be
-  // the same.
-  random_engine_initial_.seed(0);
-  random_engine_rebalance_.seed(0);
-  random_engine_mutate_.seed(0);
-  random_engine_coarsen_.seed(0);
+  : options_(options), os_(os), parent_os_(nullptr),
+    is_parallel_worker_(false),
+    run_truncated_(false), pass_state_valid_(false), balance_exceeded_(false),
+    num_coarsening_hierarchy_uses_(0) {
 
   graph->CheckInternalGraphOrDie();
 
-  num_resources_per_node_ = options_.num_resources_per_node;
-  total_capacity_ = options_.device_resource_capacities;
-  assert_b(
-      options_.num_resources_per_node ==
-      graph->internal_nodes().begin()->second->SelectedWeightVector().size()) {
-    printf("Number of resources specified in Partition Engine options does "
-           "not match the number of resources in the graph.");
-  }
-  total_weight_.insert(total_weight_.begin(), num_resources_per_node_, 0);
-
   // Remove ports.
   // This is done for simplification while developing the KLFM algorithm.
   // Later may want to restore the concept of ports to consider partitioning
@@ -68,26 +64,254 @@ PartitionEngineKlfm::PartitionEngineKlfm(Node* graph,
     internal_edge_map_.insert(make_pair(copied_edge->id_, copied_edge));
   }
 
+  InitializeFromInternalGraph();
+}
+
+PartitionEngineKlfm::PartitionEngineKlfm(unique_ptr<Node> graph,
+    PartitionEngineKlfm::Options& options, ostream& os)
+  : options_(options), os_(os), parent_os_(nullptr),
+    is_parallel_worker_(false),
+    run_truncated_(false), pass_state_valid_(false), balance_exceeded_(false),
+    num_coarsening_hierarchy_uses_(0) {
+
+  graph->CheckInternalGraphOrDie();
+  graph->StripPorts();
+
+  // The nodes are handed over as they are. Clearing the graph's node map
+  // keeps its destructor from deleting them.
+  Node::NodeMap& nodes = graph->internal_nodes();
+  for (auto node_pair : nodes) {
+    Node* node = node_pair.second;
+    node->is_locked = false;
+    internal_node_map_.insert(make_pair(node->id, node));
+  }
+  nodes.clear();
+
+  // Each edge is released as soon as it has been converted.
+  Node::EdgeMap& edges = graph->internal_edges();
+  for (auto it = edges.begin(); it != edges.end(); it = edges.erase(it)) {
+    assert(!it->second->name.empty());
+    EdgeKlfm* converted_edge = new EdgeKlfm(it->second);
+    assert(it->second->name == converted_edge->name);
+    internal_edge_map_.insert(make_pair(converted_edge->id_, converted_edge));
+    delete it->second;
+  }
+  graph.reset();
+
+  InitializeFromInternalGraph();
+}
+
+PartitionEngineKlfm::PartitionEngineKlfm(const InducedSubgraph& subgraph,
+    PartitionEngineKlfm::Options& options, ostream& os)
+  : options_(options), os_(os), parent_os_(nullptr),
+    is_parallel_worker_(false),
+    run_truncated_(false), pass_state_valid_(false), balance_exceeded_(false),
+    num_coarsening_hierarchy_uses_(0) {
+
+  // Only the nodes of the view and the edges among them are copied. The
+  // copied nodes lose their connections to edges that leave the view.
+  for (auto node_id : subgraph.node_ids()) {
+    Node* copied_node = new Node(subgraph.node(node_id));
+    copied_node->is_locked = false;
+    vector<int> edges_to_remove;
+    for (auto& port_pair : copied_node->ports()) {
+      int edge_id = port_pair.second.external_edge_id;
+      if (internal_edge_map_.find(edge_id) != internal_edge_map_.end()) {
+        continue;
+      }
+      Edge* edge = subgraph.edge(edge_id);
+      if (subgraph.ContainsEdge(edge)) {
+        assert(!edge->name.empty());
+        internal_edge_map_.insert(make_pair(edge_id, new EdgeKlfm(edge)));
+      } else {
+        edges_to_remove.push_back(edge_id);
+      }
+    }
+    for (auto edge_id : edges_to_remove) {
+      copied_node->RemoveConnection(edge_id);
+    }
+    internal_node_map_.insert(make_pair(copied_node->id, copied_node));
+  }
+
+  InitializeFromInternalGraph();
+}
+
+void PartitionEngineKlfm::InitializeFromInternalGraph() {
+  // The entropy mode is process-wide and engines may be constructed on
+  // several threads at once, so the caller sets it before creating any
+  // engine and the engine only checks it.
+  assert_b(Edge::UseEntropyMode() == options_.use_entropy) {
+    printf("Edge::SetEntropyMode must be called with the engine's use_entropy "
+           "option before the engine is created.\n");
+  }
+  profiler_.set_enabled(!options_.profile_filename.empty());
+  move_trace_.set_filename(options_.move_trace_filename);
+
+  //random_engine_.seed(time(NULL));
+  // Give the same seed each time for consistency between benchmarks. The
+  // randomization of initial partition from run-to-run will still be different,
+  // however for run 0 of one configuration and run 0 of another, they will be
+  // the same.
+  random_engine_initial_.seed(0);
+  random_engine_rebalance_.seed(0);
+  random_engine_mutate_.seed(0);
+  random_engine_coarsen_.seed(0);
+
+  num_resources_per_node_ = options_.num_resources_per_node;
+  total_capacity_ = options_.device_resource_capacities;
+  assert_b(internal_node_map_.empty() ||
+      options_.num_resources_per_node ==
+      internal_node_map_.begin()->second->SelectedWeightVector().size()) {
+    printf("Number of resources specified in Partition Engine options does "
+           "not match the number of resources in the graph.");
+  }
+  total_weight_.insert(total_weight_.begin(), num_resources_per_node_, 0);
+
   // Check that all nodes have the correct number of resources in their weight
   // vectors.
   CheckSizeOfWeightVectors();
 
+  // Selects the implementations recorded in the file, so this must precede
+  // the computation of the total weight.
+  if (!options_.initial_partition_filename.empty()) {
+    ReadInitialPartition(options_.initial_partition_filename);
+  }
+
   RecomputeTotalWeightAndMaxImbalance();
 
-  switch (options_.gain_bucket_type) {
+  CreateGainBucketManager();
+
+  RebuildHypergraph();
+
+  if (!options_.refinement_region.empty()) {
+    BuildRefinementRegion();
+  }
+
+  // Verify that all nodes fall within the limits of the weight imbalance.
+  bool skip = false;
+  for (auto node_pair : internal_node_map_) {
+    vector<int> node_weight = node_pair.second->SelectedWeightVector();
+    for (size_t i = 0; i < num_resources_per_node_; i++) {
+      if (node_weight.at(i) >= 2 * max_weight_imbalance_.at(i)) {
+        LogPrintf("WARNING: Node %s with weight %d exceeded the max weight allowance: %d "
+               "in resource %lu.\n",
+               node_pair.second->name.c_str(), node_weight.at(i),
+               2 * max_weight_imbalance_.at(i), i);
+        LogPrintf("Suppressing future warnings of this type for this run.\n");
+        skip = true;
+        break;
+      }
+    }
+    if (skip) {
+      break;
+    }
+  }
+}
+
+PartitionEngineKlfm::~PartitionEngineKlfm() {
+  while (!contracted_levels_.empty()) {
+    DiscardContractedLevel();
+  }
+  for (auto it : internal_node_map_) {
+    delete it.second;
+  }
+  internal_node_map_.clear();
+  for (auto it : internal_edge_map_) {
+    delete it.second;
+  }
+  internal_edge_map_.clear();
+  delete gain_bucket_manager_;
+}
+
+PartitionEngineKlfm::PartitionEngineKlfm(
+    const PartitionEngineKlfm& parent, size_t worker_id)
+  : options_(parent.options_), os_(worker_os_buffer_),
+    parent_os_(&parent.os_), is_parallel_worker_(true),
+    deadline_(parent.deadline_), run_truncated_(false),
+    pass_state_valid_(false), balance_exceeded_(false),
+    num_coarsening_hierarchy_uses_(0) {
+  // Each worker gets its own random streams so that the runs it executes
+  // are independent of those executed by other workers. Seeding through
+  // seed_seq spreads the worker and stream numbers over the whole engine
+  // state, so that nearby seeds do not give correlated streams.
+  default_random_engine* random_engines[] = {
+      &random_engine_initial_, &random_engine_rebalance_,
+      &random_engine_mutate_, &random_engine_coarsen_};
+  for (size_t i = 0; i < 4; i++) {
+    seed_seq seeds{kWorkerRandomSeedBase, (unsigned)worker_id, (unsigned)i};
+    random_engines[i]->seed(seeds);
+  }
+  profiler_.set_enabled(parent.profiler_.enabled());
+  move_trace_.set_filename(options_.move_trace_filename);
+
+  num_resources_per_node_ = parent.num_resources_per_node_;
+  total_capacity_ = parent.total_capacity_;
+  total_weight_.insert(total_weight_.begin(), num_resources_per_node_, 0);
+
+  for (auto node_pair : parent.internal_node_map_) {
+    Node* copied_node = new Node(node_pair.second);
+    copied_node->is_locked = false;
+    internal_node_map_.insert(make_pair(copied_node->id, copied_node));
+  }
+  for (auto edge_pair : parent.internal_edge_map_) {
+    EdgeKlfm* copied_edge = new EdgeKlfm(edge_pair.second);
+    internal_edge_map_.insert(make_pair(copied_edge->id_, copied_edge));
+  }
+
+  RecomputeTotalWeightAndMaxImbalance();
+
+  CreateGainBucketManager();
+
+  RebuildHypergraph();
+
+  // The copied graph's indices need not match the parent's.
+  if (!options_.refinement_region.empty()) {
+    BuildRefinementRegion();
+  }
+}
+
+void PartitionEngineKlfm::CreateGainBucketManager() {
+  gain_bucket_type_ = GainBucketTypeForGraph();
+  PartitionerConfig::GainBucketSelectionPolicy selection_policy =
+      options_.gain_bucket_selection_policy;
+  if (gain_bucket_type_ != options_.gain_bucket_type) {
+    // Use the mixed manager's counterpart of the exclusive policy.
+    switch (selection_policy) {
+      case PartitionerConfig::kGbmreSelectionPolicyRandomResource:
+        selection_policy =
+            PartitionerConfig::kGbmrmSelectionPolicyRandomResource;
+      break;
+      case PartitionerConfig::kGbmreSelectionPolicyLargestResourceImbalance:
+        selection_policy =
+            PartitionerConfig::kGbmrmSelectionPolicyMostUnbalancedResource;
+      break;
+      default:
+        selection_policy =
+            PartitionerConfig::kGbmrmSelectionPolicyBestGainImbalanceScoreClassic;
+    }
+    if (!reported_gain_bucket_fallback_) {
+      log_stream() << "WARNING: Some implementations use more than one "
+                   << "resource. Using the mixed gain bucket manager instead "
+                   << "of the exclusive one where they occur." << endl;
+      reported_gain_bucket_fallback_ = true;
+    }
+  }
+  switch (gain_bucket_type_) {
     case PartitionerConfig::kGainBucketSingleResource:
       DLOG(DEBUG_OPT_TRACE, 0) <<
           "Creating SINGLE RESOURCE gain bucket manager." << endl;
       gain_bucket_manager_ = new GainBucketManagerSingleResource(
-          0, options_.max_imbalance_fraction.at(0));
+          0, options_.max_imbalance_fraction.at(0),
+          options_.gain_bucket_storage, &hypergraph_);
     break;
     case PartitionerConfig::kGainBucketMultiResourceExclusive:
       DLOG(DEBUG_OPT_TRACE, 0) <<
           "Creating MULTI RESOURCE EXCLUSIVE gain bucket manager." << endl;
       gain_bucket_manager_ = new GainBucketManagerMultiResourceExclusive(
           options_.max_imbalance_fraction,
-          options_.gain_bucket_selection_policy,
-          false);
+          selection_policy,
+          false,
+          options_.gain_bucket_storage, &hypergraph_);
     break;
     case PartitionerConfig::kGainBucketMultiResourceExclusiveAdaptive:
       DLOG(DEBUG_OPT_TRACE, 0) <<
@@ -95,67 +319,40 @@ PartitionEngineKlfm::PartitionEngineKlfm(Node* graph,
           endl;
       gain_bucket_manager_ = new GainBucketManagerMultiResourceExclusive(
           options_.max_imbalance_fraction,
-          options_.gain_bucket_selection_policy,
-          true);
+          selection_policy,
+          true,
+          options_.gain_bucket_storage, &hypergraph_);
     break;
     case PartitionerConfig::kGainBucketMultiResourceMixed:
       DLOG(DEBUG_OPT_TRACE, 0) <<
           "Creating MULTI RESOURCE MIXED gain bucket manager." << endl;
       gain_bucket_manager_ = new GainBucketManagerMultiResourceMixed(
           options_.max_imbalance_fraction,
-          options_.gain_bucket_selection_policy,
+          selection_policy,
           false,
           options_.use_ratio_in_imbalance_score,
-          options_.resource_ratio_weights);
+          options_.resource_ratio_weights,
+          options_.gain_bucket_storage, &hypergraph_);
     break;
     case PartitionerConfig::kGainBucketMultiResourceMixedAdaptive:
       DLOG(DEBUG_OPT_TRACE, 0) <<
           "Creating MULTI RESOURCE MIXED ADAPTIVE gain bucket manager." << endl;
       gain_bucket_manager_ = new GainBucketManagerMultiResourceMixed(
           options_.max_imbalance_fraction,
-          options_.gain_bucket_selection_policy,
+          selection_policy,
           true,
           options_.use_ratio_in_imbalance_score,
-          options_.resource_ratio_weights);
+          options_.resource_ratio_weights,
+          options_.gain_bucket_storage, &hypergraph_);
     break;
     default:
       assert_b(false) {
         printf("\nOptions specify an unsupported gain bucket type.\n");
       }
   }
-
-  // Verify that all nodes fall within the limits of the weight imbalance.
-  bool skip = false;
-  for (auto node_pair : internal_node_map_) {
-    vector<int> node_weight = node_pair.second->SelectedWeightVector();
-    for (size_t i = 0; i < num_resources_per_node_; i++) {
-      if (node_weight.at(i) >= 2 * max_weight_imbalance_.at(i)) {
-        printf("WARNING: Node %s with weight %d exceeded the max weight allowance: %d "
-               "in resource %lu.\n",
-               node_pair.second->name.c_str(), node_weight.at(i),
-               2 * max_weight_imbalance_.at(i), i);
-        printf("Suppressing future warnings of this type for this run.\n");
-        skip = true;
-        break;
-      }
-    }
-    if (skip) {
-      break;
-    }
-  }
-
-}
-
-PartitionEngineKlfm::~PartitionEngineKlfm() {
-  for (auto it : internal_node_map_) {
-    delete it.second;
-  }
-  internal_node_map_.clear();
-  for (auto it : internal_edge_map_) {
-    delete it.second;
+  if (options_.gain_bucket_search_depth > 0) {
+    gain_bucket_manager_->set_search_depth(options_.gain_bucket_search_depth);
   }
-  internal_edge_map_.clear();
-  delete gain_bucket_manager_;
 }
 
 void PartitionEngineKlfm::Execute(vector<PartitionSummary>* summaries) {
@@ -176,48 +373,207 @@ void PartitionEngineKlfm::Execute(vector<PartitionSummary>* summaries) {
   // --IF No partition saved (initial is still best) THEN TERMINATE
   // --ELSE Set saved partition as new initial partition.
   DLOG(DEBUG_OPT_TRACE, 0) << "Start KLFM Execution." << endl;
+  deadline_ = chrono::steady_clock::now() +
+              chrono::milliseconds(options_.deadline_ms);
+  if (options_.num_threads > 1 && options_.num_runs > 1 &&
+      !options_.export_initial_sol_only) {
+    ExecuteParallel(summaries);
+  } else {
+    map<int,int> initial_implementations;
+    if (!options_.reuse_previous_run_implementations) {
+      StoreInitialImplementations(&initial_implementations);
+    }
+
+    for (size_t cur_run = 0; cur_run < options_.num_runs; cur_run++) {
+      if (cur_run != 0 && DeadlineExpired()) {
+        VLOG(1) << "Deadline expired. Skipping remaining runs." << endl;
+        break;
+      }
+      vector<PartitionSummary> this_run_summaries;
+      PrepareAndExecuteRun(cur_run, cur_run != 0, initial_implementations,
+                           &this_run_summaries);
+      for (const auto& it : this_run_summaries) {
+        if (options_.enable_print_output) {
+          PrintResultFull(it, cur_run);
+        }
+        summaries->push_back(it);
+      }
+    }
+  }
+  if (options_.enable_print_output) {
+    SummarizeResults(*summaries);
+  }
+  if (DeadlineExpired()) {
+    KeepBestRun(summaries);
+  }
+}
+
+unique_ptr<Node> PartitionEngineKlfm::ReleaseGraph() {
+  assert(contracted_levels_.empty());
+  // The same ID and name as the top-level graph that partition_main builds.
+  const int kAlot = 1000000000;
+  unique_ptr<Node> graph(new Node(kAlot, "Top-Level Graph"));
+  for (auto node_pair : internal_node_map_) {
+    graph->AddInternalNode(node_pair.first, node_pair.second);
+  }
+  internal_node_map_.clear();
+  for (auto edge_pair : internal_edge_map_) {
+    graph->AddInternalEdge(edge_pair.first, edge_pair.second);
+  }
+  internal_edge_map_.clear();
+  pass_state_valid_ = false;
+  return graph;
+}
+
+void PartitionEngineKlfm::ExecuteParallel(
+    vector<PartitionSummary>* summaries) {
+  size_t num_workers = min(options_.num_threads, options_.num_runs);
+  VLOG(1) << "Executing " << options_.num_runs << " runs on " << num_workers
+          << " threads." << endl;
+
+  // Workers are created serially, as copying the graph is not thread-safe.
+  vector<unique_ptr<PartitionEngineKlfm>> workers;
+  for (size_t worker_id = 0; worker_id < num_workers; worker_id++) {
+    workers.emplace_back(new PartitionEngineKlfm(*this, worker_id));
+  }
+  if (!options_.cutset_dir.empty()) {
+    WriteCutsetSummaryCsvHeader();
+  }
+
+  // Each worker acquires its supernode IDs from a range of its own. The
+  // engine's node maps are hashed by ID, so IDs drawn from the shared pool
+  // would make the results depend on how the threads interleave. Arrays are
+  // indexed by node ID, so the ranges are kept small: twice the number of
+  // nodes is several times what coarsening takes at once, and a worker that
+  // runs out falls back to the shared pool.
+  const int id_range_size = 2 * (int)internal_node_map_.size();
+  const int ids_begin = IdManager::ReserveRange(id_range_size * num_workers);
+  vector<int> ids_end(num_workers);
+
+  vector<vector<PartitionSummary>> run_summaries(options_.num_runs);
+  vector<thread> threads;
+  for (size_t worker_id = 0; worker_id < num_workers; worker_id++) {
+    PartitionEngineKlfm* worker = workers[worker_id].get();
+    int worker_ids_begin = ids_begin + worker_id * id_range_size;
+    threads.emplace_back([worker, worker_id, num_workers, worker_ids_begin,
+                          id_range_size, &ids_end, &run_summaries]() {
+      IdManager::SetThreadRange(worker_ids_begin,
+                                worker_ids_begin + id_range_size);
+      worker->ExecuteWorkerRuns(worker_id, num_workers, &run_summaries);
+      ids_end[worker_id] = IdManager::ClearThreadRange();
+    });
+  }
+  for (auto& worker_thread : threads) {
+    worker_thread.join();
+  }
+  // Hand back the IDs past the highest that any worker acquired.
+  IdManager::UnreserveRange(
+      *max_element(ids_end.begin(), ids_end.end()),
+      ids_begin + id_range_size * num_workers);
+
+  for (size_t cur_run = 0; cur_run < options_.num_runs; cur_run++) {
+    for (const auto& it : run_summaries[cur_run]) {
+      if (options_.enable_print_output) {
+        PrintResultFull(it, cur_run);
+      }
+      summaries->push_back(it);
+    }
+  }
+}
+
+void PartitionEngineKlfm::ExecuteWorkerRuns(
+    size_t first_run, size_t run_stride,
+    vector<vector<PartitionSummary>>* run_summaries) {
   map<int,int> initial_implementations;
   if (!options_.reuse_previous_run_implementations) {
     StoreInitialImplementations(&initial_implementations);
   }
+  for (size_t cur_run = first_run; cur_run < options_.num_runs;
+       cur_run += run_stride) {
+    if (cur_run != 0 && DeadlineExpired()) {
+      break;
+    }
+    PrepareAndExecuteRun(cur_run, cur_run != first_run,
+                         initial_implementations, &run_summaries->at(cur_run));
+    FlushWorkerOutput();
+  }
+  FlushWorkerOutput();
+}
 
-  for (size_t cur_run = 0; cur_run < options_.num_runs; cur_run++) {
-    vector<PartitionSummary> this_run_summaries;
-    if (!options_.reuse_previous_run_implementations && cur_run != 0) {
-      ResetImplementations(initial_implementations);
-      RecomputeTotalWeightAndMaxImbalance();
+void PartitionEngineKlfm::LogPrintf(const char* format, ...) const {
+  va_list args;
+  va_start(args, format);
+  if (!is_parallel_worker_) {
+    vprintf(format, args);
+  } else {
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int length = vsnprintf(nullptr, 0, format, args_copy);
+    va_end(args_copy);
+    if (length > 0) {
+      vector<char> message(length + 1);
+      vsnprintf(message.data(), message.size(), format, args);
+      worker_log_buffer_ << message.data();
     }
+  }
+  va_end(args);
+}
+
+void PartitionEngineKlfm::FlushWorkerOutput() {
+  assert(is_parallel_worker_);
+  lock_guard<mutex> lock(worker_output_mutex_);
+  cout << worker_log_buffer_.str() << flush;
+  *parent_os_ << worker_os_buffer_.str() << flush;
+  worker_log_buffer_.str("");
+  worker_os_buffer_.str("");
+}
 
-    if (!options_.initial_sol_base_filename.empty()) {
-      NodePartitions pre_run_partitions;
-      double temp_cost;
-      vector<int> temp_balance;
-      GenerateInitialPartition(&pre_run_partitions, &temp_cost, &temp_balance);
+void PartitionEngineKlfm::PrepareAndExecuteRun(
+    size_t cur_run, bool reset_implementations,
+    const map<int,int>& initial_implementations,
+    vector<PartitionSummary>* summaries) {
+  if (!options_.reuse_previous_run_implementations && reset_implementations) {
+    ResetImplementations(initial_implementations);
+    RecomputeTotalWeightAndMaxImbalance();
+  }
+
+  if (!options_.initial_sol_base_filename.empty()) {
+    NodePartitions pre_run_partitions;
+    double temp_cost;
+    vector<int> temp_balance;
+    GenerateInitialPartition(&pre_run_partitions, &temp_cost, &temp_balance);
+    {
+      lock_guard<mutex> lock(output_file_mutex_);
       if (options_.sol_scip_format) {
         WriteScipSolAlt(pre_run_partitions, options_.initial_sol_base_filename);
       }
       if (options_.sol_gurobi_format) {
         WriteGurobiMst(pre_run_partitions, options_.initial_sol_base_filename);
       }
-      if (options_.export_initial_sol_only) {
-        exit(0);
+      if (options_.sol_native_format) {
+        WriteNativePartition(pre_run_partitions, options_.initial_sol_base_filename);
       }
     }
-
-    VLOG(1) << endl << "########### Begin Run " << cur_run + 1 << "/"
-            << options_.num_runs << " ###########" << endl;
-
-    ExecuteRun(cur_run, &this_run_summaries);
-    for (const auto& it : this_run_summaries) {
-      if (options_.enable_print_output) {
-        PrintResultFull(it, cur_run);
-      }
-      summaries->push_back(it);
+    if (options_.export_initial_sol_only) {
+      exit(0);
     }
   }
-  if (options_.enable_print_output) {
-    SummarizeResults(*summaries);
-  }
+
+  VLOG(1) << endl << "########### Begin Run " << cur_run + 1 << "/"
+          << options_.num_runs << " ###########" << endl;
+
+  ExecuteRun(cur_run, summaries);
+}
+
+void PartitionEngineKlfm::WriteCutsetSummaryCsvHeader() const {
+  stringstream csv_filename;
+  csv_filename << options_.cutset_dir << "/summary.csv";
+  ofstream csv_outfile(csv_filename.str(), ios_base::out);
+  assert(csv_outfile.is_open());
+  csv_outfile << "TotalCost,"
+              << "RunNum,"
+              << "TotalSpan,"
+              << "TotalEntropy\n";
 }
 
 void PartitionEngineKlfm::CheckSizeOfWeightVectors() {
@@ -257,6 +613,9 @@ void PartitionEngineKlfm::ResetImplementations(
 void PartitionEngineKlfm::ExecuteRun(
     int cur_run, vector<PartitionSummary>* summaries) {
   rebalances_this_run_ = 0;
+  run_truncated_ = false;
+  profiler_.StartRun(cur_run);
+  if (move_trace_.enabled()) move_trace_.StartRun(cur_run);
   NodePartitions coarsened_partition;
   double current_partition_cost;
   // Balance is the difference in weight between the partitions. It is
@@ -268,17 +627,28 @@ void PartitionEngineKlfm::ExecuteRun(
     MutateImplementations(options_.mutation_rate);
   }
 
+  // A user-specified partition is either refined as it is, or coarsened
+  // without merging nodes from opposite sides.
+  bool user_specified_seed =
+      options_.seed_mode == Options::kSeedModeUserSpecified;
+  if (user_specified_seed) {
+    PartitionFromSets(options_.initial_a_nodes, options_.initial_b_nodes,
+                      &seed_partition_);
+    if (cur_run != 0) {
+      PerturbSeedPartition(&seed_partition_);
+    }
+  }
+
   DLOG(DEBUG_OPT_TRACE, 1) << "Coarsening graph." << endl;
-  options_.cap_passes = false;
-  options_.max_passes = 30;
-  //CoarsenSimple(4);
-  //CoarsenMaxNodeDegree(4);
-  // TODO Make a parameter for this.
   int pre_coarsen_size = internal_node_map_.size();
-  //CoarsenNeighborhoodInterconnection(16, 0);
-  CoarsenHierarchalInterconnection(16, 100);
+  int num_levels = 0;
+  if (!user_specified_seed || options_.coarsen_initial_partition) {
+    KlfmProfiler::ScopedTimer timer(&profiler_, KlfmProfiler::kSectionCoarsen);
+    num_levels = CoarsenMultilevel();
+  }
   VLOG(1) << "Coarsened from " << pre_coarsen_size << " to "
-          << internal_node_map_.size() << " nodes." << endl;
+          << internal_node_map_.size() << " nodes in " << num_levels
+          << " levels." << endl;
 
   GenerateInitialPartition(&coarsened_partition, &current_partition_cost,
       &current_partition_balance);
@@ -308,16 +678,50 @@ void PartitionEngineKlfm::ExecuteRun(
   VLOG(1) << "Initial Partition Cost: " << current_partition_cost << endl;
 
   // Execute coarse partitioning.
+  SetMaxPasses(options_.max_passes_coarse_level);
+  SetRefinementLevel(num_levels);
   int num_passes = RunKlfmAlgorithm(
       cur_run, coarsened_partition, current_partition_cost,
       current_partition_balance);
-  
+
+  // Uncoarsen one level at a time, refining the partition at each
+  // intermediate level.
+  for (int level = num_levels - 1; level > 0; level--) {
+    DLOG(DEBUG_OPT_TRACE, 1) << "De-Coarsening graph to level " << level
+                             << "." << endl;
+    {
+      KlfmProfiler::ScopedTimer timer(&profiler_,
+                                      KlfmProfiler::kSectionUncoarsen);
+      NodePartitions finer_partition;
+      DecoarsenPartitions(&coarsened_partition, &finer_partition);
+      swap(coarsened_partition, finer_partition);
+      PopulateEdgePartitionConnections(coarsened_partition);
+    }
+    VLOG(1) << "Refining level " << level << " with "
+            << internal_node_map_.size() << " nodes." << endl;
+    RUN_DEBUG(DEBUG_OPT_COST_CHECK, 0) {
+      assert(abs(current_partition_cost - RecomputeCurrentCost()) < 1.0);
+    }
+    RUN_DEBUG(DEBUG_OPT_BALANCE_CHECK, 0) {
+      vector<int> rec_balance = RecomputeCurrentBalance(coarsened_partition);
+      assert(current_partition_balance == rec_balance);
+    }
+    SetRefinementLevel(level);
+    num_passes += RunKlfmAlgorithm(
+        cur_run, coarsened_partition, current_partition_cost,
+        current_partition_balance);
+  }
+
   DLOG(DEBUG_OPT_TRACE, 1) << "De-Coarsening graph." << endl;
-  options_.max_passes = 30;
+  SetMaxPasses(options_.max_passes_base_level);
   NodePartitions decoarsened_partition;
-  DecoarsenPartitions(&coarsened_partition, &decoarsened_partition);
-
-  PopulateEdgePartitionConnections(decoarsened_partition);
+  {
+    KlfmProfiler::ScopedTimer timer(&profiler_,
+                                    KlfmProfiler::kSectionUncoarsen);
+    DecoarsenPartitions(&coarsened_partition, &decoarsened_partition);
+    PopulateEdgePartitionConnections(decoarsened_partition);
+  }
+  seed_partition_.Clear();
 
   RUN_DEBUG(DEBUG_OPT_COST_CHECK, 0) {
     assert(abs(current_partition_cost - RecomputeCurrentCost()) < 1.0);
@@ -339,18 +743,35 @@ void PartitionEngineKlfm::ExecuteRun(
         decoarsened_partition, current_partition_balance, true, true);
   }
 
-
+  SetRefinementLevel(0);
   num_passes += RunKlfmAlgorithm(
       cur_run, decoarsened_partition, current_partition_cost,
       current_partition_balance);
 
+  // A run that ends outside of the balance limits fails, unless moving
+  // nodes can still bring it within them.
+  if (ExceedsMaxWeightImbalance(current_partition_balance)) {
+    FixInitialWeightImbalance(&decoarsened_partition,
+                              &current_partition_balance);
+    PopulateEdgePartitionConnections(decoarsened_partition);
+    current_partition_cost = RecomputeCurrentCost();
+    if (ExceedsMaxWeightImbalance(current_partition_balance)) {
+      LogPrintf("ERROR: Run %d found no partition within the maximum weight "
+                "imbalance.\n", cur_run);
+    }
+  }
+
   if (!options_.final_sol_base_filename.empty()) {
+    lock_guard<mutex> lock(output_file_mutex_);
     if (options_.sol_scip_format) {
       WriteScipSolAlt(decoarsened_partition, options_.final_sol_base_filename);
     }
     if (options_.sol_gurobi_format) {
       WriteGurobiMst(decoarsened_partition, options_.final_sol_base_filename);
     }
+    if (options_.sol_native_format) {
+      WriteNativePartition(decoarsened_partition, options_.final_sol_base_filename);
+    }
   }
   RUN_DEBUG(DEBUG_OPT_COST_CHECK, 0) {
     assert(abs(current_partition_cost - RecomputeCurrentCost()) < 1.0);
@@ -364,6 +785,15 @@ void PartitionEngineKlfm::ExecuteRun(
       summaries, decoarsened_partition, current_partition_balance,
       current_partition_cost, num_passes, cur_run);
 
+  if (profiler_.enabled()) {
+    profiler_.EndRun(current_partition_cost);
+    lock_guard<mutex> lock(output_file_mutex_);
+    profiler_.WriteRecords(options_.profile_filename);
+  }
+  if (move_trace_.enabled()) {
+    move_trace_.EndRun(current_partition_cost);
+  }
+
   DLOG(DEBUG_OPT_TRACE, 1) << "Run complete." << endl;
 }
 
@@ -480,30 +910,31 @@ void PartitionEngineKlfm::AppendPartitionSummary(
     double rms_avg = (rms_a + rms_b) / 2;
 
     RUN_VERBOSE(1) {
-      printf("Best cost this run: %f\n", current_partition_cost);
-      printf("Imbalance: ");
+      LogPrintf("Best cost this run: %f\n", current_partition_cost);
+      LogPrintf("Imbalance: ");
       for (auto it : partition_imbalance) {
-        printf("%f ", it);
+        LogPrintf("%f ", it);
       }
-      printf("\n");
-      printf("Resource ratios:");
+      LogPrintf("\n");
+      LogPrintf("Resource ratios:");
       for (auto it : graph_ratio) {
-        printf("%f ", it);
+        LogPrintf("%f ", it);
       }
-      printf("\n");
-      printf("Graph weight: ");
+      LogPrintf("\n");
+      LogPrintf("Graph weight: ");
       for (auto it : total_weight_) {
-        printf("%d ", it);
+        LogPrintf("%d ", it);
       }
-      printf("\n");
-      printf("Run length: %d passes\n", num_passes);
+      LogPrintf("\n");
+      LogPrintf("Run length: %d passes\n", num_passes);
     }
 
     // Populate summary.
     PartitionSummary summary;
     if (options_.save_cutset) {
-      summary.partition_node_ids.push_back(partitions.first);
-      summary.partition_node_ids.push_back(partitions.second);
+      summary.partition_node_ids.resize(2);
+      PartitionToSets(partitions, &summary.partition_node_ids[0],
+                      &summary.partition_node_ids[1]);
       GetCutSet(partitions, &summary.partition_edge_ids);
       GetCutSetNames(partitions, &summary.partition_edge_names);
     }
@@ -516,8 +947,11 @@ void PartitionEngineKlfm::AppendPartitionSummary(
     summary.total_weight = total_weight_;
     summary.rms_resource_deviation = rms_avg;
     summary.num_passes_used = num_passes;
+    summary.truncated = run_truncated_;
+    summary.balanced = !ExceedsMaxWeightImbalance(current_partition_balance);
     summaries->push_back(summary);
     if (!options_.cutset_dir.empty()) {
+      lock_guard<mutex> lock(output_file_mutex_);
       stringstream filename;
       filename << options_.cutset_dir << "/"
                << summary.total_cost
@@ -536,20 +970,15 @@ void PartitionEngineKlfm::AppendPartitionSummary(
         cutset_outfile << signal.substr(0, pos) << "\n";
       }
 
+      // When runs execute concurrently, ExecuteParallel() writes the header
+      // before any run starts.
+      if (cur_run == 0 && !is_parallel_worker_) {
+        WriteCutsetSummaryCsvHeader();
+      }
       stringstream csv_filename;
       csv_filename << options_.cutset_dir << "/summary.csv";
-      ofstream csv_outfile;
-      if (cur_run == 0) {
-        csv_outfile.open(csv_filename.str(), ios_base::out);
-        assert(csv_outfile.is_open());
-        csv_outfile << "TotalCost,"
-                    << "RunNum,"
-                    << "TotalSpan,"
-                    << "TotalEntropy\n";
-      } else {
-        csv_outfile.open(csv_filename.str(), ios_base::app);
-        assert(csv_outfile.is_open());
-      }
+      ofstream csv_outfile(csv_filename.str(), ios_base::app);
+      assert(csv_outfile.is_open());
       csv_outfile << summary.total_cost << ","
                   << cur_run << ","
                   << summary.total_span << ","
@@ -562,17 +991,22 @@ int PartitionEngineKlfm::RunKlfmAlgorithm(
     int cur_run, NodePartitions& current_partition,
     double& current_partition_cost, std::vector<int>& current_partition_balance) {
 
-  // These vectors are not yet used for anything useful.
-  vector<double> best_cost_by_pass;
-  vector<vector<int>> best_cost_balance_by_pass;
+  // The partition may have been changed since the last pass was run.
+  pass_state_valid_ = false;
 
   // Perform specified number of passes.
   size_t cur_pass = 0;
   while (cur_pass < options_.max_passes || !options_.cap_passes) {
     bool partition_changed;
 
+    if (DeadlineExpired()) {
+      run_truncated_ = true;
+      return cur_pass;
+    }
+
     RUN_VERBOSE(2) { PrintPassInfo(cur_pass, cur_run); }
-    if (PROFILE_ENABLED) RefreshProfilingData(false);
+    if (profiler_.enabled()) profiler_.StartPass();
+    if (move_trace_.enabled()) move_trace_.StartPass();
 
     if (options_.rebalance_on_start_of_pass) {
       RebalanceImplementations(current_partition, current_partition_balance,
@@ -583,32 +1017,33 @@ int PartitionEngineKlfm::RunKlfmAlgorithm(
 
     ExecutePass(current_partition, current_partition_cost,
         current_partition_balance, partition_changed);
-
-    // Currently don't use this information for anything, but it's a cheap
-    // copy. Don't keep a copy of the best partition by pass because that
-    // would be expensive.
-    best_cost_by_pass.push_back(current_partition_cost);
-    best_cost_balance_by_pass.push_back(current_partition_balance);
+    if (profiler_.enabled()) {
+      profiler_.EndPass(node_count_, current_partition_cost);
+    }
+    if (move_trace_.enabled()) {
+      move_trace_.EndPass(node_count_, max_at_node_count_, partition_changed,
+                          current_partition_cost, current_partition_balance);
+    }
 
     RUN_VERBOSE(2) {
-      printf("Best cost this pass: %f\n", best_cost_by_pass.at(cur_pass));
-      printf("Best result found after %lu moves.\n", max_at_node_count_);
-      printf("Imbalance: ");
+      LogPrintf("Best cost this pass: %f\n", current_partition_cost);
+      LogPrintf("Best result found after %lu moves.\n", max_at_node_count_);
+      LogPrintf("Imbalance: ");
       for (size_t tw_i = 0; tw_i < num_resources_per_node_; tw_i++) {
         if (total_weight_[tw_i] != 0) {
-          printf("%f ",
-                ((double)abs(current_partition_balance.at(tw_i)) /
-                (double)total_weight_[tw_i]));
+          LogPrintf("%f ",
+                   ((double)abs(current_partition_balance.at(tw_i)) /
+                   (double)total_weight_[tw_i]));
         } else {
-          printf("0 ");
+          LogPrintf("0 ");
         }
       }
-      printf("\n");
-      printf("Graph weight: ");
+      LogPrintf("\n");
+      LogPrintf("Graph weight: ");
       for (auto it : total_weight_) {
-          printf("%d ", it);
+          LogPrintf("%d ", it);
       }
-      printf("\n");
+      LogPrintf("\n");
     }
 
     DLOG(DEBUG_OPT_TRACE, 2) << "Pass complete." << endl;
@@ -619,7 +1054,7 @@ int PartitionEngineKlfm::RunKlfmAlgorithm(
     // ASAP!
     if (!partition_changed || (max_at_node_count_ == 1)) {
         // Done with KLFM.
-        printf("No difference from previous pass. Early termination.\n");
+        LogPrintf("No difference from previous pass. Early termination.\n");
         return cur_pass;
     }
   }
@@ -644,32 +1079,57 @@ void PartitionEngineKlfm::ExecutePass(
     recompute_best_balance_flag_ = false;
 
     DLOG(DEBUG_OPT_TRACE, 2) << "Reset pass state." << endl;
-    ResetNodeAndEdgeKlfmState(current_partition);
+    {
+      KlfmProfiler::ScopedTimer timer(&profiler_,
+                                      KlfmProfiler::kSectionPassSetup);
+      ResetNodeAndEdgeKlfmState(current_partition);
+    }
 
     // This is used to track the moves we have made since the best result for
     // a given pass. At the end of the pass, it is used to roll back
     // to the best result. This is cheaper than copying the best result.
+    // Holds node indices in 'hypergraph_'.
     vector<int> nodes_moved_since_best_result;
 
-    node_count_ = 0;
+    size_t max_non_improving_moves = options_.max_non_improving_moves;
+    if (options_.max_non_improving_move_fraction > 0.0) {
+      size_t fraction_limit = max<size_t>(1,
+          options_.max_non_improving_move_fraction *
+          gain_bucket_manager_->NumUnlockedNodes());
+      if (max_non_improving_moves == 0 ||
+          fraction_limit < max_non_improving_moves) {
+        max_non_improving_moves = fraction_limit;
+      }
+    }
+
+    node_count_ = 0;
     max_at_node_count_ = 0;
-    // Iterate until every node is locked.
+    // Iterate until every node is locked or the pass stops improving.
     DLOG(DEBUG_OPT_TRACE, 2) << "Start moving nodes." << endl;
     while (!gain_bucket_manager_->Empty()) {
+      // Checking the clock on every move would be needlessly expensive.
+      if ((node_count_ % kDeadlineCheckInterval) == 0 && DeadlineExpired()) {
+        run_truncated_ = true;
+        break;
+      }
       node_count_++;
       MakeKlfmMove(current_partition_balance, current_partition_cost,
           best_cost_balance, best_cost, best_cost_br_power,
           current_partition, nodes_moved_since_best_result);
       if ((VERBOSITY >= 2) && (node_count_ % PROFILE_ITERATIONS == 0)) {
-          printf("Processed %lu nodes\n", node_count_);
+          LogPrintf("Processed %lu nodes\n", node_count_);
       }
-      if (PROFILE_ENABLED && (node_count_ % PROFILE_ITERATIONS == 0)) {
-        RefreshProfilingData(true);
+      if (max_non_improving_moves != 0 &&
+          nodes_moved_since_best_result.size() >= max_non_improving_moves) {
+        DLOG(DEBUG_OPT_TRACE, 2) << "Stopping pass after "
+                                 << nodes_moved_since_best_result.size()
+                                 << " non-improving moves." << endl;
+        break;
       }
     }
 
     if (pre_best_cost - best_cost < (1e-10 * best_cost)) {
-      if (pre_best_cost_br_power < best_cost_br_power) {
+      if (pre_best_cost_br_power <= best_cost_br_power) {
         partition_changed = false;
       } else {
         partition_changed = true;
@@ -680,92 +1140,288 @@ void PartitionEngineKlfm::ExecutePass(
 
     // Roll-back to the best result of the pass.
     DLOG(DEBUG_OPT_TRACE, 2) << "Roll back to best result." << endl;
-    RollBackToBestResultOfPass(nodes_moved_since_best_result,
-        current_partition, current_partition_cost, current_partition_balance,
-        best_cost, best_cost_balance);
+    {
+      KlfmProfiler::ScopedTimer timer(&profiler_,
+                                      KlfmProfiler::kSectionRollback);
+      RollBackToBestResultOfPass(nodes_moved_since_best_result,
+          current_partition, current_partition_cost,
+          current_partition_balance, best_cost, best_cost_balance);
+    }
     //assert(!ExceedsMaxWeightImbalance(*current_partition_balance));
+
+    if (!gain_bucket_manager_->Empty()) {
+      // The pass was cut short by the deadline or the non-improving move
+      // limit. Discard the nodes that were never moved so that the bucket is
+      // empty for the next pass.
+      gain_bucket_manager_->Clear();
+    }
+}
+
+PartitionerConfig::GainBucketType
+    PartitionEngineKlfm::GainBucketTypeForGraph() const {
+  bool exclusive = false;
+  bool adaptive = false;
+  switch (options_.gain_bucket_type) {
+    case PartitionerConfig::kGainBucketMultiResourceExclusive:
+      exclusive = true;
+    break;
+    case PartitionerConfig::kGainBucketMultiResourceExclusiveAdaptive:
+      exclusive = true;
+      adaptive = true;
+    break;
+    default:
+    break;
+  }
+  if (!exclusive) {
+    return options_.gain_bucket_type;
+  }
+  for (size_t i = 0; i < hypergraph_.num_nodes(); i++) {
+    for (auto& wv : hypergraph_.node(i)->WeightVectors()) {
+      int num_resources_used = 0;
+      for (int weight : wv) {
+        if (weight != 0) {
+          num_resources_used++;
+        }
+      }
+      if (num_resources_used > 1) {
+        return adaptive ?
+            PartitionerConfig::kGainBucketMultiResourceMixedAdaptive :
+            PartitionerConfig::kGainBucketMultiResourceMixed;
+      }
+    }
+  }
+  return options_.gain_bucket_type;
+}
+
+void PartitionEngineKlfm::SetRefinementLevel(int level) {
+  profiler_.set_level(level);
+  move_trace_.set_level(level);
 }
 
 void PartitionEngineKlfm::PrintPassInfo(int cur_pass, int cur_run) {
   if (options_.cap_passes) {
-    printf("\n============Run %d/%lu Pass %d/%lu============\n\n",
+    LogPrintf("\n============Run %d/%lu Pass %d/%lu============\n\n",
         cur_run + 1, options_.num_runs, cur_pass + 1, options_.max_passes);
   } else {
-    printf("\n============Run %d/%lu Pass %d============\n\n",
+    LogPrintf("\n============Run %d/%lu Pass %d============\n\n",
         cur_run + 1, options_.num_runs, cur_pass + 1);
   }
 }
 
-void PartitionEngineKlfm::RefreshProfilingData(bool record_previous_results) {
-  if (record_previous_results) {
-    os_ << "------------------------------------" << endl;
-    os_ << "GBE time: " << gbe_time_ << endl;
-    os_ << "Set Node Weight Vector and Update Total Weight time: "
-         << set_vector_and_update_weights_time_ << endl;
-    os_ << "Move Node and Update Balance time: "
-         << move_node_and_update_balance_time_ << endl;
-    os_ << "MNUB Gain Update time: " << gain_update_time_ << endl;
-    os_ << "MNUB GU Move Node: " << move_node_time_ << endl;
-    os_ << "MNUB GU Update Gains: " << update_gains_time_ << endl;
-    os_ << "Weight Update time: " << weight_update_time_ << endl;
-    os_ << "Rebalance time: " << rebalance_time_ << endl;
-    os_ << "Cost Update time: " << cost_update_time_ << endl;
-    os_ << "Total time: " << total_move_time_ << endl;
-    os_ << "Connected Edges: " << num_connected_edges_ << endl;
-    os_ << "Connected Critical Edges: " << num_critical_connected_edges_
-         << endl;
-  }
-  gbe_time_ = 0;
-  set_vector_and_update_weights_time_ = 0;
-  move_node_and_update_balance_time_ = 0;
-  gain_update_time_ = 0;
-  move_node_time_ = 0;
-  update_gains_time_ = 0;
-  weight_update_time_ = 0;
-  rebalance_time_ = 0;
-  cost_update_time_ = 0;
-  total_move_time_ = 0;
-  num_connected_edges_ = 0;
-  num_critical_connected_edges_ = 0;
-}
-
 void PartitionEngineKlfm::ResetNodeAndEdgeKlfmState(
     const NodePartitions& partitions) {
 
-  // Unlock all nodes.
-  for (auto node_pair : internal_node_map_) {
-    node_pair.second->is_locked = false;
+  const int num_nodes = hypergraph_.num_nodes();
+  const int num_nets = hypergraph_.num_nets();
+
+  if (!pass_state_valid_) {
+    // The graph has changed, so the exclusive managers may no longer fit it,
+    // or fit it again.
+    if (GainBucketTypeForGraph() != gain_bucket_type_) {
+      delete gain_bucket_manager_;
+      CreateGainBucketManager();
+    }
+    // Unlock all nodes.
+    for (int i = 0; i < num_nodes; i++) {
+      hypergraph_.node(i)->is_locked = false;
+    }
+    if (options_.use_boundary_gain_buckets) {
+      net_is_cut_.assign(num_nets, false);
+      num_cut_nets_.assign(num_nodes, 0);
+      boundary_position_.assign(num_nodes, -1);
+      boundary_nodes_.clear();
+    }
+    // Reset all edges and set their criticality.
+    for (int i = 0; i < num_nets; i++) {
+      hypergraph_.net(i)->KlfmReset(NumPinsInPartA(i, partitions));
+      if (options_.use_boundary_gain_buckets) {
+        UpdateNetBoundaryState(i);
+      }
+    }
+    // Compute initial gain of each node.
+    node_gain_cache_.resize(num_nodes);
+    for (int i = 0; i < num_nodes; i++) {
+      node_gain_cache_[i] = ComputeNodeGain(i, partitions.InPartA(i));
+    }
+    net_needs_reset_.assign(num_nets, false);
+    node_needs_gain_.assign(num_nodes, false);
+    pass_state_valid_ = true;
+  } else {
+    // Edges with no moved nodes are exactly as they were after the previous
+    // reset, and so are the gains of nodes connected only to such edges.
+    // Every moved node was locked and must be unlocked, whether or not its
+    // move was rolled back.
+    vector<int> nodes_needing_gain;
+    for (int moved_index : nodes_moved_this_pass_) {
+      hypergraph_.node(moved_index)->is_locked = false;
+      const int* nets_end = hypergraph_.NetsEnd(moved_index);
+      for (const int* it = hypergraph_.NetsBegin(moved_index); it != nets_end;
+           ++it) {
+        if (net_needs_reset_[*it]) {
+          continue;
+        }
+        net_needs_reset_[*it] = true;
+        hypergraph_.net(*it)->KlfmReset(NumPinsInPartA(*it, partitions));
+        if (options_.use_boundary_gain_buckets) {
+          UpdateNetBoundaryState(*it);
+        }
+        const int* pins_end = hypergraph_.PinsEnd(*it);
+        for (const int* pin = hypergraph_.PinsBegin(*it); pin != pins_end;
+             ++pin) {
+          if (!node_needs_gain_[*pin]) {
+            node_needs_gain_[*pin] = true;
+            nodes_needing_gain.push_back(*pin);
+          }
+        }
+      }
+    }
+    // Gains are computed only after all of the edges have been reset.
+    for (int node_index : nodes_needing_gain) {
+      node_gain_cache_[node_index] =
+          ComputeNodeGain(node_index, partitions.InPartA(node_index));
+      node_needs_gain_[node_index] = false;
+    }
+    for (int moved_index : nodes_moved_this_pass_) {
+      const int* nets_end = hypergraph_.NetsEnd(moved_index);
+      for (const int* it = hypergraph_.NetsBegin(moved_index); it != nets_end;
+           ++it) {
+        net_needs_reset_[*it] = false;
+      }
+    }
   }
-  // Reset all edges and set their criticality.
-  for (auto edge_pair : internal_edge_map_) {
-    edge_pair.second->KlfmReset(partitions);
+  nodes_moved_this_pass_.clear();
+
+  // Fill the gain buckets. Interior nodes are left out of the buckets in
+  // boundary mode until a move activates them, so only the boundary is
+  // visited. It is sorted so that nodes enter the buckets in index order,
+  // as they do otherwise. Nodes outside of the refinement region are never
+  // added.
+  if (options_.use_boundary_gain_buckets) {
+    sort(boundary_nodes_.begin(), boundary_nodes_.end());
+    for (size_t i = 0; i < boundary_nodes_.size(); i++) {
+      boundary_position_[boundary_nodes_[i]] = i;
+    }
+  }
+  const int num_candidates = options_.use_boundary_gain_buckets ?
+      boundary_nodes_.size() : num_nodes;
+  for (int candidate = 0; candidate < num_candidates; candidate++) {
+    int i = options_.use_boundary_gain_buckets ?
+        boundary_nodes_[candidate] : candidate;
+    if (!InRefinementRegion(i)) {
+      continue;
+    }
+    bool in_part_a = partitions.InPartA(i);
+    gain_bucket_manager_->AddNode(node_gain_cache_[i], hypergraph_.node(i), i,
+                                  in_part_a, total_weight_);
   }
+}
 
-  // Compute initial gain of each node.
-  for (auto node_pair : internal_node_map_) {
-    bool in_part_a = (partitions.first.count(node_pair.first) != 0);
-    ComputeInitialNodeGainAndUpdateBuckets(node_pair.second, in_part_a);
+void PartitionEngineKlfm::UpdateNetBoundaryState(int net_index) {
+  bool is_cut = hypergraph_.net(net_index)->CrossesPartitions();
+  if (is_cut == (bool)net_is_cut_[net_index]) {
+    return;
+  }
+  net_is_cut_[net_index] = is_cut;
+  const int* pins_end = hypergraph_.PinsEnd(net_index);
+  for (const int* pin = hypergraph_.PinsBegin(net_index); pin != pins_end;
+       ++pin) {
+    if (is_cut) {
+      if (num_cut_nets_[*pin]++ == 0) {
+        boundary_position_[*pin] = boundary_nodes_.size();
+        boundary_nodes_.push_back(*pin);
+      }
+    } else if (--num_cut_nets_[*pin] == 0) {
+      // Swap the node with the last one so that removal is O(1).
+      int position = boundary_position_[*pin];
+      boundary_nodes_[position] = boundary_nodes_.back();
+      boundary_position_[boundary_nodes_[position]] = position;
+      boundary_nodes_.pop_back();
+      boundary_position_[*pin] = -1;
+    }
   }
 }
 
+void PartitionEngineKlfm::BuildRefinementRegion() {
+  assert(contracted_levels_.empty());
+  const int num_nodes = hypergraph_.num_nodes();
+  in_refinement_region_.assign(num_nodes, false);
+
+  // Breadth-first search from the region's nodes, one net at a time.
+  vector<int> frontier;
+  for (auto node_id : options_.refinement_region) {
+    int node_index = hypergraph_.NodeIndex(node_id);
+    if (node_index >= 0 && !in_refinement_region_[node_index]) {
+      in_refinement_region_[node_index] = true;
+      frontier.push_back(node_index);
+    }
+  }
+  size_t region_size = frontier.size();
+  vector<char> net_visited(hypergraph_.num_nets(), false);
+  for (size_t hop = 0; hop < options_.refinement_region_radius; hop++) {
+    vector<int> next_frontier;
+    for (int node_index : frontier) {
+      const int* nets_end = hypergraph_.NetsEnd(node_index);
+      for (const int* it = hypergraph_.NetsBegin(node_index); it != nets_end;
+           ++it) {
+        if (net_visited[*it]) {
+          continue;
+        }
+        net_visited[*it] = true;
+        const int* pins_end = hypergraph_.PinsEnd(*it);
+        for (const int* pin = hypergraph_.PinsBegin(*it); pin != pins_end;
+             ++pin) {
+          if (!in_refinement_region_[*pin]) {
+            in_refinement_region_[*pin] = true;
+            next_frontier.push_back(*pin);
+          }
+        }
+      }
+    }
+    region_size += next_frontier.size();
+    frontier.swap(next_frontier);
+  }
+  VLOG(1) << "Refinement is restricted to " << region_size << " of "
+          << num_nodes << " nodes." << endl;
+}
+
+void PartitionEngineKlfm::RebuildHypergraph() {
+  hypergraph_.Build(internal_node_map_, internal_edge_map_);
+  pass_state_valid_ = false;
+  nodes_moved_this_pass_.clear();
+}
+
 void PartitionEngineKlfm::ComputeInitialNodeGainAndUpdateBuckets(
-    Node* node, bool in_part_a) {
-  double node_gain = ComputeNodeGain(node->id);
-  gain_bucket_manager_->AddNode(node_gain, node, in_part_a, total_weight_);
+    int node_index, bool in_part_a) {
+  double node_gain = ComputeNodeGain(node_index, in_part_a);
+  gain_bucket_manager_->AddNode(node_gain, hypergraph_.node(node_index),
+                                node_index, in_part_a, total_weight_);
 }
 
-double PartitionEngineKlfm::ComputeNodeGain(int node_id) {
+double PartitionEngineKlfm::ComputeNodeGain(int node_index, bool in_part_a) {
   double node_gain = 0;
-  Node* node = internal_node_map_.at(node_id);
-  for (auto& port_pair : node->ports()) {
-    Port& port = port_pair.second;
-    int connecting_edge_id = port.external_edge_id;
-    EdgeKlfm* connecting_edge = internal_edge_map_.at(connecting_edge_id);
-    node_gain += connecting_edge->GainContributionToNode(node_id);
+  const bool is_locked = hypergraph_.node(node_index)->is_locked;
+  const int* nets_end = hypergraph_.NetsEnd(node_index);
+  for (const int* it = hypergraph_.NetsBegin(node_index); it != nets_end;
+       ++it) {
+    node_gain +=
+        hypergraph_.net(*it)->GainContributionToNode(in_part_a, is_locked);
   }
   return node_gain;
 }
 
+int PartitionEngineKlfm::NumPinsInPartA(
+    int net_index, const NodePartitions& partitions) const {
+  int num_in_part_a = 0;
+  const int* pins_end = hypergraph_.PinsEnd(net_index);
+  for (const int* pin = hypergraph_.PinsBegin(net_index); pin != pins_end;
+       ++pin) {
+    if (partitions.InPartA(*pin)) {
+      num_in_part_a++;
+    }
+  }
+  return num_in_part_a;
+}
+
 void PartitionEngineKlfm::MakeKlfmMove(
     vector<int>& current_partition_balance,
     double& current_partition_cost,
@@ -774,22 +1430,19 @@ void PartitionEngineKlfm::MakeKlfmMove(
     double& best_cost_br_power,
     NodePartitions& current_partition,
     vector<int>& nodes_moved_since_best_result) {
-  if (PROFILE_ENABLED) {
-    gbe_start_time_ = GetTimeUsec();
-    total_move_start_time_ = GetTimeUsec();
-  }
+  uint64_t select_start_nsec =
+      profiler_.enabled() ? KlfmProfiler::NowNsec() : 0;
   GainBucketEntry entry = gain_bucket_manager_->GetNextGainBucketEntry(
       current_partition_balance, total_weight_);
-  if (PROFILE_ENABLED) {
-    gbe_time_ += GetTimeUsec() - gbe_start_time_;
-    set_vector_and_update_weights_start_time_ = GetTimeUsec();
+  if (profiler_.enabled()) {
+    profiler_.AddTime(KlfmProfiler::kSectionGainBucketSelect,
+                      KlfmProfiler::NowNsec() - select_start_nsec);
   }
 
   const double gain = entry.CostGain();
-  const int node_id_to_move = entry.Id();
-  const bool from_part_a = current_partition.first.find(node_id_to_move) !=
-                           current_partition.first.end();
-  Node* node_to_move = internal_node_map_.at(node_id_to_move);
+  const int node_index = entry.Index();
+  const bool from_part_a = current_partition.InPartA(node_index);
+  Node* node_to_move = hypergraph_.node(node_index);
 
   // Account for the gain bucket potentially selecting a different
   // implementation for the node than in the previous pass.
@@ -802,53 +1455,47 @@ void PartitionEngineKlfm::MakeKlfmMove(
   UpdateTotalWeightsForImplementationChange(
       previous_weight_vector, node_to_move->SelectedWeightVector());
 
-  VLOG(3) << "Move node ID: " << node_id_to_move << " Gain: " << gain << endl;
+  VLOG(3) << "Move node ID: " << entry.Id() << " Gain: " << gain << endl;
   RUN_DEBUG(DEBUG_OPT_PARTITION_IMBALANCE_EXCEEDED, 1) {
     if (balance_exceeded_) {
-      printf("In Balance Exceeded Mode. Max imbalance: ");
+      LogPrintf("In Balance Exceeded Mode. Max imbalance: ");
       for (auto it : max_weight_imbalance_) {
-        printf("%d ", it);
+        LogPrintf("%d ", it);
       }
-      printf("\n");
-      printf("Current balance: ");
+      LogPrintf("\n");
+      LogPrintf("Current balance: ");
       for (auto it : current_partition_balance) {
-        printf("%d ", it);
+        LogPrintf("%d ", it);
       }
-      printf("\n");
-      printf("Balance change from move: ");
+      LogPrintf("\n");
+      LogPrintf("Balance change from move: ");
       for (auto it : entry.current_weight_vector()) {
         if (from_part_a) {
-          printf("-");
+          LogPrintf("-");
         } else {
-          printf("+");
+          LogPrintf("+");
         }
-        printf("%d ", it);
+        LogPrintf("%d ", it);
       }
-      printf("\n");
+      LogPrintf("\n");
     }
     if (options_.rebalance_on_demand) {
       if (rebalances_this_run_ >= options_.rebalance_on_demand_cap_per_run &&
           !options_.rebalance_on_demand_cap_per_run) {
-        printf("On-Demand Rebalance cap per run exceeded\n");
+        LogPrintf("On-Demand Rebalance cap per run exceeded\n");
       } else if (rebalances_this_pass_ >=
                  options_.rebalance_on_demand_cap_per_pass &&
                  !options_.rebalance_on_demand_cap_per_pass) {
-        printf("On-Demand Rebalance cap per pass exceeded\n");
+        LogPrintf("On-Demand Rebalance cap per pass exceeded\n");
       } else {
-        printf("On-Demand Rebalance possible\n");
+        LogPrintf("On-Demand Rebalance possible\n");
       }
     }
   }
 
-  if (PROFILE_ENABLED) {
-    set_vector_and_update_weights_time_ +=
-      GetTimeUsec() - set_vector_and_update_weights_start_time_;
-    move_node_and_update_balance_start_time_ = GetTimeUsec();
-  }
-
   // Move the node in the node tracking containers.
   MoveNodeAndUpdateBalance(from_part_a, current_partition, node_to_move,
-      entry.current_weight_vector(), previous_weight_vector,
+      node_index, entry.current_weight_vector(), previous_weight_vector,
       current_partition_balance);
 
   RUN_DEBUG(DEBUG_OPT_BALANCE_CHECK, 1) {
@@ -867,12 +1514,6 @@ void PartitionEngineKlfm::MakeKlfmMove(
     assert(cur_max_imbalance == max_weight_imbalance_);
   }
 
-  if (PROFILE_ENABLED) {
-    move_node_and_update_balance_time_ +=
-      GetTimeUsec() - move_node_and_update_balance_start_time_;
-    rebalance_start_time_ = GetTimeUsec();
-  }
-
   // Include ExceedsMaxWeightImbalance check here to allow partition weight
   // to exceed max weight imbalance during the iteration but roll back to the
   // best result that fit.
@@ -911,16 +1552,11 @@ void PartitionEngineKlfm::MakeKlfmMove(
   }
   RUN_DEBUG(DEBUG_OPT_PARTITION_IMBALANCE_EXCEEDED, 0) {
     if (!prev_exceeded && balance_exceeded_) {
-      printf("Balance exceeded starting at move %lu\n", node_count_);
+      LogPrintf("Balance exceeded starting at move %lu\n", node_count_);
     } else if (prev_exceeded && !balance_exceeded_) {
-      printf("Returned to balance at move %lu\n", node_count_);
+      LogPrintf("Returned to balance at move %lu\n", node_count_);
     }
   }
-  if (PROFILE_ENABLED) {
-    rebalance_time_ += GetTimeUsec() - rebalance_start_time_;
-    cost_update_start_time_ = GetTimeUsec();
-  }
-
   // Check if the best solution result needs updating.
   current_partition_cost -= gain;
   RUN_DEBUG(DEBUG_OPT_COST_CHECK, 1) {
@@ -951,72 +1587,109 @@ void PartitionEngineKlfm::MakeKlfmMove(
     recompute_best_balance_flag_ = false;
     nodes_moved_since_best_result.clear();
   } else {
-    nodes_moved_since_best_result.push_back(node_id_to_move);
+    nodes_moved_since_best_result.push_back(node_index);
   }
-  if (PROFILE_ENABLED) {
-    cost_update_time_ += GetTimeUsec() - cost_update_start_time_;
-    total_move_time_ += GetTimeUsec() - total_move_start_time_;
+  if (move_trace_.enabled()) {
+    move_trace_.RecordMove(entry.Id(), gain, current_partition_cost,
+                           current_partition_balance);
   }
 }
 
 void PartitionEngineKlfm::MoveNodeAndUpdateBalance(
     bool from_part_a, NodePartitions& current_partition, Node* node,
-    const vector<int>& weight_vector,
+    int node_index, const vector<int>& weight_vector,
     const vector<int>& prev_weight_vector, std::vector<int>& balance) {
-  if (PROFILE_ENABLED) weight_update_start_time_ = GetTimeUsec();
   // Move the node in the node tracking containers.
+  current_partition.Move(node_index);
   if (from_part_a) {
-    current_partition.first.erase(node->id);
-    current_partition.second.insert(node->id);
     for (size_t wt_it = 0; wt_it < num_resources_per_node_; wt_it++) {
       balance[wt_it] -= (weight_vector[wt_it] + prev_weight_vector[wt_it]);
     }
   } else {
-    current_partition.second.erase(node->id);
-    current_partition.first.insert(node->id);
     for (size_t wt_it = 0; wt_it < num_resources_per_node_; wt_it++) {
       balance[wt_it] += (weight_vector[wt_it] + prev_weight_vector[wt_it]);
     }
   }
-  if (PROFILE_ENABLED) {
-    weight_update_time_ += GetTimeUsec() - weight_update_start_time_;
-  }
 
   // Move the node on all edges that touch it, update their criticality,
   // and update the gains of the nodes that need it.
-  if (PROFILE_ENABLED) gain_update_start_time_ = GetTimeUsec();
-  UpdateMovedNodeEdgesAndNodeGains(node, from_part_a);
-  if (PROFILE_ENABLED) {
-    gain_update_time_ += GetTimeUsec() - gain_update_start_time_;
-  }
+  KlfmProfiler::ScopedTimer timer(&profiler_, KlfmProfiler::kSectionGainUpdate);
+  UpdateMovedNodeEdgesAndNodeGains(node, node_index, from_part_a,
+                                   current_partition);
 }
 
 void PartitionEngineKlfm::UpdateMovedNodeEdgesAndNodeGains(
-    Node* moved_node, bool from_part_a) {
-  for (auto& port_pair : moved_node->ports()) {
-
-    num_connected_edges_++;
-    const int connected_edge_id = port_pair.second.external_edge_id;
-    EdgeKlfm* connected_edge = internal_edge_map_.at(connected_edge_id);
-    if (connected_edge->IsCritical()) num_critical_connected_edges_++;
-    EdgeKlfm::NodeIdVector nodes_to_increase_gain;
-    EdgeKlfm::NodeIdVector nodes_to_decrease_gain;
-    connected_edge->MoveNode(moved_node->id, &nodes_to_increase_gain,
-                             &nodes_to_decrease_gain);
-
+    Node* moved_node, int node_index, bool from_part_a,
+    const NodePartitions& current_partition) {
+  assert(hypergraph_.node(node_index) == moved_node);
+  moved_node->is_locked = true;
+  nodes_moved_this_pass_.push_back(node_index);
+  const int* nets_end = hypergraph_.NetsEnd(node_index);
+  for (const int* it = hypergraph_.NetsBegin(node_index); it != nets_end;
+       ++it) {
+    EdgeKlfm* connected_edge = hypergraph_.net(*it);
+    int num_increase_from_side;
+    int num_reduce_to_side;
+    connected_edge->MoveNode(from_part_a, &num_increase_from_side,
+                             &num_reduce_to_side);
     // Due to the nature of the KLFM algorithm, the nodes that have their
     // gains increased are always in the same partition that the node was
     // moved from and the gains to be decreased are in the partition it
     // was moved to.
     double gain_modifier = connected_edge->Weight();
-    if (gain_modifier != 0.0) {
-      gain_bucket_manager_->UpdateGains(gain_modifier, nodes_to_increase_gain,
-                                        nodes_to_decrease_gain, from_part_a);
-    } else {
-      /*
-      gain_bucket_manager_->TouchNodes(nodes_to_increase_gain);
-      gain_bucket_manager_->TouchNodes(nodes_to_decrease_gain);
-      */
+    if (gain_modifier == 0.0 ||
+        (num_increase_from_side == 0 && num_reduce_to_side == 0)) {
+      continue;
+    }
+    // The moved node is already on its new side, so the unlocked pins on its
+    // old side are exactly those that remain there. Inactive nodes get their
+    // full gain computed when they are activated.
+    const bool filter_inactive =
+        options_.use_boundary_gain_buckets || !in_refinement_region_.empty();
+    nodes_to_increase_gain_.clear();
+    nodes_to_decrease_gain_.clear();
+    const int* pins_end = hypergraph_.PinsEnd(*it);
+    for (const int* pin = hypergraph_.PinsBegin(*it); pin != pins_end;
+         ++pin) {
+      if (hypergraph_.node(*pin)->is_locked ||
+          (filter_inactive && !gain_bucket_manager_->HasNode(*pin))) {
+        continue;
+      }
+      if (current_partition.InPartA(*pin) == from_part_a) {
+        nodes_to_increase_gain_.insert(nodes_to_increase_gain_.end(),
+                                       num_increase_from_side, *pin);
+      } else {
+        nodes_to_decrease_gain_.insert(nodes_to_decrease_gain_.end(),
+                                       num_reduce_to_side, *pin);
+      }
+    }
+    gain_bucket_manager_->UpdateGains(gain_modifier, nodes_to_increase_gain_,
+                                      nodes_to_decrease_gain_, from_part_a);
+  }
+  if (options_.use_boundary_gain_buckets) {
+    ActivateBoundaryNeighbors(node_index, current_partition);
+  }
+}
+
+void PartitionEngineKlfm::ActivateBoundaryNeighbors(
+    int node_index, const NodePartitions& current_partition) {
+  // The gains are computed after every net of the moved node has been
+  // updated, so they reflect the partition after the move.
+  const int* nets_end = hypergraph_.NetsEnd(node_index);
+  for (const int* it = hypergraph_.NetsBegin(node_index); it != nets_end;
+       ++it) {
+    if (!hypergraph_.net(*it)->CrossesPartitions()) {
+      continue;
+    }
+    const int* pins_end = hypergraph_.PinsEnd(*it);
+    for (const int* pin = hypergraph_.PinsBegin(*it); pin != pins_end;
+         ++pin) {
+      Node* node = hypergraph_.node(*pin);
+      if (!node->is_locked && !gain_bucket_manager_->HasNode(*pin) &&
+          InRefinementRegion(*pin)) {
+        ComputeInitialNodeGainAndUpdateBuckets(
+            *pin, current_partition.InPartA(*pin));
+      }
     }
   }
 }
@@ -1026,16 +1699,9 @@ void PartitionEngineKlfm::RollBackToBestResultOfPass(
     NodePartitions& current_partition,
     double& current_partition_cost, vector<int>& current_partition_balance,
     const double& best_cost, const vector<int>& best_cost_balance) {
-  for (auto id : nodes_moved_since_best_result) {
-    if (current_partition.first.find(id) !=
-        current_partition.first.end()) {
-      current_partition.first.erase(id);
-      current_partition.second.insert(id);
-    } else {
-      current_partition.second.erase(id);
-      current_partition.first.insert(id);
-    }
-    Node* node = internal_node_map_.at(id);
+  for (int node_index : nodes_moved_since_best_result) {
+    current_partition.Move(node_index);
+    Node* node = hypergraph_.node(node_index);
     vector<int> current_wv = node->SelectedWeightVector();
     node->RevertSelectedWeightVector();
     vector<int> new_wv = node->SelectedWeightVector();
@@ -1071,46 +1737,9 @@ void PartitionEngineKlfm::RollBackToBestResultOfPass(
 
 bool PartitionEngineKlfm::PartitionsIdentical(
     const NodePartitions& a, const NodePartitions& b) const {
-
   // Handle the case where partitions may be identical by the order of first/
   // second is swapped between the two.
-  bool swap = false;
-  auto a_fb = a.first.begin();
-  auto b_fb = b.first.begin();
-  if (*a_fb != *b_fb) {
-    if (*a_fb == *b.second.begin()) {
-      swap = true;
-    } else {
-      return false;
-    }
-  }
-
-  auto af_it = a.first.begin();
-  auto as_it = a.second.begin();
-  auto bf_it = (swap) ? b.second.begin() : b.first.begin();
-  auto bs_it = (swap) ? b.first.begin() : b.second.begin();
-
-  while (af_it != a.first.end() && bf_it != b.first.end()) {
-    if (*af_it != *bf_it) {
-      return false;
-    }
-    ++af_it;
-    ++bf_it;
-  }
-  if (af_it != a.first.end() && bf_it != b.first.end()) {
-    return false;
-  }
-  while (as_it != a.second.end() && bs_it != b.second.end()) {
-    if (*as_it != *bs_it) {
-      return false;
-    }
-    ++as_it;
-    ++bs_it;
-  }
-  if (as_it != a.second.end() && bs_it != b.second.end()) {
-    return false;
-  }
-  return true;
+  return a.SameBipartition(b);
 }
 
 void PartitionEngineKlfm::Reset() {
@@ -1118,16 +1747,50 @@ void PartitionEngineKlfm::Reset() {
 
 void PartitionEngineKlfm::PopulateEdgePartitionConnections(
     const NodePartitions& partition) {
-  for (auto edge_pair : internal_edge_map_) {
-    EdgeKlfm* edge = edge_pair.second;
-    edge->PopulatePartitionNodeIds(partition);
+  assert(hypergraph_.num_nets() == internal_edge_map_.size());
+  const int num_nets = hypergraph_.num_nets();
+  for (int i = 0; i < num_nets; i++) {
+    hypergraph_.net(i)->PopulatePartitionCounts(NumPinsInPartA(i, partition));
+  }
+}
+
+void PartitionEngineKlfm::PartitionFromSets(
+    const NodeIdSet& part_a_ids, const NodeIdSet& part_b_ids,
+    NodePartitions* partition) const {
+  partition->Reset(hypergraph_.num_nodes());
+  for (int part = 0; part < 2; part++) {
+    for (int node_id : (part == 0) ? part_a_ids : part_b_ids) {
+      int node_index = hypergraph_.NodeIndex(node_id);
+      assert_b(node_index >= 0) {
+        printf("Node %d of the partition is not in the graph.\n", node_id);
+      }
+      assert_b(!partition->Contains(node_index)) {
+        printf("Node %d is in both partitions.\n", node_id);
+      }
+      partition->Assign(node_index, part == 0);
+    }
+  }
+}
+
+void PartitionEngineKlfm::PartitionToSets(
+    const NodePartitions& partition, NodeIdSet* part_a_ids,
+    NodeIdSet* part_b_ids) const {
+  assert(partition.size() == hypergraph_.num_nodes());
+  part_a_ids->clear();
+  part_b_ids->clear();
+  const int num_nodes = hypergraph_.num_nodes();
+  for (int i = 0; i < num_nodes; i++) {
+    if (partition.InPartA(i)) {
+      part_a_ids->insert(hypergraph_.node_id(i));
+    } else if (partition.InPartB(i)) {
+      part_b_ids->insert(hypergraph_.node_id(i));
+    }
   }
 }
 
 void PartitionEngineKlfm::GenerateInitialPartition(
     NodePartitions* partition, double* cost, vector<int>* balance) {
-  partition->first.clear();
-  partition->second.clear();
+  partition->Reset(hypergraph_.num_nodes());
   switch(options_.seed_mode) {
     case Options::kSeedModeRandom:
       DLOG(DEBUG_OPT_TRACE, 1) <<
@@ -1141,8 +1804,22 @@ void PartitionEngineKlfm::GenerateInitialPartition(
     case Options::kSeedModeUserSpecified:
       DLOG(DEBUG_OPT_TRACE, 1) <<
           "Generating initial partition using USER SPECIFIED policy." << endl;
-      partition->first = options_.initial_a_nodes;
-      partition->second = options_.initial_b_nodes;
+      if (seed_partition_.size() == hypergraph_.num_nodes()) {
+        // Supernodes were only made from nodes on the same side, and the
+        // seed partition follows the graph to each coarser level.
+        *partition = seed_partition_;
+      } else {
+        // Outside of a run, as when exporting the initial solution.
+        assert(contracted_levels_.empty());
+        PartitionFromSets(options_.initial_a_nodes, options_.initial_b_nodes,
+                          partition);
+      }
+      assert_b(partition->num_unassigned() == 0) {
+        printf("The user-specified partition does not cover the graph.\n");
+      }
+      PopulateEdgePartitionConnections(*partition);
+      *cost = RecomputeCurrentCost();
+      *balance = RecomputeCurrentBalance(*partition);
       break;
     case Options::kSeedModeSimpleDeterministic:
       DLOG(DEBUG_OPT_TRACE, 1) <<
@@ -1160,7 +1837,15 @@ void PartitionEngineKlfm::GenerateInitialPartition(
             << "Attempting Rebalance" << endl;
     RebalanceImplementations(*partition, *balance, true, false);
     if (ExceedsMaxWeightImbalance(*balance)) {
-      printf("Warning initial partition exceeds weight imbalance maximum!\n");
+      VLOG(1) << "Moving nodes to rebalance the initial partition." << endl;
+      bool fixed = FixInitialWeightImbalance(partition, balance);
+      PopulateEdgePartitionConnections(*partition);
+      *cost = RecomputeCurrentCost();
+      if (!fixed) {
+        // Refinement may still find a balanced partition, which is checked
+        // at the end of the run.
+        LogPrintf("Warning initial partition exceeds weight imbalance maximum!\n");
+      }
     }
   }
 }
@@ -1209,13 +1894,13 @@ void PartitionEngineKlfm::GenerateInitialPartitionRandom(
       }
     }
     if (current_balance[choose_resource] >= 0) {
-      partition->second.insert(it);
+      partition->Assign(hypergraph_.NodeIndex(it), false);
       for (size_t i = 0; i < node_weights.size(); i++) {
         part_b_current_weight[i] += node_weights[i];
         current_balance[i] -= node_weights[i];
       }
     } else {
-      partition->first.insert(it);
+      partition->Assign(hypergraph_.NodeIndex(it), true);
       for (size_t i = 0; i < node_weights.size(); i++) {
         part_a_current_weight[i] += node_weights[i];
         current_balance[i] += node_weights[i];
@@ -1223,7 +1908,7 @@ void PartitionEngineKlfm::GenerateInitialPartitionRandom(
     }
   }
   *balance = current_balance;
-  assert(!partition->first.empty() && !partition->second.empty());
+  assert(partition->num_part_a() != 0 && partition->num_part_b() != 0);
 
   PopulateEdgePartitionConnections(*partition);
 
@@ -1274,11 +1959,10 @@ void PartitionEngineKlfm::GenerateInitialPartitionRandomEntropyAware(
         bool first_anchor = false;
         bool second_anchor = false;
         for (int anchor_node_id : edge->connection_ids()) {
-          if (partition->first.find(anchor_node_id) !=
-              partition->first.end()) {
+          int anchor_index = hypergraph_.NodeIndex(anchor_node_id);
+          if (partition->InPartA(anchor_index)) {
             first_anchor = true;
-          } else if (partition->second.find(anchor_node_id) !=
-                     partition->second.end()) {
+          } else if (partition->InPartB(anchor_index)) {
             second_anchor = true;
           }
         }
@@ -1320,13 +2004,13 @@ void PartitionEngineKlfm::GenerateInitialPartitionRandomEntropyAware(
 
     if (force_second ||
         (!force_first && current_balance[choose_resource] >= 0)) {
-      partition->second.insert(it);
+      partition->Assign(hypergraph_.NodeIndex(it), false);
       for (size_t i = 0; i < node_weights.size(); i++) {
         part_b_current_weight[i] += node_weights[i];
         current_balance[i] -= node_weights[i];
       }
     } else {
-      partition->first.insert(it);
+      partition->Assign(hypergraph_.NodeIndex(it), true);
       for (size_t i = 0; i < node_weights.size(); i++) {
         part_a_current_weight[i] += node_weights[i];
         current_balance[i] += node_weights[i];
@@ -1334,24 +2018,145 @@ void PartitionEngineKlfm::GenerateInitialPartitionRandomEntropyAware(
     }
   }
   *balance = current_balance;
-  assert(!partition->first.empty() && !partition->second.empty());
+  assert(partition->num_part_a() != 0 && partition->num_part_b() != 0);
 
   PopulateEdgePartitionConnections(*partition);
 
   // Get the initial cost.
   *cost = RecomputeCurrentCost();
 
-  cout << "Forced " << num_entropy_forced_placements << " placements based "
+  log_stream() << "Forced " << num_entropy_forced_placements << " placements based "
        << "on entropy.\n";
 }
 
-void PartitionEngineKlfm::FixInitialWeightImbalance(
-    NodePartitions* partition, vector<int>* part_a_current_weight,
-    vector<int>* part_b_current_weight, vector<int>* current_balance) {
-  // TODO implement.
-  assert_b(false) {
-    printf("Function not implemented\n");
+bool PartitionEngineKlfm::FixInitialWeightImbalance(
+    NodePartitions* partition, vector<int>* current_balance) {
+  const int num_nodes = hypergraph_.num_nodes();
+  const int num_nets = hypergraph_.num_nets();
+  vector<int> num_pins_in_part_a(num_nets);
+  for (int i = 0; i < num_nets; i++) {
+    num_pins_in_part_a[i] = NumPinsInPartA(i, *partition);
+  }
+  // The decrease in cut weight if the node at 'node_index' changes sides.
+  auto move_gain = [&](int node_index) {
+    bool in_part_a = partition->InPartA(node_index);
+    double gain = 0.0;
+    const int* nets_end = hypergraph_.NetsEnd(node_index);
+    for (const int* it = hypergraph_.NetsBegin(node_index); it != nets_end;
+         ++it) {
+      int num_pins = hypergraph_.PinsEnd(*it) - hypergraph_.PinsBegin(*it);
+      int num_in_a = num_pins_in_part_a[*it];
+      int num_in_a_after = num_in_a + (in_part_a ? -1 : 1);
+      bool cut = num_in_a != 0 && num_in_a != num_pins;
+      bool cut_after = num_in_a_after != 0 && num_in_a_after != num_pins;
+      gain += hypergraph_.net(*it)->Weight() * ((int)cut - (int)cut_after);
+    }
+    return gain;
+  };
+
+  // The queue is built once and updated as nodes move. 'gain' holds the
+  // current gain of every node, and a queue entry whose gain differs from it
+  // is stale: a fresh entry was pushed when the gain changed, whether it rose
+  // or dropped, so stale entries are skipped when they reach the top.
+  vector<double> gain(num_nodes);
+  priority_queue<pair<double,int>> candidates;
+  for (int i = 0; i < num_nodes; i++) {
+    gain[i] = move_gain(i);
+    candidates.push(make_pair(gain[i], i));
+  }
+  // Nodes that did not reduce the excess and nodes that have been moved are
+  // set aside. A move can change which side is too heavy for some resource,
+  // after which they may help, so they are queued again when the queue runs
+  // out if any node has moved since they were last queued.
+  vector<char> queued(num_nodes, true);
+  vector<int> set_aside;
+  bool moved_since_queued = false;
+  // The move after which each node's gain was last recomputed.
+  vector<int> last_update(num_nodes, -1);
+  int num_moves = 0;
+
+  double excess = ExcessWeightImbalance(*current_balance);
+  vector<int> new_balance(num_resources_per_node_);
+  while (excess > 0.0) {
+    if (candidates.empty()) {
+      if (!moved_since_queued) {
+        break;
+      }
+      for (int node_index : set_aside) {
+        queued[node_index] = true;
+        candidates.push(make_pair(gain[node_index], node_index));
+      }
+      set_aside.clear();
+      moved_since_queued = false;
+      continue;
+    }
+    pair<double,int> candidate = candidates.top();
+    candidates.pop();
+    int node_index = candidate.second;
+    if (!queued[node_index] || candidate.first != gain[node_index]) {
+      continue;
+    }
+    queued[node_index] = false;
+    set_aside.push_back(node_index);
+    bool from_part_a = partition->InPartA(node_index);
+    const vector<int>& weight =
+        hypergraph_.node(node_index)->SelectedWeightVector();
+    for (size_t i = 0; i < num_resources_per_node_; i++) {
+      new_balance[i] = current_balance->at(i) +
+                       (from_part_a ? -2 : 2) * weight[i];
+    }
+    double new_excess = ExcessWeightImbalance(new_balance);
+    if (new_excess >= excess) {
+      continue;
+    }
+    partition->Move(node_index);
+    current_balance->swap(new_balance);
+    new_balance.resize(num_resources_per_node_);
+    excess = new_excess;
+    moved_since_queued = true;
+    num_moves++;
+    const int* nets_end = hypergraph_.NetsEnd(node_index);
+    for (const int* it = hypergraph_.NetsBegin(node_index); it != nets_end;
+         ++it) {
+      num_pins_in_part_a[*it] += from_part_a ? -1 : 1;
+    }
+    // Only the nodes that share a net with the moved node can have a new
+    // gain.
+    for (const int* it = hypergraph_.NetsBegin(node_index); it != nets_end;
+         ++it) {
+      const int* pins_end = hypergraph_.PinsEnd(*it);
+      for (const int* pin = hypergraph_.PinsBegin(*it); pin != pins_end;
+           ++pin) {
+        if (last_update[*pin] == num_moves) {
+          continue;
+        }
+        last_update[*pin] = num_moves;
+        double new_gain = move_gain(*pin);
+        if (new_gain != gain[*pin]) {
+          gain[*pin] = new_gain;
+          if (queued[*pin]) {
+            candidates.push(make_pair(new_gain, *pin));
+          }
+        }
+      }
+    }
+  }
+  RUN_DEBUG(DEBUG_OPT_BALANCE_CHECK, 0) {
+    assert(*current_balance == RecomputeCurrentBalance(*partition));
   }
+  return excess == 0.0;
+}
+
+double PartitionEngineKlfm::ExcessWeightImbalance(
+    const vector<int>& current_balance) const {
+  double excess = 0.0;
+  for (size_t res_id = 0; res_id < num_resources_per_node_; res_id++) {
+    int over = abs(current_balance[res_id]) - max_weight_imbalance_[res_id];
+    if (options_.constrain_balance_by_resource[res_id] && over > 0) {
+      excess += (double)over / max(1, max_weight_imbalance_[res_id]);
+    }
+  }
+  return excess;
 }
 
 bool PartitionEngineKlfm::ExceedsMaxWeightImbalance(
@@ -1432,12 +2237,15 @@ double PartitionEngineKlfm::ComputeEdgeCost(const EdgeKlfm& edge) {
 
 void PartitionEngineKlfm::GetCutSet(const NodePartitions& partition,
                                     std::set<int>* cut_set) {
-  for (auto it : internal_edge_map_) {
-    const Edge* edge = it.second;
+  const int num_nets = hypergraph_.num_nets();
+  for (int net_index = 0; net_index < num_nets; net_index++) {
+    const Edge* edge = hypergraph_.net(net_index);
     int a_count = 0;
     int b_count = 0;
-    for (auto node_id : edge->connection_ids()) {
-      if (partition.first.count(node_id) != 0) {
+    const int* pins_end = hypergraph_.PinsEnd(net_index);
+    for (const int* pin = hypergraph_.PinsBegin(net_index); pin != pins_end;
+         ++pin) {
+      if (partition.InPartA(*pin)) {
         a_count++;
       } else {
         b_count++;
@@ -1452,12 +2260,15 @@ void PartitionEngineKlfm::GetCutSet(const NodePartitions& partition,
 
 void PartitionEngineKlfm::GetCutSetNames(
     const NodePartitions& partition, std::set<std::string>* cut_set) {
-  for (auto it : internal_edge_map_) {
-    const Edge* edge = it.second;
+  const int num_nets = hypergraph_.num_nets();
+  for (int net_index = 0; net_index < num_nets; net_index++) {
+    const Edge* edge = hypergraph_.net(net_index);
     int a_count = 0;
     int b_count = 0;
-    for (auto node_id : edge->connection_ids()) {
-      if (partition.first.count(node_id) != 0) {
+    const int* pins_end = hypergraph_.PinsEnd(net_index);
+    for (const int* pin = hypergraph_.PinsBegin(net_index); pin != pins_end;
+         ++pin) {
+      if (partition.InPartA(*pin)) {
         a_count++;
       } else {
         b_count++;
@@ -1476,16 +2287,18 @@ std::vector<int> PartitionEngineKlfm::RecomputeCurrentBalance(
     const NodePartitions& partition) {
   vector<int> balance;
   balance.assign(num_resources_per_node_, 0);
-  for (auto node_id : partition.first) {
-    Node* node = internal_node_map_.at(node_id);
-    for (size_t res = 0; res < num_resources_per_node_; res++) {
-      balance[res] += node->SelectedWeightVector()[res];
+  assert(partition.size() == hypergraph_.num_nodes());
+  const int num_nodes = hypergraph_.num_nodes();
+  for (int i = 0; i < num_nodes; i++) {
+    assert_b(partition.Contains(i)) {
+      printf("Node %d is not assigned to a partition.\n",
+             hypergraph_.node_id(i));
     }
-  }
-  for (auto node_id : partition.second) {
-    Node* node = internal_node_map_.at(node_id);
+    Node* node = hypergraph_.node(i);
+    const int sign = partition.InPartA(i) ? 1 : -1;
+    const vector<int>& weight_vector = node->SelectedWeightVector();
     for (size_t res = 0; res < num_resources_per_node_; res++) {
-      balance[res] -= node->SelectedWeightVector()[res];
+      balance[res] += sign * weight_vector[res];
     }
   }
   return balance;
@@ -1496,11 +2309,12 @@ std::vector<int> PartitionEngineKlfm::RecomputeCurrentBalanceAtBaseLevel(
   vector<int> balance;
   balance.assign(num_resources_per_node_, 0);
   map<int, Node*> first, second;
-  for (auto node_id : partition.first) {
-    first.insert(make_pair(node_id, internal_node_map_.at(node_id)));
-  }
-  for (auto node_id : partition.second) {
-    second.insert(make_pair(node_id, internal_node_map_.at(node_id)));
+  for (auto node_pair : internal_node_map_) {
+    if (partition.InPartA(hypergraph_.NodeIndex(node_pair.first))) {
+      first.insert(node_pair);
+    } else {
+      second.insert(node_pair);
+    }
   }
   bool base_level = false;
   while (!base_level) {
@@ -1565,27 +2379,26 @@ std::vector<int> PartitionEngineKlfm::RecomputeCurrentBalanceAtBaseLevel(
 void PartitionEngineKlfm::RebalanceImplementations(
     const NodePartitions& current_partition, vector<int>& partition_imbalance,
     bool use_imbalance, bool use_ratio) {
+  KlfmProfiler::ScopedTimer timer(&profiler_, KlfmProfiler::kSectionRebalance);
   // TODO : Once a resource's weight has reached zero, that resource cannot
   // be used again, as any change will result in balance exceeded.
   if (!(use_ratio || use_imbalance)) {
     return;
   }
-  vector<int> all_ids;
-  for (auto node_id : current_partition.first) {
-    all_ids.push_back(node_id);
-  }
-  for (auto node_id : current_partition.second) {
-    all_ids.push_back(node_id);
-  }
+  vector<int> all_indices =
+      current_partition.NodeIndices(NodePartitions::kPartA);
+  vector<int> part_b_indices =
+      current_partition.NodeIndices(NodePartitions::kPartB);
+  all_indices.insert(all_indices.end(), part_b_indices.begin(),
+                     part_b_indices.end());
   bool prev_exceeds = ExceedsMaxWeightImbalance(partition_imbalance);
-  shuffle(all_ids.begin(), all_ids.end(), random_engine_rebalance_);
+  shuffle(all_indices.begin(), all_indices.end(), random_engine_rebalance_);
   for (int pass = 0; pass < REBALANCE_PASSES; pass++) {
-    for (auto node_id : all_ids) {
+    for (auto node_index : all_indices) {
       vector<int> old_balance = partition_imbalance;
 
-      Node* node = internal_node_map_.at(node_id);
-      bool in_part_a =
-         current_partition.first.find(node_id) != current_partition.first.end();
+      Node* node = hypergraph_.node(node_index);
+      bool in_part_a = current_partition.InPartA(node_index);
       vector<int> prev_wv = node->SelectedWeightVector();
       int prev_wv_index = node->selected_weight_vector_index();
       node->SetWeightVectorToMinimizeImbalance(
@@ -1609,7 +2422,7 @@ void PartitionEngineKlfm::RebalanceImplementations(
         assert(!new_exceeds);
       } else {
         // If this becomes a performance issue, it could be removed.
-        gain_bucket_manager_->UpdateNodeImplementation(node);
+        gain_bucket_manager_->UpdateNodeImplementation(node, node_index);
       }
       prev_exceeds = new_exceeds;
 
@@ -1645,10 +2458,18 @@ void PartitionEngineKlfm::MutateImplementations(int mutation_rate) {
 void PartitionEngineKlfm::Options::Print(ostream& os) {
   os << "KLFM Options: " << endl;
   os << "Num Runs: " << num_runs << endl;
+  os << "Num Threads: " << num_threads << endl;
+  if (deadline_ms != 0) {
+    os << "Deadline (ms): " << deadline_ms << endl;
+  }
   os << "Cap Passes: " << (cap_passes ? "true" : "false") << endl;
   if (cap_passes) {
     os << "Max Passes: " << max_passes << endl;
   }
+  os << "Max Non-Improving Moves per Pass: " << max_non_improving_moves
+     << endl;
+  os << "Max Non-Improving Move Fraction per Pass: "
+     << max_non_improving_move_fraction << endl;
   os << "Number of Resources: " << num_resources_per_node << endl;
   os << "Maximum Imbalance: ";
   for (auto it : max_imbalance_fraction) {
@@ -1668,6 +2489,37 @@ void PartitionEngineKlfm::Options::Print(ostream& os) {
      << (use_adaptive_node_implementations ? "true" : "false") << endl;
   os << "Use Multilevel Constraint Relaxation: "
      << (use_multilevel_constraint_relaxation ? "true" : "false") << endl;
+  os << "Use Boundary Gain Buckets: "
+     << (use_boundary_gain_buckets ? "true" : "false") << endl;
+  os << "Multilevel: " << (multilevel ? "true" : "false") << endl;
+  if (multilevel) {
+    os << "Coarsen Max Levels: " << coarsen_max_levels << endl;
+    os << "Coarsen Target Num Nodes: " << coarsen_target_num_nodes << endl;
+    os << "Coarsen Target Ratio: " << coarsen_target_ratio << endl;
+    os << "Coarsening Hierarchy Pool Size: "
+       << coarsening_hierarchy_pool_size << endl;
+    os << "Coarsening Algorithm: ";
+    switch (coarsening_algorithm) {
+      case PartitionerConfig::kCoarsenHierarchalInterconnection:
+        os << "Hierarchal Interconnection";
+      break;
+      case PartitionerConfig::kCoarsenLabelPropagation:
+        os << "Label Propagation";
+      break;
+      default:
+        assert_b(false) {
+          printf("\nUnrecognized coarsening algorithm.\n");
+        }
+    }
+    os << endl;
+    os << "Coarsen Max Supernode Size: " << coarsen_max_supernode_size << endl;
+    os << "Coarsen Neighbor Limit: " << coarsen_neighbor_limit << endl;
+    os << "Coarsen Label Propagation Iterations: "
+       << coarsen_label_propagation_iterations << endl;
+    os << "Coarsen Edge Degree Max: " << coarsen_edge_degree_max << endl;
+  }
+  os << "Max Passes at Coarse Levels: " << max_passes_coarse_level << endl;
+  os << "Max Passes at Base Level: " << max_passes_base_level << endl;
   os << "Gain Bucket Type: ";
   switch (gain_bucket_type) {
     case PartitionerConfig::kGainBucketSingleResource:
@@ -1723,6 +2575,24 @@ void PartitionEngineKlfm::Options::Print(ostream& os) {
     }
   }
   os << endl;
+  os << "Gain Bucket Storage: ";
+  switch (gain_bucket_storage) {
+    case PartitionerConfig::kGainBucketStorageList:
+      os << "List";
+    break;
+    case PartitionerConfig::kGainBucketStorageArray:
+      os << "Array";
+    break;
+    case PartitionerConfig::kGainBucketStorageHeap:
+      os << "Heap";
+    break;
+    default:
+      assert_b(false) {
+        printf("\nUnrecognized gain bucket storage.\n");
+      }
+  }
+  os << endl;
+  os << "Gain Bucket Search Depth: " << gain_bucket_search_depth << endl;
   os << "Restrict Supernodes to Default Implementation: "
      << (restrict_supernodes_to_default_implementation ? "true" : "false")
      << endl;
@@ -1755,6 +2625,8 @@ void PartitionEngineKlfm::Options::PopulateFromPartitionerConfig(
   num_resources_per_node = config.device_resource_capacities.size();
   gain_bucket_type = config.gain_bucket_type;
   gain_bucket_selection_policy = config.gain_bucket_selection_policy;
+  gain_bucket_storage = config.gain_bucket_storage;
+  gain_bucket_search_depth = config.gain_bucket_search_depth;
   max_imbalance_fraction.clear();
   for (auto frac : config.device_resource_max_imbalances) {
     max_imbalance_fraction.push_back(frac);
@@ -1788,6 +2660,21 @@ void PartitionEngineKlfm::Options::PopulateFromPartitionerConfig(
   assert(resource_ratio_weights.size() == num_resources_per_node);
   use_multilevel_constraint_relaxation =
       config.use_multilevel_constraint_relaxation;
+  use_boundary_gain_buckets = config.use_boundary_gain_buckets;
+  coarsen_max_levels = config.multilevel_max_levels;
+  coarsen_target_num_nodes = config.multilevel_target_num_nodes;
+  coarsen_target_ratio = config.multilevel_target_ratio;
+  max_passes_coarse_level = config.multilevel_coarse_level_max_passes;
+  max_passes_base_level = config.multilevel_base_level_max_passes;
+  coarsening_hierarchy_pool_size = config.multilevel_hierarchy_pool_size;
+  coarsening_algorithm = config.coarsening_algorithm;
+  coarsen_max_supernode_size = config.multilevel_max_supernode_size;
+  coarsen_neighbor_limit = config.multilevel_neighbor_limit;
+  coarsen_label_propagation_iterations =
+      config.multilevel_label_propagation_iterations;
+  coarsen_edge_degree_max = config.multilevel_max_edge_degree;
+  max_non_improving_moves = config.max_non_improving_moves;
+  max_non_improving_move_fraction = config.max_non_improving_move_fraction;
   use_adaptive_node_implementations = config.use_adaptive_node_implementations;
   use_ratio_in_imbalance_score = config.use_ratio_in_imbalance_score;
   use_ratio_in_partition_quality = config.use_ratio_in_partition_quality;
@@ -1837,6 +2724,7 @@ void PartitionEngineKlfm::CoarsenMaxNodeDegree(
     start_it = one_past_end_it;
   }
 
+  vector<NodeIdSet> groups;
   for (auto id_degree_pair : node_id_degree_pairs) {
     int main_node_id = id_degree_pair.first;
     auto mn_it = valid_node_ids.find(main_node_id);
@@ -1864,15 +2752,12 @@ void PartitionEngineKlfm::CoarsenMaxNodeDegree(
         }
       }
       if (found_nodes != 1) {
-        MakeSupernode(
-            nodes_in_supernode, &internal_node_map_, &internal_edge_map_, NULL);
+        groups.push_back(nodes_in_supernode);
       }
-      // Note: It might make sense to update the degrees here for nodes that
-      // touched more than one of the nodes that went into the supernode,
-      // however, because supernode formation does not consolidate edges, the
-      // degrees should be unchanged.
     }
   }
+  vector<int> supernode_ids;
+  ContractLevel(groups, &supernode_ids);
 }
 
 // TODO - SIGSEGV occurs in gain bucket add when this coarsening method is used.
@@ -1901,6 +2786,7 @@ void PartitionEngineKlfm::CoarsenNeighborhoodInterconnection(
     start_it = one_past_end_it;
   }
 
+  vector<NodeIdSet> groups;
   for (auto id_degree_pair : node_id_degree_pairs) {
     int seed_node_id = id_degree_pair.first;
     auto seed_available_it = available_node_ids.find(seed_node_id);
@@ -1993,14 +2879,16 @@ void PartitionEngineKlfm::CoarsenNeighborhoodInterconnection(
       }
     }
     if (supernode_membership_count > 1) {
-      MakeSupernode(
-          nodes_in_supernode, &internal_node_map_, &internal_edge_map_, NULL);
+      groups.push_back(nodes_in_supernode);
     }
   }
+  vector<int> supernode_ids;
+  ContractLevel(groups, &supernode_ids);
 }
 
 void PartitionEngineKlfm::CoarsenHierarchalInterconnection(
-    int max_nodes_per_supernode, int neighbor_limit) {
+    int max_nodes_per_supernode, int neighbor_limit,
+    CoarseningLevel* recorded_level) {
   assert(neighbor_limit >= 0);
   assert(max_nodes_per_supernode > 0);
 
@@ -2022,15 +2910,23 @@ void PartitionEngineKlfm::CoarsenHierarchalInterconnection(
   unordered_set<int> finalized_supernode_indices;
   unordered_set<int> non_finalized_supernode_indices;
 
+  // The nodes are indexed in random order, which determines the order in
+  // which they are scanned. Otherwise every run would coarsen the same graph
+  // identically.
+  vector<int> node_ids;
+  for (auto node_pair : internal_node_map_) {
+    node_ids.push_back(node_pair.first);
+  }
+  shuffle(node_ids.begin(), node_ids.end(), random_engine_coarsen_);
   supernode_id_sets.resize(internal_node_map_.size());
   int insert_index = 0;
-  for (auto node_pair : internal_node_map_) {
-    supernode_id_sets.at(insert_index).insert(node_pair.first);
+  for (auto node_id : node_ids) {
+    supernode_id_sets.at(insert_index).insert(node_id);
     /*
     node_id_to_current_supernode_index.insert(
-        make_pair(node_pair.first, insert_index));
+        make_pair(node_id, insert_index));
         */
-    node_id_to_current_supernode_index_v[node_pair.first] = insert_index;
+    node_id_to_current_supernode_index_v[node_id] = insert_index;
     insert_index++;
   }
   supernode_indices_is_finalized.assign(supernode_id_sets.size(), false);
@@ -2091,7 +2987,7 @@ void PartitionEngineKlfm::CoarsenHierarchalInterconnection(
           for (auto& port_pair : neighbor_node->ports()) {
             Edge* edge =
                 internal_edge_map_.at(port_pair.second.external_edge_id);
-            if (edge->degree() < coarsen_edge_degree_max_) {
+            if (edge->degree() < options_.coarsen_edge_degree_max) {
               for (auto connected_node_id : edge->connection_ids()) {
                 int connected_index =
                     node_id_to_current_supernode_index_v.at(connected_node_id);
@@ -2147,12 +3043,505 @@ void PartitionEngineKlfm::CoarsenHierarchalInterconnection(
   }
 
   VLOG(0) << finalized_supernode_indices.size() << " finalized sets." << endl;
+  vector<NodeIdSet> groups;
   for (auto sn_index : finalized_supernode_indices) {
     set<int>& sn_set = supernode_id_sets.at(sn_index);
     if (sn_set.size() > 1) {
-      MakeSupernode(sn_set, &internal_node_map_, &internal_edge_map_, NULL);
+      groups.push_back(sn_set);
+    }
+  }
+  vector<int> supernode_ids;
+  ContractLevel(groups, &supernode_ids);
+  if (recorded_level != NULL) {
+    recorded_level->groups.insert(
+        recorded_level->groups.end(), groups.begin(), groups.end());
+    recorded_level->supernode_ids.insert(
+        recorded_level->supernode_ids.end(), supernode_ids.begin(),
+        supernode_ids.end());
+  }
+}
+
+void PartitionEngineKlfm::CoarsenLabelPropagation(
+    int max_nodes_per_supernode, int max_iterations,
+    CoarseningLevel* recorded_level) {
+  assert(max_nodes_per_supernode > 0);
+  const int num_nodes = hypergraph_.num_nodes();
+  if (num_nodes == 0) {
+    return;
+  }
+
+  // Each node starts in its own cluster, labeled by its node index.
+  vector<atomic<int>> cluster(num_nodes);
+  vector<atomic<int>> cluster_size(num_nodes);
+  vector<int> node_order(num_nodes);
+  for (int i = 0; i < num_nodes; i++) {
+    cluster[i].store(i);
+    cluster_size[i].store(1);
+    node_order[i] = i;
+  }
+
+  size_t num_threads = is_parallel_worker_ ? 1 : options_.num_threads;
+  num_threads = max<size_t>(1, min<size_t>(num_threads, num_nodes));
+  // Each thread keeps its score array for all rounds and levels. The arrays
+  // are left zeroed by PropagateLabels, so they only need to grow.
+  if (label_propagation_scores_.size() < num_threads) {
+    label_propagation_scores_.resize(num_threads);
+  }
+  for (size_t t = 0; t < num_threads; t++) {
+    if (label_propagation_scores_[t].size() < (size_t)num_nodes) {
+      label_propagation_scores_[t].resize(num_nodes, 0.0);
+    }
+  }
+  for (int iteration = 0; iteration < max_iterations; iteration++) {
+    shuffle(node_order.begin(), node_order.end(), random_engine_coarsen_);
+    atomic<int> num_moves(0);
+    if (num_threads == 1) {
+      PropagateLabels(node_order, 0, num_nodes, max_nodes_per_supernode,
+                      &cluster, &cluster_size, &num_moves,
+                      &label_propagation_scores_[0]);
+    } else {
+      vector<thread> threads;
+      for (size_t t = 0; t < num_threads; t++) {
+        size_t begin = t * num_nodes / num_threads;
+        size_t end = (t + 1) * num_nodes / num_threads;
+        vector<double>* cluster_score = &label_propagation_scores_[t];
+        threads.emplace_back([this, &node_order, begin, end,
+                              max_nodes_per_supernode, &cluster,
+                              &cluster_size, &num_moves, cluster_score]() {
+          PropagateLabels(node_order, begin, end, max_nodes_per_supernode,
+                          &cluster, &cluster_size, &num_moves, cluster_score);
+        });
+      }
+      for (auto& propagation_thread : threads) {
+        propagation_thread.join();
+      }
+    }
+    VLOG(2) << "Label propagation iteration " << iteration << " moved "
+            << num_moves.load() << " nodes." << endl;
+    if (num_moves.load() == 0) {
+      break;
+    }
+  }
+
+  // Group the nodes by cluster with a counting sort over the cluster labels.
+  vector<int> cluster_offsets(num_nodes + 1, 0);
+  for (int i = 0; i < num_nodes; i++) {
+    cluster_offsets[cluster[i].load() + 1]++;
+  }
+  for (int c = 0; c < num_nodes; c++) {
+    cluster_offsets[c + 1] += cluster_offsets[c];
+  }
+  vector<int> clustered_node_ids(num_nodes);
+  vector<int> insert_offsets(cluster_offsets.begin(), cluster_offsets.end() - 1);
+  for (int i = 0; i < num_nodes; i++) {
+    clustered_node_ids[insert_offsets[cluster[i].load()]++] =
+        hypergraph_.node_id(i);
+  }
+
+  vector<NodeIdSet> groups;
+  for (int c = 0; c < num_nodes; c++) {
+    if (cluster_offsets[c + 1] - cluster_offsets[c] > 1) {
+      groups.push_back(
+          NodeIdSet(clustered_node_ids.begin() + cluster_offsets[c],
+                    clustered_node_ids.begin() + cluster_offsets[c + 1]));
+    }
+  }
+  vector<int> supernode_ids;
+  ContractLevel(groups, &supernode_ids);
+  if (recorded_level != NULL) {
+    recorded_level->groups.insert(
+        recorded_level->groups.end(), groups.begin(), groups.end());
+    recorded_level->supernode_ids.insert(
+        recorded_level->supernode_ids.end(), supernode_ids.begin(),
+        supernode_ids.end());
+  }
+  VLOG(2) << groups.size() << " supernodes made by label propagation."
+          << endl;
+}
+
+void PartitionEngineKlfm::PropagateLabels(
+    const vector<int>& node_order, size_t begin, size_t end,
+    int max_nodes_per_supernode, vector<atomic<int>>* cluster,
+    vector<atomic<int>>* cluster_size, atomic<int>* num_moves,
+    vector<double>* cluster_score_ptr) const {
+  // Connection scores are accumulated in a dense array indexed by cluster
+  // label. The labels that were touched are tracked so that only those
+  // entries need to be cleared.
+  vector<double>& cluster_score = *cluster_score_ptr;
+  assert(cluster_score.size() >= cluster->size());
+  vector<int> touched_clusters;
+  int moves = 0;
+  for (size_t i = begin; i < end; i++) {
+    const int node_index = node_order[i];
+    const int own_cluster = (*cluster)[node_index].load(memory_order_relaxed);
+    const int* nets_end = hypergraph_.NetsEnd(node_index);
+    for (const int* net_it = hypergraph_.NetsBegin(node_index);
+         net_it != nets_end; ++net_it) {
+      const int* pins_begin = hypergraph_.PinsBegin(*net_it);
+      const int* pins_end = hypergraph_.PinsEnd(*net_it);
+      const int degree = pins_end - pins_begin;
+      if (degree < 2 || degree >= options_.coarsen_edge_degree_max) {
+        continue;
+      }
+      // Spread the weight of the edge across the other nodes it connects.
+      const double weight = hypergraph_.net(*net_it)->Weight() / (degree - 1);
+      for (const int* pin = pins_begin; pin != pins_end; ++pin) {
+        if (*pin != node_index) {
+          int pin_cluster = (*cluster)[*pin].load(memory_order_relaxed);
+          if (cluster_score[pin_cluster] == 0.0) {
+            touched_clusters.push_back(pin_cluster);
+          }
+          cluster_score[pin_cluster] += weight;
+        }
+      }
+    }
+
+    int best_cluster = own_cluster;
+    double best_score = cluster_score[own_cluster];
+    for (auto candidate : touched_clusters) {
+      if (candidate != own_cluster && cluster_score[candidate] > best_score &&
+          (*cluster_size)[candidate].load(memory_order_relaxed) <
+              max_nodes_per_supernode) {
+        best_cluster = candidate;
+        best_score = cluster_score[candidate];
+      }
+    }
+    for (auto touched : touched_clusters) {
+      cluster_score[touched] = 0.0;
+    }
+    touched_clusters.clear();
+
+    if (best_cluster != own_cluster) {
+      // Another thread may have filled the cluster since its size was read.
+      if ((*cluster_size)[best_cluster].fetch_add(1) <
+          max_nodes_per_supernode) {
+        (*cluster_size)[own_cluster].fetch_sub(1);
+        (*cluster)[node_index].store(best_cluster, memory_order_relaxed);
+        moves++;
+      } else {
+        (*cluster_size)[best_cluster].fetch_sub(1);
+      }
+    }
+  }
+  num_moves->fetch_add(moves);
+}
+
+int PartitionEngineKlfm::CoarsenMultilevel() {
+  if (!options_.multilevel) {
+    return 0;
+  }
+  CoarseningHierarchy* recorded_hierarchy = NULL;
+  if (options_.coarsening_hierarchy_pool_size != 0) {
+    size_t pool_index = num_coarsening_hierarchy_uses_ %
+                        options_.coarsening_hierarchy_pool_size;
+    num_coarsening_hierarchy_uses_++;
+    if (pool_index < coarsening_hierarchy_pool_.size()) {
+      return ReplayCoarseningHierarchy(
+          coarsening_hierarchy_pool_.at(pool_index));
+    }
+    coarsening_hierarchy_pool_.push_back(CoarseningHierarchy());
+    recorded_hierarchy = &coarsening_hierarchy_pool_.back();
+  }
+
+  const size_t base_num_nodes = internal_node_map_.size();
+  int num_levels = 0;
+  while ((size_t)num_levels < options_.coarsen_max_levels) {
+    // The levels made so far are enough to partition, so coarsening stops
+    // there. No further runs start after the deadline, so a hierarchy that
+    // is cut short is never replayed.
+    if (DeadlineExpired()) {
+      VLOG(1) << "Deadline expired. Stopping coarsening at level "
+              << num_levels << "." << endl;
+      run_truncated_ = true;
+      break;
+    }
+    size_t num_nodes = internal_node_map_.size();
+    if (options_.coarsen_target_num_nodes != 0 &&
+        num_nodes <= options_.coarsen_target_num_nodes) {
+      break;
+    }
+    if (options_.coarsen_target_ratio > 0.0 &&
+        num_nodes <= options_.coarsen_target_ratio * base_num_nodes) {
+      break;
+    }
+    //CoarsenSimple(4);
+    //CoarsenMaxNodeDegree(4);
+    //CoarsenNeighborhoodInterconnection(16, 0);
+    CoarseningLevel* recorded_level = NULL;
+    if (recorded_hierarchy != NULL) {
+      recorded_hierarchy->push_back(CoarseningLevel());
+      recorded_level = &recorded_hierarchy->back();
+    }
+    switch (options_.coarsening_algorithm) {
+      case PartitionerConfig::kCoarsenHierarchalInterconnection:
+        CoarsenHierarchalInterconnection(options_.coarsen_max_supernode_size,
+                                         options_.coarsen_neighbor_limit,
+                                         recorded_level);
+      break;
+      case PartitionerConfig::kCoarsenLabelPropagation:
+        CoarsenLabelPropagation(options_.coarsen_max_supernode_size,
+                                options_.coarsen_label_propagation_iterations,
+                                recorded_level);
+      break;
+      default:
+        assert_b(false) {
+          printf("Unrecognized coarsening algorithm.\n");
+        }
+    }
+    if (internal_node_map_.size() == num_nodes) {
+      // Nothing was merged, so further coarsening is pointless.
+      if (recorded_hierarchy != NULL) {
+        recorded_hierarchy->pop_back();
+      }
+      break;
+    }
+    if (recorded_level != NULL) {
+      RecordContraction(recorded_level);
+    }
+    num_levels++;
+    VLOG(1) << "Coarsened level " << num_levels << " from " << num_nodes
+            << " to " << internal_node_map_.size() << " nodes." << endl;
+  }
+  return num_levels;
+}
+
+int PartitionEngineKlfm::ReplayCoarseningHierarchy(
+    const CoarseningHierarchy& hierarchy) {
+  // Supernodes are given new IDs each time they are made, so members that
+  // were supernodes when the hierarchy was recorded must be translated.
+  // Once a level has to be contracted again from its groups, its supernodes
+  // may differ from the recorded ones, so the levels above it are too.
+  unordered_map<int,int> current_id_by_recorded_id;
+  bool use_recorded_contractions = true;
+  int num_levels = 0;
+  for (auto& level : hierarchy) {
+    if (DeadlineExpired()) {
+      VLOG(1) << "Deadline expired. Stopping replay at level " << num_levels
+              << "." << endl;
+      run_truncated_ = true;
+      break;
+    }
+    size_t pre_replay_size = internal_node_map_.size();
+    if (use_recorded_contractions &&
+        ReplayRecordedContraction(level, &current_id_by_recorded_id)) {
+      num_levels++;
+      VLOG(1) << "Replayed recorded coarsening level from " << pre_replay_size
+              << " to " << internal_node_map_.size() << " nodes." << endl;
+      continue;
+    }
+    use_recorded_contractions = false;
+    // Under a seed partition, the members of a group that were left out of
+    // its supernode when the level was recorded may have been merged into a
+    // supernode in this replay, or the other way around, and a recorded
+    // supernode may now be represented by a node that another group names
+    // directly. Members that are no longer in the graph or already belong to
+    // a group are skipped, along with groups that have no members left,
+    // whose recorded IDs are mapped to -1.
+    vector<NodeIdSet> groups;
+    vector<int> recorded_supernode_ids;
+    vector<char> is_grouped(hypergraph_.num_nodes(), false);
+    for (size_t i = 0; i < level.groups.size(); i++) {
+      NodeIdSet group;
+      for (auto recorded_id : level.groups[i]) {
+        int current_id = recorded_id;
+        auto id_it = current_id_by_recorded_id.find(recorded_id);
+        if (id_it != current_id_by_recorded_id.end()) {
+          current_id = id_it->second;
+        }
+        int node_index =
+            (current_id >= 0) ? hypergraph_.NodeIndex(current_id) : -1;
+        if (node_index >= 0 && !is_grouped[node_index]) {
+          is_grouped[node_index] = true;
+          group.insert(current_id);
+        }
+      }
+      if (group.empty()) {
+        current_id_by_recorded_id.insert(
+            make_pair(level.supernode_ids[i], -1));
+        continue;
+      }
+      groups.push_back(group);
+      recorded_supernode_ids.push_back(level.supernode_ids[i]);
+    }
+    vector<int> supernode_ids;
+    ContractLevel(groups, &supernode_ids);
+    for (size_t i = 0; i < groups.size(); i++) {
+      current_id_by_recorded_id.insert(
+          make_pair(recorded_supernode_ids[i], supernode_ids[i]));
+    }
+    num_levels++;
+    VLOG(1) << "Replayed coarsening level from " << pre_replay_size
+            << " to " << internal_node_map_.size() << " nodes." << endl;
+  }
+  return num_levels;
+}
+
+void PartitionEngineKlfm::RecordContraction(CoarseningLevel* recorded_level) {
+  if (seed_partition_.num_part_a() + seed_partition_.num_part_b() != 0) {
+    // The supernodes hold only the part of each group on one side of this
+    // run's seed partition.
+    return;
+  }
+  const ContractedLevel& level = contracted_levels_.back();
+  size_t supernode_num = 0;
+  for (size_t i = 0; i < recorded_level->groups.size(); i++) {
+    if (recorded_level->groups[i].size() == 1) {
+      continue;
+    }
+    const Node* supernode = level.supernodes.at(supernode_num++);
+    assert(supernode->id == recorded_level->supernode_ids[i]);
+    recorded_level->supernodes.push_back(RecordedSupernode{
+        i, supernode->WeightVectors(),
+        supernode->internal_node_weight_vector_indices()});
+  }
+  assert(supernode_num == level.supernodes.size());
+  for (auto edge_pair : internal_edge_map_) {
+    auto fine_it = level.fine_edge_map.find(edge_pair.first);
+    if (fine_it != level.fine_edge_map.end() &&
+        fine_it->second == edge_pair.second) {
+      recorded_level->shared_edge_ids.push_back(edge_pair.first);
+    }
+  }
+  for (const EdgeKlfm* contracted_edge : level.contracted_edges) {
+    recorded_level->contracted_edges.push_back(RecordedEdge{
+        contracted_edge->id_,
+        vector<int>(contracted_edge->connection_ids().begin(),
+                    contracted_edge->connection_ids().end())});
+  }
+  recorded_level->has_contraction = true;
+}
+
+bool PartitionEngineKlfm::ReplayRecordedContraction(
+    const CoarseningLevel& recorded_level,
+    unordered_map<int,int>* current_id_by_recorded_id) {
+  if (!recorded_level.has_contraction ||
+      seed_partition_.num_part_a() + seed_partition_.num_part_b() != 0) {
+    return false;
+  }
+  auto current_id = [current_id_by_recorded_id](int recorded_id) {
+    auto id_it = current_id_by_recorded_id->find(recorded_id);
+    return (id_it == current_id_by_recorded_id->end()) ?
+        recorded_id : id_it->second;
+  };
+  // The stored weight vectors are sums over the implementations the
+  // components had selected, which is what the first vector records.
+  for (auto& recorded_supernode : recorded_level.supernodes) {
+    for (auto& member : recorded_supernode.internal_indices[0]) {
+      int node_index = hypergraph_.NodeIndex(current_id(member.first));
+      assert(node_index >= 0);
+      if (hypergraph_.node(node_index)->selected_weight_vector_index() !=
+          member.second) {
+        return false;
+      }
+    }
+  }
+
+  const int num_fine_nodes = hypergraph_.num_nodes();
+  vector<int> coarse_node_ids(num_fine_nodes);
+  vector<char> is_merged(num_fine_nodes, false);
+  for (int i = 0; i < num_fine_nodes; i++) {
+    coarse_node_ids[i] = hypergraph_.node_id(i);
+  }
+  vector<Node*> supernodes;
+  vector<pair<int,int>> new_ids;
+  for (auto& recorded_supernode : recorded_level.supernodes) {
+    int supernode_id = IdManager::AcquireNodeId();
+    Node* supernode = new Node(supernode_id);
+    vector<vector<pair<int,int>>> internal_indices =
+        recorded_supernode.internal_indices;
+    for (auto& indices : internal_indices) {
+      for (auto& member : indices) {
+        member.first = current_id(member.first);
+      }
+    }
+    for (auto& member : internal_indices[0]) {
+      int node_index = hypergraph_.NodeIndex(member.first);
+      assert(!is_merged[node_index]);
+      supernode->internal_nodes().insert(
+          make_pair(member.first, hypergraph_.node(node_index)));
+      coarse_node_ids[node_index] = supernode_id;
+      is_merged[node_index] = true;
+    }
+    // The first weight vector is the components' selected total, so the
+    // total weights are unchanged.
+    supernode->SetSupernodeWeightVectors(recorded_supernode.weight_vectors,
+                                         internal_indices);
+    supernodes.push_back(supernode);
+    new_ids.push_back(make_pair(
+        recorded_level.supernode_ids[recorded_supernode.group_index],
+        supernode_id));
+  }
+  for (auto& id_pair : new_ids) {
+    current_id_by_recorded_id->insert(id_pair);
+  }
+
+  KlfmNodeMap coarse_node_map;
+  for (int i = 0; i < num_fine_nodes; i++) {
+    if (!is_merged[i]) {
+      coarse_node_map.insert(
+          make_pair(hypergraph_.node_id(i), hypergraph_.node(i)));
+    }
+  }
+  for (Node* supernode : supernodes) {
+    coarse_node_map.insert(make_pair(supernode->id, supernode));
+  }
+
+  // As in ContractLevel(), the edges are added in random order, which
+  // numbers the supernode ports differently in each replay. Entries past
+  // the shared edges refer to the contracted edges.
+  const size_t num_shared_edges = recorded_level.shared_edge_ids.size();
+  vector<size_t> edge_order(num_shared_edges +
+                            recorded_level.contracted_edges.size());
+  for (size_t i = 0; i < edge_order.size(); i++) {
+    edge_order[i] = i;
+  }
+  shuffle(edge_order.begin(), edge_order.end(), random_engine_coarsen_);
+  KlfmEdgeMap coarse_edge_map;
+  vector<EdgeKlfm*> contracted_edges;
+  vector<int> coarse_pins;
+  for (auto edge_num : edge_order) {
+    if (edge_num < num_shared_edges) {
+      int edge_id = recorded_level.shared_edge_ids[edge_num];
+      coarse_edge_map.insert(
+          make_pair(edge_id, internal_edge_map_.at(edge_id)));
+      continue;
+    }
+    const RecordedEdge& recorded_edge =
+        recorded_level.contracted_edges[edge_num - num_shared_edges];
+    const EdgeKlfm* edge = internal_edge_map_.at(recorded_edge.edge_id);
+    coarse_pins.clear();
+    for (auto recorded_id : recorded_edge.pin_ids) {
+      coarse_pins.push_back(current_id(recorded_id));
+    }
+    sort(coarse_pins.begin(), coarse_pins.end());
+    EdgeKlfm* contracted_edge = new EdgeKlfm(edge->id_, edge->name);
+    contracted_edge->SetEntropy(edge->Entropy());
+    contracted_edge->SetWidth(edge->Width());
+    for (auto coarse_id : coarse_pins) {
+      contracted_edge->AddConnection(coarse_id);
+      if (hypergraph_.NodeIndex(coarse_id) < 0) {
+        int port_id = contracted_edges.size();
+        coarse_node_map.at(coarse_id)->ports().insert(make_pair(port_id,
+            Port(port_id, edge->id_, edge->id_, Port::kDontCareType)));
+      }
     }
+    coarse_edge_map.insert(make_pair(edge->id_, contracted_edge));
+    contracted_edges.push_back(contracted_edge);
   }
+
+  PushContractedLevel(&coarse_node_map, &coarse_edge_map, &coarse_node_ids,
+                      &supernodes, &contracted_edges);
+  return true;
+}
+
+bool PartitionEngineKlfm::DeadlineExpired() {
+  return options_.deadline_ms != 0 &&
+         chrono::steady_clock::now() >= deadline_;
+}
+
+void PartitionEngineKlfm::SetMaxPasses(size_t max_passes) {
+  options_.cap_passes = (max_passes != 0);
+  options_.max_passes = max_passes;
 }
 
 void PartitionEngineKlfm::PrintWeightImbalanceFraction(
@@ -2168,7 +3557,7 @@ void PartitionEngineKlfm::PrintWeightImbalanceFraction(
 
 void PartitionEngineKlfm::CoarsenSimple(int num_nodes_per_supernode) {
   set<int> not_yet_processed_node_ids;
-  set<int> processed_node_ids;
+  vector<NodeIdSet> groups;
   for (auto node_pair : internal_node_map_) {
     not_yet_processed_node_ids.insert(node_pair.first);
   }
@@ -2197,135 +3586,250 @@ void PartitionEngineKlfm::CoarsenSimple(int num_nodes_per_supernode) {
     }
     for (auto id : component_nodes) {
       not_yet_processed_node_ids.erase(id);
-      processed_node_ids.insert(id);
     }
-    int supernode_id = MakeSupernode(
-        component_nodes, &internal_node_map_, &internal_edge_map_, NULL);
-    processed_node_ids.insert(supernode_id);
+    groups.push_back(component_nodes);
   }
+  vector<int> supernode_ids;
+  ContractLevel(groups, &supernode_ids);
 }
 
 void PartitionEngineKlfm::DecoarsenPartitions(
     NodePartitions* coarsened, NodePartitions* decoarsened) {
-  DecoarsenPartition(&(coarsened->first), &(decoarsened->first));
-  DecoarsenPartition(&(coarsened->second), &(decoarsened->second));
-  DeCoarsen();
+  decoarsened->Clear();
+  if (contracted_levels_.empty()) {
+    swap(*coarsened, *decoarsened);
+    return;
+  }
+  const ContractedLevel& level = contracted_levels_.back();
+  const int num_fine_nodes = level.fine_hypergraph.num_nodes();
+  decoarsened->Reset(num_fine_nodes);
+  for (int i = 0; i < num_fine_nodes; i++) {
+    int coarse_index = hypergraph_.NodeIndex(level.coarse_node_ids[i]);
+    assert(coarse_index >= 0);
+    decoarsened->Assign(i, coarsened->InPartA(coarse_index));
+  }
+  coarsened->Clear();
+  DiscardContractedLevel();
 }
 
-void PartitionEngineKlfm::DecoarsenPartition(
-    NodeIdSet* coarsened, NodeIdSet* decoarsened) {
-  for (auto node_id : *coarsened) {
-    Node* node = internal_node_map_.at(node_id);
-    if (node->is_supernode()) {
-      RUN_DEBUG(DEBUG_OPT_SUPERNODE_WEIGHT_VECTOR, 0) {
-        node->CheckSupernodeWeightVectorOrDie();
+void PartitionEngineKlfm::ContractLevel(
+    const vector<NodeIdSet>& groups, vector<int>* supernode_ids) {
+  const int num_fine_nodes = hypergraph_.num_nodes();
+  vector<int> coarse_node_ids(num_fine_nodes);
+  vector<char> is_merged(num_fine_nodes, false);
+  for (int i = 0; i < num_fine_nodes; i++) {
+    coarse_node_ids[i] = hypergraph_.node_id(i);
+  }
+
+  const bool respect_seed_partition =
+      seed_partition_.num_part_a() + seed_partition_.num_part_b() != 0;
+  vector<Node*> supernodes;
+  NodeIdSet seed_side_members;
+  for (auto& group : groups) {
+    assert(!group.empty());
+    const NodeIdSet* members = &group;
+    bool seed_side_is_a = false;
+    if (respect_seed_partition) {
+      // Members on the other side are left out rather than forming a second
+      // supernode, so that each group still has one representative.
+      size_t num_in_a = 0;
+      for (auto node_id : group) {
+        int node_index = hypergraph_.NodeIndex(node_id);
+        assert(seed_partition_.Contains(node_index));
+        num_in_a += seed_partition_.InPartA(node_index);
       }
-      for (auto internal_node_pair : node->internal_nodes()) {
-        decoarsened->insert(internal_node_pair.first);
+      seed_side_is_a = 2 * num_in_a >= group.size();
+      if (num_in_a != 0 && num_in_a != group.size()) {
+        seed_side_members.clear();
+        for (auto node_id : group) {
+          if (seed_partition_.InPartA(hypergraph_.NodeIndex(node_id)) ==
+              seed_side_is_a) {
+            seed_side_members.insert(seed_side_members.end(), node_id);
+          }
+        }
+        members = &seed_side_members;
       }
-    } else {
-      decoarsened->insert(node_id);
     }
+    if (members->size() == 1) {
+      // No need to make a supernode if only one node.
+      supernode_ids->push_back(*members->begin());
+      continue;
+    }
+    int supernode_id = IdManager::AcquireNodeId();
+    Node* supernode = new Node(supernode_id);
+    for (auto node_id : *members) {
+      int node_index = hypergraph_.NodeIndex(node_id);
+      assert(node_index >= 0 && !is_merged[node_index]);
+      supernode->internal_nodes().insert(
+          make_pair(node_id, hypergraph_.node(node_index)));
+      coarse_node_ids[node_index] = supernode_id;
+      is_merged[node_index] = true;
+    }
+    supernodes.push_back(supernode);
+    supernode_ids->push_back(supernode_id);
+  }
+  if (supernodes.empty()) {
+    return;
   }
-  coarsened->clear();
-}
 
-bool PartitionEngineKlfm::DeCoarsen() {
-  // De-coarsening will alter internal_node_map_, therefore we cannot directly
-  // iterate on it.
-  vector<int> unprocessed_node_ids;
-  for (auto it : internal_node_map_) {
-    unprocessed_node_ids.push_back(it.first);
+  // Set the Supernodes' weight vectors. Each depends only on the supernode's
+  // own members, so they are enumerated on several threads when the engine
+  // has them.
+  vector<vector<int>> default_weight_vectors(supernodes.size());
+  auto populate_weight_vectors =
+      [this, &supernodes, &default_weight_vectors](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      default_weight_vectors[i] = supernodes[i]->SelectedWeightVector();
+      supernodes[i]->PopulateSupernodeWeightVectors(
+          options_.restrict_supernodes_to_default_implementation,
+          options_.supernode_implementations_cap);
+      assert(!supernodes[i]->WeightVectors().empty());
+    }
+  };
+  size_t num_threads = is_parallel_worker_ ? 1 : options_.num_threads;
+  num_threads = max<size_t>(1, min<size_t>(num_threads, supernodes.size()));
+  if (num_threads == 1) {
+    populate_weight_vectors(0, supernodes.size());
+  } else {
+    vector<thread> threads;
+    for (size_t t = 0; t < num_threads; t++) {
+      threads.emplace_back(populate_weight_vectors,
+                           t * supernodes.size() / num_threads,
+                           (t + 1) * supernodes.size() / num_threads);
+    }
+    for (auto& populate_thread : threads) {
+      populate_thread.join();
+    }
   }
-  bool found_supernode = false;
-  for (auto node_id : unprocessed_node_ids) {
-    found_supernode |= ExpandSupernode(
-        node_id, &internal_node_map_, &internal_edge_map_, NULL);
+  for (size_t i = 0; i < supernodes.size(); i++) {
+    UpdateTotalWeightsForImplementationChange(
+        default_weight_vectors[i], supernodes[i]->SelectedWeightVector());
   }
-  return found_supernode;
-}
-
-int PartitionEngineKlfm::MakeSupernode(const NodeIdSet& component_nodes,
-    KlfmNodeMap* node_map, KlfmEdgeMap* edge_map, PortMap* port_map) {
 
-  int num_nodes = component_nodes.size();
-  assert(num_nodes != 0);
-  if (num_nodes == 1) {
-    // No need to make a supernode if only one node.
-    return *component_nodes.begin();
+  KlfmNodeMap coarse_node_map;
+  for (int i = 0; i < num_fine_nodes; i++) {
+    if (!is_merged[i]) {
+      coarse_node_map.insert(
+          make_pair(hypergraph_.node_id(i), hypergraph_.node(i)));
+    }
   }
-
-  int supernode_id = IdManager::AcquireNodeId();
-  Node* supernode = new Node(supernode_id);
-  ostringstream oss;
-
-  EdgeIdSet touching_edges;
-  for (auto node_id : component_nodes) {
-    // Make a set of all edges that touch the component nodes.
-    Node* node = node_map->at(node_id);
-    for (auto& port_pair : node->ports()) {
-      touching_edges.insert(port_pair.second.external_edge_id);
-    }
-  }
-  assert(!touching_edges.empty());
-
-  // Check if edges touching each component node are wholly internal to the
-  // supernode (i.e. do they only connect other component nodes)
-  EdgeIdSet supernode_internal_edges;
-  EdgeIdSet supernode_external_edges;
-  bool is_wholly_internal;
-  for (auto edge_id : touching_edges) {
-    is_wholly_internal = true;
-    Edge* edge = edge_map->at(edge_id);
-    for (auto cnx_id : edge->connection_ids()) {
-      if (component_nodes.count(cnx_id) == 0) {
-        supernode_external_edges.insert(edge_id);
-        is_wholly_internal = false;
-        break;
+  for (Node* supernode : supernodes) {
+    coarse_node_map.insert(make_pair(supernode->id, supernode));
+  }
+
+  // Edges that connect a supernode are replaced by an edge with the same ID
+  // that connects the supernode once. The supernode gets a port for each of
+  // them, numbered in the order the edges are contracted. Edges that are
+  // wholly internal to a supernode are dropped.
+  // The edges are visited in random order. The order of the ports decides
+  // ties during later coarsening, and ordering them by edge ID ties the
+  // clusters to the order of the input file, which gives noticeably worse
+  // cuts.
+  const int num_fine_nets = hypergraph_.num_nets();
+  vector<int> net_order(num_fine_nets);
+  for (int i = 0; i < num_fine_nets; i++) {
+    net_order[i] = i;
+  }
+  shuffle(net_order.begin(), net_order.end(), random_engine_coarsen_);
+  KlfmEdgeMap coarse_edge_map;
+  vector<EdgeKlfm*> contracted_edges;
+  vector<int> coarse_pins;
+  for (auto net_index : net_order) {
+    EdgeKlfm* edge = hypergraph_.net(net_index);
+    bool touches_supernode = false;
+    coarse_pins.clear();
+    const int* pins_end = hypergraph_.PinsEnd(net_index);
+    for (const int* pin = hypergraph_.PinsBegin(net_index); pin != pins_end;
+         ++pin) {
+      touches_supernode |= is_merged[*pin];
+      coarse_pins.push_back(coarse_node_ids[*pin]);
+    }
+    if (!touches_supernode) {
+      coarse_edge_map.insert(make_pair(edge->id_, edge));
+      continue;
+    }
+    sort(coarse_pins.begin(), coarse_pins.end());
+    coarse_pins.erase(unique(coarse_pins.begin(), coarse_pins.end()),
+                      coarse_pins.end());
+    if (coarse_pins.size() < 2) {
+      continue;
+    }
+    EdgeKlfm* contracted_edge = new EdgeKlfm(edge->id_, edge->name);
+    contracted_edge->SetEntropy(edge->Entropy());
+    contracted_edge->SetWidth(edge->Width());
+    for (auto coarse_id : coarse_pins) {
+      contracted_edge->AddConnection(coarse_id);
+      if (hypergraph_.NodeIndex(coarse_id) < 0) {
+        int port_id = contracted_edges.size();
+        coarse_node_map.at(coarse_id)->ports().insert(make_pair(port_id,
+            Port(port_id, edge->id_, edge->id_, Port::kDontCareType)));
       }
     }
-    if (is_wholly_internal) {
-      supernode_internal_edges.insert(edge_id);
+    coarse_edge_map.insert(make_pair(edge->id_, contracted_edge));
+    contracted_edges.push_back(contracted_edge);
+  }
+
+  PushContractedLevel(&coarse_node_map, &coarse_edge_map, &coarse_node_ids,
+                      &supernodes, &contracted_edges);
+
+  if (respect_seed_partition) {
+    const ContractedLevel& level = contracted_levels_.back();
+    // Every member of a supernode is on the supernode's side, so each coarse
+    // node takes the side of any fine node it represents.
+    NodePartitions coarse_seed_partition;
+    coarse_seed_partition.Reset(hypergraph_.num_nodes());
+    for (int i = 0; i < num_fine_nodes; i++) {
+      int coarse_index = hypergraph_.NodeIndex(level.coarse_node_ids[i]);
+      if (!coarse_seed_partition.Contains(coarse_index)) {
+        coarse_seed_partition.Assign(coarse_index,
+                                     seed_partition_.InPartA(i));
+      }
     }
+    swap(seed_partition_, coarse_seed_partition);
   }
+}
 
-  // Cut the edges that span the boundaries of the supernode, making a new
-  // edge with a new id to take its place in this node and moving the old
-  // edge into the supernode.
-  SplitSupernodeBoundaryEdges(supernode, component_nodes,
-      supernode_external_edges, node_map, edge_map, port_map);
-
-  // Move wholly internal edges from this node to the supernode.
-  for (auto sn_int_edge_id : supernode_internal_edges) {
-    Edge* sn_int_edge = edge_map->at(sn_int_edge_id);
-    supernode->internal_edges().insert(make_pair(sn_int_edge_id, sn_int_edge));
-    edge_map->erase(sn_int_edge_id);
-  }
-
-  // Move all component nodes to the supernode.
-  for (auto c_node_id : component_nodes) {
-    supernode->internal_nodes().insert(
-        make_pair(c_node_id, node_map->at(c_node_id)));
-    node_map->erase(c_node_id);
-  }
-
-  // Set the Supernode's weight vectors.
-  vector<int> default_weight_vector = supernode->SelectedWeightVector();
-  supernode->PopulateSupernodeWeightVectors(
-      total_weight_, options_.restrict_supernodes_to_default_implementation,
-      options_.supernode_implementations_cap);
-  vector<int> newly_selected_weight_vector = supernode->SelectedWeightVector();
-  UpdateTotalWeightsForImplementationChange(
-      default_weight_vector, newly_selected_weight_vector);
-  assert(!supernode->WeightVectors().empty());
-
-  // Supernode is finished. Insert it as one of the internal nodes.
-  node_map->insert(make_pair(supernode_id, supernode));
+void PartitionEngineKlfm::PushContractedLevel(
+    KlfmNodeMap* coarse_node_map, KlfmEdgeMap* coarse_edge_map,
+    vector<int>* coarse_node_ids, vector<Node*>* supernodes,
+    vector<EdgeKlfm*>* contracted_edges) {
+  contracted_levels_.push_back(ContractedLevel());
+  ContractedLevel& level = contracted_levels_.back();
+  level.fine_node_map.swap(internal_node_map_);
+  level.fine_edge_map.swap(internal_edge_map_);
+  swap(level.fine_hypergraph, hypergraph_);
+  level.coarse_node_ids.swap(*coarse_node_ids);
+  level.supernodes.swap(*supernodes);
+  level.contracted_edges.swap(*contracted_edges);
+  internal_node_map_.swap(*coarse_node_map);
+  internal_edge_map_.swap(*coarse_edge_map);
+  RebuildHypergraph();
+}
 
-  // Debug.
-  assert(supernode->is_supernode());
-  //assert(!supernode->ports().empty());
-  return supernode_id;
+void PartitionEngineKlfm::DiscardContractedLevel() {
+  assert(!contracted_levels_.empty());
+  ContractedLevel& level = contracted_levels_.back();
+  for (Node* supernode : level.supernodes) {
+    supernode->SetSupernodeInternalWeightVectors();
+    RUN_DEBUG(DEBUG_OPT_SUPERNODE_WEIGHT_VECTOR, 1) {
+      supernode->CheckSupernodeWeightVectorOrDie();
+    }
+    // The component nodes belong to the finer level.
+    supernode->internal_nodes().clear();
+    IdManager::ReleaseNodeId(supernode->id);
+    delete supernode;
+  }
+  for (EdgeKlfm* contracted_edge : level.contracted_edges) {
+    delete contracted_edge;
+  }
+  // The finer graph is unchanged since it was contracted, so its view can be
+  // restored instead of rebuilt.
+  internal_node_map_.swap(level.fine_node_map);
+  internal_edge_map_.swap(level.fine_edge_map);
+  swap(hypergraph_, level.fine_hypergraph);
+  contracted_levels_.pop_back();
+  pass_state_valid_ = false;
+  nodes_moved_this_pass_.clear();
 }
 
 void PartitionEngineKlfm::UpdateTotalWeightsForImplementationChange(
@@ -2345,170 +3849,6 @@ void PartitionEngineKlfm::UpdateTotalWeightsForImplementationChange(
   }
 }
 
-void PartitionEngineKlfm::SplitSupernodeBoundaryEdges(
-    Node* supernode, const NodeIdSet& component_nodes,
-    const EdgeIdSet& boundary_edges, KlfmNodeMap* node_map,
-    KlfmEdgeMap* edge_map, PortMap* port_map) {
-  int supernode_id = supernode->id;
-
-  for (auto edge_id : boundary_edges) {
-    // Move edge to supernode.
-    Edge* edge = edge_map->at(edge_id);
-    supernode->internal_edges().insert(make_pair(edge_id, edge));
-    edge_map->erase(edge_id);
-
-    // Make new edge.
-    int new_edge_id = IdManager::AcquireEdgeId();
-    EdgeKlfm* new_boundary_edge = new EdgeKlfm(
-        new_edge_id, edge->GenerateSplitEdgeName(new_edge_id));
-    new_boundary_edge->SetEntropy(edge->Entropy());
-    new_boundary_edge->SetWidth(edge->Width());
-    edge_map->insert(make_pair(new_edge_id, new_boundary_edge));
-    new_boundary_edge->AddConnection(supernode_id); 
-
-    // Create port inside supernode and update connection IDs.
-
-    // This vector contains the IDs of Nodes/Ports that will need to be updated
-    // to reflect the change in the ID of the edge that connects to them.
-    vector<int> entities_to_update;
-
-    // Transfer all nodes/ports not in the supernode from the old edge to the
-    // new.
-    vector<int> entities_to_remove_from_edge;
-
-    for (auto entity_id : edge->connection_ids()) {
-      // If the node/port is not one of the components that make up
-      // the new supernode, the edge connection to it must be split.
-      if (component_nodes.count(entity_id) == 0) {
-        new_boundary_edge->AddConnection(entity_id);
-        entities_to_update.push_back(entity_id);
-        entities_to_remove_from_edge.push_back(entity_id);
-      }
-    }
-
-    // This must not be done in the previous loop to avoid invalidating
-    // iterators.
-    for (auto removed_entity_id : entities_to_remove_from_edge) {
-      edge->RemoveConnection(removed_entity_id);
-    }
-
-    // Add supernode port as source for the part of the edge that is inside
-    // the supernode.
-    int new_port_id = IdManager::AcquireNodeId();
-    ostringstream port_oss;
-    port_oss << "Supernode_" << supernode_id << "_Port_" << new_port_id;
-    edge->AddConnection(new_port_id);
-    supernode->ports().insert(make_pair(new_port_id,
-        Port(new_port_id, edge_id, new_edge_id, Port::kDontCareType,
-              port_oss.str())));
-
-    // Replace references to the old edge id in all nodes/ports not in the
-    // supernode with reference to new edge.
-    for (auto outdated_entity_id : entities_to_update) {
-      if (node_map->count(outdated_entity_id) != 0) {
-        Node* outdated_node = node_map->at(outdated_entity_id);
-        outdated_node->SwapPortConnection(edge_id, new_edge_id);
-        //assert(!((edge_id == 4594) && (outdated_entity_id == 31719)));
-      } else if (port_map != NULL && port_map->count(outdated_entity_id) != 0) {
-        Port& p = port_map->at(outdated_entity_id);
-        p.internal_edge_id = new_edge_id;
-      } else {
-        printf("Internal error: Could not find entity that needs to be "
-               "updated.");
-        exit(1);
-      }
-    }
-  }
-}
-
-bool PartitionEngineKlfm::ExpandSupernode(
-    int supernode_id, KlfmNodeMap* node_map, KlfmEdgeMap* edge_map,
-    PortMap* port_map) {
-
-  // Check that 'supernode_id' represents a supernode.
-  Node* supernode = node_map->at(supernode_id);
-  if (!supernode->is_supernode()) {
-    // Not a supernode.
-    return false;
-  }
-
-  supernode->SetSupernodeInternalWeightVectors();
-  RUN_DEBUG(DEBUG_OPT_SUPERNODE_WEIGHT_VECTOR, 1) {
-    supernode->CheckSupernodeWeightVectorOrDie();
-  }
-
-  // Merge edges on the boundary of the supernode to the rest of the parent
-  // node'd internal graph.
-  MergeSupernodeBoundaryEdges(supernode, node_map, edge_map, port_map);
-
-  // Transfer supernode's internal graph member to parent node's internal graph.
-  for (auto entry : supernode->internal_nodes()) {
-    node_map->insert(make_pair(entry.first, entry.second));
-  }
-  supernode->internal_nodes().clear();
-  assert(supernode->internal_nodes().empty());
-  for (auto entry : supernode->internal_edges()) {
-    edge_map->insert(
-        make_pair(entry.first, reinterpret_cast<EdgeKlfm*>(entry.second)));
-  }
-  supernode->internal_edges().clear();
-  assert(supernode->internal_edges().empty());
-
-  // Remove supernode.
-  node_map->erase(supernode_id);
-  IdManager::ReleaseNodeId(supernode_id);
-  delete supernode;
-
-  return true;
-}
-
-void PartitionEngineKlfm::MergeSupernodeBoundaryEdges(
-    Node* supernode, KlfmNodeMap* node_map, KlfmEdgeMap* edge_map,
-    PortMap* port_map) {
-  // Iterate through all the ports on 'supernode', replacing all references
-  // to the port's external connection edge with the internal edge.
-
-  // Cycle through all the ports, merging edges on each port.
-  for (auto& supernode_port_pair : supernode->ports()) {
-    Port& supernode_port = supernode_port_pair.second;
-    Edge* external_edge = edge_map->at(supernode_port.external_edge_id);
-    Edge* internal_edge =
-        supernode->internal_edges().at(supernode_port.internal_edge_id);
-
-    // Remove reference to the supernode's port.
-    internal_edge->RemoveConnection(supernode_port.id);
-
-    // Transfer references to all of the external edge's connections to the
-    // internal edge and update the connecting nodes and ports with the
-    // internal edge's ID.
-    for (auto entity_id : external_edge->connection_ids()) {
-      if (entity_id != supernode->id) {
-        internal_edge->AddConnection(entity_id);
-        if (node_map->count(entity_id) != 0) {
-          node_map->at(entity_id)->SwapPortConnection(
-              external_edge->id_, internal_edge->id_);
-        } else if (port_map != NULL && port_map->count(entity_id) != 0) {
-          Port p = port_map->at(entity_id);
-          p.internal_edge_id = internal_edge->id_;
-        } else {
-          printf("Fatal error: Edge connection not found in internal nodes");
-          assert(false);
-        }
-      }
-    }
-
-    // TODO What if two supernodes are connected by this edge? Will it get
-    // deleted twice? Will something that shouldn't have been deleted get
-    // deleted?
-    // Remove external edge.
-    auto external_edge_it = edge_map->find(external_edge->id_);
-    if (external_edge_it != edge_map->end()) {
-      edge_map->erase(external_edge->id_);
-      delete external_edge;
-    }
-  }
-}
-
 void PartitionEngineKlfm::SummarizeResults(
     const vector<PartitionSummary>& summaries) {
   vector<double> passes;
@@ -2534,6 +3874,63 @@ void PartitionEngineKlfm::SummarizeResults(
     cost_span_ratios.push_back(costs.at(i) / spans.at(i));
   }
   SummarizeResultMetric(cost_span_ratios, "COST/SPAN", true);
+  if (options_.deadline_ms != 0) {
+    int num_truncated = 0;
+    for (auto& it : summaries) {
+      if (it.truncated) {
+        num_truncated++;
+      }
+    }
+    os_ << "RUNS COMPLETED: " << summaries.size() << "/" << options_.num_runs
+        << endl;
+    os_ << "RUNS TRUNCATED BY DEADLINE: " << num_truncated << endl;
+  }
+  int num_unbalanced = 0;
+  for (auto& it : summaries) {
+    if (!it.balanced) {
+      num_unbalanced++;
+    }
+  }
+  if (num_unbalanced != 0) {
+    os_ << "RUNS FAILED BY EXCEEDING MAXIMUM IMBALANCE: " << num_unbalanced
+        << endl;
+  }
+}
+
+void PartitionEngineKlfm::KeepBestRun(vector<PartitionSummary>* summaries) {
+  if (summaries->empty()) {
+    return;
+  }
+  auto max_imbalance = [](const PartitionSummary& summary) {
+    return summary.balance.empty() ?
+        0.0 : *max_element(summary.balance.begin(), summary.balance.end());
+  };
+  size_t best = 0;
+  for (size_t i = 1; i < summaries->size(); i++) {
+    const PartitionSummary& candidate = summaries->at(i);
+    const PartitionSummary& incumbent = summaries->at(best);
+    if (candidate.balanced != incumbent.balanced) {
+      if (candidate.balanced) {
+        best = i;
+      }
+    } else if (candidate.balanced) {
+      if (candidate.total_cost < incumbent.total_cost) {
+        best = i;
+      }
+    } else if (max_imbalance(candidate) < max_imbalance(incumbent)) {
+      best = i;
+    }
+  }
+  if (options_.enable_print_output) {
+    os_ << "Deadline expired. Returning the "
+        << (summaries->at(best).balanced ? "best balanced" :
+                                           "least imbalanced")
+        << " of " << summaries->size() << " runs. Cost: "
+        << summaries->at(best).total_cost << endl;
+  }
+  PartitionSummary best_summary = summaries->at(best);
+  summaries->clear();
+  summaries->push_back(best_summary);
 }
 
 void PartitionEngineKlfm::SummarizeResultMetric(
@@ -2572,6 +3969,12 @@ void PartitionEngineKlfm::PrintResultFull(const PartitionSummary& summary,
   os_ << endl << "----------------Run Summary------------------" << endl;
   os_ << "Run " << run_num << endl;
   os_ << "Passes: " << summary.num_passes_used << endl;
+  if (summary.truncated) {
+    os_ << "Truncated by deadline: true" << endl;
+  }
+  if (!summary.balanced) {
+    os_ << "FAILED: Exceeds maximum weight imbalance" << endl;
+  }
   os_ << "Cut cost: " << summary.total_cost << endl;
   os_ << "Cut span: " << summary.total_span << endl;
   os_ << "Cut entropy: " << summary.total_entropy << endl;
@@ -2660,13 +4063,16 @@ void PartitionEngineKlfm::WriteScipSol(const NodePartitions& partitions,
   ofstream of(filename_with_extension.c_str());
   assert(of.is_open());
 
+  NodeIdSet part_a_ids, part_b_ids;
+  PartitionToSets(partitions, &part_a_ids, &part_b_ids);
+
   // Use this instead of internal_node_map because we want to guarantee
   // order.
   set<int> combined_node_ids;
-  for (int id : partitions.first) {
+  for (int id : part_a_ids) {
     combined_node_ids.insert(id);
   }
-  for (int id : partitions.second) {
+  for (int id : part_b_ids) {
     combined_node_ids.insert(id);
   }
 
@@ -2677,7 +4083,7 @@ void PartitionEngineKlfm::WriteScipSol(const NodePartitions& partitions,
   for (int node_id : combined_node_ids) {
     of << "V" << mps_name_hash::Hash(node_id);
     char partition_id =
-        (partitions.first.find(node_id) != partitions.first.end()) ? 'A' : 'B';
+        (part_a_ids.find(node_id) != part_a_ids.end()) ? 'A' : 'B';
     of << partition_id;
     int personality_id =
         internal_node_map_.at(node_id)->selected_weight_vector_index();
@@ -2713,13 +4119,16 @@ void PartitionEngineKlfm::WriteScipSolAlt(const NodePartitions& partitions,
   ofstream of(filename_with_extension.c_str());
   assert(of.is_open());
 
+  NodeIdSet part_a_ids, part_b_ids;
+  PartitionToSets(partitions, &part_a_ids, &part_b_ids);
+
   // Use this instead of internal_node_map because we want to guarantee
   // order.
   set<int> combined_node_ids;
-  for (int id : partitions.first) {
+  for (int id : part_a_ids) {
     combined_node_ids.insert(id);
   }
-  for (int id : partitions.second) {
+  for (int id : part_b_ids) {
     combined_node_ids.insert(id);
   }
   set<int> combined_edge_ids;
@@ -2735,7 +4144,7 @@ void PartitionEngineKlfm::WriteScipSolAlt(const NodePartitions& partitions,
     Node* n = CHECK_NOTNULL(internal_node_map_.at(node_id));
     for (int part = 0; part < 2; ++part) {
       const NodeIdSet& this_partition = (part == 0) ?
-          partitions.first : partitions.second;
+          part_a_ids : part_b_ids;
       bool in_this_partition =
           this_partition.find(node_id) != this_partition.end();
       for (int per = 0; per < n->num_personalities(); ++per) {
@@ -2792,13 +4201,16 @@ void PartitionEngineKlfm::WriteGurobiMst(const NodePartitions& partitions,
   ofstream of(filename_with_extension.c_str());
   assert(of.is_open());
 
+  NodeIdSet part_a_ids, part_b_ids;
+  PartitionToSets(partitions, &part_a_ids, &part_b_ids);
+
   // Use this instead of internal_node_map because we want to guarantee
   // order.
   set<int> combined_node_ids;
-  for (int id : partitions.first) {
+  for (int id : part_a_ids) {
     combined_node_ids.insert(id);
   }
-  for (int id : partitions.second) {
+  for (int id : part_b_ids) {
     combined_node_ids.insert(id);
   }
 
@@ -2809,7 +4221,7 @@ void PartitionEngineKlfm::WriteGurobiMst(const NodePartitions& partitions,
     Node* n = CHECK_NOTNULL(internal_node_map_.at(node_id));
     for (int part = 0; part < 2; ++part) {
       const NodeIdSet& this_partition = (part == 0) ?
-          partitions.first : partitions.second;
+          part_a_ids : part_b_ids;
       bool in_this_partition =
           this_partition.find(node_id) != this_partition.end();
       for (int per = 0; per < n->num_personalities(); ++per) {
@@ -2854,3 +4266,248 @@ void PartitionEngineKlfm::WriteGurobiMst(const NodePartitions& partitions,
   }
 }
 
+void PartitionEngineKlfm::WriteNativePartition(
+    const NodePartitions& partitions, const std::string& base_filename) {
+  string filename_with_extension = base_filename + ".part";
+  ofstream of(filename_with_extension.c_str());
+  assert(of.is_open());
+
+  NodeIdSet part_a_ids, part_b_ids;
+  PartitionToSets(partitions, &part_a_ids, &part_b_ids);
+
+  of << "# node side implementation\n";
+  for (int part = 0; part < 2; ++part) {
+    const NodeIdSet& this_partition = (part == 0) ? part_a_ids : part_b_ids;
+    for (int node_id : this_partition) {
+      Node* n = CHECK_NOTNULL(internal_node_map_.at(node_id));
+      if (n->name.empty()) {
+        of << node_id;
+      } else {
+        of << n->name;
+      }
+      of << " " << (char)('A' + part) << " "
+         << n->selected_weight_vector_index() << "\n";
+    }
+  }
+}
+
+// SCIP and Gurobi solutions are read back through the node identity
+// variables, named V<hashed node ID><partition><personality>. Only the
+// variables that are set matter, so the sparse .SOL files written by
+// WriteScipSol() can be read as well. Native files name their nodes, and a
+// name that no node has is read as the ID of an unnamed node.
+void PartitionEngineKlfm::ReadInitialPartition(const std::string& filename) {
+  ifstream infile(filename.c_str());
+  assert_b(infile.is_open()) {
+    printf("Failed to open initial partition file '%s'.\n", filename.c_str());
+  }
+  bool is_solution = false;
+  size_t extension_pos = filename.rfind('.');
+  if (extension_pos != string::npos) {
+    string extension = filename.substr(extension_pos);
+    is_solution = (extension == ".sol" || extension == ".mst");
+  }
+  unordered_map<string,int> node_id_by_hash;
+  // Names shared by several nodes map to -1.
+  unordered_map<string,int> node_id_by_name;
+  for (auto node_pair : internal_node_map_) {
+    if (is_solution) {
+      node_id_by_hash.insert(
+          make_pair(mps_name_hash::Hash(node_pair.first), node_pair.first));
+    } else if (!node_pair.second->name.empty()) {
+      auto inserted = node_id_by_name.insert(
+          make_pair(node_pair.second->name, node_pair.first));
+      if (!inserted.second) {
+        inserted.first->second = -1;
+      }
+    }
+  }
+
+  options_.seed_mode = Options::kSeedModeUserSpecified;
+  options_.initial_a_nodes.clear();
+  options_.initial_b_nodes.clear();
+  // A few of the nodes that are not in the graph are named in the warning.
+  const size_t kMaxReportedNodes = 5;
+  vector<string> unknown_nodes;
+  size_t num_unknown_nodes = 0;
+  size_t num_ambiguous_nodes = 0;
+  string line;
+  while (getline(infile, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    istringstream line_stream(line);
+    int node_id = -1;
+    string node_name;
+    char side = 0;
+    int implementation = -1;
+    if (is_solution) {
+      string name;
+      double value = 0.0;
+      line_stream >> name >> value;
+      // Hashed IDs are written with lowercase letters and digits only.
+      size_t side_pos = name.find_first_of("AB", 1);
+      if (name.empty() || name[0] != 'V' || side_pos == string::npos ||
+          value < 0.5) {
+        continue;
+      }
+      node_name = name.substr(1, side_pos - 1);
+      auto hash_it = node_id_by_hash.find(node_name);
+      if (hash_it != node_id_by_hash.end()) {
+        node_id = hash_it->second;
+      }
+      side = name[side_pos];
+      implementation = atoi(name.c_str() + side_pos + 1);
+    } else {
+      line_stream >> node_name >> side;
+      assert_b(!line_stream.fail() && (side == 'A' || side == 'B')) {
+        printf("Malformed line in initial partition file '%s': %s\n",
+               filename.c_str(), line.c_str());
+      }
+      if (!(line_stream >> implementation)) {
+        implementation = -1;
+      }
+      auto name_it = node_id_by_name.find(node_name);
+      if (name_it != node_id_by_name.end()) {
+        node_id = name_it->second;
+        if (node_id < 0) {
+          num_ambiguous_nodes++;
+          continue;
+        }
+      } else if (node_name.find_first_not_of("0123456789") == string::npos) {
+        node_id = atoi(node_name.c_str());
+        auto id_it = internal_node_map_.find(node_id);
+        if (id_it != internal_node_map_.end() &&
+            !id_it->second->name.empty()) {
+          node_id = -1;
+        }
+      }
+    }
+    auto node_it = internal_node_map_.find(node_id);
+    if (node_it == internal_node_map_.end()) {
+      if (unknown_nodes.size() < kMaxReportedNodes) {
+        unknown_nodes.push_back(node_name);
+      }
+      num_unknown_nodes++;
+      continue;
+    }
+    NodeIdSet& this_partition =
+        (side == 'A') ? options_.initial_a_nodes : options_.initial_b_nodes;
+    const NodeIdSet& other_partition =
+        (side == 'A') ? options_.initial_b_nodes : options_.initial_a_nodes;
+    assert_b(other_partition.find(node_id) == other_partition.end()) {
+      printf("Node %d is in both partitions of initial partition file '%s'.\n",
+             node_id, filename.c_str());
+    }
+    this_partition.insert(node_id);
+    Node* node = node_it->second;
+    if (implementation >= 0 && implementation < node->num_personalities()) {
+      node->SetSelectedWeightVector(implementation);
+    }
+  }
+  if (num_unknown_nodes != 0) {
+    log_stream() << "WARNING: Ignored " << num_unknown_nodes
+                 << " nodes of the initial partition that are not in the "
+                 << "graph:";
+    for (auto& name : unknown_nodes) {
+      log_stream() << " " << name;
+    }
+    log_stream() << ((num_unknown_nodes > unknown_nodes.size()) ? " ..." : "")
+                 << endl;
+  }
+  if (num_ambiguous_nodes != 0) {
+    LogPrintf("WARNING: Ignored %lu nodes of the initial partition whose "
+              "names are shared by several nodes of the graph.\n",
+              num_ambiguous_nodes);
+  }
+  size_t num_unassigned_nodes = internal_node_map_.size() -
+      options_.initial_a_nodes.size() - options_.initial_b_nodes.size();
+  if (num_unassigned_nodes != 0) {
+    log_stream() << "WARNING: " << num_unassigned_nodes
+                 << " nodes are missing from the initial partition. Placing "
+                 << "them next to their neighbors:";
+    size_t num_reported = 0;
+    for (auto& node_pair : internal_node_map_) {
+      if (num_reported == kMaxReportedNodes) {
+        log_stream() << " ...";
+        break;
+      }
+      if (options_.initial_a_nodes.count(node_pair.first) == 0 &&
+          options_.initial_b_nodes.count(node_pair.first) == 0) {
+        log_stream() << " " << (node_pair.second->name.empty() ?
+                                    to_string(node_pair.first) :
+                                    node_pair.second->name);
+        num_reported++;
+      }
+    }
+    log_stream() << endl;
+    PlaceUnassignedInitialNodes();
+  }
+  VLOG(1) << "Read initial partition with " << options_.initial_a_nodes.size()
+          << " nodes in A and " << options_.initial_b_nodes.size()
+          << " nodes in B from " << filename << endl;
+}
+
+void PartitionEngineKlfm::PerturbSeedPartition(NodePartitions* partition) {
+  if (options_.initial_partition_perturbation <= 0.0) {
+    return;
+  }
+  vector<int> movable[2];
+  for (int i = 0; i < (int)partition->size(); i++) {
+    if (InRefinementRegion(i)) {
+      movable[partition->InPartA(i) ? 0 : 1].push_back(i);
+    }
+  }
+  size_t num_swaps = options_.initial_partition_perturbation *
+                     min(movable[0].size(), movable[1].size());
+  for (auto& side : movable) {
+    // Only the first 'num_swaps' positions need to be shuffled.
+    for (size_t i = 0; i < num_swaps; i++) {
+      uniform_int_distribution<size_t> distribution(i, side.size() - 1);
+      swap(side[i], side[distribution(random_engine_initial_)]);
+    }
+  }
+  for (size_t i = 0; i < num_swaps; i++) {
+    partition->Move(movable[0][i]);
+    partition->Move(movable[1][i]);
+  }
+  VLOG(1) << "Perturbed the initial partition by swapping " << num_swaps
+          << " pairs of nodes." << endl;
+}
+
+void PartitionEngineKlfm::PlaceUnassignedInitialNodes() {
+  NodeIdSet& part_a = options_.initial_a_nodes;
+  NodeIdSet& part_b = options_.initial_b_nodes;
+  // Nodes are placed in ID order, so that nodes placed earlier count as
+  // neighbors of those placed later.
+  map<int,Node*> unassigned_nodes;
+  for (auto node_pair : internal_node_map_) {
+    if (part_a.find(node_pair.first) == part_a.end() &&
+        part_b.find(node_pair.first) == part_b.end()) {
+      unassigned_nodes.insert(node_pair);
+    }
+  }
+  for (auto node_pair : unassigned_nodes) {
+    int num_neighbors_a = 0;
+    int num_neighbors_b = 0;
+    for (auto& port_pair : node_pair.second->ports()) {
+      auto edge_it = internal_edge_map_.find(port_pair.second.external_edge_id);
+      if (edge_it == internal_edge_map_.end()) {
+        continue;
+      }
+      for (auto cnx_id : edge_it->second->connection_ids()) {
+        num_neighbors_a += (part_a.find(cnx_id) != part_a.end());
+        num_neighbors_b += (part_b.find(cnx_id) != part_b.end());
+      }
+    }
+    // Ties go to the side with fewer nodes.
+    bool to_part_a = (num_neighbors_a != num_neighbors_b) ?
+        (num_neighbors_a > num_neighbors_b) : (part_a.size() <= part_b.size());
+    if (to_part_a) {
+      part_a.insert(node_pair.first);
+    } else {
+      part_b.insert(node_pair.first);
+    }
+  }
+}
+
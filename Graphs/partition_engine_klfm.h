@@ -2,19 +2,26 @@
 #define PARTITION_ENGINE_KLFM_H_
 
 /* Engine for performing Kernighan-Lin / Fiduccia-Mattheyes partitioning on a
-   graph/hypergraph. This class is NOT thread-safe. */
+   graph/hypergraph. This class is NOT thread-safe. If 'num_threads' is set
+   in its Options, Execute() internally spreads independent runs across
+   worker engines, each of which owns a private copy of the graph. */
 
 #include "partition_engine.h"
 
+#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <ctime>
 #include <iostream>
 #include <fstream>
 #include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <random>
 #include <set>
+#include <sstream>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -23,7 +30,12 @@
 #include "edge_klfm.h"
 #include "gain_bucket_entry.h"
 #include "gain_bucket_manager.h"
+#include "induced_subgraph.h"
+#include "klfm_hypergraph.h"
+#include "klfm_move_trace.h"
+#include "klfm_profiler.h"
 #include "node.h"
+#include "partition_side_array.h"
 #include "partitioner_config.h"
 
 class PartitionEngineKlfm : public PartitionEngine {
@@ -36,7 +48,10 @@ class PartitionEngineKlfm : public PartitionEngine {
   typedef Node::PortMap PortMap;
   typedef std::unordered_map<int, Node*> KlfmNodeMap;
   typedef std::unordered_map<int, EdgeKlfm*> KlfmEdgeMap;
-  typedef std::pair<NodeIdSet, NodeIdSet> NodePartitions;
+  // Partition sides are tracked in a dense array indexed by the node's index
+  // in 'hypergraph_'. std::set representations of node IDs are only used at
+  // the API boundary.
+  typedef PartitionSideArray NodePartitions;
   typedef std::pair<NodeIdVector, NodeIdVector> NodeVectorPair;
   typedef std::unordered_map<int, NodePartitions> NodePartitionsMap;
   typedef std::vector<std::pair<NodeIdSet, NodeIdSet>>
@@ -44,12 +59,31 @@ class PartitionEngineKlfm : public PartitionEngine {
   typedef std::map<int, NodeVectorPair> NodeVectorPairMap;
 
   PartitionEngineKlfm(Node* graph, Options& options, std::ostream& os);
+  // Takes ownership of 'graph' instead of copying it. Its nodes are moved
+  // into the engine and its edges are converted one at a time, deleting each
+  // original as it goes, so the graph and the engine's copy are never both
+  // held in full. 'graph' is destroyed before the constructor returns.
+  PartitionEngineKlfm(std::unique_ptr<Node> graph, Options& options,
+                      std::ostream& os);
+  // Partitions only the part of the graph in 'subgraph'. The engine modifies
+  // the nodes and edges it partitions, so it copies those of the view from
+  // the underlying graph, which is not modified. Ports of the copies that
+  // lead out of the view are dropped. Only the view's part of the graph is
+  // copied, and the view need not outlive the constructor.
+  PartitionEngineKlfm(const InducedSubgraph& subgraph, Options& options,
+                      std::ostream& os);
   virtual ~PartitionEngineKlfm();
 
   // Execute may be called multiple times for a given partition engine, but
   // may not be called concurrently.
   virtual void Execute(std::vector<PartitionSummary>* summaries);
 
+  // Hands the nodes and edges of the engine's graph over to a new graph owned
+  // by the caller, without copying them. The nodes keep the implementations
+  // that the last run left selected. May only be called after Execute(), and
+  // the engine may only be destroyed afterwards.
+  std::unique_ptr<Node> ReleaseGraph();
+
   class Options {
    public:
     // Determines the mechanism for obtaining the initial partition for each
@@ -68,13 +102,32 @@ class PartitionEngineKlfm : public PartitionEngine {
         gain_bucket_type(PartitionerConfig::kGainBucketSingleResource),
         gain_bucket_selection_policy(
             PartitionerConfig::kGbmreSelectionPolicyLargestGain),
+        gain_bucket_storage(PartitionerConfig::kGainBucketStorageList),
+        gain_bucket_search_depth(0),
         use_ratio_in_imbalance_score(false),
         use_ratio_in_partition_quality(false),
         cap_passes(false),
         max_passes(100),
+        max_non_improving_moves(0),
+        max_non_improving_move_fraction(0.0),
         num_runs(5),
+        num_threads(1),
+        deadline_ms(0),
         use_adaptive_node_implementations(false),
         use_multilevel_constraint_relaxation(false),
+        use_boundary_gain_buckets(false),
+        coarsen_max_levels(1),
+        coarsen_target_num_nodes(0),
+        coarsen_target_ratio(0.0),
+        max_passes_coarse_level(0),
+        max_passes_base_level(0),
+        coarsening_hierarchy_pool_size(0),
+        coarsening_algorithm(
+            PartitionerConfig::kCoarsenHierarchalInterconnection),
+        coarsen_max_supernode_size(16),
+        coarsen_neighbor_limit(100),
+        coarsen_label_propagation_iterations(5),
+        coarsen_edge_degree_max(50),
         restrict_supernodes_to_default_implementation(false),
         supernode_implementations_cap(16),
         reuse_previous_run_implementations(true),
@@ -91,6 +144,10 @@ class PartitionEngineKlfm : public PartitionEngine {
         export_initial_sol_only(false),
         sol_scip_format(true),
         sol_gurobi_format(false),
+        sol_native_format(false),
+        coarsen_initial_partition(false),
+        initial_partition_perturbation(0.05),
+        refinement_region_radius(2),
         use_entropy(false),
         save_cutset(true),
         cutset_dir("") {
@@ -105,13 +162,32 @@ class PartitionEngineKlfm : public PartitionEngine {
         gain_bucket_type(PartitionerConfig::kGainBucketMultiResourceExclusive),
         gain_bucket_selection_policy(
             PartitionerConfig::kGbmreSelectionPolicyLargestGain),
+        gain_bucket_storage(PartitionerConfig::kGainBucketStorageList),
+        gain_bucket_search_depth(0),
         use_ratio_in_imbalance_score(false),
         use_ratio_in_partition_quality(false),
         cap_passes(false),
         max_passes(100),
+        max_non_improving_moves(0),
+        max_non_improving_move_fraction(0.0),
         num_runs(5),
+        num_threads(1),
+        deadline_ms(0),
         use_adaptive_node_implementations(false),
         use_multilevel_constraint_relaxation(false),
+        use_boundary_gain_buckets(false),
+        coarsen_max_levels(1),
+        coarsen_target_num_nodes(0),
+        coarsen_target_ratio(0.0),
+        max_passes_coarse_level(0),
+        max_passes_base_level(0),
+        coarsening_hierarchy_pool_size(0),
+        coarsening_algorithm(
+            PartitionerConfig::kCoarsenHierarchalInterconnection),
+        coarsen_max_supernode_size(16),
+        coarsen_neighbor_limit(100),
+        coarsen_label_propagation_iterations(5),
+        coarsen_edge_degree_max(50),
         restrict_supernodes_to_default_implementation(false),
         supernode_implementations_cap(16),
         reuse_previous_run_implementations(true),
@@ -128,6 +204,10 @@ class PartitionEngineKlfm : public PartitionEngine {
         export_initial_sol_only(false),
         sol_scip_format(true),
         sol_gurobi_format(false),
+        sol_native_format(false),
+        coarsen_initial_partition(false),
+        initial_partition_perturbation(0.05),
+        refinement_region_radius(2),
         use_entropy(false),
         save_cutset(true),
         cutset_dir("") {
@@ -148,6 +228,10 @@ class PartitionEngineKlfm : public PartitionEngine {
     PartitionerConfig::GainBucketType gain_bucket_type;
     PartitionerConfig::GainBucketSelectionPolicy
         gain_bucket_selection_policy;
+    PartitionerConfig::GainBucketStorage gain_bucket_storage;
+    // Entries examined per bucket when searching past moves that do not fit.
+    // 0 leaves the gain bucket manager's default.
+    int gain_bucket_search_depth;
 
     // One entry to reach resource. If set to false, that resource is excluded
     // from balance constraints.
@@ -169,11 +253,39 @@ class PartitionEngineKlfm : public PartitionEngine {
     bool cap_passes;
     size_t max_passes;
 
+    // A pass stops moving nodes once 'max_non_improving_moves' moves, or
+    // 'max_non_improving_move_fraction' of the nodes that were unlocked at
+    // the start of the pass, have been moved since the best result of the
+    // pass was found. Those moves would be rolled back anyway. If both are
+    // set, whichever limit is smaller applies. Zero disables a limit.
+    size_t max_non_improving_moves;
+    double max_non_improving_move_fraction;
+
     // Algorithm will run 'num_runs' times and return the best results.
     // If the algorithm does not contain a random element, there is no reason
     // to set above 1.
     size_t num_runs;
 
+    // Number of threads used to execute independent runs concurrently. Each
+    // thread owns a private copy of the graph, gain bucket manager, and
+    // random engines, and executes every 'num_threads'th run. Summaries are
+    // still returned in run order. A thread seeds its random engines from
+    // kWorkerRandomSeedBase and its index, rather than from the fixed seed
+    // of the single-threaded engine, and draws supernode IDs from a range of
+    // its own. Results therefore differ from the single-threaded results and
+    // between thread counts, but are the same on every execution with the
+    // same thread count, unless a deadline cuts runs short. Ignored if
+    // 'export_initial_sol_only' is set.
+    size_t num_threads;
+
+    // If non-zero, limits the wall-clock time of Execute() to roughly this
+    // many milliseconds. The deadline is checked between runs, between
+    // passes, and periodically during each pass. Once it expires, no further
+    // runs are started, except that the first run always executes, and the
+    // run in progress is finished without further refinement. Its summary
+    // is flagged as truncated.
+    uint64_t deadline_ms;
+
     // Indicates whether gain buckets can select between multiple
     // node implementations. Note that if this option is set to false,
     // node implmentations may still be changed by rebalancing or mutation.
@@ -184,12 +296,58 @@ class PartitionEngineKlfm : public PartitionEngine {
     // constaint for fine partitioning.
     bool use_multilevel_constraint_relaxation;
 
+    // If set to true, only nodes on the partition boundary (nodes connected to
+    // a net that has pins in both partitions) are inserted into the gain
+    // buckets at the start of each pass. Interior nodes are inserted when a
+    // move places one of their nets on the boundary. Interior nodes can only
+    // have non-positive gain, so this mainly saves bucket work on large,
+    // already well-partitioned graphs such as refinement levels.
+    bool use_boundary_gain_buckets;
+
+    // The graph is coarsened repeatedly, up to 'coarsen_max_levels' times,
+    // before the initial partition is made. Coarsening stops early once the
+    // graph has at most 'coarsen_target_num_nodes' nodes, once it has at most
+    // 'coarsen_target_ratio' times the number of nodes in the base graph, or
+    // once a level fails to merge any nodes. A target of 0 is ignored.
+    size_t coarsen_max_levels;
+    size_t coarsen_target_num_nodes;
+    double coarsen_target_ratio;
+
+    // Caps the number of KLFM passes made at each coarsened level and at the
+    // base level while uncoarsening. Setting to zero removes the cap.
+    size_t max_passes_coarse_level;
+    size_t max_passes_base_level;
+
+    // If non-zero, the merges made while building the coarsening hierarchy
+    // are recorded for the first 'coarsening_hierarchy_pool_size' runs.
+    // Subsequent runs cycle through the recorded hierarchies and rebuild the
+    // supernodes directly, skipping the search for nodes to merge. Only the
+    // partition state differs between runs that share a hierarchy. If zero,
+    // a new hierarchy is built for every run.
+    size_t coarsening_hierarchy_pool_size;
+
+    // Selects the algorithm used to build each level of the hierarchy.
+    PartitionerConfig::CoarseningAlgorithm coarsening_algorithm;
+
+    // Supernodes made by either algorithm hold at most
+    // 'coarsen_max_supernode_size' nodes. Hierarchal interconnection
+    // considers at most 'coarsen_neighbor_limit' neighbors of each
+    // supernode, and label propagation makes at most
+    // 'coarsen_label_propagation_iterations' rounds. Edges with
+    // 'coarsen_edge_degree_max' or more connections are ignored when scoring
+    // merges.
+    int coarsen_max_supernode_size;
+    int coarsen_neighbor_limit;
+    int coarsen_label_propagation_iterations;
+    int coarsen_edge_degree_max;
+
     // If set to true, supernodes are only allowed a single weight vector that
     // is the sum of the selected weight vectors of its component nodes.
     bool restrict_supernodes_to_default_implementation;
 
-    // Sets a limit on the number of weight vectors generated for a supernode.
-    // This cap is only honored if it is greater 1 + the number of resources.
+    // Sets a limit on the number of weight vectors generated for a supernode,
+    // including the one made from the component nodes' selected weight
+    // vectors.
     size_t supernode_implementations_cap;
 
     // If set to true and 'num_runs > 1', subsequent runs after the initial one
@@ -263,7 +421,45 @@ class PartitionEngineKlfm : public PartitionEngine {
     // Will write solutions in the Gurobi .MST format.
     bool sol_gurobi_format;
 
-    // Use edge entropy to determine move cost.
+    // Will write solutions in the native .PART format, which lists the side
+    // and implementation of each node.
+    bool sol_native_format;
+
+    // If non-empty, the initial partition of every run is read from this
+    // file instead of being generated, and 'seed_mode' is set to
+    // kSeedModeUserSpecified. Files ending in .sol or .mst are read as SCIP
+    // or Gurobi solutions, and any other file as a native .PART file. The
+    // implementations recorded in the file are selected as well. Nodes the
+    // file does not mention join the side most of their neighbors are on,
+    // and nodes the graph does not have are ignored, with a warning for
+    // each. Native files identify nodes by name, so they can be read back
+    // for a modified design whose node IDs have shifted.
+    std::string initial_partition_filename;
+
+    // By default, runs that start from a user-specified partition skip
+    // coarsening and only refine the partition of the base graph. If set,
+    // the graph is coarsened first, but nodes are only merged with nodes on
+    // the same side of the initial partition.
+    bool coarsen_initial_partition;
+
+    // Every run after the first starts from a perturbed copy of the
+    // user-specified partition, so that the runs explore different
+    // solutions. This fraction of the nodes on the smaller side are swapped
+    // with as many random nodes from the other side. Only nodes that
+    // refinement may move are swapped. If zero, all runs start from the
+    // same partition.
+    double initial_partition_perturbation;
+
+    // If non-empty, KLFM passes on the base graph only move these nodes and
+    // the nodes within 'refinement_region_radius' nets of them. Rebalancing
+    // may still move any node. Used to repair a partition locally after a
+    // small change to the graph. Passes on coarsened graphs are unaffected.
+    NodeIdSet refinement_region;
+    size_t refinement_region_radius;
+
+    // Use edge entropy to determine move cost. Entropy mode is global to all
+    // edges, so Edge::SetEntropyMode(use_entropy) must be called before the
+    // engine is constructed.
     bool use_entropy;
 
     // If set to false, edge names and node IDs that define a cutset will
@@ -274,14 +470,133 @@ class PartitionEngineKlfm : public PartitionEngine {
 
     // If non-empty, cutsets are written to files stored in this directory.
     std::string cutset_dir;
+
+    // If non-empty, the time spent in the main sections of the algorithm is
+    // appended to this file in CSV format, with one record per pass and one
+    // per run. The file must already hold the header written by
+    // KlfmProfiler::WriteHeader.
+    std::string profile_filename;
+
+    // If non-empty, every move and a summary of every pass are appended to
+    // this file in the binary format described in klfm_move_trace.h. The file
+    // must already hold the header written by
+    // KlfmMoveTrace::Writer::WriteHeader.
+    std::string move_trace_filename;
   };
 
  private:
+  // A supernode as it was built when its level was recorded. 'group_index'
+  // is its position in the level's groups. The weight vectors and the
+  // component implementations behind them are those computed by
+  // Node::PopulateSupernodeWeightVectors(), with recorded member IDs.
+  struct RecordedSupernode {
+    size_t group_index;
+    std::vector<std::vector<int>> weight_vectors;
+    std::vector<std::vector<std::pair<int,int>>> internal_indices;
+  };
+
+  // A contracted edge as it was built when its level was recorded, with the
+  // recorded IDs of the nodes it connects.
+  struct RecordedEdge {
+    int edge_id;
+    std::vector<int> pin_ids;
+  };
+
+  // The supernodes made during one level of coarsening. 'groups' holds the
+  // IDs of the nodes merged into each supernode and 'supernode_ids' the ID
+  // that supernode was given when the level was recorded. If
+  // 'has_contraction' is set, the level also holds the contraction itself:
+  // the supernodes with more than one member, in order, the IDs of the
+  // edges that were carried over unchanged, and the contracted edges in port
+  // order. Replays reuse these instead of recomputing them. Levels that were
+  // contracted around a seed partition keep only the groups.
+  struct CoarseningLevel {
+    std::vector<NodeIdSet> groups;
+    std::vector<int> supernode_ids;
+    bool has_contraction{false};
+    std::vector<RecordedSupernode> supernodes;
+    std::vector<int> shared_edge_ids;
+    std::vector<RecordedEdge> contracted_edges;
+  };
+  typedef std::vector<CoarseningLevel> CoarseningHierarchy;
+
+  // A graph that was replaced by its contraction during multilevel
+  // coarsening. 'coarse_node_ids' is indexed by node index in
+  // 'fine_hypergraph' and holds the ID of the node that represents it in the
+  // contracted graph. The supernodes refer to their component nodes without
+  // owning them. Contracted edges keep the ID of the edge they replace;
+  // edges that touch no merged node are shared with the contracted graph.
+  struct ContractedLevel {
+    KlfmNodeMap fine_node_map;
+    KlfmEdgeMap fine_edge_map;
+    KlfmHypergraph fine_hypergraph;
+    std::vector<int> coarse_node_ids;
+    std::vector<Node*> supernodes;
+    std::vector<EdgeKlfm*> contracted_edges;
+  };
+
+  // Completes construction once the internal node and edge maps have been
+  // populated.
+  void InitializeFromInternalGraph();
+
   void AppendPartitionSummary(
     std::vector<PartitionSummary>* summaries, const NodePartitions& partitions,
     std::vector<int>& current_partition_balance, double current_partition_cost,
     int num_passes, int cur_run);
 
+  // Creates a worker engine for parallel execution of runs. The worker
+  // copies the current internal graph and options of 'parent' and seeds its
+  // random engines with 'worker_id'.
+  PartitionEngineKlfm(const PartitionEngineKlfm& parent, size_t worker_id);
+
+  // Creates 'gain_bucket_manager_' according to the gain bucket type in
+  // 'options_', as adjusted by GainBucketTypeForGraph().
+  void CreateGainBucketManager();
+
+  // Returns the gain bucket type to use for the current graph. The exclusive
+  // managers keep each node in the buckets of the single resource its
+  // implementation uses, so the mixed manager of the same adaptivity is used
+  // instead while an implementation of some node, such as a supernode merging
+  // nodes of different resources, has weight in more than one resource.
+  PartitionerConfig::GainBucketType GainBucketTypeForGraph() const;
+
+  // Executes all runs across 'options_.num_threads' worker engines and appends
+  // their summaries to 'summaries' in run order.
+  void ExecuteParallel(std::vector<PartitionSummary>* summaries);
+
+  // Called on a worker engine. Executes runs 'first_run',
+  // 'first_run + run_stride', ... and stores the summaries of each run at
+  // the corresponding index of 'run_summaries'.
+  void ExecuteWorkerRuns(
+      size_t first_run, size_t run_stride,
+      std::vector<std::vector<PartitionSummary>>* run_summaries);
+
+  // Stream for progress and debug messages, including VLOG and DLOG output.
+  // Standard output for most engines. Parallel workers buffer their messages
+  // so that the output of concurrent runs does not interleave.
+  std::ostream& log_stream() const {
+    return is_parallel_worker_ ? worker_log_buffer_ : std::cout;
+  }
+
+  // printf() to log_stream().
+  void LogPrintf(const char* format, ...) const
+      __attribute__((format(printf, 2, 3)));
+
+  // Called on a worker engine. Writes the messages buffered since the last
+  // call to standard output and the parent's output stream, as one block.
+  void FlushWorkerOutput();
+
+  // Restores 'initial_implementations' if 'reset_implementations' is set,
+  // exports the initial solution if requested, then executes the run.
+  void PrepareAndExecuteRun(
+      size_t cur_run, bool reset_implementations,
+      const std::map<int,int>& initial_implementations,
+      std::vector<PartitionSummary>* summaries);
+
+  // Truncates the cutset summary CSV in 'options_.cutset_dir' and writes its
+  // header.
+  void WriteCutsetSummaryCsvHeader() const;
+
   // Verifies that all of weight vectors for every node in the node map have
   // the same number of entries as num_resources_per_node_;
   void CheckSizeOfWeightVectors();
@@ -304,6 +619,10 @@ class PartitionEngineKlfm : public PartitionEngine {
   // Reset any execution-specific state to allow Execute() to be called again.
   void Reset();
 
+  // Sets the coarsening level reported by the profiler and the move trace
+  // for subsequent passes. 0 is the base graph.
+  void SetRefinementLevel(int level);
+
   // Print progress information on current status.
   void PrintPassInfo(int cur_pass, int cur_run);
 
@@ -315,7 +634,10 @@ class PartitionEngineKlfm : public PartitionEngine {
 
   // Resets state of nodes and edges for the beginning of a KLFM iteration.
   // Unlocks all nodes, resets edges and their criticality, and computes initial
-  // node gains. KLFM helper fn.
+  // node gains. If 'pass_state_valid_' is set, only the edges connected to the
+  // nodes moved in the previous pass and the gains of the nodes on those edges
+  // are recomputed. If 'options_.use_boundary_gain_buckets' is set, only
+  // boundary nodes are added to the gain buckets. KLFM helper fn.
   void ResetNodeAndEdgeKlfmState(const NodePartitions& current_partition);
 
   // Performs one node move for the KLFM algorithm.
@@ -328,27 +650,51 @@ class PartitionEngineKlfm : public PartitionEngine {
       NodePartitions& current_partition,
       std::vector<int>& nodes_moved_since_best_result);
 
-  // Handles operations at the end of a profiling interval (printing data,
-  // reseting variables, etc.).
-  void RefreshProfilingData(bool record_previous_results);
 
-  // Computes the initial gain of 'node' and adds it to the appropriate bucket.
-  // 'in_part_a' indicates if the node is in Partition A or B. KLFM helper fn.
-  void ComputeInitialNodeGainAndUpdateBuckets(Node* node, bool in_part_a);
+  // Rebuilds 'hypergraph_' from the internal node and edge maps. Must be
+  // called whenever nodes or edges are added to or removed from the maps.
+  void RebuildHypergraph();
 
-  // Compute the gain for 'node_id'. KLFM helper fn.
-  double ComputeNodeGain(int node_id);
+  // Computes the initial gain of the node with index 'node_index' in
+  // 'hypergraph_' and adds it to the appropriate bucket. 'in_part_a' indicates
+  // if the node is in Partition A or B. KLFM helper fn.
+  void ComputeInitialNodeGainAndUpdateBuckets(int node_index, bool in_part_a);
 
-  // Moves node (to 'part_b' if 'from_part_a' is true, else to 'part_a') and
-  // updates 'balance' according to the change in weight. KLFM helper fn.
+  // Compute the gain for the node with index 'node_index' in 'hypergraph_',
+  // which is in Partition A if 'in_part_a'. KLFM helper fn.
+  double ComputeNodeGain(int node_index, bool in_part_a);
+
+  // Returns the number of nodes connected to the net with index 'net_index'
+  // in 'hypergraph_' that are in Partition A of 'partitions'.
+  int NumPinsInPartA(int net_index, const NodePartitions& partitions) const;
+
+  // Moves node, which has index 'node_index' in 'hypergraph_', (to 'part_b'
+  // if 'from_part_a' is true, else to 'part_a') and updates 'balance'
+  // according to the change in weight. KLFM helper fn.
   void MoveNodeAndUpdateBalance(
       bool from_part_a, NodePartitions& current_partition, Node* node,
-      const std::vector<int>& weight_vector,
+      int node_index, const std::vector<int>& weight_vector,
       const std::vector<int>& prev_weight_vector, std::vector<int>& balance);
 
-  // Updates the edges connected to 'moved_node' and change the gain on all
-  // nodes connected to those edges. KLFM helper fn.
-  void UpdateMovedNodeEdgesAndNodeGains(Node* moved_node, bool from_part_a);
+  // Updates the edges connected to 'moved_node', which has index
+  // 'node_index' in 'hypergraph_', and change the gain on all nodes connected
+  // to those edges. If 'options_.use_boundary_gain_buckets' is set, also adds
+  // the unlocked nodes that the move placed on the boundary to the gain
+  // buckets. KLFM helper fn.
+  void UpdateMovedNodeEdgesAndNodeGains(
+      Node* moved_node, int node_index, bool from_part_a,
+      const NodePartitions& current_partition);
+
+  // Adds each unlocked node connected to the nets of the node with index
+  // 'node_index' that is on the boundary but not yet in the gain buckets.
+  // Used only with 'options_.use_boundary_gain_buckets'. KLFM helper fn.
+  void ActivateBoundaryNeighbors(int node_index,
+                                 const NodePartitions& current_partition);
+
+  // Brings the boundary state of the pins of the net with index 'net_index'
+  // up to date after the net has been reset. Used only with
+  // 'options_.use_boundary_gain_buckets'. KLFM helper fn.
+  void UpdateNetBoundaryState(int net_index);
 
   // Moves all nodes in 'nodes_moved_since_best_result' to the opposite
   // node set they are currently in, according to 'current_a_nodes' and
@@ -368,10 +714,18 @@ class PartitionEngineKlfm : public PartitionEngine {
   void StripPorts(KlfmNodeMap* node_map, KlfmEdgeMap* edge_set,
                   const NodeIdSet& port_ids);
 
-  // Populates the partition-specific node id data structures in all internal
-  // edges.
+  // Populates the per-partition node counts of all internal edges.
   void PopulateEdgePartitionConnections(const NodePartitions& current_partition);
 
+  // Converts between a partition of the nodes of 'hypergraph_' and the sets
+  // of IDs of the nodes on each side. PartitionFromSets() requires every ID to
+  // be a node of the graph, and leaves the nodes in neither set unassigned.
+  void PartitionFromSets(const NodeIdSet& part_a_ids,
+                         const NodeIdSet& part_b_ids,
+                         NodePartitions* partition) const;
+  void PartitionToSets(const NodePartitions& partition, NodeIdSet* part_a_ids,
+                       NodeIdSet* part_b_ids) const;
+
   // Returns true if the two pairs of node sets are the same. Order of 
   // node sets does not matter.
   bool PartitionsIdentical(const NodePartitions& a,
@@ -393,15 +747,20 @@ class PartitionEngineKlfm : public PartitionEngine {
       NodePartitions* partition, double* cost, std::vector<int>* balance);
 
   // Attempts to correct a weight imbalance that exceeds the maximum allowable
-  // imbalance, either by moving a node between partitions or by changing
-  // a node's implementation. Updates 'part_a', 'part_b', and 'current_balance'
-  // accordingly. Not safe to call during a KLFM iteration, as it does not
-  // consider whether nodes are locked or update KLFM state.
-  void FixInitialWeightImbalance(NodePartitions* partition,
-                                 std::vector<int>* part_a_current_weight,
-                                 std::vector<int>* part_b_current_weight,
+  // imbalance by moving nodes between partitions. Each move is the one that
+  // reduces the cut weight the most, or increases it the least, among the
+  // moves that bring the balance closer to the limits. Updates 'partition'
+  // and 'current_balance' accordingly, and returns true if the balance is
+  // within the limits. Not safe to call during a KLFM iteration, as it does
+  // not consider whether nodes are locked or update KLFM state.
+  bool FixInitialWeightImbalance(NodePartitions* partition,
                                  std::vector<int>* current_balance);
 
+  // Returns how far 'current_balance' exceeds the max imbalance, summed over
+  // the constrained resources, each relative to its max imbalance. Zero if
+  // the balance is within the limits.
+  double ExcessWeightImbalance(const std::vector<int>& current_balance) const;
+
   // Returns true is the 'current_balance' exceeds the max imbalance for any
   // of the resources.
   bool ExceedsMaxWeightImbalance(const std::vector<int>& current_balance) const;
@@ -441,23 +800,102 @@ class PartitionEngineKlfm : public PartitionEngine {
   // partner with another node(set) and continues making passes until no more
   // consolidation can be made. Tends to coarsen the graph to a higher degree
   // than Neighborhood.
+  // If 'recorded_level' is non-null, the supernodes that are made are
+  // appended to it.
   void CoarsenHierarchalInterconnection(
-      int max_nodes_per_supernode, int neighbor_limit);
-
-  // Transfers nodes from 'coarsened' to 'decoarsened', breaking them down
-  // into component nodes if they are supernodes.
+      int max_nodes_per_supernode, int neighbor_limit,
+      CoarseningLevel* recorded_level = NULL);
+
+  // Label propagation repeatedly lets each node join the neighboring cluster
+  // it is most heavily connected to, as long as the cluster holds fewer than
+  // 'max_nodes_per_supernode' nodes. Edges with a degree of
+  // 'options_.coarsen_edge_degree_max' or more are ignored. Makes at most
+  // 'max_iterations' rounds, each of which is spread across
+  // 'options_.num_threads' threads unless this engine is a parallel worker.
+  // Results are only reproducible with a single thread. The clusters are
+  // then contracted into supernodes. If 'recorded_level' is non-null, the
+  // supernodes that are made are appended to it.
+  void CoarsenLabelPropagation(
+      int max_nodes_per_supernode, int max_iterations,
+      CoarseningLevel* recorded_level = NULL);
+
+  // Performs one round of label propagation for the nodes at positions
+  // ['begin', 'end') of 'node_order'. 'cluster' and 'cluster_size' are
+  // indexed by node index in 'hypergraph_' and may be updated concurrently
+  // by other threads. Adds the number of nodes that changed cluster to
+  // 'num_moves'. 'cluster_score' is scratch space owned by the calling
+  // thread; it must cover every cluster label and be zeroed, and is left
+  // zeroed.
+  void PropagateLabels(
+      const std::vector<int>& node_order, size_t begin, size_t end,
+      int max_nodes_per_supernode, std::vector<std::atomic<int>>* cluster,
+      std::vector<std::atomic<int>>* cluster_size,
+      std::atomic<int>* num_moves, std::vector<double>* cluster_score) const;
+
+  // Builds the multilevel hierarchy by coarsening the graph repeatedly until
+  // one of the limits in 'options_' is reached, or by replaying a hierarchy
+  // from 'coarsening_hierarchy_pool_'. Returns the number of levels that were
+  // added above the base graph.
+  int CoarsenMultilevel();
+
+  // Rebuilds the supernodes of 'hierarchy' on the base graph. Returns the
+  // number of levels in 'hierarchy'.
+  int ReplayCoarseningHierarchy(const CoarseningHierarchy& hierarchy);
+
+  // Stores the contraction made by the last call to ContractLevel() in
+  // 'recorded_level', whose groups and supernode IDs must already be set.
+  void RecordContraction(CoarseningLevel* recorded_level);
+
+  // Contracts the current graph with the supernodes and edges stored in
+  // 'recorded_level' by RecordContraction(), and maps the recorded IDs of
+  // its supernodes to their new IDs in 'current_id_by_recorded_id'. Returns
+  // false without changing anything if the level has no stored contraction,
+  // a seed partition is in use, or the components no longer have the
+  // implementations selected when the level was recorded.
+  bool ReplayRecordedContraction(
+      const CoarseningLevel& recorded_level,
+      std::unordered_map<int,int>* current_id_by_recorded_id);
+
+  // Caps the number of passes RunKlfmAlgorithm may make. Zero removes the cap.
+  void SetMaxPasses(size_t max_passes);
+
+  // Returns true if 'options_.deadline_ms' is set and the deadline for the
+  // current call to Execute() has passed.
+  bool DeadlineExpired();
+
+  // Projects the partition of the nodes in 'coarsened' onto the nodes of the
+  // next finer level in 'decoarsened' and restores that level with
+  // DiscardContractedLevel(). If the graph is not coarsened, the partition
+  // is transferred unchanged.
   void DecoarsenPartitions(
       NodePartitions* coarsened, NodePartitions* decoarsened);
 
-  // Decoarsen a single partition.
-  void DecoarsenPartition(
-      NodeIdSet* coarsened, NodeIdSet* decoarsened);
-
-
-  // De-Coarsen the graph by one level - i.e. break every supernode in the
-  // internal node map down once. Returns false if none of the nodes in the
-  // internal node map was a supernode.
-  bool DeCoarsen();
+  // Contracts each of 'groups' into a supernode and replaces the internal
+  // node and edge maps with the contracted graph, saving the finer graph in
+  // a new entry of 'contracted_levels_'. Groups must be disjoint sets of IDs
+  // of nodes in the internal node map. The ID of the node that represents
+  // each group is appended to 'supernode_ids'; groups with a single member
+  // are represented by that member. 'hypergraph_' must be current. While
+  // 'seed_partition_' is in use, only the members of a group on the side
+  // most of the group is on are merged, and the supernode is placed on that
+  // side.
+  void ContractLevel(const std::vector<NodeIdSet>& groups,
+                     std::vector<int>* supernode_ids);
+
+  // Saves the current graph as a new entry of 'contracted_levels_' and
+  // replaces it with the contracted graph made of 'coarse_node_map' and
+  // 'coarse_edge_map'. The other arguments are moved into the new entry.
+  void PushContractedLevel(KlfmNodeMap* coarse_node_map,
+                           KlfmEdgeMap* coarse_edge_map,
+                           std::vector<int>* coarse_node_ids,
+                           std::vector<Node*>* supernodes,
+                           std::vector<EdgeKlfm*>* contracted_edges);
+
+  // Restores the internal node and edge maps to the graph saved by the last
+  // call to ContractLevel(), deleting the supernodes and contracted edges of
+  // that level. Component nodes take on the implementations selected by
+  // their supernodes.
+  void DiscardContractedLevel();
 
   // Attempts to improve the partition's imbalance by changing the
   // implementation of the nodes.
@@ -474,60 +912,17 @@ class PartitionEngineKlfm : public PartitionEngine {
   // run.
   void MutateImplementations(int mutation_rate);
 
-  // Creates a supernode that contains the nodes specifed by the IDs in
-  // 'component_nodes'. The nodes and edges connected to them must be present
-  // in 'node_map' and 'edge_map' respectively. The two maps will be updated
-  // to remove the consolidated nodes and edges and insert the supernode and
-  // any its boundary edges. The supernode gains ownership of the nodes and
-  // edges that are removed from the maps. 'port_map' must contain the ports
-  // of the graph/parent node of 'component_nodes' or NULL if none of the
-  // nodes in 'component_nodes' has an edge that connects to one of the
-  // parent's ports. Returns the ID of the supernode.
-  int MakeSupernode(const NodeIdSet& component_nodes,
-      KlfmNodeMap* node_map, KlfmEdgeMap* edge_map, PortMap* port_map);
-
-  // Breaks a supernode into its component internal graph. This only breaks
-  // down a single level of hierarchy; to completely reduce the hierarchy, it
-  // must be recursively executed on any supernodes present in this supernode's
-  // internal graph. The supernode and its connected edges must be present in
-  // 'node_map' and 'edge_map' respectively. These maps are updated to include
-  // the components of the supernode and remove the supernode and any
-  // redundant edge entries. These objects are also deleted.
-  // Returns false and does not otherwise alter the graph if 'supernode_id'
-  // denotes a valid node in 'node_map' that is not a supernode.
-  static bool ExpandSupernode(int supernode_id, KlfmNodeMap* node_map,
-      KlfmEdgeMap* edge_map, PortMap* port_map);
-
   // Computes the difference of 'old_weight_vector' and 'new_weight_vector'
   // and adjusts 'total_weights_' by that amount.
   void UpdateTotalWeightsForImplementationChange(
       const std::vector<int>& old_weight_vector,
       const std::vector<int>& new_weight_vector);
 
-  // Split edges that are not wholly internal to the supernode. Keep the
-  // original id on the portion that is internal to the supernode and assign
-  // a new id to the external part(s), update the nodes connected to the
-  // external part, and connect the split edges to ports on the supernode.
-  // Remove the original edges from 'edge_map' and add the new ones,
-  // transferring ownership of the original edges to the supernode. 'node_map'
-  // must contain the nodes in 'component_nodes'. 'port_map' must contain the
-  // ports of the graph/parent node of 'component_nodes', or may contain NULL if
-  // none of the nodes in 'component_nodes' connects externally to a port.
-  static void SplitSupernodeBoundaryEdges(
-      Node* supernode, const NodeIdSet& component_nodes,
-      const EdgeIdSet& boundary_edges, KlfmNodeMap* node_map,
-      KlfmEdgeMap* edge_map, PortMap* port_map);
-
-  // Merge the edges that span the boundary of the specifed supernode. The
-  // supernode-internal edge IDs will be kept and will replace the corresponding
-  // edges external to the supernode. Removed edges are deleted and their IDs
-  // free'd. If the supernode does not connect to any ports in its parent node,
-  // 'port_map' may be passed as NULL.
-  static void MergeSupernodeBoundaryEdges(
-      Node* supernode, KlfmNodeMap* node_map, KlfmEdgeMap* edge_map,
-      PortMap* port_map);
-
   void SummarizeResults(const std::vector<PartitionSummary>& summaries);
+  // Reduces 'summaries' to the best of its runs: the balanced run with the
+  // lowest cost, or, if no run is balanced, the least imbalanced one. Used
+  // when the deadline cuts execution short.
+  void KeepBestRun(std::vector<PartitionSummary>* summaries);
   void SummarizeResultMetric(
     std::vector<double>& data, const std::string& name, bool extended);
   void PrintResultFull(const PartitionSummary& summary, int run_num);
@@ -541,6 +936,31 @@ class PartitionEngineKlfm : public PartitionEngine {
   // Write solution in .mst format used by Gurobi.
   void WriteGurobiMst(const NodePartitions& partition,
                       const std::string& filename);
+  // Write solution in the native .part format. Each line holds a node's
+  // name, its side (A or B) and its selected implementation. Nodes without
+  // a name, such as those of CHACO graphs, are written by ID instead.
+  void WriteNativePartition(const NodePartitions& partition,
+                            const std::string& filename);
+  // Reads the partition in 'filename' into 'initial_a_nodes' and
+  // 'initial_b_nodes' and selects the implementations it records. See
+  // Options::initial_partition_filename.
+  void ReadInitialPartition(const std::string& filename);
+  // Places the nodes missing from 'initial_a_nodes' and 'initial_b_nodes' on
+  // the side most of their already placed neighbors are on.
+  void PlaceUnassignedInitialNodes();
+  // Swaps random pairs of nodes between the sides of 'partition', which is
+  // indexed like 'hypergraph_'. See Options::initial_partition_perturbation.
+  void PerturbSeedPartition(NodePartitions* partition);
+
+  // Marks the nodes of Options::refinement_region and their neighborhood in
+  // 'in_refinement_region_'. 'hypergraph_' must hold the base graph.
+  void BuildRefinementRegion();
+  // Returns true if KLFM passes may move the node at 'node_index' of
+  // 'hypergraph_'.
+  bool InRefinementRegion(int node_index) const {
+    return in_refinement_region_.empty() || !contracted_levels_.empty() ||
+           in_refinement_region_[node_index];
+  }
 
   // Comparison fn for sort.
   static bool cmp_pair_second_gt(const std::pair<int,int>& lhs,
@@ -548,17 +968,37 @@ class PartitionEngineKlfm : public PartitionEngine {
     return lhs.second > rhs.second;
   }
 
-  // Needs -lrt during linking.
-  static uint64_t GetTimeUsec() {
-    timespec tS;
-    assert(clock_gettime(CLOCK_REALTIME, &tS) != -1);
-    return (uint64_t)tS.tv_sec * 1000000LL + (uint64_t)tS.tv_nsec / 1000LL;
-  }
 
   Options options_;
 
+  // Output buffered by a parallel worker until FlushWorkerOutput(). Declared
+  // before 'os_', which refers to 'worker_os_buffer_' in workers.
+  mutable std::ostringstream worker_log_buffer_;
+  std::ostringstream worker_os_buffer_;
+
   // Output stream.
   std::ostream& os_;
+  // The parent's output stream, if this is a parallel worker.
+  std::ostream* parent_os_;
+
+  // Set for engines created by ExecuteParallel().
+  bool is_parallel_worker_;
+
+  // Deadline for the current call to Execute(), if 'options_.deadline_ms' is
+  // set. Workers inherit the deadline of their parent.
+  std::chrono::steady_clock::time_point deadline_;
+  // Set when the deadline cuts refinement of the current run short.
+  bool run_truncated_;
+  // Number of moves between deadline checks within a pass.
+  static const size_t kDeadlineCheckInterval = 64;
+
+  // Serializes writes to solution and cutset files that are shared by all
+  // runs when runs are executed concurrently.
+  static std::mutex output_file_mutex_;
+  // Serializes FlushWorkerOutput().
+  static std::mutex worker_output_mutex_;
+  // Base of the seeds of the random streams of parallel workers.
+  static const unsigned kWorkerRandomSeedBase = 0;
 
   // Random number generator used for initial partitions. Used to prevent
   // class from becoming thread-hostile.
@@ -571,7 +1011,50 @@ class PartitionEngineKlfm : public PartitionEngine {
   // pointers are owned by this object.
   KlfmNodeMap internal_node_map_;
   KlfmEdgeMap internal_edge_map_;
+  // Flat view of the internal node and edge maps used by the KLFM inner
+  // loops.
+  KlfmHypergraph hypergraph_;
+  // The finer graphs of the current multilevel hierarchy, from the base
+  // graph up.
+  std::vector<ContractedLevel> contracted_levels_;
+  // The user-specified initial partition of the current run, perturbed for
+  // runs after the first and carried to the supernodes made from it.
+  // Indexed like 'hypergraph_' at the current level. Empty outside of runs
+  // that start from a user-specified partition.
+  NodePartitions seed_partition_;
+  // Indexed like 'hypergraph_' at the base level, which is built once per
+  // engine and restored on decoarsening. Empty if the refinement region is
+  // unrestricted.
+  std::vector<char> in_refinement_region_;
+  // State carried between the passes of a single call to RunKlfmAlgorithm so
+  // that ResetNodeAndEdgeKlfmState only has to reinitialize the nets and node
+  // gains touched by the moves of the previous pass. All vectors are indexed
+  // by index in 'hypergraph_'. The cache is invalidated whenever the
+  // hypergraph is rebuilt or a new sequence of passes begins.
+  bool pass_state_valid_;
+  std::vector<double> node_gain_cache_;
+  std::vector<int> nodes_moved_this_pass_;
+  std::vector<char> net_needs_reset_;
+  std::vector<char> node_needs_gain_;
+  // The boundary of the partition as of the last reset, kept only with
+  // 'options_.use_boundary_gain_buckets'. It changes only on the nets that
+  // are reset, so it is maintained along with the rest of the pass state.
+  // 'num_cut_nets_' counts the nets of each node that cross the partitions,
+  // and 'boundary_position_' is a node's position in 'boundary_nodes_', or
+  // -1 if it has no such net.
+  std::vector<char> net_is_cut_;
+  std::vector<int> num_cut_nets_;
+  std::vector<int> boundary_nodes_;
+  std::vector<int> boundary_position_;
+  // Scratch space for the gain updates of a single moved node and net. Holds
+  // node indices in 'hypergraph_'.
+  std::vector<int> nodes_to_increase_gain_;
+  std::vector<int> nodes_to_decrease_gain_;
   GainBucketManager* gain_bucket_manager_;
+  // The type 'gain_bucket_manager_' was created with.
+  PartitionerConfig::GainBucketType gain_bucket_type_;
+  // Set once the fallback from an exclusive manager has been reported.
+  bool reported_gain_bucket_fallback_{false};
   std::vector<int> total_weight_;
   std::vector<int> max_weight_imbalance_;
   std::vector<double> max_imbalance_fraction_;
@@ -591,33 +1074,23 @@ class PartitionEngineKlfm : public PartitionEngine {
   unsigned int rebalances_this_run_;
   unsigned int rebalances_this_pass_;
 
-  // Todo make a parameter.
-  const int coarsen_edge_degree_max_ = 50;
-
-  // Used for profiling run-time of methods in this class.
-  //uint64_t start_time_;
-  uint64_t gbe_start_time_;
-  uint64_t gbe_time_;
-  uint64_t set_vector_and_update_weights_start_time_;
-  uint64_t set_vector_and_update_weights_time_;
-  uint64_t move_node_and_update_balance_start_time_;
-  uint64_t move_node_and_update_balance_time_;
-  uint64_t gain_update_start_time_;
-  uint64_t gain_update_time_;
-  uint64_t rebalance_start_time_;
-  uint64_t rebalance_time_;
-  uint64_t weight_update_start_time_;
-  uint64_t weight_update_time_;
-  uint64_t cost_update_start_time_;
-  uint64_t cost_update_time_;
-  uint64_t total_move_start_time_;
-  uint64_t total_move_time_;
-
-  // temp
-  uint64_t move_node_time_;
-  uint64_t update_gains_time_;
-  uint64_t num_connected_edges_;
-  uint64_t num_critical_connected_edges_;
+  // Hierarchies recorded for reuse when
+  // 'options_.coarsening_hierarchy_pool_size' is non-zero, and the number of
+  // times a hierarchy has been built or replayed.
+  std::vector<CoarseningHierarchy> coarsening_hierarchy_pool_;
+  size_t num_coarsening_hierarchy_uses_;
+
+  // Per-thread connection scores for label propagation, indexed by cluster
+  // label. Kept zeroed between rounds.
+  std::vector<std::vector<double>> label_propagation_scores_;
+
+  // Times the hot sections of the algorithm if 'options_.profile_filename'
+  // is non-empty.
+  KlfmProfiler profiler_;
+
+  // Records the moves of each run if 'options_.move_trace_filename' is
+  // non-empty.
+  KlfmMoveTrace::Writer move_trace_;
 };
 
 #endif /* PARTITION_ENGINE_KLFM_H_ */
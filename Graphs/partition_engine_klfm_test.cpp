@@ -0,0 +1,257 @@
+/* Regression checks for bipartitioning runs that start from a user-specified
+   partition: warm starts from a native partition file, and ECO runs that
+   repair a partition after a delta is applied to the graph.
+
+   The graph is two cliques of eight nodes joined by a single net, so the
+   best bipartition cuts exactly one net. Node IDs are offset from the
+   numbers in the node names, so a partition file is only applied correctly
+   if its nodes are looked up by name.
+
+   Exits with a non-zero status if any check fails. */
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "edge.h"
+#include "id_manager.h"
+#include "netlist_delta.h"
+#include "node.h"
+#include "partition_engine.h"
+#include "partition_engine_klfm.h"
+
+using namespace std;
+
+namespace {
+
+int num_failures = 0;
+
+#define EXPECT(cond) \
+  do { \
+    if (!(cond)) { \
+      printf("%s:%d: Check failed: %s\n", __FILE__, __LINE__, #cond); \
+      num_failures++; \
+    } \
+  } while (0)
+
+const int kCliqueSize = 8;
+const int kIdOffset = 100;
+const char kPartitionFilename[] = "partition_engine_klfm_test.part";
+const char kDeltaFilename[] = "partition_engine_klfm_test.delta";
+
+int NodeId(int number) {
+  return number + kIdOffset;
+}
+
+void Connect(Node* graph, const vector<int>& node_ids) {
+  Edge* edge = new Edge(IdManager::AcquireEdgeId());
+  for (int node_id : node_ids) {
+    edge->AddConnection(node_id);
+    graph->internal_nodes().at(node_id)->AddConnection(edge->id_);
+  }
+  graph->AddInternalEdge(edge->id_, edge);
+}
+
+// Nodes n1 to n8 form one clique and n9 to n16 the other. The only net
+// between them connects n8 and n9.
+unique_ptr<Node> BuildTwoCliques() {
+  const int kAlot = 1000000000;
+  IdManager::Reset(1000);
+  unique_ptr<Node> graph(new Node(kAlot, "Top-Level Graph"));
+  for (int number = 1; number <= 2 * kCliqueSize; number++) {
+    Node* node = new Node(NodeId(number), "n" + to_string(number));
+    node->AddWeightVector(vector<int>{1});
+    graph->AddInternalNode(node->id, node);
+  }
+  for (int first = 1; first <= 2 * kCliqueSize; first += kCliqueSize) {
+    for (int i = first; i < first + kCliqueSize; i++) {
+      for (int j = i + 1; j < first + kCliqueSize; j++) {
+        Connect(graph.get(), {NodeId(i), NodeId(j)});
+      }
+    }
+  }
+  Connect(graph.get(), {NodeId(kCliqueSize), NodeId(kCliqueSize + 1)});
+  return graph;
+}
+
+// Writes a native partition file that places the nodes numbered in
+// 'a_numbers' on side A and the rest of n1 to n16 on side B.
+void WritePartitionFile(const set<int>& a_numbers) {
+  ofstream outfile(kPartitionFilename);
+  outfile << "# node side implementation" << endl;
+  for (int number = 1; number <= 2 * kCliqueSize; number++) {
+    outfile << "n" << number << " " << (a_numbers.count(number) ? 'A' : 'B')
+            << " 0" << endl;
+  }
+}
+
+PartitionEngineKlfm::Options WarmStartOptions() {
+  PartitionEngineKlfm::Options options;
+  options.num_runs = 4;
+  options.multilevel = false;
+  options.enable_print_output = false;
+  // Normally filled in from the device's resources by
+  // PopulateFromPartitionerConfig().
+  options.device_resource_capacities = {100};
+  options.resource_ratio_weights = {1};
+  options.initial_partition_filename = kPartitionFilename;
+  return options;
+}
+
+vector<PartitionSummary> Run(unique_ptr<Node> graph,
+                             PartitionEngineKlfm::Options& options) {
+  ostringstream log;
+  PartitionEngineKlfm engine(move(graph), options, log);
+  vector<PartitionSummary> summaries;
+  engine.Execute(&summaries);
+  return summaries;
+}
+
+bool OnSideA(const PartitionSummary& summary, int number) {
+  return summary.partition_node_ids[0].count(NodeId(number)) != 0;
+}
+
+set<int> FirstClique() {
+  set<int> numbers;
+  for (int number = 1; number <= kCliqueSize; number++) {
+    numbers.insert(number);
+  }
+  return numbers;
+}
+
+// Starting from the best partition, every run keeps it.
+void TestWarmStartKeepsPartition() {
+  WritePartitionFile(FirstClique());
+  PartitionEngineKlfm::Options options = WarmStartOptions();
+  options.initial_partition_perturbation = 0.0;
+  vector<PartitionSummary> summaries = Run(BuildTwoCliques(), options);
+  EXPECT(summaries.size() == (size_t)options.num_runs);
+  for (const PartitionSummary& summary : summaries) {
+    EXPECT(summary.total_cost == 1.0);
+    EXPECT(summary.balanced);
+    for (int number = 1; number <= 2 * kCliqueSize; number++) {
+      EXPECT(OnSideA(summary, number) == (number <= kCliqueSize));
+    }
+  }
+}
+
+// A seed partition with two nodes swapped, perturbed further for every run
+// after the first, is refined to the best partition.
+void TestWarmStartRefinesPerturbedPartition() {
+  set<int> a_numbers = FirstClique();
+  a_numbers.erase(1);
+  a_numbers.insert(2 * kCliqueSize);
+  WritePartitionFile(a_numbers);
+  PartitionEngineKlfm::Options options = WarmStartOptions();
+  options.initial_partition_perturbation = 0.25;
+  vector<PartitionSummary> summaries = Run(BuildTwoCliques(), options);
+  EXPECT(summaries.size() == (size_t)options.num_runs);
+  for (const PartitionSummary& summary : summaries) {
+    EXPECT(summary.total_cost == 1.0);
+    EXPECT(summary.balanced);
+  }
+}
+
+// Adds n17 to the first clique and n18 to the second, then repairs a seed
+// partition that misplaces n7 and n15. Both lie outside the refinement
+// region, so they keep their seed sides, while the new nodes and the
+// perturbed nodes inside the region end up with their cliques.
+void TestEcoRefinesOnlyRegion() {
+  {
+    ofstream delta_file(kDeltaFilename);
+    delta_file << "add_node " << NodeId(17) << " 1" << endl
+               << "add_node " << NodeId(18) << " 1" << endl
+               << "add_net 5001 1 " << NodeId(17) << " " << NodeId(1) << " "
+               << NodeId(2) << endl
+               << "add_net 5002 1 " << NodeId(18) << " " << NodeId(9) << " "
+               << NodeId(10) << endl;
+  }
+  set<int> a_numbers = FirstClique();
+  a_numbers.erase(7);
+  a_numbers.insert(15);
+  WritePartitionFile(a_numbers);
+
+  unique_ptr<Node> graph = BuildTwoCliques();
+  NetlistDelta delta;
+  EXPECT(delta.Parse(kDeltaFilename));
+  set<int> affected_node_ids;
+  delta.Apply(graph.get(), &affected_node_ids);
+  EXPECT(affected_node_ids == set<int>({NodeId(1), NodeId(2), NodeId(9),
+                                        NodeId(10), NodeId(17), NodeId(18)}));
+
+  PartitionEngineKlfm::Options options = WarmStartOptions();
+  options.initial_partition_perturbation = 0.5;
+  options.refinement_region.insert(affected_node_ids.begin(),
+                                   affected_node_ids.end());
+  options.refinement_region_radius = 0;
+  vector<PartitionSummary> summaries = Run(move(graph), options);
+  EXPECT(summaries.size() == (size_t)options.num_runs);
+  // n7 and n15 each cut the seven nets to their own clique, and n8 the net
+  // to n9.
+  const double kSeedCost = 15.0;
+  for (const PartitionSummary& summary : summaries) {
+    EXPECT(summary.total_cost == kSeedCost);
+    EXPECT(summary.balanced);
+    EXPECT(!OnSideA(summary, 7));
+    EXPECT(OnSideA(summary, 15));
+    for (int number : {1, 2, 17}) {
+      EXPECT(OnSideA(summary, number));
+    }
+    for (int number : {9, 10, 18}) {
+      EXPECT(!OnSideA(summary, number));
+    }
+  }
+}
+
+// Adds four nodes to the first clique, so the seed partition, with the new
+// nodes on their neighbors' side, exceeds the balance limit. Nodes are moved
+// to repair it, and every run ends balanced.
+void TestEcoRepairsBalance() {
+  {
+    ofstream delta_file(kDeltaFilename);
+    for (int number = 17; number <= 20; number++) {
+      delta_file << "add_node " << NodeId(number) << " 1" << endl
+                 << "add_net " << 5000 + number << " 1 " << NodeId(number)
+                 << " " << NodeId(1) << " " << NodeId(2) << endl;
+    }
+  }
+  WritePartitionFile(FirstClique());
+
+  unique_ptr<Node> graph = BuildTwoCliques();
+  NetlistDelta delta;
+  EXPECT(delta.Parse(kDeltaFilename));
+  set<int> affected_node_ids;
+  delta.Apply(graph.get(), &affected_node_ids);
+
+  PartitionEngineKlfm::Options options = WarmStartOptions();
+  options.refinement_region.insert(affected_node_ids.begin(),
+                                   affected_node_ids.end());
+  vector<PartitionSummary> summaries = Run(move(graph), options);
+  EXPECT(summaries.size() == (size_t)options.num_runs);
+  for (const PartitionSummary& summary : summaries) {
+    EXPECT(summary.balanced);
+    EXPECT(summary.partition_node_ids[0].size() == 10);
+    EXPECT(summary.partition_node_ids[1].size() == 10);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  TestWarmStartKeepsPartition();
+  TestWarmStartRefinesPerturbedPartition();
+  TestEcoRefinesOnlyRegion();
+  TestEcoRepairsBalance();
+  remove(kPartitionFilename);
+  remove(kDeltaFilename);
+  if (num_failures != 0) {
+    printf("partition_engine_klfm_test: %d checks FAILED\n", num_failures);
+    return 1;
+  }
+  printf("partition_engine_klfm_test: PASSED\n");
+  return 0;
+}
@@ -0,0 +1,838 @@
+#include "partition_engine_kway.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <queue>
+#include <thread>
+
+#include "universal_macros.h"
+
+using namespace std;
+
+// Workers buffer their messages, so logging goes through log_stream().
+#undef VLOG
+#define VLOG(lev) if (VERBOSITY >= lev) log_stream()
+
+mutex PartitionEngineKway::worker_output_mutex_;
+
+PartitionEngineKway::PartitionEngineKway(
+    Node* graph, const PartitionEngineKway::Options& options, ostream& os)
+  : options_(options), os_(os), num_parts_(options.num_parts),
+    num_resources_per_node_(options.num_resources_per_node),
+    is_parallel_worker_(false), run_truncated_(false), current_cost_(0.0) {
+  assert_b(options_.num_parts >= 2) {
+    printf("K-way partitioning requires at least 2 partitions.\n");
+  }
+  assert_b(options_.objective != kNullObjective) {
+    printf("No k-way partitioning objective was set.\n");
+  }
+  assert(options_.max_imbalance_fraction.size() == num_resources_per_node_);
+  assert(options_.constrain_balance_by_resource.size() ==
+         num_resources_per_node_);
+
+  // Give the same seed each time for consistency between benchmarks.
+  random_engine_.seed(0);
+
+  graph->CheckInternalGraphOrDie();
+  graph->StripPorts();
+
+  for (auto node_pair : graph->internal_nodes()) {
+    node_map_.insert(node_pair);
+  }
+  for (auto edge_pair : graph->internal_edges()) {
+    EdgeKlfm* copied_edge = new EdgeKlfm(edge_pair.second);
+    edge_map_.insert(make_pair(copied_edge->id_, copied_edge));
+  }
+  hypergraph_.Build(node_map_, edge_map_);
+
+  const int num_nodes = hypergraph_.num_nodes();
+  node_weights_.resize(num_nodes * num_resources_per_node_);
+  total_weight_.assign(num_resources_per_node_, 0);
+  for (int i = 0; i < num_nodes; i++) {
+    vector<int> weight = hypergraph_.node(i)->SelectedWeightVector();
+    assert_b(weight.size() == num_resources_per_node_) {
+      printf("Node %d has %lu resources in its weight vector, but %lu were "
+             "expected.\n", hypergraph_.node_id(i), weight.size(),
+             num_resources_per_node_);
+    }
+    for (size_t res = 0; res < num_resources_per_node_; res++) {
+      node_weights_[i * num_resources_per_node_ + res] = weight[res];
+      total_weight_[res] += weight[res];
+    }
+  }
+
+  // Each partition may hold its share of a resource plus the allowed
+  // imbalance, but never less than an even share rounded up.
+  max_part_weight_.resize(num_resources_per_node_);
+  for (size_t res = 0; res < num_resources_per_node_; res++) {
+    if (options_.constrain_balance_by_resource[res]) {
+      int even_share = (total_weight_[res] + num_parts_ - 1) / num_parts_;
+      int limit = (int)(total_weight_[res] *
+                        (1.0 + options_.max_imbalance_fraction[res]) /
+                        num_parts_);
+      max_part_weight_[res] = max(limit, even_share);
+    } else {
+      max_part_weight_[res] = numeric_limits<int>::max() / 2;
+    }
+  }
+
+  move_stamps_.assign(num_nodes, 0);
+}
+
+PartitionEngineKway::PartitionEngineKway(
+    const PartitionEngineKway& parent, size_t worker_id)
+  : options_(parent.options_), os_(worker_log_buffer_),
+    num_parts_(parent.num_parts_),
+    num_resources_per_node_(parent.num_resources_per_node_),
+    is_parallel_worker_(true), deadline_(parent.deadline_),
+    run_truncated_(false), hypergraph_(parent.hypergraph_),
+    node_weights_(parent.node_weights_), total_weight_(parent.total_weight_),
+    max_part_weight_(parent.max_part_weight_), current_cost_(0.0),
+    move_stamps_(parent.move_stamps_.size(), 0) {
+  seed_seq seed{kWorkerRandomSeedBase, (unsigned)worker_id};
+  random_engine_.seed(seed);
+}
+
+PartitionEngineKway::~PartitionEngineKway() {
+  for (auto it : edge_map_) {
+    delete it.second;
+  }
+  edge_map_.clear();
+}
+
+void PartitionEngineKway::Execute(vector<PartitionSummary>* summaries) {
+  deadline_ = chrono::steady_clock::now() +
+              chrono::milliseconds(options_.deadline_ms);
+  if (options_.num_threads > 1 && options_.num_runs > 1) {
+    ExecuteParallel(summaries);
+  } else {
+    for (size_t cur_run = 0; cur_run < options_.num_runs; cur_run++) {
+      if (cur_run != 0 && DeadlineExpired()) {
+        VLOG(1) << "Deadline expired. Skipping remaining runs." << endl;
+        break;
+      }
+      ExecuteRun(cur_run, summaries);
+      if (options_.enable_print_output) {
+        PrintResultFull(summaries->back(), cur_run);
+      }
+    }
+  }
+  if (options_.enable_print_output) {
+    SummarizeResults(*summaries);
+  }
+  if (DeadlineExpired()) {
+    KeepBestRun(summaries);
+  }
+}
+
+void PartitionEngineKway::ExecuteParallel(
+    vector<PartitionSummary>* summaries) {
+  size_t num_workers = min(options_.num_threads, options_.num_runs);
+  VLOG(1) << "Executing " << options_.num_runs << " runs on " << num_workers
+          << " threads." << endl;
+
+  vector<unique_ptr<PartitionEngineKway>> workers;
+  for (size_t worker_id = 0; worker_id < num_workers; worker_id++) {
+    workers.emplace_back(new PartitionEngineKway(*this, worker_id));
+  }
+
+  vector<vector<PartitionSummary>> run_summaries(options_.num_runs);
+  vector<thread> threads;
+  for (size_t worker_id = 0; worker_id < num_workers; worker_id++) {
+    PartitionEngineKway* worker = workers[worker_id].get();
+    threads.emplace_back([worker, worker_id, num_workers, &run_summaries]() {
+      worker->ExecuteWorkerRuns(worker_id, num_workers, &run_summaries);
+    });
+  }
+  for (auto& worker_thread : threads) {
+    worker_thread.join();
+  }
+
+  for (size_t cur_run = 0; cur_run < options_.num_runs; cur_run++) {
+    for (const auto& it : run_summaries[cur_run]) {
+      if (options_.enable_print_output) {
+        PrintResultFull(it, cur_run);
+      }
+      summaries->push_back(it);
+    }
+  }
+}
+
+void PartitionEngineKway::ExecuteWorkerRuns(
+    size_t first_run, size_t run_stride,
+    vector<vector<PartitionSummary>>* run_summaries) {
+  for (size_t cur_run = first_run; cur_run < options_.num_runs;
+       cur_run += run_stride) {
+    if (cur_run != 0 && DeadlineExpired()) {
+      break;
+    }
+    ExecuteRun(cur_run, &run_summaries->at(cur_run));
+    FlushWorkerOutput();
+  }
+  FlushWorkerOutput();
+}
+
+void PartitionEngineKway::FlushWorkerOutput() {
+  assert(is_parallel_worker_);
+  lock_guard<mutex> lock(worker_output_mutex_);
+  cout << worker_log_buffer_.str() << flush;
+  worker_log_buffer_.str("");
+}
+
+bool PartitionEngineKway::DeadlineExpired() const {
+  return options_.deadline_ms != 0 &&
+         chrono::steady_clock::now() >= deadline_;
+}
+
+void PartitionEngineKway::KeepBestRun(vector<PartitionSummary>* summaries) {
+  if (summaries->empty()) {
+    return;
+  }
+  auto max_imbalance = [](const PartitionSummary& summary) {
+    return summary.balance.empty() ?
+        0.0 : *max_element(summary.balance.begin(), summary.balance.end());
+  };
+  size_t best = 0;
+  for (size_t i = 1; i < summaries->size(); i++) {
+    const PartitionSummary& candidate = summaries->at(i);
+    const PartitionSummary& incumbent = summaries->at(best);
+    if (candidate.balanced != incumbent.balanced) {
+      if (candidate.balanced) {
+        best = i;
+      }
+    } else if (candidate.balanced) {
+      if (candidate.total_cost < incumbent.total_cost) {
+        best = i;
+      }
+    } else if (max_imbalance(candidate) < max_imbalance(incumbent)) {
+      best = i;
+    }
+  }
+  if (options_.enable_print_output) {
+    os_ << "Deadline expired. Returning the "
+        << (summaries->at(best).balanced ? "best balanced" :
+                                           "least imbalanced")
+        << " of " << summaries->size() << " runs. Cost: "
+        << summaries->at(best).total_cost << endl;
+  }
+  PartitionSummary best_summary = summaries->at(best);
+  summaries->clear();
+  summaries->push_back(best_summary);
+}
+
+void PartitionEngineKway::ExecuteRun(
+    int cur_run, vector<PartitionSummary>* summaries) {
+  run_truncated_ = false;
+  GenerateInitialPartition();
+  RecomputePartitionState();
+  VLOG(1) << "Run " << cur_run << " initial cost: " << current_cost_
+          << " overload: " << TotalOverload() << endl;
+
+  size_t num_passes = 0;
+  while (num_passes < options_.max_passes && !run_truncated_) {
+    if (DeadlineExpired()) {
+      VLOG(1) << "Deadline expired. Ending run " << cur_run << " after "
+              << num_passes << " passes." << endl;
+      run_truncated_ = true;
+      break;
+    }
+    num_passes++;
+    bool improved = ExecutePass();
+    VLOG(2) << "Pass " << num_passes << " cost: " << current_cost_ << endl;
+    if (!improved) {
+      break;
+    }
+  }
+  const bool balanced = (TotalOverload() == 0);
+  if (!balanced) {
+    log_stream() << "ERROR: Run " << cur_run << " exceeds the maximum weight "
+                 << "imbalance." << endl;
+  }
+
+  PartitionSummary summary;
+  summary.partition_node_ids.resize(num_parts_);
+  for (size_t i = 0; i < node_parts_.size(); i++) {
+    summary.partition_node_ids[node_parts_[i]].insert(hypergraph_.node_id(i));
+  }
+  summary.total_cost = current_cost_;
+  const int num_nets = hypergraph_.num_nets();
+  for (int net_index = 0; net_index < num_nets; net_index++) {
+    int net_size = hypergraph_.PinsEnd(net_index) -
+                   hypergraph_.PinsBegin(net_index);
+    bool cut = false;
+    for (int part = 0; part < num_parts_ && !cut; part++) {
+      int count = PinCount(net_index, part);
+      cut = (count != 0 && count != net_size);
+    }
+    if (!cut) {
+      continue;
+    }
+    const EdgeKlfm* edge = hypergraph_.net(net_index);
+    summary.total_span += (int)edge->Width();
+    if (options_.save_cutset) {
+      summary.partition_edge_ids.insert(edge->id_);
+      if (!edge->name.empty()) {
+        summary.partition_edge_names.insert(edge->name);
+      }
+    }
+  }
+  summary.total_weight = total_weight_;
+  // For each resource, the largest amount by which a partition exceeds an
+  // even share, as a fraction of that share. For two partitions this is the
+  // same as the KLFM engine's imbalance.
+  int total_weight_sum =
+      accumulate(total_weight_.begin(), total_weight_.end(), 0);
+  summary.partition_resource_ratios.resize(num_parts_);
+  for (size_t res = 0; res < num_resources_per_node_; res++) {
+    double share = (double)total_weight_[res] / num_parts_;
+    double max_deviation = 0.0;
+    if (share != 0.0) {
+      for (int part = 0; part < num_parts_; part++) {
+        max_deviation = max(max_deviation,
+                            (PartWeight(part, res) - share) / share);
+      }
+    }
+    summary.balance.push_back(max_deviation);
+    summary.total_resource_ratio.push_back(
+        (total_weight_sum != 0) ?
+        (double)total_weight_[res] / total_weight_sum : 0.0);
+  }
+  for (int part = 0; part < num_parts_; part++) {
+    int part_weight_sum = 0;
+    for (size_t res = 0; res < num_resources_per_node_; res++) {
+      part_weight_sum += PartWeight(part, res);
+    }
+    for (size_t res = 0; res < num_resources_per_node_; res++) {
+      summary.partition_resource_ratios[part].push_back(
+          (part_weight_sum != 0) ?
+          (double)PartWeight(part, res) / part_weight_sum : 0.0);
+    }
+  }
+  summary.num_passes_used = num_passes;
+  summary.truncated = run_truncated_;
+  summary.balanced = balanced;
+  summaries->push_back(summary);
+}
+
+void PartitionEngineKway::GenerateInitialPartition() {
+  const int num_nodes = hypergraph_.num_nodes();
+  node_parts_.assign(num_nodes, -1);
+  part_weights_.assign(num_parts_ * num_resources_per_node_, 0);
+
+  vector<int> seed_order(num_nodes);
+  iota(seed_order.begin(), seed_order.end(), 0);
+  shuffle(seed_order.begin(), seed_order.end(), random_engine_);
+
+  // A region is full once it reaches an even share of any constrained
+  // resource. If no resource is constrained, resource 0 is used.
+  vector<bool> fill_resource = options_.constrain_balance_by_resource;
+  if (find(fill_resource.begin(), fill_resource.end(), true) ==
+      fill_resource.end()) {
+    fill_resource[0] = true;
+  }
+  auto part_full = [&](int part) {
+    for (size_t res = 0; res < num_resources_per_node_; res++) {
+      if (fill_resource[res] && total_weight_[res] != 0 &&
+          PartWeight(part, res) * num_parts_ >= total_weight_[res]) {
+        return true;
+      }
+    }
+    return false;
+  };
+  auto node_fits = [&](int node_index, int part) {
+    for (size_t res = 0; res < num_resources_per_node_; res++) {
+      if (PartWeight(part, res) + NodeWeight(node_index, res) >
+          max_part_weight_[res]) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  // Grow each region breadth-first through the nets, starting a new seed
+  // whenever the frontier runs out. The last partition takes the remaining
+  // nodes.
+  vector<int> queued_for_part(num_nodes, -1);
+  size_t next_seed = 0;
+  for (int part = 0; part < num_parts_ - 1; part++) {
+    vector<int> frontier;
+    size_t head = 0;
+    while (!part_full(part)) {
+      if (head == frontier.size()) {
+        while (next_seed < seed_order.size() &&
+               node_parts_[seed_order[next_seed]] >= 0) {
+          next_seed++;
+        }
+        if (next_seed == seed_order.size()) {
+          break;
+        }
+        int seed = seed_order[next_seed++];
+        frontier.push_back(seed);
+        queued_for_part[seed] = part;
+      }
+      int node_index = frontier[head++];
+      if (node_parts_[node_index] >= 0 || !node_fits(node_index, part)) {
+        continue;
+      }
+      node_parts_[node_index] = part;
+      for (size_t res = 0; res < num_resources_per_node_; res++) {
+        part_weights_[part * num_resources_per_node_ + res] +=
+            NodeWeight(node_index, res);
+      }
+      const int* nets_end = hypergraph_.NetsEnd(node_index);
+      for (const int* net = hypergraph_.NetsBegin(node_index); net != nets_end;
+           ++net) {
+        const int* pins_end = hypergraph_.PinsEnd(*net);
+        for (const int* pin = hypergraph_.PinsBegin(*net); pin != pins_end;
+             ++pin) {
+          if (node_parts_[*pin] < 0 && queued_for_part[*pin] != part) {
+            queued_for_part[*pin] = part;
+            frontier.push_back(*pin);
+          }
+        }
+      }
+    }
+    // Nodes that were skipped because they did not fit may be used by a
+    // later region.
+    next_seed = 0;
+  }
+  for (int i = 0; i < num_nodes; i++) {
+    if (node_parts_[i] < 0) {
+      node_parts_[i] = num_parts_ - 1;
+    }
+  }
+}
+
+void PartitionEngineKway::RecomputePartitionState() {
+  const int num_nodes = hypergraph_.num_nodes();
+  const int num_nets = hypergraph_.num_nets();
+  pin_counts_.assign((size_t)num_nets * num_parts_, 0);
+  for (int net_index = 0; net_index < num_nets; net_index++) {
+    const int* pins_end = hypergraph_.PinsEnd(net_index);
+    for (const int* pin = hypergraph_.PinsBegin(net_index); pin != pins_end;
+         ++pin) {
+      PinCount(net_index, node_parts_[*pin])++;
+    }
+  }
+  part_weights_.assign(num_parts_ * num_resources_per_node_, 0);
+  for (int i = 0; i < num_nodes; i++) {
+    for (size_t res = 0; res < num_resources_per_node_; res++) {
+      part_weights_[node_parts_[i] * num_resources_per_node_ + res] +=
+          NodeWeight(i, res);
+    }
+  }
+  current_cost_ = 0.0;
+  for (int net_index = 0; net_index < num_nets; net_index++) {
+    current_cost_ += NetCost(net_index);
+  }
+}
+
+double PartitionEngineKway::NetCost(int net_index) const {
+  int num_spanned = 0;
+  for (int part = 0; part < num_parts_; part++) {
+    if (PinCount(net_index, part) != 0) {
+      num_spanned++;
+    }
+  }
+  double weight = hypergraph_.net(net_index)->Weight();
+  if (options_.objective == kObjectiveConnectivity) {
+    return weight * (num_spanned - 1);
+  } else {
+    return (num_spanned > 1) ? weight : 0.0;
+  }
+}
+
+long long PartitionEngineKway::TotalOverload() const {
+  long long overload = 0;
+  for (int part = 0; part < num_parts_; part++) {
+    for (size_t res = 0; res < num_resources_per_node_; res++) {
+      int excess = PartWeight(part, res) - max_part_weight_[res];
+      if (excess > 0) {
+        overload += excess;
+      }
+    }
+  }
+  return overload;
+}
+
+bool PartitionEngineKway::ExecutePass() {
+  const int num_nodes = hypergraph_.num_nodes();
+  vector<char> locked(num_nodes, false);
+  vector<char> affected_marked(num_nodes, false);
+  priority_queue<MoveCandidate> candidates;
+  // Nodes with no feasible move are set aside rather than dropped. Later
+  // moves may free room for them without changing their gains, so they are
+  // evaluated again whenever the candidates run out after a move.
+  vector<int> deferred;
+  vector<char> deferred_marked(num_nodes, false);
+  auto defer = [&](int node_index) {
+    if (!deferred_marked[node_index]) {
+      deferred_marked[node_index] = true;
+      deferred.push_back(node_index);
+    }
+  };
+  for (int i = 0; i < num_nodes; i++) {
+    move_stamps_[i]++;
+    MoveCandidate candidate = BestMove(i);
+    if (candidate.to_part >= 0) {
+      candidates.push(candidate);
+    } else {
+      defer(i);
+    }
+  }
+
+  // A partition is better than another if it is closer to meeting the
+  // balance constraints, or equally close and lower in cost.
+  vector<MoveRecord> moves;
+  double best_cost = current_cost_;
+  long long best_overload = TotalOverload();
+  size_t best_num_moves = 0;
+  vector<int> affected_nodes;
+  bool moved_since_retry = false;
+  while (true) {
+    if (candidates.empty()) {
+      if (!moved_since_retry) {
+        break;
+      }
+      moved_since_retry = false;
+      size_t num_still_deferred = 0;
+      for (int node_index : deferred) {
+        if (locked[node_index]) {
+          deferred_marked[node_index] = false;
+          continue;
+        }
+        move_stamps_[node_index]++;
+        MoveCandidate retried = BestMove(node_index);
+        if (retried.to_part >= 0) {
+          deferred_marked[node_index] = false;
+          candidates.push(retried);
+        } else {
+          deferred[num_still_deferred++] = node_index;
+        }
+      }
+      deferred.resize(num_still_deferred);
+      continue;
+    }
+    MoveCandidate candidate = candidates.top();
+    candidates.pop();
+    const int node_index = candidate.node_index;
+    if (locked[node_index] || candidate.stamp != move_stamps_[node_index]) {
+      continue;
+    }
+    // The partition weights may have changed since the candidate was made,
+    // so the best feasible move is found again before moving.
+    MoveCandidate current = BestMove(node_index);
+    if (current.to_part < 0) {
+      defer(node_index);
+      continue;
+    }
+    if (current.gain < candidate.gain) {
+      current.stamp = ++move_stamps_[node_index];
+      candidates.push(current);
+      continue;
+    }
+
+    moves.push_back(MoveRecord{node_index, node_parts_[node_index]});
+    locked[node_index] = true;
+    moved_since_retry = true;
+    affected_nodes.clear();
+    MoveNode(node_index, current.to_part, locked, &affected_nodes);
+    for (int affected_index : affected_nodes) {
+      if (affected_marked[affected_index]) {
+        continue;
+      }
+      affected_marked[affected_index] = true;
+      move_stamps_[affected_index]++;
+      MoveCandidate updated = BestMove(affected_index);
+      if (updated.to_part >= 0) {
+        candidates.push(updated);
+      } else {
+        defer(affected_index);
+      }
+    }
+    for (int affected_index : affected_nodes) {
+      affected_marked[affected_index] = false;
+    }
+
+    long long overload = TotalOverload();
+    if (overload < best_overload ||
+        (overload == best_overload && current_cost_ < best_cost)) {
+      best_overload = overload;
+      best_cost = current_cost_;
+      best_num_moves = moves.size();
+    }
+    if ((moves.size() % kDeadlineCheckInterval) == 0 && DeadlineExpired()) {
+      run_truncated_ = true;
+      break;
+    }
+  }
+
+  // Roll back to the best partition seen in the pass.
+  while (moves.size() > best_num_moves) {
+    const MoveRecord& move = moves.back();
+    MoveNode(move.node_index, move.from_part, locked, NULL);
+    moves.pop_back();
+  }
+  current_cost_ = best_cost;
+  return best_num_moves > 0;
+}
+
+PartitionEngineKway::MoveCandidate PartitionEngineKway::BestMove(
+    int node_index) {
+  MoveCandidate best;
+  best.gain = -numeric_limits<double>::infinity();
+  best.node_index = node_index;
+  best.to_part = -1;
+  best.stamp = move_stamps_[node_index];
+
+  const int from_part = node_parts_[node_index];
+  // 'gain_to_part[p]' accumulates the part of the gain that depends on the
+  // destination, and 'base_gain' the part that depends only on the source.
+  vector<double>& gain_to_part = gain_to_part_;
+  gain_to_part.assign(num_parts_, 0.0);
+  double base_gain = 0.0;
+  const int* nets_end = hypergraph_.NetsEnd(node_index);
+  for (const int* net = hypergraph_.NetsBegin(node_index); net != nets_end;
+       ++net) {
+    const double weight = hypergraph_.net(*net)->Weight();
+    const int net_size = hypergraph_.PinsEnd(*net) -
+                         hypergraph_.PinsBegin(*net);
+    const int from_count = PinCount(*net, from_part);
+    if (options_.objective == kObjectiveConnectivity) {
+      // Leaving a partition in which it is the only pin removes that
+      // partition from the net. Entering a partition the net does not
+      // touch adds one.
+      if (from_count == 1) {
+        base_gain += weight;
+      }
+      for (int part = 0; part < num_parts_; part++) {
+        if (PinCount(*net, part) == 0) {
+          gain_to_part[part] -= weight;
+        }
+      }
+    } else {
+      // The net is uncut exactly when one partition holds all of its pins.
+      if (from_count == net_size) {
+        base_gain -= weight;
+      }
+      for (int part = 0; part < num_parts_; part++) {
+        if (PinCount(*net, part) == net_size - 1) {
+          gain_to_part[part] += weight;
+        }
+      }
+    }
+  }
+
+  for (int part = 0; part < num_parts_; part++) {
+    if (part == from_part) {
+      continue;
+    }
+    bool fits = true;
+    for (size_t res = 0; res < num_resources_per_node_; res++) {
+      if (NodeWeight(node_index, res) != 0 &&
+          PartWeight(part, res) + NodeWeight(node_index, res) >
+          max_part_weight_[res]) {
+        fits = false;
+        break;
+      }
+    }
+    if (!fits) {
+      continue;
+    }
+    double gain = base_gain + gain_to_part[part];
+    // Ties go to the lighter partition.
+    if (gain > best.gain ||
+        (gain == best.gain &&
+         PartWeight(part, 0) < PartWeight(best.to_part, 0))) {
+      best.gain = gain;
+      best.to_part = part;
+    }
+  }
+  return best;
+}
+
+void PartitionEngineKway::MoveNode(
+    int node_index, int to_part, const vector<char>& locked,
+    vector<int>* affected_nodes) {
+  const int from_part = node_parts_[node_index];
+  assert(from_part != to_part);
+  node_parts_[node_index] = to_part;
+  for (size_t res = 0; res < num_resources_per_node_; res++) {
+    int weight = NodeWeight(node_index, res);
+    part_weights_[from_part * num_resources_per_node_ + res] -= weight;
+    part_weights_[to_part * num_resources_per_node_ + res] += weight;
+  }
+
+  const int* nets_end = hypergraph_.NetsEnd(node_index);
+  for (const int* net = hypergraph_.NetsBegin(node_index); net != nets_end;
+       ++net) {
+    const double weight = hypergraph_.net(*net)->Weight();
+    const int net_size = hypergraph_.PinsEnd(*net) -
+                         hypergraph_.PinsBegin(*net);
+    int& from_count = PinCount(*net, from_part);
+    int& to_count = PinCount(*net, to_part);
+    if (options_.objective == kObjectiveConnectivity) {
+      if (to_count == 0) {
+        current_cost_ += weight;
+      }
+      if (from_count == 1) {
+        current_cost_ -= weight;
+      }
+    } else {
+      bool cut_before = (from_count != net_size);
+      bool cut_after = (to_count + 1 != net_size);
+      if (cut_after && !cut_before) {
+        current_cost_ += weight;
+      } else if (cut_before && !cut_after) {
+        current_cost_ -= weight;
+      }
+    }
+    bool changes_gains = MoveChangesPinGains(net_size, from_count, to_count);
+    from_count--;
+    to_count++;
+
+    if (affected_nodes != NULL && changes_gains) {
+      const int* pins_end = hypergraph_.PinsEnd(*net);
+      for (const int* pin = hypergraph_.PinsBegin(*net); pin != pins_end;
+           ++pin) {
+        if (!locked[*pin]) {
+          affected_nodes->push_back(*pin);
+        }
+      }
+    }
+  }
+}
+
+bool PartitionEngineKway::MoveChangesPinGains(
+    int net_size, int from_count, int to_count) const {
+  if (options_.objective == kObjectiveConnectivity) {
+    // Gains depend on whether a partition holds zero or one of the pins.
+    return from_count <= 2 || to_count <= 1;
+  } else {
+    // Gains depend on whether a partition holds all or all but one of the
+    // pins.
+    return from_count >= net_size - 1 || to_count >= net_size - 2;
+  }
+}
+
+void PartitionEngineKway::PrintResultFull(const PartitionSummary& summary,
+                                          int run_num) {
+  os_ << endl << "----------------Run Summary------------------" << endl;
+  os_ << "Run " << run_num << endl;
+  os_ << "Passes: " << summary.num_passes_used << endl;
+  if (summary.truncated) {
+    os_ << "Truncated by deadline: true" << endl;
+  }
+  if (!summary.balanced) {
+    os_ << "FAILED: Exceeds maximum weight imbalance" << endl;
+  }
+  os_ << "Cut cost: " << summary.total_cost << endl;
+  os_ << "Cut span: " << summary.total_span << endl;
+  os_ << "Imbalance: ";
+  for (auto imb : summary.balance) {
+    os_ << imb << " ";
+  }
+  os_ << endl;
+  os_ << "Total Resource Weights: ";
+  for (auto wt : summary.total_weight) {
+    os_ << wt << " ";
+  }
+  os_ << endl;
+  for (size_t part = 0; part < summary.partition_resource_ratios.size();
+       part++) {
+    os_ << "Partition " << part << " Nodes: "
+        << summary.partition_node_ids[part].size()
+        << " Resource Weight Ratio: ";
+    for (auto rr : summary.partition_resource_ratios[part]) {
+      os_ << rr << " ";
+    }
+    os_ << endl;
+  }
+  os_ << endl;
+}
+
+void PartitionEngineKway::SummarizeResults(
+    const vector<PartitionSummary>& summaries) {
+  os_ << endl << "----------------K-Way Results------------------" << endl;
+  if (summaries.empty()) {
+    return;
+  }
+  vector<pair<string, vector<double>>> metrics(3);
+  metrics[0].first = "PASSES";
+  metrics[1].first = "COST";
+  metrics[2].first = "SPAN";
+  for (auto& it : summaries) {
+    metrics[0].second.push_back(it.num_passes_used);
+    metrics[1].second.push_back(it.total_cost);
+    metrics[2].second.push_back(it.total_span);
+  }
+  for (auto& metric : metrics) {
+    const vector<double>& data = metric.second;
+    double sum = accumulate(data.begin(), data.end(), 0.0);
+    os_ << "MIN " << metric.first << ": "
+        << *min_element(data.begin(), data.end()) << endl;
+    os_ << "MAX " << metric.first << ": "
+        << *max_element(data.begin(), data.end()) << endl;
+    os_ << "AVERAGE " << metric.first << ": " << sum / data.size() << endl;
+    os_ << endl;
+  }
+}
+
+void PartitionEngineKway::Options::Print(ostream& os) {
+  os << "-----------K-Way Partitioning Options-----------" << endl;
+  os << "Number of Partitions: " << num_parts << endl;
+  os << "Objective: ";
+  switch (objective) {
+    case kObjectiveConnectivity:
+      os << "Connectivity (lambda - 1)";
+      break;
+    case kObjectiveCutNet:
+      os << "Cut Net";
+      break;
+    default:
+      assert_b(false) {
+        printf("\nUnrecognized k-way objective.\n");
+      }
+  }
+  os << endl;
+  os << "Number of Runs: " << num_runs << endl;
+  os << "Num Threads: " << num_threads << endl;
+  if (deadline_ms != 0) {
+    os << "Deadline (ms): " << deadline_ms << endl;
+  }
+  os << "Max Passes: " << max_passes << endl;
+  os << "Max Imbalance: ";
+  for (auto it : max_imbalance_fraction) {
+    os << it << " ";
+  }
+  os << endl;
+  os << "Constrain Balance by Resource: ";
+  for (auto it : constrain_balance_by_resource) {
+    os << (it ? "true" : "false") << " ";
+  }
+  os << endl;
+}
+
+void PartitionEngineKway::Options::PopulateFromPartitionerConfig(
+    const PartitionerConfig& config) {
+  // Resources are constrained the same way as in the KLFM engine.
+  num_resources_per_node = config.device_resource_capacities.size();
+  max_imbalance_fraction.clear();
+  for (auto frac : config.device_resource_max_imbalances) {
+    max_imbalance_fraction.push_back(frac);
+  }
+  assert(max_imbalance_fraction.size() == num_resources_per_node);
+  constrain_balance_by_resource.assign(num_resources_per_node, true);
+  for (size_t i = 0; i < num_resources_per_node; i++) {
+    if (config.gain_bucket_type == PartitionerConfig::kGainBucketSingleResource) {
+      constrain_balance_by_resource[i] = (i == 0);
+    } else {
+      constrain_balance_by_resource[i] = (max_imbalance_fraction[i] < 0.99);
+    }
+  }
+}
@@ -0,0 +1,285 @@
+#ifndef PARTITION_ENGINE_KWAY_H_
+#define PARTITION_ENGINE_KWAY_H_
+
+/* Partitions a graph or hypergraph directly into k parts, rather than by
+   recursive bisection.
+
+   Each run grows k balanced regions from random seed nodes to form an
+   initial partition, then refines it with k-way FM passes. In a pass, every
+   node may be moved once to whichever other partition gives it the largest
+   feasible gain. At the end of the pass, the moves made after the best
+   partition seen in the pass are rolled back. Passes repeat until one fails
+   to improve the partition.
+
+   Nodes keep their selected implementations. The graph is not coarsened.
+
+   If 'num_threads' is set above 1, independent runs are executed
+   concurrently by worker engines that share this engine's hypergraph but
+   keep their own partition state and random engine. */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "edge_klfm.h"
+#include "klfm_hypergraph.h"
+#include "node.h"
+#include "partition_engine.h"
+#include "partitioner_config.h"
+
+class PartitionEngineKway : public PartitionEngine {
+ public:
+  typedef std::unordered_map<int, Node*> KwayNodeMap;
+  typedef std::unordered_map<int, EdgeKlfm*> KwayEdgeMap;
+
+  typedef enum {
+    kNullObjective, // Guard value.
+    // Sum over nets of weight * (number of partitions spanned - 1).
+    kObjectiveConnectivity,
+    // Sum of the weights of the nets that span more than one partition.
+    kObjectiveCutNet,
+  } Objective;
+
+  class Options {
+   public:
+    Options()
+      : num_parts(2),
+        objective(kObjectiveConnectivity),
+        num_runs(1),
+        num_threads(1),
+        deadline_ms(0),
+        max_passes(100),
+        num_resources_per_node(1),
+        save_cutset(true),
+        enable_print_output(true) {
+      max_imbalance_fraction.insert(max_imbalance_fraction.begin(),
+                                    num_resources_per_node, 0.1);
+      constrain_balance_by_resource.insert(
+          constrain_balance_by_resource.begin(), num_resources_per_node, true);
+    }
+
+    // Print the options to 'os'.
+    void Print(std::ostream& os);
+
+    // Sets the balance constraints from 'config'. The remaining options are
+    // not part of the configuration file and are left unchanged.
+    void PopulateFromPartitionerConfig(const PartitionerConfig& config);
+
+    // The number of partitions to create. Must be at least 2.
+    size_t num_parts;
+
+    // The cost function minimized by refinement.
+    Objective objective;
+
+    // Number of independent runs to execute.
+    size_t num_runs;
+
+    // Number of threads used to execute independent runs concurrently.
+    // Summaries are still returned in run order. Results differ from the
+    // single-threaded results, since each thread has its own random engine.
+    size_t num_threads;
+
+    // If non-zero, limits the wall-clock time of Execute() to roughly this
+    // many milliseconds, as in the KLFM engine. The first run always
+    // executes. Once the deadline expires, no further runs or passes are
+    // started, the pass in progress is rolled back to its best partition,
+    // and only the best run is returned.
+    uint64_t deadline_ms;
+
+    // Caps the number of refinement passes made in each run.
+    size_t max_passes;
+
+    // The number of resources in each node's weight vector.
+    size_t num_resources_per_node;
+
+    // The weight of each partition in resource i may exceed an even share of
+    // the total weight in that resource by at most
+    // 'max_imbalance_fraction[i]' times that share. For two partitions this
+    // is the same limit the KLFM engine applies. Resources for which
+    // 'constrain_balance_by_resource' is false are not constrained.
+    std::vector<double> max_imbalance_fraction;
+    std::vector<bool> constrain_balance_by_resource;
+
+    // Fill in the IDs and names of the cut nets in each summary.
+    bool save_cutset;
+
+    // If set to false, will suppress printing of the per-run and summary
+    // results.
+    bool enable_print_output;
+  };
+
+  PartitionEngineKway(Node* graph, const Options& options, std::ostream& os);
+  virtual ~PartitionEngineKway();
+
+  virtual void Execute(std::vector<PartitionSummary>* summaries);
+  virtual void Reset() {}
+
+ private:
+  // Creates a worker that executes runs for 'parent' in ExecuteParallel().
+  // The worker shares the hypergraph, nodes and edges of 'parent', which
+  // must outlive it.
+  PartitionEngineKway(const PartitionEngineKway& parent, size_t worker_id);
+
+  // A candidate move of the node with index 'node_index' in 'hypergraph_' to
+  // partition 'to_part'. 'stamp' is compared against 'move_stamps_' to
+  // discard candidates that have been superseded.
+  struct MoveCandidate {
+    double gain;
+    int node_index;
+    int to_part;
+    unsigned int stamp;
+    bool operator<(const MoveCandidate& rhs) const {
+      return gain < rhs.gain;
+    }
+  };
+
+  // A move made during a pass, recorded so that it can be rolled back.
+  struct MoveRecord {
+    int node_index;
+    int from_part;
+  };
+
+  // Executes a single run and appends its result to 'summaries'.
+  void ExecuteRun(int cur_run, std::vector<PartitionSummary>* summaries);
+
+  // Executes all runs across 'options_.num_threads' worker engines and
+  // appends their summaries to 'summaries' in run order.
+  void ExecuteParallel(std::vector<PartitionSummary>* summaries);
+
+  // Called on a worker engine. Executes runs 'first_run',
+  // 'first_run + run_stride', ... and stores the summary of each run at its
+  // index in 'run_summaries'.
+  void ExecuteWorkerRuns(size_t first_run, size_t run_stride,
+                         std::vector<std::vector<PartitionSummary>>*
+                             run_summaries);
+
+  // Messages are written to standard output, except in workers, which
+  // buffer them until FlushWorkerOutput().
+  std::ostream& log_stream() {
+    return is_parallel_worker_ ? worker_log_buffer_ : std::cout;
+  }
+
+  // Called on a worker engine. Writes the messages buffered since the last
+  // call to standard output as one block.
+  void FlushWorkerOutput();
+
+  // Returns true if 'options_.deadline_ms' is set and the deadline for the
+  // current call to Execute() has passed.
+  bool DeadlineExpired() const;
+
+  // Replaces 'summaries' with the lowest cost balanced run, or the least
+  // imbalanced run if none is balanced.
+  void KeepBestRun(std::vector<PartitionSummary>* summaries);
+
+  // Assigns every node to a partition by growing balanced regions through
+  // the nets from randomly chosen seed nodes.
+  void GenerateInitialPartition();
+
+  // Performs one k-way FM pass. Returns true if the pass improved the
+  // partition. Sets 'run_truncated_' if the deadline cuts the pass short.
+  bool ExecutePass();
+
+  // Returns the best feasible move of the node with index 'node_index', or a
+  // candidate with 'to_part' < 0 if no move is feasible.
+  MoveCandidate BestMove(int node_index);
+
+  // Moves the node with index 'node_index' to 'to_part', updating the pin
+  // counts, partition weights and cost. If 'affected_nodes' is non-NULL, the
+  // nodes that are not in 'locked' and whose gains may have changed are
+  // appended to it.
+  void MoveNode(int node_index, int to_part, const std::vector<char>& locked,
+                std::vector<int>* affected_nodes);
+
+  // Returns true if the change in the pin counts of a net with 'net_size'
+  // pins, from 'from_count' pins in the source partition and 'to_count' pins
+  // in the destination partition before a move, can change the gain of any
+  // other node on the net.
+  bool MoveChangesPinGains(int net_size, int from_count, int to_count) const;
+
+  // Cost of net 'net_index' under the configured objective.
+  double NetCost(int net_index) const;
+
+  // Recomputes 'pin_counts_', 'part_weights_' and 'current_cost_' from
+  // 'node_parts_'.
+  void RecomputePartitionState();
+
+  // Total amount by which partition weights exceed their limits.
+  long long TotalOverload() const;
+
+  int PinCount(int net_index, int part) const {
+    return pin_counts_[(size_t)net_index * num_parts_ + part];
+  }
+  int& PinCount(int net_index, int part) {
+    return pin_counts_[(size_t)net_index * num_parts_ + part];
+  }
+  int PartWeight(int part, size_t resource) const {
+    return part_weights_[part * num_resources_per_node_ + resource];
+  }
+  int NodeWeight(int node_index, size_t resource) const {
+    return node_weights_[node_index * num_resources_per_node_ + resource];
+  }
+
+  void PrintResultFull(const PartitionSummary& summary, int run_num);
+  void SummarizeResults(const std::vector<PartitionSummary>& summaries);
+
+  Options options_;
+
+  // Messages buffered by a parallel worker. Declared before 'os_'.
+  std::ostringstream worker_log_buffer_;
+
+  std::ostream& os_;
+  const int num_parts_;
+  const size_t num_resources_per_node_;
+
+  // Set for engines created by ExecuteParallel().
+  bool is_parallel_worker_;
+
+  // Deadline for the current call to Execute(), if 'options_.deadline_ms' is
+  // set. Workers inherit the deadline of their parent.
+  std::chrono::steady_clock::time_point deadline_;
+  // Set when the deadline cuts refinement of the current run short.
+  bool run_truncated_;
+  // Number of moves between deadline checks within a pass.
+  static const size_t kDeadlineCheckInterval = 64;
+
+  // Serializes FlushWorkerOutput().
+  static std::mutex worker_output_mutex_;
+  // Base of the seeds of the random engines of parallel workers.
+  static const unsigned kWorkerRandomSeedBase = 0;
+
+  // The edges in this map are copied from the starting graph and are owned
+  // by this object. The nodes are not copied, since they are not modified.
+  // Both maps are empty in workers.
+  KwayNodeMap node_map_;
+  KwayEdgeMap edge_map_;
+  KlfmHypergraph hypergraph_;
+
+  // Selected weight vectors of the nodes, indexed by node index and then
+  // resource.
+  std::vector<int> node_weights_;
+  std::vector<int> total_weight_;
+  std::vector<int> max_part_weight_;
+
+  // State of the partition in the current run. 'pin_counts_' is indexed by
+  // net index and then partition, and 'part_weights_' by partition and then
+  // resource.
+  std::vector<int> node_parts_;
+  std::vector<int> pin_counts_;
+  std::vector<int> part_weights_;
+  double current_cost_;
+
+  std::vector<unsigned int> move_stamps_;
+
+  // Scratch space for BestMove(), indexed by partition.
+  std::vector<double> gain_to_part_;
+
+  std::default_random_engine random_engine_;
+};
+
+#endif /* PARTITION_ENGINE_KWAY_H_ */
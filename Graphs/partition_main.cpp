@@ -6,10 +6,15 @@
 
 #include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <exception>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -18,9 +23,14 @@
 
 #include "id_manager.h"
 #include "chaco_parser.h"
+#include "induced_subgraph.h"
+#include "klfm_move_trace.h"
+#include "klfm_profiler.h"
+#include "netlist_delta.h"
 #include "node.h"
 #include "partition_engine.h"
 #include "partition_engine_klfm.h"
+#include "partition_engine_kway.h"
 #include "preprocessor.h"
 #include "ntl_parser.h"
 #include "testbench_generator.h"
@@ -38,7 +48,12 @@ class KlfmRunConfig {
   };
   PartitionerConfig partitioner_config;
   int num_runs{1};
+  int num_threads{1};
+  int deadline_ms{0};
   int num_ways{2};
+  PartitionEngineKway::Objective kway_objective{
+      PartitionEngineKway::kObjectiveConnectivity};
+  bool direct_kway{false};
   string graph_filename;
   GraphFileType graph_file_type{kChacoGraph};
   string result_filename;
@@ -49,18 +64,44 @@ class KlfmRunConfig {
   bool export_initial_sol_only{false};
   bool sol_scip_format{true};
   bool sol_gurobi_format{false};
+  bool sol_native_format{false};
+  string initial_partition_filename;
+  bool coarsen_initial_partition{false};
+  double initial_partition_perturbation{0.05};
+  string eco_delta_filename;
+  int eco_region_radius{2};
   bool use_entropy{false};
   bool save_cutset{false};
   string cutset_dir;
+  string profile_filename;
+  string move_trace_filename;
 };
 
 void print_usage_and_exit();
 
 KlfmRunConfig ConfigFromCommandLineOptions(int argc, char* argv[]);
 
+// Moves the nodes of 'graph' with IDs in 'node_ids' into a new graph, along
+// with the edges among them, and drops their connections to edges that lead
+// elsewhere. 'graph' keeps the other edges, which may still refer to the
+// moved nodes, so it must not be used again except to extract other nodes.
+unique_ptr<Node> ExtractSubgraph(Node* graph, const set<int>& node_ids);
+
+// Bipartitions 'subgraph', which the engine takes over, or if it is null, the
+// subgraph of 'graph' induced by 'node_ids', and returns the summary of the
+// result. If 'halves' is not null, it receives the two sides of the result as
+// graphs of their own, so that they can be bisected without being copied.
+PartitionSummary BisectSubgraph(Node* graph, const set<int>& node_ids,
+    unique_ptr<Node> subgraph, const PartitionEngineKlfm::Options& options,
+    ostream& os, vector<unique_ptr<Node>>* halves);
+
+// Bisects each of 'starting_partitions' recursively until there are
+// 'num_ways' partitions. If 'options.deadline_ms' is set, every bisection
+// shares the time left until 'deadline', and none is started after it.
 void RepartitionKway(int num_ways, int cur_lev, Node* graph,
     const vector<set<int>>& starting_partitions,
     PartitionEngineKlfm::Options& options,
+    chrono::steady_clock::time_point deadline,
     vector<int>* results_this_run,
     vector<double>* rms_devs_this_run,
     ostream& os);
@@ -109,9 +150,9 @@ int main(int argc, char *argv[]) {
   PrintPreamble(rs, run_config.graph_filename);
 
   map<int, string> edge_id_name_map;
-  Node* graph;
   const int kAlot = 1000000000;
-  graph = new Node(kAlot, "Top-Level Graph");
+  // Released on every return, including the early ones.
+  unique_ptr<Node> graph(new Node(kAlot, "Top-Level Graph"));
   {
     if (run_config.graph_file_type == KlfmRunConfig::kNtlGraph ||
         run_config.graph_file_type == KlfmRunConfig::kXntlGraph) {
@@ -122,34 +163,113 @@ int main(int argc, char *argv[]) {
       }
       run_config.num_ways = 2;
       NtlParser parser(ver);
-      parser.Parse(graph, run_config.graph_filename.c_str(), &edge_id_name_map);
+      parser.Parse(graph.get(), run_config.graph_filename.c_str(),
+                   &edge_id_name_map);
     } else {
       ls << "Invoking Chaco Parser" << endl;
       ChacoParser parser;
-      assert(parser.Parse(graph, run_config.graph_filename.c_str()));
+      assert(parser.Parse(graph.get(), run_config.graph_filename.c_str()));
     }
   }
-  run_config.partitioner_config.ValidateOrDie(graph);
+  // An ECO delta is applied to the base graph before preprocessing, so that
+  // new and changed nodes are preprocessed like the rest.
+  set<int> eco_affected_node_ids;
+  if (!run_config.eco_delta_filename.empty()) {
+    NetlistDelta delta;
+    if (!delta.Parse(run_config.eco_delta_filename.c_str())) {
+      cout << "Failed to parse ECO delta " << run_config.eco_delta_filename
+           << endl;
+      return 1;
+    }
+    delta.Apply(graph.get(), &eco_affected_node_ids);
+    ls << "Applied " << delta.changes().size() << " changes affecting "
+       << eco_affected_node_ids.size() << " nodes" << endl;
+  }
+  run_config.partitioner_config.ValidateOrDie(graph.get());
 
   {
     Preprocessor preprocessor(run_config.partitioner_config);
-    preprocessor.ProcessGraph(graph);
+    preprocessor.ProcessGraph(graph.get());
   }
 
   PartitionEngineKlfm::Options options;
   options.PopulateFromPartitionerConfig(run_config.partitioner_config);
   options.num_runs = run_config.num_runs;
+  options.num_threads = run_config.num_threads;
+  options.deadline_ms = run_config.deadline_ms;
   options.initial_sol_base_filename = run_config.initial_sol_base_filename;
   options.final_sol_base_filename = run_config.final_sol_base_filename;
   options.export_initial_sol_only = run_config.export_initial_sol_only;
   options.sol_scip_format = run_config.sol_scip_format;
   options.sol_gurobi_format = run_config.sol_gurobi_format;
+  options.sol_native_format = run_config.sol_native_format;
+  options.initial_partition_filename = run_config.initial_partition_filename;
+  options.coarsen_initial_partition = run_config.coarsen_initial_partition;
+  options.initial_partition_perturbation =
+      run_config.initial_partition_perturbation;
+  options.refinement_region = eco_affected_node_ids;
+  options.refinement_region_radius = run_config.eco_region_radius;
   options.use_entropy = run_config.use_entropy;
+  // Set once here, before any engine or worker thread exists.
+  Edge::SetEntropyMode(options.use_entropy);
   options.save_cutset = run_config.save_cutset;
   options.cutset_dir = run_config.cutset_dir;
+  options.profile_filename = run_config.profile_filename;
+  options.move_trace_filename = run_config.move_trace_filename;
+
+  // Partitioning into more than two parts is done by recursive bisection
+  // unless the direct k-way engine is requested.
+  bool k_way = run_config.num_ways > 2;
+  bool direct_kway = k_way && run_config.direct_kway;
+  bool recursive_bisection = k_way && !run_config.direct_kway;
+  PartitionEngineKway::Options kway_options;
+  kway_options.PopulateFromPartitionerConfig(run_config.partitioner_config);
+  kway_options.num_parts = run_config.num_ways;
+  kway_options.objective = run_config.kway_objective;
+  kway_options.num_runs = run_config.num_runs;
+  kway_options.num_threads = run_config.num_threads;
+  kway_options.deadline_ms = run_config.deadline_ms;
+  // The testbench is generated from the cut nets.
+  kway_options.save_cutset =
+      run_config.save_cutset || !run_config.testbench_filename.empty();
+
+  if (direct_kway) {
+    vector<string> ignored_flags;
+    if (!run_config.profile_filename.empty()) {
+      ignored_flags.push_back("--profile-file");
+    }
+    if (!run_config.move_trace_filename.empty()) {
+      ignored_flags.push_back("--move-trace-file");
+    }
+    if (!run_config.initial_sol_base_filename.empty()) {
+      ignored_flags.push_back("--export-initial-sol");
+    }
+    if (!run_config.final_sol_base_filename.empty()) {
+      ignored_flags.push_back("--export-final-sol");
+    }
+    if (!run_config.cutset_dir.empty()) {
+      ignored_flags.push_back("--write_cutset_dir");
+    }
+    for (auto& flag : ignored_flags) {
+      cout << "WARNING: The direct k-way engine does not support " << flag
+           << ". It is ignored." << endl;
+    }
+  } else {
+    if (!options.profile_filename.empty()) {
+      KlfmProfiler::WriteHeader(options.profile_filename);
+    }
+    if (!options.move_trace_filename.empty()) {
+      KlfmMoveTrace::Writer::WriteHeader(options.move_trace_filename,
+                                         options.num_resources_per_node);
+    }
+  }
 
   run_config.partitioner_config.PrintPreprocessorOptions(rs);
-  options.Print(rs);
+  if (direct_kway) {
+    kway_options.Print(rs);
+  } else {
+    options.Print(rs);
+  }
 
   vector<int> total_weights = graph->SelectedWeightVector();
   ls << "Inital Graph Weight after Preprocessing: ";
@@ -166,16 +286,35 @@ int main(int argc, char *argv[]) {
 
   std::chrono::high_resolution_clock::time_point t_start =
       std::chrono::high_resolution_clock::now();
+  // A deadline covers the whole partitioning, including recursive bisection.
+  chrono::steady_clock::time_point deadline =
+      chrono::steady_clock::now() + chrono::milliseconds(options.deadline_ms);
 
-  bool k_way = run_config.num_ways > 2;
   ls << "Create partitioner" << endl;
   vector<PartitionSummary> summaries;
-  {
-    PartitionEngineKlfm klfm_partitioner(graph, options, rs);
-
-    if (!k_way) {
-      delete graph;
+  if (direct_kway) {
+    // The k-way engine refers to the nodes of 'graph', so it must outlive
+    // the engine.
+    {
+      PartitionEngineKway kway_partitioner(graph.get(), kway_options, rs);
+      ls << "Execute partitioner" << endl;
+      kway_partitioner.Execute(&summaries);
+    }
+    graph.reset();
+  } else {
+    // Recursive bisection starts from the node sets of each bipartition, so
+    // it needs the graph afterwards. Otherwise the engine takes ownership of
+    // the graph rather than copying it.
+    unique_ptr<PartitionEngineKlfm> klfm_partitioner_ptr;
+    if (recursive_bisection) {
+      options.save_cutset = true;
+      klfm_partitioner_ptr.reset(
+          new PartitionEngineKlfm(graph.get(), options, rs));
+    } else {
+      klfm_partitioner_ptr.reset(
+          new PartitionEngineKlfm(move(graph), options, rs));
     }
+    PartitionEngineKlfm& klfm_partitioner = *klfm_partitioner_ptr;
 
     ls << "Execute partitioner" << endl;
     klfm_partitioner.Execute(&summaries);
@@ -191,7 +330,19 @@ int main(int argc, char *argv[]) {
 
   std::cout << "Duration: " << duration_s.count() << std::endl;
 
-  if (k_way) {
+  // Runs that end outside of the balance limits have failed. Without a
+  // single balanced run there is no usable partition.
+  bool found_balanced_partition = false;
+  for (auto& it : summaries) {
+    found_balanced_partition |= it.balanced;
+  }
+  if (!summaries.empty() && !found_balanced_partition) {
+    cout << "No run found a partition within the maximum weight imbalance"
+         << endl;
+    return 1;
+  }
+
+  if (recursive_bisection) {
     vector<vector<int>> costs_by_run;
     vector<vector<double>> rms_devs_by_run;
     for (size_t result_num = 0; result_num < summaries.size(); result_num++) {
@@ -199,9 +350,9 @@ int main(int argc, char *argv[]) {
       vector<double> rms_devs_this_run;
       rs << endl << "Executing K-Way Partitioning for Result " << result_num
          << endl;
-      RepartitionKway(run_config.num_ways, 4, graph,
-          summaries[result_num].partition_node_ids, options, &results_this_run,
-          &rms_devs_this_run, rs);
+      RepartitionKway(run_config.num_ways, 4, graph.get(),
+          summaries[result_num].partition_node_ids, options, deadline,
+          &results_this_run, &rms_devs_this_run, rs);
       costs_by_run.push_back(results_this_run);
       rms_devs_by_run.push_back(rms_devs_this_run);
     }
@@ -213,8 +364,13 @@ int main(int argc, char *argv[]) {
       rms_devs_by_run[i].insert(rms_devs_by_run[i].begin(),
           summaries[i].rms_resource_deviation);
     }
+    // A deadline can leave later runs with fewer complete levels.
+    size_t num_levels = costs_by_run[0].size();
+    for (auto& costs : costs_by_run) {
+      num_levels = min(num_levels, costs.size());
+    }
     rs << "Mincosts:" << endl;
-    for (size_t i = 0; i < costs_by_run[0].size(); i++) {
+    for (size_t i = 0; i < num_levels; i++) {
       int min_val = costs_by_run[0][i];
       double min_val_rms_dev = rms_devs_by_run[0][i];
       for (size_t j = 0; j < costs_by_run.size(); j++) {
@@ -225,7 +381,6 @@ int main(int argc, char *argv[]) {
       }
       rs << min_val << " " << min_val_rms_dev << endl;
     }
-    delete graph;
   }
 
   if (!run_config.testbench_filename.empty()) {
@@ -253,101 +408,214 @@ int main(int argc, char *argv[]) {
   return 0;
 }
 
+unique_ptr<Node> ExtractSubgraph(Node* graph, const set<int>& node_ids) {
+  unique_ptr<Node> subgraph(new Node(graph->id, graph->name));
+  Node::NodeMap& nodes = graph->internal_nodes();
+  Node::EdgeMap& edges = graph->internal_edges();
+  for (auto node_id : node_ids) {
+    Node* node = nodes.at(node_id);
+    vector<int> edges_to_remove;
+    for (auto& port_pair : node->ports()) {
+      int edge_id = port_pair.second.external_edge_id;
+      if (subgraph->internal_edges().count(edge_id) != 0) {
+        continue;
+      }
+      auto edge_it = edges.find(edge_id);
+      assert(edge_it != edges.end());
+      bool inside = true;
+      for (auto cnx_id : edge_it->second->connection_ids()) {
+        inside &= node_ids.count(cnx_id) != 0;
+      }
+      if (inside) {
+        subgraph->AddInternalEdge(edge_id, edge_it->second);
+        edges.erase(edge_it);
+      } else {
+        edges_to_remove.push_back(edge_id);
+      }
+    }
+    for (auto edge_id : edges_to_remove) {
+      node->RemoveConnection(edge_id);
+    }
+    subgraph->AddInternalNode(node_id, node);
+    nodes.erase(node_id);
+  }
+  return subgraph;
+}
+
+PartitionSummary BisectSubgraph(Node* graph, const set<int>& node_ids,
+    unique_ptr<Node> subgraph, const PartitionEngineKlfm::Options& options,
+    ostream& os, vector<unique_ptr<Node>>* halves) {
+  // The halves start from the implementations that this bisection started
+  // from, as they would if they were copied from 'graph', rather than from
+  // those that its run left selected.
+  map<int, int> implementations;
+  if (halves != nullptr) {
+    for (auto node_id : node_ids) {
+      Node* node = subgraph ? subgraph->internal_nodes().at(node_id)
+                            : graph->internal_nodes().at(node_id);
+      implementations[node_id] = node->selected_weight_vector_index();
+    }
+  }
+
+  PartitionEngineKlfm::Options subgraph_options = options;
+  unique_ptr<PartitionEngineKlfm> klfm_partitioner;
+  if (subgraph) {
+    klfm_partitioner.reset(
+        new PartitionEngineKlfm(move(subgraph), subgraph_options, os));
+  } else {
+    // Edges that span the previous partition are not part of the view. The
+    // engine copies the nodes and edges of the view straight from 'graph',
+    // which is shared by every result and so cannot be taken over.
+    klfm_partitioner.reset(new PartitionEngineKlfm(
+        InducedSubgraph(graph, node_ids), subgraph_options, os));
+  }
+  vector<PartitionSummary> my_summary;
+  klfm_partitioner->Execute(&my_summary);
+  if (halves != nullptr) {
+    unique_ptr<Node> bisected_graph = klfm_partitioner->ReleaseGraph();
+    klfm_partitioner.reset();
+    for (auto& implementation : implementations) {
+      bisected_graph->internal_nodes().at(implementation.first)
+          ->SetSelectedWeightVector(implementation.second);
+    }
+    halves->clear();
+    for (auto& side_node_ids : my_summary[0].partition_node_ids) {
+      halves->push_back(ExtractSubgraph(bisected_graph.get(), side_node_ids));
+    }
+  }
+  return my_summary[0];
+}
+
 void RepartitionKway(int num_ways, int cur_lev, Node* graph,
     const vector<set<int>>& starting_partitions,
     PartitionEngineKlfm::Options& options,
+    chrono::steady_clock::time_point deadline,
     vector<int>* results_this_run,
     vector<double>* rms_devs_this_run,
     ostream& os) {
+  const bool has_deadline = options.deadline_ms != 0;
   options.num_runs = 1;
   options.enable_print_output = false;
-  vector<set<int>> next_level_partitions;
-  Node graph_copy(graph);
-  // Remove all edges that span the previous partition from the graph.
-  set<int> edges_to_remove;
-  for (auto edge_pair : graph_copy.internal_edges()) {
-    // Currently only supports graphs, not hypergraphs.
-    assert(edge_pair.second->connection_ids().size() == 2);
-    int home_part = -1;
-    int first_node = *(edge_pair.second->connection_ids().begin());
-    for (size_t part_num = 0; part_num < starting_partitions.size(); part_num++) {
-      if (starting_partitions[part_num].find(first_node) !=
-          starting_partitions[part_num].end()) {
-        home_part = part_num;
-        break;
+  // The thread budget is spent on running bisection tasks side by side, one
+  // per thread, so each task's engine runs single-threaded.
+  size_t num_workers = max<size_t>(1, options.num_threads);
+  options.num_threads = 1;
+  // The initial partition describes the whole graph, not the subgraphs.
+  options.initial_partition_filename.clear();
+  options.refinement_region.clear();
+  // The node sets of both halves are needed to bisect them further.
+  options.save_cutset = true;
+
+  // Each task bisects one partition of the level that will have 'level'
+  // partitions once all of its tasks are complete. The sub-problems are
+  // independent, so the tasks run on a pool of threads, and the halves of
+  // a bisection are queued as soon as it finishes rather than waiting for
+  // the rest of its level. The first tasks copy their nodes from 'graph'.
+  // Later tasks take over the nodes of the bisection that made them, in
+  // 'subgraph'.
+  struct BisectionTask {
+    int level;
+    set<int> node_ids;
+    unique_ptr<Node> subgraph;
+  };
+  mutex task_mutex;
+  condition_variable task_cv;
+  deque<BisectionTask> tasks;
+  size_t num_unfinished_tasks = 0;
+  map<int, int> total_cost_by_level;
+  map<int, double> rms_sum_by_level;
+  map<int, int> num_bisections_by_level;
+  size_t num_skipped_tasks = 0;
+
+  for (auto& partition_node_ids : starting_partitions) {
+    tasks.push_back(BisectionTask{cur_lev, partition_node_ids, nullptr});
+    num_unfinished_tasks++;
+  }
+
+  auto worker = [&]() {
+    unique_lock<mutex> lock(task_mutex);
+    while (true) {
+      task_cv.wait(lock, [&]() {
+        return !tasks.empty() || num_unfinished_tasks == 0;
+      });
+      if (tasks.empty()) {
+        return;
       }
-    }
-    assert(home_part >= 0);
-    bool remove = false;
-    for (auto node_id : edge_pair.second->connection_ids()) {
-      if (starting_partitions[home_part].find(node_id) ==
-          starting_partitions[home_part].end()) {
-        // Edge spans partitions.
-        remove = true;
-        break;
+      BisectionTask task = std::move(tasks.front());
+      tasks.pop_front();
+      PartitionEngineKlfm::Options task_options = options;
+      if (has_deadline) {
+        // Each bisection only gets the time that is left, and none starts
+        // once it has run out.
+        int64_t remaining_ms = chrono::duration_cast<chrono::milliseconds>(
+            deadline - chrono::steady_clock::now()).count();
+        if (remaining_ms <= 0) {
+          num_skipped_tasks++;
+          num_unfinished_tasks--;
+          task_cv.notify_all();
+          continue;
+        }
+        task_options.deadline_ms = remaining_ms;
       }
-    }
-    if (remove) {
-      edges_to_remove.insert(edge_pair.first);
-      for (auto node_id : edge_pair.second->connection_ids()) {
-        graph_copy.internal_nodes().at(node_id)->RemoveConnection(
-            edge_pair.first);
+      cout << "Create partitioner for " << task.node_ids.size()
+           << " nodes at level " << task.level << endl;
+      lock.unlock();
+
+      int next_lev = task.level * 2;
+      vector<unique_ptr<Node>> halves;
+      PartitionSummary summary = BisectSubgraph(
+          graph, task.node_ids, move(task.subgraph), task_options, os,
+          next_lev <= num_ways ? &halves : nullptr);
+
+      lock.lock();
+      cout << "Partitioner for " << task.node_ids.size()
+           << " nodes at level " << task.level << " Complete" << endl;
+      total_cost_by_level[task.level] += summary.total_cost;
+      rms_sum_by_level[task.level] += summary.rms_resource_deviation;
+      num_bisections_by_level[task.level]++;
+      if (next_lev <= num_ways &&
+          !(has_deadline && chrono::steady_clock::now() >= deadline)) {
+        tasks.push_back(BisectionTask{next_lev,
+                                      summary.partition_node_ids[0],
+                                      move(halves[0])});
+        tasks.push_back(BisectionTask{next_lev,
+                                      summary.partition_node_ids[1],
+                                      move(halves[1])});
+        num_unfinished_tasks += 2;
       }
-      delete edge_pair.second;
+      num_unfinished_tasks--;
+      task_cv.notify_all();
     }
+  };
+
+  vector<thread> workers;
+  for (size_t i = 1; i < num_workers; i++) {
+    workers.push_back(thread(worker));
   }
-  for (auto edge_id : edges_to_remove) {
-    graph_copy.internal_edges().erase(edge_id);
-  }
-
-  // Bipartition all starting partitions.
-  vector<PartitionSummary> all_summaries;
-  for (size_t part_num = 0; part_num < starting_partitions.size(); part_num++) {
-    Node* starting_graph = new Node(-1, "");
-    auto& partition_node_id_set = starting_partitions[part_num];
-    for (auto node_id : partition_node_id_set) {
-      Node* move_node = graph_copy.internal_nodes().at(node_id);
-      starting_graph->AddInternalNode(node_id, move_node);
-      graph_copy.internal_nodes().erase(node_id);
-      for (auto& port_pair : move_node->ports()) {
-        int edge_id = port_pair.second.external_edge_id;
-        if (graph_copy.internal_edges().find(edge_id) !=
-            graph_copy.internal_edges().end()) {
-          Edge* move_edge = graph_copy.internal_edges().at(edge_id);
-          starting_graph->AddInternalEdge(edge_id, move_edge);
-          graph_copy.internal_edges().erase(edge_id);
-        }
-      }
-    }
-    vector<PartitionSummary> my_summary;
-    cout << "Create partitioner " << part_num << "/" << cur_lev << endl;
-    {
-      PartitionEngineKlfm klfm_partitioner(starting_graph, options, os);
-      cout << "Execute partitioner" << endl;
-      klfm_partitioner.Execute(&my_summary);
+  worker();
+  for (auto& it : workers) {
+    it.join();
+  }
+
+  if (num_skipped_tasks != 0) {
+    os << "Deadline expired before " << num_skipped_tasks
+       << " bisections started" << endl;
+  }
+  for (auto& level_cost : total_cost_by_level) {
+    int level = level_cost.first;
+    // A level is only complete if all of its partitions were bisected. Once
+    // the deadline stops one level short, no deeper level is complete.
+    if (num_bisections_by_level[level] * 2 != level) {
+      os << "Deadline expired before level " << level << " was complete"
+         << endl;
+      break;
     }
-    cout << "Partitioner " << (part_num + 1) << "/" << (cur_lev/2) << " Complete" << endl;
-    all_summaries.push_back(my_summary[0]);
-    delete starting_graph;
-  }
-  vector<set<int>> next_level_starting_partitions;
-  int total_cost = 0;
-  double rms_sum = 0;
-  for (auto& it : all_summaries) {
-    next_level_starting_partitions.push_back(it.partition_node_ids[0]);
-    next_level_starting_partitions.push_back(it.partition_node_ids[1]);
-    total_cost += it.total_cost;
-    rms_sum += it.rms_resource_deviation;
-  }
-  double rms_avg = rms_sum / all_summaries.size();
-  os << "RESULT: Total cost at level " << cur_lev << ": " << total_cost << endl;
-  results_this_run->push_back(total_cost);
-  rms_devs_this_run->push_back(rms_avg);
-
-  int next_lev = cur_lev * 2;
-  if (next_lev <= num_ways) {
-    RepartitionKway(num_ways, next_lev, graph, next_level_starting_partitions,
-        options, results_this_run, rms_devs_this_run, os);
+    double rms_avg =
+        rms_sum_by_level[level] / num_bisections_by_level[level];
+    os << "RESULT: Total cost at level " << level << ": "
+       << level_cost.second << endl;
+    results_this_run->push_back(level_cost.second);
+    rms_devs_this_run->push_back(rms_avg);
   }
 }
 
@@ -377,9 +645,27 @@ KlfmRunConfig ConfigFromCommandLineOptions(int argc, char* argv[]) {
   TCLAP::ValueArg<int> num_runs_flag(
       "r", "nruns", "Number of runs to execute", false, 1, "int", cmd);
 
+  TCLAP::ValueArg<int> num_threads_flag(
+      "j", "nthreads", "Number of threads used to execute runs", false, 1,
+      "int", cmd);
+
+  TCLAP::ValueArg<int> deadline_ms_flag(
+      "d", "deadline", "Wall-clock budget for partitioning in milliseconds",
+      false, 0, "int", cmd);
+
   TCLAP::ValueArg<int> num_ways_flag(
       "w", "nways", "Number of ways to partition", false, 2, "int", cmd);
 
+  TCLAP::ValueArg<string> kway_objective_flag(
+      "", "kway-objective",
+      "Objective minimized by the direct k-way engine (km1 or cut)",
+      false, "km1", "string", cmd);
+
+  TCLAP::SwitchArg direct_kway_switch(
+      "", "direct-kway",
+      "Partition more than 2 ways with the direct k-way engine rather than "
+      "by recursive bisection", cmd, false);
+
   TCLAP::ValueArg<string> result_output_file_flag(
       "o", "resultfile", "Output file for results", false, "", "string",
       cmd);
@@ -413,6 +699,34 @@ KlfmRunConfig ConfigFromCommandLineOptions(int argc, char* argv[]) {
       "", "sol-gurobi-format", "Write solution in Gurobi's .MST format", cmd,
       false);
 
+  TCLAP::SwitchArg sol_native_format_switch(
+      "", "sol-native-format", "Write solution in the native .PART format",
+      cmd, false);
+
+  TCLAP::ValueArg<string> initial_partition_input_file_flag(
+      "", "initial-partition",
+      "Start each run from the partition in this .sol, .mst or .part file",
+      false, "", "string", cmd);
+
+  TCLAP::SwitchArg coarsen_initial_partition_switch(
+      "", "coarsen-initial-partition",
+      "Coarsen the graph before refining the initial partition", cmd, false);
+
+  TCLAP::ValueArg<double> initial_partition_perturbation_flag(
+      "", "initial-partition-perturbation",
+      "Fraction of nodes swapped between the sides of the initial partition "
+      "for each run after the first", false, 0.05, "double", cmd);
+
+  TCLAP::ValueArg<string> eco_delta_input_file_flag(
+      "", "eco-delta",
+      "Apply this delta to the graph and repair the initial partition locally",
+      false, "", "string", cmd);
+
+  TCLAP::ValueArg<int> eco_region_radius_flag(
+      "", "eco-region-radius",
+      "Number of nets around the changed nodes that ECO refinement may move",
+      false, 2, "int", cmd);
+
   TCLAP::SwitchArg use_entropy_switch(
       "", "use_entropy", "Use an entropy-based cost function", cmd,
       false);
@@ -425,6 +739,14 @@ KlfmRunConfig ConfigFromCommandLineOptions(int argc, char* argv[]) {
       "", "write_cutset_dir", "Write cutsets to this directory", false,
       "", "string", cmd);
 
+  TCLAP::ValueArg<string> profile_output_file_flag(
+      "", "profile-file", "Write per-pass timing records to this CSV file",
+      false, "", "string", cmd);
+
+  TCLAP::ValueArg<string> move_trace_output_file_flag(
+      "", "move-trace-file", "Write a binary trace of every move to this file",
+      false, "", "string", cmd);
+
 
   cmd.parse(argc, argv);
 
@@ -449,7 +771,26 @@ KlfmRunConfig ConfigFromCommandLineOptions(int argc, char* argv[]) {
   run_config.partitioner_config = config;
 
   run_config.num_runs = num_runs_flag.getValue();
+  run_config.num_threads = num_threads_flag.getValue();
+  if (run_config.num_threads < 1) {
+    cout << "Number of threads must be at least 1";
+    exit(1);
+  }
+  run_config.deadline_ms = deadline_ms_flag.getValue();
+  if (run_config.deadline_ms < 0) {
+    cout << "Deadline must not be negative";
+    exit(1);
+  }
   run_config.num_ways = num_ways_flag.getValue();
+  if (kway_objective_flag.getValue() == "km1") {
+    run_config.kway_objective = PartitionEngineKway::kObjectiveConnectivity;
+  } else if (kway_objective_flag.getValue() == "cut") {
+    run_config.kway_objective = PartitionEngineKway::kObjectiveCutNet;
+  } else {
+    cout << "K-way objective must be km1 or cut";
+    exit(1);
+  }
+  run_config.direct_kway = direct_kway_switch.isSet();
   run_config.result_filename = result_output_file_flag.getValue();
   run_config.log_filename = log_output_file_flag.getValue();
   run_config.testbench_filename = testbench_output_file_flag.getValue();
@@ -464,13 +805,51 @@ KlfmRunConfig ConfigFromCommandLineOptions(int argc, char* argv[]) {
     exit(1);
   }
   run_config.sol_gurobi_format = sol_gurobi_format_switch.isSet();
+  run_config.sol_native_format = sol_native_format_switch.isSet();
   run_config.sol_scip_format = sol_scip_format_switch.isSet() ||
-                               !run_config.sol_gurobi_format;
+                               !(run_config.sol_gurobi_format ||
+                                 run_config.sol_native_format);
+  run_config.initial_partition_filename =
+      initial_partition_input_file_flag.getValue();
+  run_config.coarsen_initial_partition =
+      coarsen_initial_partition_switch.isSet();
+  if (run_config.coarsen_initial_partition &&
+      run_config.initial_partition_filename.empty()) {
+    cout << "Must provide an initial partition to coarsen";
+    exit(1);
+  }
+  if (!run_config.initial_partition_filename.empty() &&
+      run_config.num_ways > 2 && run_config.direct_kway) {
+    cout << "The direct k-way engine cannot start from an initial "
+         << "partition. Omit --direct-kway to start the first bisection "
+         << "from it";
+    exit(1);
+  }
+  run_config.initial_partition_perturbation =
+      initial_partition_perturbation_flag.getValue();
+  if (run_config.initial_partition_perturbation < 0.0 ||
+      run_config.initial_partition_perturbation > 1.0) {
+    cout << "Initial partition perturbation must be between 0 and 1";
+    exit(1);
+  }
+  run_config.eco_delta_filename = eco_delta_input_file_flag.getValue();
+  if (!run_config.eco_delta_filename.empty() &&
+      run_config.initial_partition_filename.empty()) {
+    cout << "Must provide an initial partition to apply an ECO delta to";
+    exit(1);
+  }
+  run_config.eco_region_radius = eco_region_radius_flag.getValue();
+  if (run_config.eco_region_radius < 0) {
+    cout << "ECO region radius must not be negative";
+    exit(1);
+  }
   run_config.use_entropy = use_entropy_switch.isSet();
   run_config.save_cutset = save_cutset_switch.isSet();
   if (write_cutset_dir.isSet()) {
     run_config.cutset_dir = write_cutset_dir.getValue();
   }
+  run_config.profile_filename = profile_output_file_flag.getValue();
+  run_config.move_trace_filename = move_trace_output_file_flag.getValue();
   return run_config;
 }
 
@@ -486,7 +865,11 @@ void print_usage_and_exit() {
        << "OPTIONS:" << endl
        << "--help" << endl
        << "--nruns              int_val               (default: 1)" << endl
+       << "--nthreads           int_val               (default: 1)" << endl
+       << "--deadline           int_val (ms)          (default: none)" << endl
        << "--nways              int_val               (default: 2)" << endl
+       << "--kway-objective     (km1 | cut)           (default: km1)" << endl
+       << "--direct-kway                              (default: false)" << endl
        << "--resultfile         output_file_path      (default: std::out)" << endl
        << "--logfile            output_file_path      (default: std::out)" << endl
        << "--export-testbench   output_file_path      (default: none)" << endl
@@ -496,7 +879,15 @@ void print_usage_and_exit() {
        << "--sol-scip-format                          (default: true*)" << endl
        << "                                            *If no other sol format" << endl
        << "--sol-gurobi-format                        (default: false)" << endl
+       << "--sol-native-format                        (default: false)" << endl
+       << "--initial-partition  input_file_path       (default: none)" << endl
+       << "--coarsen-initial-partition                (default: false)" << endl
+       << "--initial-partition-perturbation double_val (default: 0.05)" << endl
+       << "--eco-delta          input_file_path       (default: none)" << endl
+       << "--eco-region-radius  int_val               (default: 2)" << endl
        << "--use_entropy                              (default: false)" << endl
+       << "--profile-file       output_file_path      (default: none)" << endl
+       << "--move-trace-file    output_file_path      (default: none)" << endl
        << endl;
   exit(1);
 }
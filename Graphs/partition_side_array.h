@@ -0,0 +1,128 @@
+#ifndef PARTITION_SIDE_ARRAY_H_
+#define PARTITION_SIDE_ARRAY_H_
+
+/* Records which side of a bipartition each node is on. The side is stored as
+   a single byte per node in a contiguous array indexed by the node's dense
+   index in the KLFM hypergraph (see klfm_hypergraph.h), so the array is
+   exactly as long as the graph it describes, and membership tests and moves
+   are O(1) array accesses. Every node starts out unassigned and must be
+   assigned explicitly. Translating node IDs to indices is left to the owner
+   of the hypergraph. */
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+class PartitionSideArray {
+ public:
+  typedef enum : unsigned char {
+    kUnassigned = 0,
+    kPartA,
+    kPartB
+  } Side;
+
+  PartitionSideArray() : num_part_a_(0), num_part_b_(0) {}
+
+  // Makes room for 'num_nodes' nodes, all of them unassigned.
+  void Reset(size_t num_nodes) {
+    sides_.assign(num_nodes, kUnassigned);
+    num_part_a_ = 0;
+    num_part_b_ = 0;
+  }
+
+  // Removes all nodes.
+  void Clear() {
+    Reset(0);
+  }
+
+  // The number of nodes, assigned or not.
+  size_t size() const { return sides_.size(); }
+
+  // Places the node with index 'node_index' in partition A if 'in_part_a' is
+  // true, else in partition B. The node must not already be assigned.
+  void Assign(int node_index, bool in_part_a) {
+    assert(node_index >= 0 && (size_t)node_index < sides_.size());
+    assert(sides_[node_index] == kUnassigned);
+    if (in_part_a) {
+      sides_[node_index] = kPartA;
+      num_part_a_++;
+    } else {
+      sides_[node_index] = kPartB;
+      num_part_b_++;
+    }
+  }
+
+  // Moves the node with index 'node_index' to the opposite partition. Returns
+  // true if the node was moved from partition A.
+  bool Move(int node_index) {
+    assert(Contains(node_index));
+    if (sides_[node_index] == kPartA) {
+      sides_[node_index] = kPartB;
+      num_part_a_--;
+      num_part_b_++;
+      return true;
+    } else {
+      sides_[node_index] = kPartA;
+      num_part_b_--;
+      num_part_a_++;
+      return false;
+    }
+  }
+
+  Side side(int node_index) const {
+    assert(node_index >= 0 && (size_t)node_index < sides_.size());
+    return (Side)sides_[node_index];
+  }
+  bool InPartA(int node_index) const { return side(node_index) == kPartA; }
+  bool InPartB(int node_index) const { return side(node_index) == kPartB; }
+  bool Contains(int node_index) const {
+    return side(node_index) != kUnassigned;
+  }
+
+  size_t num_part_a() const { return num_part_a_; }
+  size_t num_part_b() const { return num_part_b_; }
+  size_t num_unassigned() const {
+    return sides_.size() - num_part_a_ - num_part_b_;
+  }
+
+  // Returns the indices of the nodes on 'side' in ascending order.
+  std::vector<int> NodeIndices(Side side) const {
+    assert(side != kUnassigned);
+    std::vector<int> indices;
+    indices.reserve((side == kPartA) ? num_part_a_ : num_part_b_);
+    for (size_t i = 0; i < sides_.size(); i++) {
+      if (sides_[i] == side) {
+        indices.push_back(i);
+      }
+    }
+    return indices;
+  }
+
+  // Returns true if both arrays split the same nodes into the same two
+  // groups, whichever of the groups is called A.
+  bool SameBipartition(const PartitionSideArray& other) const {
+    if (sides_ == other.sides_) {
+      return true;
+    }
+    if (sides_.size() != other.sides_.size() ||
+        num_part_a_ != other.num_part_b_) {
+      return false;
+    }
+    for (size_t i = 0; i < sides_.size(); i++) {
+      if (sides_[i] == other.sides_[i] && sides_[i] != kUnassigned) {
+        return false;
+      }
+      if ((sides_[i] == kUnassigned) != (other.sides_[i] == kUnassigned)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  std::vector<unsigned char> sides_;
+  size_t num_part_a_;
+  size_t num_part_b_;
+};
+
+#endif /* PARTITION_SIDE_ARRAY_H_ */
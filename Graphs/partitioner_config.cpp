@@ -12,7 +12,23 @@ PartitionerConfig::PartitionerConfig()
     preprocessor_capacity_type(kNullCapacity),
     gain_bucket_type(kNullBucketType),
     gain_bucket_selection_policy(kNullSelectionPolicy),
+    gain_bucket_storage(kGainBucketStorageList),
+    gain_bucket_search_depth(0),
     use_multilevel_constraint_relaxation(false),
+    use_boundary_gain_buckets(false),
+    multilevel_max_levels(1),
+    multilevel_target_num_nodes(0),
+    multilevel_target_ratio(0.0),
+    multilevel_coarse_level_max_passes(0),
+    multilevel_base_level_max_passes(0),
+    multilevel_hierarchy_pool_size(0),
+    coarsening_algorithm(kCoarsenHierarchalInterconnection),
+    multilevel_max_supernode_size(16),
+    multilevel_neighbor_limit(100),
+    multilevel_label_propagation_iterations(5),
+    multilevel_max_edge_degree(50),
+    max_non_improving_moves(0),
+    max_non_improving_move_fraction(0.0),
     use_adaptive_node_implementations(false),
     use_ratio_in_imbalance_score(false),
     use_ratio_in_partition_quality(false),
@@ -134,6 +150,41 @@ void PartitionerConfig::PrintKlfmOptions(ostream& os) {
      << (use_adaptive_node_implementations ? "true" : "false") << endl;
   os << "Use Multi-level Constraint Relaxation: "
      << (use_multilevel_constraint_relaxation ? "true" : "false") << endl;
+  os << "Use Boundary Gain Buckets: "
+     << (use_boundary_gain_buckets ? "true" : "false") << endl;
+  os << "Multilevel Max Levels: " << multilevel_max_levels << endl;
+  os << "Multilevel Target Num Nodes: " << multilevel_target_num_nodes << endl;
+  os << "Multilevel Target Ratio: " << multilevel_target_ratio << endl;
+  os << "Multilevel Coarse Level Max Passes: "
+     << multilevel_coarse_level_max_passes << endl;
+  os << "Multilevel Base Level Max Passes: "
+     << multilevel_base_level_max_passes << endl;
+  os << "Multilevel Hierarchy Pool Size: " << multilevel_hierarchy_pool_size
+     << endl;
+  os << "Coarsening Algorithm: ";
+  switch (coarsening_algorithm) {
+    case kCoarsenHierarchalInterconnection:
+      os << "Hierarchal Interconnection";
+    break;
+    case kCoarsenLabelPropagation:
+      os << "Label Propagation";
+    break;
+    default:
+      assert_b(false) {
+        printf("\nUnrecognized coarsening algorithm.\n");
+      }
+  }
+  os << endl;
+  os << "Multilevel Max Supernode Size: " << multilevel_max_supernode_size
+     << endl;
+  os << "Multilevel Neighbor Limit: " << multilevel_neighbor_limit << endl;
+  os << "Multilevel Label Propagation Iterations: "
+     << multilevel_label_propagation_iterations << endl;
+  os << "Multilevel Max Edge Degree: " << multilevel_max_edge_degree << endl;
+  os << "Max Non-Improving Moves per Pass: " << max_non_improving_moves
+     << endl;
+  os << "Max Non-Improving Move Fraction per Pass: "
+     << max_non_improving_move_fraction << endl;
   os << "Gain Bucket Type: ";
   switch (gain_bucket_type) {
     case kGainBucketSingleResource:
@@ -189,6 +240,24 @@ void PartitionerConfig::PrintKlfmOptions(ostream& os) {
     }
   }
   os << endl;
+  os << "Gain Bucket Storage: ";
+  switch (gain_bucket_storage) {
+    case kGainBucketStorageList:
+      os << "List";
+    break;
+    case kGainBucketStorageArray:
+      os << "Array";
+    break;
+    case kGainBucketStorageHeap:
+      os << "Heap";
+    break;
+    default:
+      assert_b(false) {
+        printf("\nUnrecognized gain bucket storage.\n");
+      }
+  }
+  os << endl;
+  os << "Gain Bucket Search Depth: " << gain_bucket_search_depth << endl;
   os << "Restrict Supernodes to Default Implementation: "
      << (restrict_supernodes_to_default_implementation ? "true" : "false")
      << endl;
@@ -319,6 +388,41 @@ void PartitionerConfig::ValidateOrDieKlfmOptions() {
              "adaptive node implementations are enabled\n");
     }
   }
+  assert_b(multilevel_max_levels >= 0 && multilevel_target_num_nodes >= 0 &&
+           multilevel_coarse_level_max_passes >= 0 &&
+           multilevel_base_level_max_passes >= 0 &&
+           multilevel_hierarchy_pool_size >= 0) {
+    printf("Configuration Error: Multilevel options must not be negative.\n");
+  }
+  assert_b(multilevel_max_supernode_size >= 2 &&
+           multilevel_neighbor_limit >= 1 &&
+           multilevel_label_propagation_iterations >= 1 &&
+           multilevel_max_edge_degree >= 2) {
+    printf("Configuration Error: Multilevel max supernode size and max edge "
+           "degree must be at least 2, and the neighbor limit and label "
+           "propagation iterations at least 1.\n");
+  }
+  assert_b(multilevel_target_ratio >= 0.0 && multilevel_target_ratio < 1.0) {
+    printf("Configuration Error: Multilevel target ratio (%f) must be in the "
+           "range [0, 1).\n", multilevel_target_ratio);
+  }
+  assert_b(gain_bucket_search_depth >= 0) {
+    printf("Configuration Error: Gain bucket search depth must not be "
+           "negative.\n");
+  }
+  assert_b(max_non_improving_moves >= 0) {
+    printf("Configuration Error: Max non-improving moves must not be "
+           "negative.\n");
+  }
+  assert_b(max_non_improving_move_fraction >= 0.0 &&
+           max_non_improving_move_fraction <= 1.0) {
+    printf("Configuration Error: Max non-improving move fraction (%f) must "
+           "be in the range [0, 1].\n", max_non_improving_move_fraction);
+  }
+  assert_b(coarsening_algorithm != kNullCoarseningAlgorithm) {
+    printf("Unexpected error: PartitionerConfig thinks KLFM options are set, "
+           "but coarsening algorithm was not set. Terminating\n");
+  }
   switch (gain_bucket_type) {
     case kGainBucketSingleResource:
       if (num_device_resources_specified != 1) {
@@ -74,10 +74,45 @@ struct PartitionerConfig {
     kGbmrmSelectionPolicyBestGainImbalanceScoreWithAffinities,
   } GainBucketSelectionPolicy;
 
+  // How each gain bucket stores its entries.
+  typedef enum {
+    kNullGainBucketStorage, // Guard value.
+    // A list per gain value with a node ID map.
+    kGainBucketStorageList,
+    // Link arrays indexed by dense node index. See GainBucketArray.
+    kGainBucketStorageArray,
+    // A heap keyed on the exact gain. See GainBucketHeap.
+    kGainBucketStorageHeap,
+  } GainBucketStorage;
+
+  typedef enum {
+    kNullCoarseningAlgorithm, // Guard value.
+    kCoarsenHierarchalInterconnection,
+    kCoarsenLabelPropagation,
+  } CoarseningAlgorithm;
+
   GainBucketType gain_bucket_type;
   GainBucketSelectionPolicy
       gain_bucket_selection_policy;
+  GainBucketStorage gain_bucket_storage;
+  // Entries examined per bucket when searching past moves that do not fit.
+  // 0 leaves the gain bucket manager's default.
+  int gain_bucket_search_depth;
   bool use_multilevel_constraint_relaxation;
+  bool use_boundary_gain_buckets;
+  int multilevel_max_levels;
+  int multilevel_target_num_nodes;
+  double multilevel_target_ratio;
+  int multilevel_coarse_level_max_passes;
+  int multilevel_base_level_max_passes;
+  int multilevel_hierarchy_pool_size;
+  CoarseningAlgorithm coarsening_algorithm;
+  int multilevel_max_supernode_size;
+  int multilevel_neighbor_limit;
+  int multilevel_label_propagation_iterations;
+  int multilevel_max_edge_degree;
+  int max_non_improving_moves;
+  double max_non_improving_move_fraction;
   bool use_adaptive_node_implementations;
   bool use_ratio_in_imbalance_score;
   bool use_ratio_in_partition_quality;
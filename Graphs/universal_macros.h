@@ -16,7 +16,8 @@
    beyond the number of nodes in the graph (more typically, 50% of the nodes).
 
    It does not impact the solution quality for unit weight graphs, so should
-   be left at 1 for them. */
+   be left at 1 for them. This is only the default; a configuration may set
+   its own depth with gain_bucket_search_depth. */
 #ifndef MAX_CONSTRAINED_ENTRY_CHECKS
   #define MAX_CONSTRAINED_ENTRY_CHECKS 1
 #endif
@@ -93,10 +94,6 @@
 #define DEBUG_OPT_BUCKET_NODE_SELECT_GAIN_IMBALANCE_WITH_AFFINITIES 0
 #endif
 
-#ifndef PROFILE_ENABLED
-#define PROFILE_ENABLED 0
-#endif
-
 #ifndef PROFILE_ITERATIONS
   #define PROFILE_ITERATIONS 5000
 #endif
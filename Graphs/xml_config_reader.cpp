@@ -231,6 +231,90 @@ void XmlConfigReader::PopulateKlfmConfiguration(
         "use_multilevel_constraint_relaxation")) {
       partitioner_config->use_multilevel_constraint_relaxation = true;
     }
+    else if (!strcmp((char*)(myNodePtr->name), "use_boundary_gain_buckets")) {
+      partitioner_config->use_boundary_gain_buckets = true;
+    }
+    else if (!strcmp((char*)(myNodePtr->name),"pass_early_termination")) {
+      for (xmlNodePtr childPtr = ChildNonComment(myNodePtr);
+           childPtr != NULL; childPtr = NextNonComment(childPtr)) {
+        if (!strcmp((char*)childPtr->name, "max_non_improving_moves")) {
+          partitioner_config->max_non_improving_moves =
+              atoi((char*)(childPtr->children->content));
+        } else if (!strcmp((char*)childPtr->name,
+                           "max_non_improving_move_fraction")) {
+          partitioner_config->max_non_improving_move_fraction =
+              atof((char*)(childPtr->children->content));
+        } else {
+          assert_b(false) {
+            printf("Unknown pass_early_termination element: "
+                  "--%s--\nDid you run verification with the DTD?\n",
+                  childPtr->name);
+          }
+        }
+      }
+    }
+    else if (!strcmp((char*)(myNodePtr->name),"multilevel_options")) {
+      for (xmlNodePtr childPtr = ChildNonComment(myNodePtr);
+           childPtr != NULL; childPtr = NextNonComment(childPtr)) {
+        if (!strcmp((char*)childPtr->name, "coarsening_algorithm")) {
+          xmlNodePtr algPtr = ChildNonComment(childPtr);
+          assert(algPtr != NULL);
+          if (!strcmp((char*)algPtr->name,
+                      "hierarchal_interconnection_coarsening")) {
+            partitioner_config->coarsening_algorithm =
+                PartitionerConfig::kCoarsenHierarchalInterconnection;
+          } else if (!strcmp((char*)algPtr->name,
+                             "label_propagation_coarsening")) {
+            partitioner_config->coarsening_algorithm =
+                PartitionerConfig::kCoarsenLabelPropagation;
+          } else {
+            assert_b(false) {
+              printf("Unknown coarsening_algorithm element: "
+                    "--%s--\nDid you run verification with the DTD?\n",
+                    algPtr->name);
+            }
+          }
+        } else if (!strcmp((char*)childPtr->name, "max_levels")) {
+          partitioner_config->multilevel_max_levels =
+              atoi((char*)(childPtr->children->content));
+        } else if (!strcmp((char*)childPtr->name, "target_num_nodes")) {
+          partitioner_config->multilevel_target_num_nodes =
+              atoi((char*)(childPtr->children->content));
+        } else if (!strcmp((char*)childPtr->name, "target_ratio")) {
+          partitioner_config->multilevel_target_ratio =
+              atof((char*)(childPtr->children->content));
+        } else if (!strcmp((char*)childPtr->name,
+                           "coarse_level_max_passes")) {
+          partitioner_config->multilevel_coarse_level_max_passes =
+              atoi((char*)(childPtr->children->content));
+        } else if (!strcmp((char*)childPtr->name, "base_level_max_passes")) {
+          partitioner_config->multilevel_base_level_max_passes =
+              atoi((char*)(childPtr->children->content));
+        } else if (!strcmp((char*)childPtr->name, "hierarchy_pool_size")) {
+          partitioner_config->multilevel_hierarchy_pool_size =
+              atoi((char*)(childPtr->children->content));
+        } else if (!strcmp((char*)childPtr->name, "max_supernode_size")) {
+          partitioner_config->multilevel_max_supernode_size =
+              atoi((char*)(childPtr->children->content));
+        } else if (!strcmp((char*)childPtr->name, "neighbor_limit")) {
+          partitioner_config->multilevel_neighbor_limit =
+              atoi((char*)(childPtr->children->content));
+        } else if (!strcmp((char*)childPtr->name,
+                           "label_propagation_iterations")) {
+          partitioner_config->multilevel_label_propagation_iterations =
+              atoi((char*)(childPtr->children->content));
+        } else if (!strcmp((char*)childPtr->name, "max_edge_degree")) {
+          partitioner_config->multilevel_max_edge_degree =
+              atoi((char*)(childPtr->children->content));
+        } else {
+          assert_b(false) {
+            printf("Unknown multilevel_options element: "
+                  "--%s--\nDid you run verification with the DTD?\n",
+                  childPtr->name);
+          }
+        }
+      }
+    }
     else if (!strcmp((char*)(myNodePtr->name),"gain_bucket_type")) {
       xmlNodePtr childPtr = ChildNonComment(myNodePtr);
       assert(childPtr != NULL);
@@ -315,6 +399,39 @@ void XmlConfigReader::PopulateKlfmConfiguration(
                  "verification with the DTD?\n", childPtr->name);
         }
       }
+      for (childPtr = NextNonComment(ChildNonComment(myNodePtr));
+           childPtr != NULL; childPtr = NextNonComment(childPtr)) {
+        if (!strcmp((char*)childPtr->name, "gain_bucket_storage")) {
+          xmlNodePtr storagePtr = ChildNonComment(childPtr);
+          assert(storagePtr != NULL);
+          if (!strcmp((char*)storagePtr->name, "list_gain_bucket_storage")) {
+            partitioner_config->gain_bucket_storage =
+                PartitionerConfig::kGainBucketStorageList;
+          } else if (!strcmp((char*)storagePtr->name,
+                             "array_gain_bucket_storage")) {
+            partitioner_config->gain_bucket_storage =
+                PartitionerConfig::kGainBucketStorageArray;
+          } else if (!strcmp((char*)storagePtr->name,
+                             "heap_gain_bucket_storage")) {
+            partitioner_config->gain_bucket_storage =
+                PartitionerConfig::kGainBucketStorageHeap;
+          } else {
+            assert_b(false) {
+              printf("Unknown gain_bucket_storage element: --%s--\nDid you "
+                     "run verification with the DTD?\n", storagePtr->name);
+            }
+          }
+        } else if (!strcmp((char*)childPtr->name,
+                           "gain_bucket_search_depth")) {
+          partitioner_config->gain_bucket_search_depth =
+              atoi((char*)(childPtr->children->content));
+        } else {
+          assert_b(false) {
+            printf("Unknown gain_bucket_type element: --%s--\nDid you run "
+                   "verification with the DTD?\n", childPtr->name);
+          }
+        }
+      }
     } else if (!strcmp((char*)myNodePtr->name,
                        "node_implementation_options")) {
       for (xmlNodePtr childPtr = ChildNonComment(myNodePtr);